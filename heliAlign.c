@@ -0,0 +1,291 @@
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Pattern aligned configuration changes
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "heliAlign.h"
+#include "heliSeq.h"
+#include "heliPrivate.h"
+
+static inline uint64_t
+alignNow(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Read the state register and extend the window counter */
+static int32_t
+alignPoll(heliAlign_t *a, uint64_t *time)
+{
+  uint32_t bank[HELI_READOUT_NWORDS];
+  int32_t state = heliReadSequencerState();
+
+  *time = alignNow();
+  if(state < 0)
+    {
+      HELI_ERR("Unable to read the sequencer state\n");
+      return -1;
+    }
+
+  heliReadoutWriteState(&a->ro, bank, state, *time);
+
+  return 0;
+}
+
+/* Window of the current pattern, from 0 */
+static inline uint32_t
+alignPosition(const heliAlign_t *a)
+{
+  return (a->ro.window % a->patternLength + a->patternLength - a->refPhase) %
+    a->patternLength;
+}
+
+/**
+ * @brief Initialize the aligner from the module
+ * @details Reads the registers under the library lock.  Nothing is
+ *          queued, and there is no reference.
+ * @param[out] a Aligner
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliAlignInit(heliAlign_t *a)
+{
+  memset(a, 0, sizeof(*a));
+
+  if(heliGetRegisterSnapshot(&a->regs) != 0)
+    return -1;
+
+  heliReadoutInitRegs(&a->ro, &a->regs, alignNow());
+  a->patternLength = heliSeqPatternLength(heliFieldGet(&a->regs, HELI_REGFIELD_PATTERN));
+  if((int32_t) a->patternLength <= 0)
+    {
+      HELI_ERR("Unknown pattern (%d)\n", heliFieldGet(&a->regs, HELI_REGFIELD_PATTERN));
+      return -1;
+    }
+
+  return 0;
+}
+
+/**
+ * @brief Set the pattern reference
+ * @param[inout] a Aligner
+ * @param[in] state Sequencer state of a window that began a pattern,
+ *                  within the last 256 windows
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliAlignSetReference(heliAlign_t *a, uint8_t state)
+{
+  uint64_t t;
+  uint32_t back;
+
+  if(alignPoll(a, &t) < 0)
+    return -1;
+
+  back = (a->ro.lastState - state) & HELI_STATE_MASK;
+  a->refPhase = (a->ro.window % a->patternLength + a->patternLength -
+		 back % a->patternLength) % a->patternLength;
+  a->haveReference = 1;
+
+  return 0;
+}
+
+/**
+ * @brief Queue a field selection
+ * @details Replaces a selection of the same field already queued.
+ * @param[inout] a Aligner
+ * @param[in] field Register field
+ * @param[in] value Selection
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliAlignQueueField(heliAlign_t *a, heliFieldId_t field, uint32_t value)
+{
+  if(heliFieldCheck(field, value) < 0)
+    return -1;
+
+  a->values[field] = value;
+  a->queued |= 1 << field;
+
+  return 0;
+}
+
+/**
+ * @brief Queue a configuration
+ * @param[inout] a Aligner
+ * @param[in] cfg Configuration register values
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliAlignQueueConfig(heliAlign_t *a, const heliConfig_t *cfg)
+{
+  heliRegs regs;
+  uint32_t ifield;
+
+  memset(&regs, 0, sizeof(regs));
+  regs.tsettle = cfg->tsettle;
+  regs.tstable = cfg->tstable;
+  regs.delay = cfg->delay;
+  regs.pattern = cfg->pattern;
+  regs.clock = cfg->clock;
+
+  for(ifield = 0; ifield < HELI_NREGFIELDS; ifield++)
+    if(heliFieldCheck(ifield, heliFieldGet(&regs, ifield)) < 0)
+      return -1;
+
+  for(ifield = 0; ifield < HELI_NREGFIELDS; ifield++)
+    heliAlignQueueField(a, ifield, heliFieldGet(&regs, ifield));
+
+  return 0;
+}
+
+/**
+ * @brief Drop the queued selections
+ * @param[inout] a Aligner
+ */
+void
+heliAlignClear(heliAlign_t *a)
+{
+  a->queued = 0;
+}
+
+/**
+ * @brief Write the queued selections after the next pattern boundary
+ * @details Queued selections equal to the registers are dropped.  The
+ *          rest are written by heliSetFields, as one burst under one
+ *          lock, after the state register shows the first window of a
+ *          pattern.  The queue is cleared if successful.
+ * @param[inout] a Aligner
+ * @param[in] timeoutMs Longest wait for a boundary
+ * @param[out] res Alignment result, if not NULL
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliAlignApply(heliAlign_t *a, uint32_t timeoutMs, heliAlignResult_t *res)
+{
+  heliAlignResult_t r;
+  heliFieldValue_t fv[HELI_NREGFIELDS];
+  uint32_t ifield, nfields = 0, remaining;
+  uint64_t start, deadline, t, prev, done, lastWindow, boundary;
+  struct timespec ts;
+  int64_t sleepNs;
+
+  memset(&r, 0, sizeof(r));
+
+  if(!a->haveReference)
+    {
+      HELI_ERR("No pattern reference.  @see heliAlignSetReference\n");
+      return -1;
+    }
+
+  for(ifield = 0; ifield < HELI_NREGFIELDS; ifield++)
+    {
+      if((a->queued & (1 << ifield)) &&
+	 (a->values[ifield] != heliFieldGet(&a->regs, ifield)))
+	{
+	  fv[nfields].field = ifield;
+	  fv[nfields].value = a->values[ifield];
+	  nfields++;
+	}
+    }
+
+  if(nfields == 0)
+    {
+      a->queued = 0;
+      if(res)
+	*res = r;
+      return 0;
+    }
+
+  start = alignNow();
+  deadline = start + (uint64_t) timeoutMs * 1000000ULL;
+
+  if(alignPoll(a, &t) < 0)
+    return -1;
+
+  while(1)
+    {
+      /* Sleep through all but the last window of the pattern */
+      remaining = a->patternLength - alignPosition(a);
+      sleepNs = (int64_t) ((remaining - 1.5) * a->ro.windowNs);
+      if((remaining > 1) && (sleepNs > 0))
+	{
+	  if(t + sleepNs > deadline)
+	    sleepNs = (deadline > t) ? deadline - t : 0;
+	  ts.tv_sec = (t + sleepNs) / 1000000000ULL;
+	  ts.tv_nsec = (t + sleepNs) % 1000000000ULL;
+	  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+	  if(alignPoll(a, &t) < 0)
+	    return -1;
+	}
+
+      /* Poll for the first window of the next pattern */
+      lastWindow = a->ro.window;
+      prev = t;
+      while(a->ro.window == lastWindow)
+	{
+	  if(t > deadline)
+	    {
+	      HELI_ERR("No pattern boundary within %u ms\n", timeoutMs);
+	      return -1;
+	    }
+	  prev = t;
+	  if(alignPoll(a, &t) < 0)
+	    return -1;
+	}
+
+      if(alignPosition(a) == 0)
+	break;
+    }
+
+  boundary = a->ro.window;
+  if(heliSetFields(fv, nfields) != 0)
+    return -1;
+  done = alignNow();
+
+  r.nfields = nfields;
+  r.window = boundary;
+  r.waitNs = t - start;
+  r.detectNs = t - prev;
+  r.applyNs = done - t;
+  r.latencyNs = r.detectNs + r.applyNs;
+
+  /* Check that the burst landed in the first window */
+  if(alignPoll(a, &t) < 0)
+    return -1;
+  r.late = a->ro.window - boundary;
+
+  for(ifield = 0; ifield < nfields; ifield++)
+    heliFieldSet(&a->regs, fv[ifield].field, fv[ifield].value);
+
+  /* New timing and fingerprint, same window counter */
+  a->regs.state = a->ro.lastState;
+  lastWindow = a->ro.window;
+  heliReadoutInitRegs(&a->ro, &a->regs, t);
+  a->ro.window = lastWindow;
+
+  /* The new pattern begins at the boundary */
+  a->patternLength = heliSeqPatternLength(heliFieldGet(&a->regs, HELI_REGFIELD_PATTERN));
+  a->refPhase = boundary % a->patternLength;
+  a->queued = 0;
+
+  if(res)
+    *res = r;
+
+  return 0;
+}
@@ -0,0 +1,62 @@
+#pragma once
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Header for pattern aligned configuration changes
+ *
+ *   Changes of the configuration fields are queued, coalesced per field,
+ *   and written by heliAlignApply as one burst under one lock, right
+ *   after the sequencer state register shows the first window of a
+ *   pattern.  A write that lands mid-pattern breaks that pattern; one
+ *   that lands at its start costs at most the one pattern.
+ *
+ *   The state register counts windows modulo 256.  The reference is the
+ *   state of a window that began a pattern (e.g. from the helicity bank
+ *   of an event with pattern sync, heliReadout.h).  Between calls, the
+ *   window counter is extended as in heliReadout, so patterns whose
+ *   length does not divide 256 stay aligned.  A change of pattern is
+ *   taken to begin the new pattern at the boundary where it was written.
+ *
+ *   Waits sleep until one window before the boundary, then poll the
+ *   state register without locking.
+ *
+ */
+
+#include <stdint.h>
+#include "heliLib.h"
+#include "heliReadout.h"
+
+typedef struct
+{
+  heliReadout_t ro;           /* Window counter from the state register */
+  heliRegs regs;              /* Registers, as last read or written */
+  int32_t  haveReference;
+  uint32_t refPhase;          /* Window counter modulo patternLength at a pattern start */
+  uint32_t patternLength;     /* Windows per pattern */
+  uint32_t queued;            /* Bit per queued field */
+  uint32_t values[HELI_NREGFIELDS]; /* Queued values */
+} heliAlign_t;
+
+typedef struct
+{
+  uint32_t nfields;           /* Fields written */
+  uint64_t window;            /* Window counter at the boundary */
+  uint64_t waitNs;            /* Call to boundary seen */
+  uint64_t detectNs;          /* Uncertainty of the boundary: time between the last two polls */
+  uint64_t applyNs;           /* Boundary seen to burst written */
+  uint64_t latencyNs;         /* Bound of boundary to burst written: detectNs + applyNs */
+  uint32_t late;              /* Windows passed before the burst was written */
+} heliAlignResult_t;
+
+int32_t heliAlignInit(heliAlign_t *a);
+int32_t heliAlignSetReference(heliAlign_t *a, uint8_t state);
+int32_t heliAlignQueueField(heliAlign_t *a, heliFieldId_t field, uint32_t value);
+int32_t heliAlignQueueConfig(heliAlign_t *a, const heliConfig_t *cfg);
+void    heliAlignClear(heliAlign_t *a);
+int32_t heliAlignApply(heliAlign_t *a, uint32_t timeoutMs, heliAlignResult_t *res);
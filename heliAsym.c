@@ -0,0 +1,349 @@
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Pattern Asymmetry accumulator
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "heliReplay.h"
+#include "heliAsym.h"
+#include "heliPrivate.h"
+
+/* Two doubles per vector.  Every pattern has an even number of windows. */
+typedef double v2d __attribute__ ((vector_size (16)));
+
+/* Window signs of each pattern, +1 or -1 */
+static double asymSigns[HELI_SEQ_NPATTERNS][64] __attribute__ ((aligned (16)));
+static pthread_once_t asymOnce = PTHREAD_ONCE_INIT;
+
+typedef struct
+{
+  heliAsymAccum_t acc;
+  const uint8_t *windows;
+  const double *yields;
+  uint64_t first;
+  uint64_t last;
+} asymJob;
+
+static void
+asymSignsInit()
+{
+  uint32_t ipat, iwin;
+
+  for(ipat = 0; ipat < HELI_SEQ_NPATTERNS; ipat++)
+    for(iwin = 0; iwin < 64; iwin++)
+      asymSigns[ipat][iwin] = ((heliSeqPatternSignMask(ipat) >> iwin) & 1) ? -1.0 : 1.0;
+}
+
+static void
+asymMomentsAdd(heliAsymMoments_t *m, double x)
+{
+  double d = x - m->mean;
+  m->n++;
+  m->mean += d / m->n;
+  m->m2 += d * (x - m->mean);
+}
+
+static void
+asymMomentsMerge(heliAsymMoments_t *m, const heliAsymMoments_t *o)
+{
+  if(o->n == 0)
+    return;
+
+  uint64_t n = m->n + o->n;
+  double d = o->mean - m->mean;
+
+  m->mean += d * o->n / n;
+  m->m2 += o->m2 + d * d * ((double) m->n * o->n / n);
+  m->n = n;
+}
+
+/* Accumulate the pattern starting at windows[0].  Return -1 if rejected. */
+static int32_t
+asymPattern(heliAsymAccum_t *acc, const uint8_t *windows, const double *yields,
+	    uint32_t len)
+{
+  const uint64_t mask = heliSeqPatternSignMask(acc->pattern);
+  const double *sign = asymSigns[acc->pattern];
+  const uint8_t pol = windows[0] & HELI_WINDOW_HELICITY;
+  uint8_t bad = 0;
+  uint32_t j;
+
+  for(j = 0; j < len; j++)
+    {
+      bad |= (windows[j] ^ pol ^ (mask >> j)) & HELI_WINDOW_HELICITY;
+      bad |= windows[j] & (HELI_REPLAY_MISMATCH | HELI_REPLAY_UNLOCKED);
+    }
+  for(j = 1; j < len; j++)
+    bad |= windows[j] & HELI_WINDOW_PATTERN_SYNC;
+
+  if(bad)
+    {
+      acc->rejected++;
+      return -1;
+    }
+
+  v2d vsum = { 0, 0 }, vdiff = { 0, 0 };
+  for(j = 0; j < len; j += 2)
+    {
+      v2d y, s;
+      memcpy(&y, &yields[j], sizeof(y));
+      memcpy(&s, &sign[j], sizeof(s));
+      vsum += y;
+      vdiff += y * s;
+    }
+
+  double sum = vsum[0] + vsum[1];
+  double diff = (pol) ? (vdiff[0] + vdiff[1]) : -(vdiff[0] + vdiff[1]);
+
+  asymMomentsAdd(&acc->yield, sum / len);
+  asymMomentsAdd(&acc->diff, diff / (len / 2));
+  if(sum != 0)
+    asymMomentsAdd(&acc->asym, diff / sum);
+
+  acc->patterns++;
+
+  return 0;
+}
+
+/**
+ * @brief Initialize a pattern asymmetry accumulator
+ * @param[out] acc Accumulator
+ * @param[in] pattern Helicity pattern index
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliAsymInit(heliAsymAccum_t *acc, uint32_t pattern)
+{
+  if(heliSeqPatternLength(pattern) < 0)
+    {
+      HELI_ERR("Invalid pattern (%d)\n", pattern);
+      return -1;
+    }
+
+  pthread_once(&asymOnce, asymSignsInit);
+
+  memset(acc, 0, sizeof(*acc));
+  acc->pattern = pattern;
+
+  return 0;
+}
+
+/**
+ * @brief Accumulate consecutive windows
+ * @details Accumulate the complete patterns in consecutive windows.  A
+ *          pattern that is not complete at the end of the block is held,
+ *          and finished by the next call.
+ * @param[inout] acc Accumulator
+ * @param[in] windows Array of true HELI_WINDOW_* signals, one per window,
+ *            with HELI_REPLAY_* flags.  @see heliReplay
+ * @param[in] yields Array of yields, one per window
+ * @param[in] nwindows Number of windows
+ */
+void
+heliAsymAccumulate(heliAsymAccum_t *acc, const uint8_t *windows,
+		   const double *yields, uint64_t nwindows)
+{
+  const uint32_t len = heliSeqPatternLength(acc->pattern);
+  uint64_t iwin = 0;
+
+  if(acc->ncarry)
+    {
+      uint64_t take = len - acc->ncarry;
+      if(take > nwindows)
+	take = nwindows;
+
+      memcpy(&acc->carryWindows[acc->ncarry], windows, take);
+      memcpy(&acc->carryYields[acc->ncarry], yields, take * sizeof(*yields));
+      acc->ncarry += take;
+      iwin = take;
+
+      if(acc->ncarry < len)
+	return;
+
+      asymPattern(acc, acc->carryWindows, acc->carryYields, len);
+      acc->ncarry = 0;
+    }
+
+  while(iwin < nwindows)
+    {
+      if(!(windows[iwin] & HELI_WINDOW_PATTERN_SYNC))
+	{
+	  iwin++;
+	  continue;
+	}
+
+      if(iwin + len > nwindows)
+	{
+	  acc->ncarry = nwindows - iwin;
+	  memcpy(acc->carryWindows, &windows[iwin], acc->ncarry);
+	  memcpy(acc->carryYields, &yields[iwin], acc->ncarry * sizeof(*yields));
+	  break;
+	}
+
+      if(asymPattern(acc, &windows[iwin], &yields[iwin], len) == 0)
+	iwin += len;
+      else
+	iwin++;
+    }
+}
+
+/**
+ * @brief Merge one accumulator into another
+ * @details Merge the counts and moments of other into acc.  Held windows of
+ *          other are not merged.
+ * @param[inout] acc Accumulator
+ * @param[in] other Accumulator of the same pattern
+ */
+void
+heliAsymMerge(heliAsymAccum_t *acc, const heliAsymAccum_t *other)
+{
+  acc->patterns += other->patterns;
+  acc->rejected += other->rejected;
+  asymMomentsMerge(&acc->asym, &other->asym);
+  asymMomentsMerge(&acc->diff, &other->diff);
+  asymMomentsMerge(&acc->yield, &other->yield);
+}
+
+static void *
+asymThread(void *arg)
+{
+  asymJob *job = arg;
+
+  heliAsymAccumulate(&job->acc, &job->windows[job->first], &job->yields[job->first],
+		     job->last - job->first);
+
+  return NULL;
+}
+
+/**
+ * @brief Accumulate a whole run using several threads
+ * @details Split the windows in nthreads ranges.  Each thread accumulates
+ *          the patterns that start in its range, and the per-thread
+ *          accumulators are merged into acc in order.
+ * @param[inout] acc Accumulator
+ * @param[in] windows Array of true HELI_WINDOW_* signals, one per window
+ * @param[in] yields Array of yields, one per window
+ * @param[in] nwindows Number of windows
+ * @param[in] nthreads Number of threads
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliAsymProcess(heliAsymAccum_t *acc, const uint8_t *windows,
+		const double *yields, uint64_t nwindows, uint32_t nthreads)
+{
+  const uint32_t len = heliSeqPatternLength(acc->pattern);
+  uint32_t ithr;
+
+  if(nthreads == 0)
+    nthreads = 1;
+
+  asymJob *jobs = calloc(nthreads, sizeof(*jobs));
+  pthread_t *threads = calloc(nthreads, sizeof(*threads));
+  int8_t *started = calloc(nthreads, sizeof(*started));
+  if((jobs == NULL) || (threads == NULL) || (started == NULL))
+    {
+      HELI_ERR("Unable to allocate memory\n");
+      free(jobs);
+      free(threads);
+      free(started);
+      return -1;
+    }
+
+  for(ithr = 0; ithr < nthreads; ithr++)
+    {
+      asymJob *job = &jobs[ithr];
+      heliAsymInit(&job->acc, acc->pattern);
+      job->windows = windows;
+      job->yields = yields;
+      job->first = nwindows * ithr / nthreads;
+      /* Let patterns starting in range finish in the next range */
+      job->last = nwindows * (ithr + 1) / nthreads + len - 1;
+      if(job->last > nwindows)
+	job->last = nwindows;
+
+      if(ithr > 0)
+	started[ithr] = (pthread_create(&threads[ithr], NULL, asymThread, job) == 0);
+    }
+
+  asymThread(&jobs[0]);
+
+  for(ithr = 0; ithr < nthreads; ithr++)
+    {
+      if(ithr > 0)
+	{
+	  if(started[ithr])
+	    pthread_join(threads[ithr], NULL);
+	  else
+	    asymThread(&jobs[ithr]);
+	}
+      heliAsymMerge(acc, &jobs[ithr].acc);
+    }
+
+  free(jobs);
+  free(threads);
+  free(started);
+
+  return 0;
+}
+
+/**
+ * @brief Sum event weights into window yields
+ * @param[inout] yields Array of yields, one per window
+ * @param[in] nwindows Number of windows
+ * @param[in] eventWindows Window of each event
+ * @param[in] weights Weight of each event (NULL for unit weights)
+ * @param[in] nevents Number of events
+ * @return 0 if successful, -1 if any event was outside the windows
+ */
+int32_t
+heliAsymBinEvents(double *yields, uint64_t nwindows,
+		  const uint64_t *eventWindows, const double *weights,
+		  uint64_t nevents)
+{
+  uint64_t iev, noutside = 0;
+
+  for(iev = 0; iev < nevents; iev++)
+    {
+      uint64_t w = eventWindows[iev];
+      if(w >= nwindows)
+	{
+	  noutside++;
+	  continue;
+	}
+      yields[w] += (weights) ? weights[iev] : 1.0;
+    }
+
+  if(noutside)
+    {
+      HELI_ERR("%llu events outside of %llu windows\n",
+	       (unsigned long long) noutside, (unsigned long long) nwindows);
+      return -1;
+    }
+
+  return 0;
+}
+
+/**
+ * @brief Return the mean and its error from running moments
+ * @param[in] m Running moments
+ * @param[out] mean Mean
+ * @param[out] error Error on the mean
+ */
+void
+heliAsymGetMean(const heliAsymMoments_t *m, double *mean, double *error)
+{
+  *mean = m->mean;
+  *error = (m->n > 1) ? sqrt(m->m2 / (m->n - 1) / m->n) : 0;
+}
@@ -0,0 +1,60 @@
+#pragma once
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Header for the Pattern Asymmetry accumulator
+ *
+ *   Windows are assembled into complete patterns, starting at the pattern
+ *   sync.  A pattern is kept only if the helicity of every window follows
+ *   the sign layout of the pattern (heliSeqPatternSignMask), and no window
+ *   is flagged HELI_REPLAY_MISMATCH or HELI_REPLAY_UNLOCKED.  For each kept
+ *   pattern, with Y+ (Y-) the summed yield of the windows with helicity 1
+ *   (0):
+ *
+ *     asymmetry  = (Y+ - Y-) / (Y+ + Y-)
+ *     difference = (Y+ - Y-) / (windows / 2)
+ *     yield      = (Y+ + Y-) / windows
+ *
+ *   Running mean and variance of each are accumulated.
+ *
+ */
+
+#include <stdint.h>
+#include "heliSeq.h"
+
+typedef struct
+{
+  uint64_t n;                 /* Entries */
+  double   mean;              /* Running mean */
+  double   m2;                /* Sum of squared deviations from the mean */
+} heliAsymMoments_t;
+
+typedef struct
+{
+  uint32_t pattern;           /* Helicity pattern index */
+  uint64_t patterns;          /* Patterns accumulated */
+  uint64_t rejected;          /* Patterns rejected */
+  heliAsymMoments_t asym;     /* Pattern asymmetry */
+  heliAsymMoments_t diff;     /* Pattern difference */
+  heliAsymMoments_t yield;    /* Pattern yield */
+  uint32_t ncarry;            /* Windows of an unfinished pattern */
+  uint8_t  carryWindows[64];
+  double   carryYields[64];
+} heliAsymAccum_t;
+
+int32_t heliAsymInit(heliAsymAccum_t *acc, uint32_t pattern);
+void    heliAsymAccumulate(heliAsymAccum_t *acc, const uint8_t *windows,
+			   const double *yields, uint64_t nwindows);
+void    heliAsymMerge(heliAsymAccum_t *acc, const heliAsymAccum_t *other);
+int32_t heliAsymProcess(heliAsymAccum_t *acc, const uint8_t *windows,
+			const double *yields, uint64_t nwindows, uint32_t nthreads);
+int32_t heliAsymBinEvents(double *yields, uint64_t nwindows,
+			  const uint64_t *eventWindows, const double *weights,
+			  uint64_t nevents);
+void    heliAsymGetMean(const heliAsymMoments_t *m, double *mean, double *error);
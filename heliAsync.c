@@ -0,0 +1,645 @@
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Asynchronous control API
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include "heliAsync.h"
+#include "heliNotify.h"
+#include "heliPrivate.h"
+
+#define HELI_ASYNC_MAX_THREADS 16
+
+/* Reset: set, wait, clear, wait.  @see heliReset */
+#define RESET_HOLD_MS 1000
+
+typedef struct asyncOp
+{
+  struct asyncOp *next;       /* Job, done, or waiter list */
+  struct asyncOp *timerNext;  /* Timer list */
+  int32_t  op;                /* enum heliAsyncOp */
+  int32_t  step;              /* Next step of the operation */
+  heliAsyncCallback_t callback;
+  void    *arg;
+  heliConfig_t cfg;
+  uint64_t deadline;          /* Timer [ns, CLOCK_MONOTONIC], 0 if none */
+  uint64_t notifySeq;         /* Notifications seen at the start of a wait */
+  heliAsyncResult_t result;
+} asyncOp;
+
+struct heliAsync
+{
+  int      epfd;              /* Returned to the loop */
+  int      evfd;              /* Done list, or a notification */
+  int      tmfd;              /* First timer */
+  uint32_t nthreads;
+  pthread_t threads[HELI_ASYNC_MAX_THREADS];
+
+  /* Shared with the executor and the notification callback */
+  pthread_mutex_t mutex;
+  pthread_cond_t jobCond;
+  int32_t  stopping;
+  asyncOp  *jobHead, *jobTail;
+  asyncOp  *doneHead, *doneTail;
+  uint64_t notifySeq;         /* Notifications received */
+  uint32_t notifyEvents;      /* Events of the last notification */
+  heliRegs notifyRegs;        /* Registers of the last notification */
+
+  /* Loop thread only */
+  asyncOp  *timers;           /* By deadline */
+  uint64_t armed;             /* Deadline set on tmfd, 0 if none */
+  asyncOp  *waiters;
+  int32_t  subscription;      /* heliNotify id, -1 if none */
+  uint64_t notifyHandled;
+  int32_t  finished;          /* Callbacks run by this dispatch */
+};
+
+static uint64_t
+asyncNow()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+asyncWake(heliAsync_t *a)
+{
+  uint64_t one = 1;
+
+  if(write(a->evfd, &one, sizeof(one)) != sizeof(one))
+    {
+      /* Counter saturated: already readable */
+    }
+}
+
+/* Executor: run the bus work of one step */
+static void
+asyncStep(asyncOp *op)
+{
+  int32_t stat = 0;
+
+  switch(op->op)
+    {
+    case HELI_ASYNC_RESET:
+      stat = heliSetReset((op->step == 0) ? 1 : 0);
+      break;
+
+    case HELI_ASYNC_APPLY_CONFIG:
+      stat = heliApplyConfig(&op->cfg);
+      break;
+
+    case HELI_ASYNC_SNAPSHOT:
+      stat = heliGetRegisterSnapshot(&op->result.regs);
+      break;
+    }
+
+  if(stat != 0)
+    op->result.status = HELI_ASYNC_ERROR;
+}
+
+static void *
+asyncExecutor(void *arg)
+{
+  heliAsync_t *a = (heliAsync_t *) arg;
+  asyncOp *op;
+
+  pthread_mutex_lock(&a->mutex);
+  while(1)
+    {
+      while(!a->stopping && (a->jobHead == NULL))
+	pthread_cond_wait(&a->jobCond, &a->mutex);
+
+      if(a->stopping)
+	break;
+
+      op = a->jobHead;
+      a->jobHead = op->next;
+      if(a->jobHead == NULL)
+	a->jobTail = NULL;
+      pthread_mutex_unlock(&a->mutex);
+
+      asyncStep(op);
+
+      pthread_mutex_lock(&a->mutex);
+      op->next = NULL;
+      if(a->doneTail)
+	a->doneTail->next = op;
+      else
+	a->doneHead = op;
+      a->doneTail = op;
+      asyncWake(a);
+    }
+  pthread_mutex_unlock(&a->mutex);
+
+  return NULL;
+}
+
+/* Notification dispatcher thread: record the event, wake the loop */
+static void
+asyncNotify(void *arg, uint32_t events, const heliRegs *regs)
+{
+  heliAsync_t *a = (heliAsync_t *) arg;
+
+  pthread_mutex_lock(&a->mutex);
+  a->notifySeq++;
+  a->notifyEvents = events;
+  a->notifyRegs = *regs;
+  asyncWake(a);
+  pthread_mutex_unlock(&a->mutex);
+}
+
+static void
+asyncSubmitJob(heliAsync_t *a, asyncOp *op)
+{
+  pthread_mutex_lock(&a->mutex);
+  op->next = NULL;
+  if(a->jobTail)
+    a->jobTail->next = op;
+  else
+    a->jobHead = op;
+  a->jobTail = op;
+  pthread_cond_signal(&a->jobCond);
+  pthread_mutex_unlock(&a->mutex);
+}
+
+static void
+asyncTimerAdd(heliAsync_t *a, asyncOp *op, uint64_t deadline)
+{
+  asyncOp **p = &a->timers;
+
+  op->deadline = deadline;
+  while(*p && ((*p)->deadline <= deadline))
+    p = &(*p)->timerNext;
+  op->timerNext = *p;
+  *p = op;
+}
+
+static void
+asyncTimerRemove(heliAsync_t *a, asyncOp *op)
+{
+  asyncOp **p = &a->timers;
+
+  if(op->deadline == 0)
+    return;
+
+  while(*p && (*p != op))
+    p = &(*p)->timerNext;
+  if(*p)
+    *p = op->timerNext;
+  op->deadline = 0;
+}
+
+/* Set tmfd to the first deadline */
+static void
+asyncTimerArm(heliAsync_t *a)
+{
+  struct itimerspec its;
+  uint64_t deadline = (a->timers) ? a->timers->deadline : 0;
+
+  if(deadline == a->armed)
+    return;
+
+  memset(&its, 0, sizeof(its));
+  its.it_value.tv_sec = deadline / 1000000000ULL;
+  its.it_value.tv_nsec = deadline % 1000000000ULL;
+  timerfd_settime(a->tmfd, TFD_TIMER_ABSTIME, &its, NULL);
+  a->armed = deadline;
+}
+
+static void
+asyncFinish(heliAsync_t *a, asyncOp *op)
+{
+  a->finished++;
+  op->callback(op->arg, &op->result);
+  free(op);
+}
+
+/* Remove a waiter, and the subscription after the last one */
+static void
+asyncWaiterRemove(heliAsync_t *a, asyncOp *op)
+{
+  asyncOp **p = &a->waiters;
+
+  while(*p && (*p != op))
+    p = &(*p)->next;
+  if(*p)
+    *p = op->next;
+
+  if((a->waiters == NULL) && (a->subscription >= 0))
+    {
+      heliUnsubscribe(a->subscription);
+      a->subscription = -1;
+    }
+}
+
+/* Loop thread: an executor step finished */
+static void
+asyncAdvance(heliAsync_t *a, asyncOp *op)
+{
+  if((op->op == HELI_ASYNC_RESET) && (op->result.status == HELI_ASYNC_OK) &&
+     (op->step < 2))
+    {
+      /* Hold the reset bit, then let the sequencer restart */
+      op->step++;
+      asyncTimerAdd(a, op, asyncNow() + RESET_HOLD_MS * 1000000ULL);
+      return;
+    }
+
+  asyncFinish(a, op);
+}
+
+/* Loop thread: a timer expired */
+static void
+asyncExpire(heliAsync_t *a, asyncOp *op)
+{
+  op->deadline = 0;
+
+  if(op->op == HELI_ASYNC_WAIT_STATE)
+    {
+      asyncWaiterRemove(a, op);
+      op->result.status = HELI_ASYNC_TIMEOUT;
+      asyncFinish(a, op);
+    }
+  else if(op->step == 1)
+    asyncSubmitJob(a, op);
+  else
+    asyncFinish(a, op);
+}
+
+/**
+ * @brief Create an asynchronous control context
+ * @param[in] nthreads Executor threads (0 for HELI_ASYNC_DEFAULT_THREADS)
+ * @return Context if successful, otherwise NULL
+ */
+heliAsync_t *
+heliAsyncCreate(uint32_t nthreads)
+{
+  heliAsync_t *a;
+  struct epoll_event ev;
+
+  if(nthreads == 0)
+    nthreads = HELI_ASYNC_DEFAULT_THREADS;
+  if(nthreads > HELI_ASYNC_MAX_THREADS)
+    {
+      HELI_ERR("Invalid threads (%u, max %d)\n", nthreads, HELI_ASYNC_MAX_THREADS);
+      return NULL;
+    }
+
+  a = malloc(sizeof(*a));
+  if(a == NULL)
+    {
+      HELI_ERR("Unable to allocate memory\n");
+      return NULL;
+    }
+  memset(a, 0, sizeof(*a));
+  a->subscription = -1;
+
+  a->epfd = epoll_create1(EPOLL_CLOEXEC);
+  a->evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  a->tmfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if((a->epfd < 0) || (a->evfd < 0) || (a->tmfd < 0))
+    {
+      HELI_ERR("Unable to create descriptors\n");
+      goto FAIL;
+    }
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = a->evfd;
+  if(epoll_ctl(a->epfd, EPOLL_CTL_ADD, a->evfd, &ev) != 0)
+    goto FAIL;
+  ev.data.fd = a->tmfd;
+  if(epoll_ctl(a->epfd, EPOLL_CTL_ADD, a->tmfd, &ev) != 0)
+    goto FAIL;
+
+  pthread_mutex_init(&a->mutex, NULL);
+  pthread_cond_init(&a->jobCond, NULL);
+
+  for(a->nthreads = 0; a->nthreads < nthreads; a->nthreads++)
+    {
+      if(pthread_create(&a->threads[a->nthreads], NULL, asyncExecutor, a) != 0)
+	{
+	  HELI_ERR("Unable to start executor thread\n");
+	  heliAsyncDestroy(a);
+	  return NULL;
+	}
+    }
+
+  return a;
+
+ FAIL:
+  if(a->epfd >= 0)
+    close(a->epfd);
+  if(a->evfd >= 0)
+    close(a->evfd);
+  if(a->tmfd >= 0)
+    close(a->tmfd);
+  free(a);
+  return NULL;
+}
+
+static void
+asyncFreeList(asyncOp *op)
+{
+  asyncOp *next;
+
+  for(; op; op = next)
+    {
+      next = op->next;
+      free(op);
+    }
+}
+
+/**
+ * @brief Destroy an asynchronous control context
+ * @details Waits for the bus work in progress.  Operations not finished
+ *          are dropped, without their callbacks.
+ * @param[in] a Context
+ */
+void
+heliAsyncDestroy(heliAsync_t *a)
+{
+  asyncOp *op, *next;
+  uint32_t ithread;
+
+  if(a == NULL)
+    return;
+
+  if(a->subscription >= 0)
+    heliUnsubscribe(a->subscription);
+
+  pthread_mutex_lock(&a->mutex);
+  a->stopping = 1;
+  pthread_cond_broadcast(&a->jobCond);
+  pthread_mutex_unlock(&a->mutex);
+
+  for(ithread = 0; ithread < a->nthreads; ithread++)
+    pthread_join(a->threads[ithread], NULL);
+
+  asyncFreeList(a->jobHead);
+  asyncFreeList(a->doneHead);
+  asyncFreeList(a->waiters);
+  for(op = a->timers; op; op = next)
+    {
+      next = op->timerNext;
+      if(op->op != HELI_ASYNC_WAIT_STATE)
+	free(op);
+    }
+
+  pthread_mutex_destroy(&a->mutex);
+  pthread_cond_destroy(&a->jobCond);
+  close(a->epfd);
+  close(a->evfd);
+  close(a->tmfd);
+  free(a);
+}
+
+/**
+ * @brief Return the descriptor for the event loop to watch
+ * @details Readable (EPOLLIN) when heliAsyncDispatch has work to do.
+ * @param[in] a Context
+ * @return Descriptor
+ */
+int
+heliAsyncGetFd(const heliAsync_t *a)
+{
+  return a->epfd;
+}
+
+/**
+ * @brief Advance the operations, and run the callbacks of those finished
+ * @details Call from the event loop thread, when the descriptor from
+ *          heliAsyncGetFd is readable.  Never blocks.
+ * @param[in] a Context
+ * @return Number of callbacks run
+ */
+int32_t
+heliAsyncDispatch(heliAsync_t *a)
+{
+  asyncOp *done, *op, *next;
+  heliRegs regs;
+  uint32_t events;
+  uint64_t seq, now, count;
+  struct epoll_event ev[2];
+
+  a->finished = 0;
+
+  /* Clear the readiness */
+  epoll_wait(a->epfd, ev, 2, 0);
+  if(read(a->evfd, &count, sizeof(count)) < 0)
+    count = 0;
+  if(read(a->tmfd, &count, sizeof(count)) < 0)
+    count = 0;
+  a->armed = 0;
+
+  pthread_mutex_lock(&a->mutex);
+  done = a->doneHead;
+  a->doneHead = a->doneTail = NULL;
+  seq = a->notifySeq;
+  events = a->notifyEvents;
+  regs = a->notifyRegs;
+  pthread_mutex_unlock(&a->mutex);
+
+  for(op = done; op; op = next)
+    {
+      next = op->next;
+      asyncAdvance(a, op);
+    }
+
+  /* Complete the waiters that started before the last notification */
+  if(seq != a->notifyHandled)
+    {
+      asyncOp **p = &a->waiters;
+
+      a->notifyHandled = seq;
+      while(*p)
+	{
+	  op = *p;
+	  if(op->notifySeq >= seq)
+	    {
+	      p = &op->next;
+	      continue;
+	    }
+	  *p = op->next;
+	  asyncTimerRemove(a, op);
+	  op->result.status = (events & HELI_NOTIFY_STATE) ? HELI_ASYNC_OK : HELI_ASYNC_STALL;
+	  op->result.regs = regs;
+	  asyncFinish(a, op);
+	}
+
+      if((a->waiters == NULL) && (a->subscription >= 0))
+	{
+	  heliUnsubscribe(a->subscription);
+	  a->subscription = -1;
+	}
+    }
+
+  now = asyncNow();
+  while(a->timers && (a->timers->deadline <= now))
+    {
+      op = a->timers;
+      a->timers = op->timerNext;
+      asyncExpire(a, op);
+    }
+
+  asyncTimerArm(a);
+
+  return a->finished;
+}
+
+static asyncOp *
+asyncNewOp(int32_t type, heliAsyncCallback_t callback, void *arg)
+{
+  asyncOp *op;
+
+  if(callback == NULL)
+    {
+      HELI_ERR("Invalid callback\n");
+      return NULL;
+    }
+
+  op = malloc(sizeof(*op));
+  if(op == NULL)
+    {
+      HELI_ERR("Unable to allocate memory\n");
+      return NULL;
+    }
+  memset(op, 0, sizeof(*op));
+  op->op = type;
+  op->callback = callback;
+  op->arg = arg;
+  op->result.op = type;
+
+  return op;
+}
+
+/**
+ * @brief Reset the module, without blocking
+ * @details Toggles the reset bit like heliReset, with timers in place of
+ *          the sleeps.  The callback runs about two seconds later.
+ * @param[in] a Context
+ * @param[in] callback Called when done
+ * @param[in] arg Argument passed to callback
+ * @return 0 if started, otherwise -1
+ */
+int32_t
+heliAsyncReset(heliAsync_t *a, heliAsyncCallback_t callback, void *arg)
+{
+  asyncOp *op = asyncNewOp(HELI_ASYNC_RESET, callback, arg);
+
+  if(op == NULL)
+    return -1;
+
+  asyncSubmitJob(a, op);
+
+  return 0;
+}
+
+/**
+ * @brief Apply a configuration, without blocking
+ * @details @see heliApplyConfig
+ * @param[in] a Context
+ * @param[in] cfg Configuration register values, copied
+ * @param[in] callback Called when done
+ * @param[in] arg Argument passed to callback
+ * @return 0 if started, otherwise -1
+ */
+int32_t
+heliAsyncApplyConfig(heliAsync_t *a, const heliConfig_t *cfg,
+		     heliAsyncCallback_t callback, void *arg)
+{
+  asyncOp *op = asyncNewOp(HELI_ASYNC_APPLY_CONFIG, callback, arg);
+
+  if(op == NULL)
+    return -1;
+
+  op->cfg = *cfg;
+  asyncSubmitJob(a, op);
+
+  return 0;
+}
+
+/**
+ * @brief Read all registers, without blocking
+ * @details The registers are in the result.  @see heliGetRegisterSnapshot
+ * @param[in] a Context
+ * @param[in] callback Called when done
+ * @param[in] arg Argument passed to callback
+ * @return 0 if started, otherwise -1
+ */
+int32_t
+heliAsyncSnapshot(heliAsync_t *a, heliAsyncCallback_t callback, void *arg)
+{
+  asyncOp *op = asyncNewOp(HELI_ASYNC_SNAPSHOT, callback, arg);
+
+  if(op == NULL)
+    return -1;
+
+  asyncSubmitJob(a, op);
+
+  return 0;
+}
+
+/**
+ * @brief Wait for the sequencer state to change, without blocking
+ * @details Finishes with HELI_ASYNC_OK and the state in the result when
+ *          the state changes, HELI_ASYNC_STALL when it stalls, or
+ *          HELI_ASYNC_TIMEOUT.  All waiters share one heliNotify
+ *          subscription.  @see heliNotifySetInterval
+ * @param[in] a Context
+ * @param[in] timeoutMs Timeout [ms], 0 for none
+ * @param[in] callback Called when done
+ * @param[in] arg Argument passed to callback
+ * @return 0 if started, otherwise -1
+ */
+int32_t
+heliAsyncWaitStateChange(heliAsync_t *a, uint32_t timeoutMs,
+			 heliAsyncCallback_t callback, void *arg)
+{
+  asyncOp *op = asyncNewOp(HELI_ASYNC_WAIT_STATE, callback, arg);
+
+  if(op == NULL)
+    return -1;
+
+  if(a->subscription < 0)
+    {
+      a->subscription = heliSubscribe(HELI_NOTIFY_STATE | HELI_NOTIFY_STALL, asyncNotify, a);
+      if(a->subscription < 0)
+	{
+	  free(op);
+	  return -1;
+	}
+    }
+
+  pthread_mutex_lock(&a->mutex);
+  op->notifySeq = a->notifySeq;
+  pthread_mutex_unlock(&a->mutex);
+
+  op->next = a->waiters;
+  a->waiters = op;
+
+  if(timeoutMs)
+    {
+      asyncTimerAdd(a, op, asyncNow() + timeoutMs * 1000000ULL);
+      asyncTimerArm(a);
+    }
+
+  return 0;
+}
@@ -0,0 +1,69 @@
+#pragma once
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Header for the asynchronous control API
+ *
+ *   For event loops (epoll, poll, select).  Each call starts an operation
+ *   and returns at once.  Bus work runs on a small pool of executor
+ *   threads, waits run on timers (the reset toggle) or on register change
+ *   notifications (heliNotify), and no thread blocks while an operation
+ *   waits.
+ *
+ *   heliAsyncGetFd returns one descriptor for the loop to watch.  When it
+ *   is readable, the loop calls heliAsyncDispatch, which advances the
+ *   operations and runs the callbacks of those finished, on the loop
+ *   thread.  Call the API from the loop thread only.  Callbacks may start
+ *   new operations.
+ *
+ */
+
+#include <stdint.h>
+#include "heliLib.h"
+
+#define HELI_ASYNC_DEFAULT_THREADS 2
+
+/* Operations */
+enum heliAsyncOp
+  {
+    HELI_ASYNC_RESET        = 0, /* heliReset */
+    HELI_ASYNC_APPLY_CONFIG = 1, /* heliApplyConfig */
+    HELI_ASYNC_SNAPSHOT     = 2, /* heliGetRegisterSnapshot */
+    HELI_ASYNC_WAIT_STATE   = 3  /* Wait for the sequencer state to change */
+  };
+
+/* Result status */
+#define HELI_ASYNC_OK       0
+#define HELI_ASYNC_ERROR   -1
+#define HELI_ASYNC_TIMEOUT  1  /* Wait timed out */
+#define HELI_ASYNC_STALL    2  /* Sequencer state stalled.  @see HELI_NOTIFY_STALL */
+
+typedef struct
+{
+  int32_t  op;                /* enum heliAsyncOp */
+  int32_t  status;            /* HELI_ASYNC_* status */
+  heliRegs regs;              /* Registers of a snapshot, state of a wait */
+} heliAsyncResult_t;
+
+/* Called on the thread running heliAsyncDispatch */
+typedef void (*heliAsyncCallback_t)(void *arg, const heliAsyncResult_t *result);
+
+typedef struct heliAsync heliAsync_t;
+
+heliAsync_t *heliAsyncCreate(uint32_t nthreads);
+void    heliAsyncDestroy(heliAsync_t *a);
+int     heliAsyncGetFd(const heliAsync_t *a);
+int32_t heliAsyncDispatch(heliAsync_t *a);
+
+int32_t heliAsyncReset(heliAsync_t *a, heliAsyncCallback_t callback, void *arg);
+int32_t heliAsyncApplyConfig(heliAsync_t *a, const heliConfig_t *cfg,
+			     heliAsyncCallback_t callback, void *arg);
+int32_t heliAsyncSnapshot(heliAsync_t *a, heliAsyncCallback_t callback, void *arg);
+int32_t heliAsyncWaitStateChange(heliAsync_t *a, uint32_t timeoutMs,
+				 heliAsyncCallback_t callback, void *arg);
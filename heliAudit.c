@@ -0,0 +1,431 @@
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Register Audit log
+ *
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "heliAudit.h"
+#include "heliPrivate.h"
+
+_Static_assert(sizeof(heliAuditHeader_t) == HELI_AUDIT_PAGE,
+	       "heliAuditHeader_t must fill one page");
+_Static_assert(sizeof(heliAuditRecord_t) == 64,
+	       "heliAuditRecord_t must be 64 bytes");
+
+struct heliAuditLog
+{
+  uint8_t *map;                 /* Mapped file */
+  size_t size;                  /* Size of the mapping */
+  heliAuditHeader_t *hdr;
+  heliAuditRecord_t *rec;       /* Ring of records */
+  uint64_t nrecords;
+  uint32_t pid;
+};
+
+/* Configuration registers, compared with the board on attach */
+static const uint8_t auditConfigRegs[] =
+  {
+    offsetof(heliRegs, tsettle),
+    offsetof(heliRegs, tstable),
+    offsetof(heliRegs, delay),
+    offsetof(heliRegs, pattern),
+    offsetof(heliRegs, clock)
+  };
+
+static inline uint64_t
+auditNow()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Mark a slot as being written */
+static inline heliAuditRecord_t *
+auditBegin(heliAuditLog_t *log, uint64_t seq)
+{
+  heliAuditRecord_t *rec = &log->rec[seq % log->nrecords];
+
+  __atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  return rec;
+}
+
+/* Publish a written slot */
+static inline void
+auditCommit(heliAuditRecord_t *rec, uint64_t seq)
+{
+  __atomic_store_n(&rec->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+/* Write a checkpoint of the logged configuration */
+static void
+auditCheckpoint(heliAuditLog_t *log, uint64_t seq, uint64_t now)
+{
+  heliAuditRecord_t *rec = auditBegin(log, seq);
+  uint32_t ireg;
+
+  rec->time = now;
+  rec->pid = log->pid;
+  rec->type = HELI_AUDIT_CHECKPOINT;
+  rec->reg = 0;
+  rec->oldValue = 0;
+  rec->newValue = 0;
+  for(ireg = 0; ireg < sizeof(heliRegs); ireg++)
+    rec->regs[ireg] = __atomic_load_n(&log->hdr->regs[ireg], __ATOMIC_RELAXED);
+
+  auditCommit(rec, seq);
+}
+
+static void
+auditAppend(heliAuditLog_t *log, uint8_t type, const char *caller, uint8_t reg, uint8_t value)
+{
+  heliAuditHeader_t *hdr = log->hdr;
+  uint64_t now = auditNow();
+  uint64_t seq = __atomic_fetch_add(&hdr->head, 1, __ATOMIC_ACQ_REL);
+
+  while((seq % HELI_AUDIT_CHECKPOINT_EVERY) == 0)
+    {
+      auditCheckpoint(log, seq, now);
+      seq = __atomic_fetch_add(&hdr->head, 1, __ATOMIC_ACQ_REL);
+    }
+
+  uint8_t old = __atomic_exchange_n(&hdr->regs[reg], value, __ATOMIC_ACQ_REL);
+  heliAuditRecord_t *rec = auditBegin(log, seq);
+
+  rec->time = now;
+  rec->pid = log->pid;
+  rec->type = type;
+  rec->reg = reg;
+  rec->oldValue = old;
+  rec->newValue = value;
+  strncpy(rec->caller, caller, sizeof(rec->caller) - 1);
+  rec->caller[sizeof(rec->caller) - 1] = 0;
+
+  auditCommit(rec, seq);
+}
+
+/* Register write hook of the library */
+static void
+auditHook(void *arg, const char *func, uint8_t reg, uint8_t value)
+{
+  auditAppend(arg, HELI_AUDIT_WRITE, func, reg, value);
+}
+
+/**
+ * @brief Open a register audit log
+ * @details Open a register audit log file, or create it if it does not
+ *          exist.  The file may be open in several processes at once.
+ * @param[in] path Name of the file
+ * @param[in] nrecords Records in the ring, when created (0 for
+ *            HELI_AUDIT_DEFAULT_RECORDS).  Rounded up to a multiple of
+ *            HELI_AUDIT_CHECKPOINT_EVERY.
+ * @return Pointer to the log if successful, otherwise NULL
+ */
+heliAuditLog_t *
+heliAuditOpen(const char *path, uint64_t nrecords)
+{
+  heliAuditHeader_t hdr;
+  struct stat st;
+  int fd;
+
+  if(nrecords == 0)
+    nrecords = HELI_AUDIT_DEFAULT_RECORDS;
+  nrecords = (nrecords + HELI_AUDIT_CHECKPOINT_EVERY - 1) /
+    HELI_AUDIT_CHECKPOINT_EVERY * HELI_AUDIT_CHECKPOINT_EVERY;
+
+  fd = open(path, O_RDWR | O_CREAT, 0664);
+  if(fd < 0)
+    {
+      HELI_ERR("Unable to open %s\n", path);
+      return NULL;
+    }
+
+  /* Only one process creates the file */
+  if(flock(fd, LOCK_EX) < 0)
+    {
+      perror("flock");
+      close(fd);
+      return NULL;
+    }
+
+  if(fstat(fd, &st) < 0)
+    {
+      perror("fstat");
+      goto ERROR;
+    }
+
+  if(st.st_size == 0)
+    {
+      memset(&hdr, 0, sizeof(hdr));
+      memcpy(hdr.magic, HELI_AUDIT_MAGIC, sizeof(hdr.magic));
+      hdr.version = HELI_AUDIT_VERSION;
+      hdr.recordSize = sizeof(heliAuditRecord_t);
+      hdr.nrecords = nrecords;
+
+      if((ftruncate(fd, HELI_AUDIT_PAGE + nrecords * sizeof(heliAuditRecord_t)) < 0) ||
+	 (pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)))
+	{
+	  HELI_ERR("Unable to create %s\n", path);
+	  goto ERROR;
+	}
+    }
+  else
+    {
+      if((pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) ||
+	 (memcmp(hdr.magic, HELI_AUDIT_MAGIC, sizeof(hdr.magic)) != 0) ||
+	 (hdr.version != HELI_AUDIT_VERSION) ||
+	 (hdr.recordSize != sizeof(heliAuditRecord_t)) ||
+	 (hdr.nrecords == 0) || (hdr.nrecords % HELI_AUDIT_CHECKPOINT_EVERY) ||
+	 (HELI_AUDIT_PAGE + hdr.nrecords * sizeof(heliAuditRecord_t) > (uint64_t) st.st_size))
+	{
+	  HELI_ERR("%s is not a valid audit log\n", path);
+	  goto ERROR;
+	}
+      nrecords = hdr.nrecords;
+    }
+
+  flock(fd, LOCK_UN);
+
+  size_t size = HELI_AUDIT_PAGE + nrecords * sizeof(heliAuditRecord_t);
+  uint8_t *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED)
+    {
+      perror("mmap");
+      return NULL;
+    }
+
+  heliAuditLog_t *log = calloc(1, sizeof(*log));
+  if(log == NULL)
+    {
+      HELI_ERR("Unable to allocate log\n");
+      munmap(map, size);
+      return NULL;
+    }
+
+  log->map = map;
+  log->size = size;
+  log->hdr = (heliAuditHeader_t *) map;
+  log->rec = (heliAuditRecord_t *) (map + HELI_AUDIT_PAGE);
+  log->nrecords = nrecords;
+  log->pid = getpid();
+
+  return log;
+
+ ERROR:
+  flock(fd, LOCK_UN);
+  close(fd);
+  return NULL;
+}
+
+/**
+ * @brief Close a register audit log
+ * @param[in] log Log from heliAuditOpen
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliAuditClose(heliAuditLog_t *log)
+{
+  int32_t rval = 0;
+
+  if(munmap(log->map, log->size) < 0)
+    {
+      perror("munmap");
+      rval = -1;
+    }
+
+  free(log);
+
+  return rval;
+}
+
+/**
+ * @brief Log the register writes of the library
+ * @details Compare the configuration registers with the last logged
+ *          values, and log those that changed as HELI_AUDIT_SYNC.  Then log
+ *          every register write made by the library.  The library must be
+ *          initialized.  @see heliSetWriteHook
+ * @param[in] log Log from heliAuditOpen
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliAuditAttach(heliAuditLog_t *log)
+{
+  heliRegs board;
+  uint32_t ireg;
+
+  if(heliGetRegisterSnapshot(&board) < 0)
+    return -1;
+
+  for(ireg = 0; ireg < sizeof(auditConfigRegs); ireg++)
+    {
+      uint8_t reg = auditConfigRegs[ireg];
+      uint8_t value = ((const uint8_t *) &board)[reg];
+
+      if(__atomic_load_n(&log->hdr->regs[reg], __ATOMIC_RELAXED) != value)
+	auditAppend(log, HELI_AUDIT_SYNC, __func__, reg, value);
+    }
+
+  return heliSetWriteHook(auditHook, log);
+}
+
+/**
+ * @brief Stop logging the register writes of the library
+ * @details Stop logging to log.  A write hook set by anyone else is kept.
+ * @param[in] log Log from heliAuditOpen
+ * @return 0 if successful, otherwise -1 (log is not attached)
+ */
+int32_t
+heliAuditDetach(heliAuditLog_t *log)
+{
+  return heliRemoveWriteHook(auditHook, log);
+}
+
+/**
+ * @brief Append a register write to the log
+ * @details Append a record of a register write.  The old value is the last
+ *          logged value of the register.  Lock free.
+ * @param[in] log Log from heliAuditOpen
+ * @param[in] caller Name of the writer
+ * @param[in] reg Register offset in heliRegs
+ * @param[in] value Value written
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliAuditAppend(heliAuditLog_t *log, const char *caller, uint8_t reg, uint8_t value)
+{
+  if(reg >= sizeof(heliRegs))
+    {
+      HELI_ERR("Invalid register offset (0x%x)\n", reg);
+      return -1;
+    }
+
+  auditAppend(log, HELI_AUDIT_WRITE, caller, reg, value);
+
+  return 0;
+}
+
+/**
+ * @brief Return the range of sequence numbers held in the log
+ * @param[in] log Log from heliAuditOpen
+ * @param[out] first Oldest sequence number
+ * @param[out] next Next sequence number to be written
+ */
+void
+heliAuditGetRange(const heliAuditLog_t *log, uint64_t *first, uint64_t *next)
+{
+  uint64_t head = __atomic_load_n(&log->hdr->head, __ATOMIC_ACQUIRE);
+
+  *next = head;
+  *first = (head > log->nrecords) ? head - log->nrecords : 0;
+}
+
+/**
+ * @brief Read a record
+ * @param[in] log Log from heliAuditOpen
+ * @param[in] seq Sequence number
+ * @param[out] rec Copy of the record
+ * @return 0 if successful, -1 if the record was overwritten or is not
+ *         finished
+ */
+int32_t
+heliAuditRead(const heliAuditLog_t *log, uint64_t seq, heliAuditRecord_t *rec)
+{
+  const heliAuditRecord_t *slot = &log->rec[seq % log->nrecords];
+  uint64_t s1, s2;
+
+  s1 = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+  if(s1 != seq + 1)
+    return -1;
+
+  memcpy(rec, slot, sizeof(*rec));
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  s2 = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+
+  return (s2 == s1) ? 0 : -1;
+}
+
+/**
+ * @brief Return the logged configuration at a time
+ * @details Find the last checkpoint at or before time by binary search,
+ *          and apply the writes logged after it, up to time.
+ * @param[in] log Log from heliAuditOpen
+ * @param[in] time CLOCK_REALTIME [ns]
+ * @param[out] config Logged register values
+ * @return 0 if successful, -1 if time is older than the log
+ */
+int32_t
+heliAuditConfigAt(const heliAuditLog_t *log, uint64_t time, heliRegs *config)
+{
+  heliAuditRecord_t rec, found;
+  uint64_t first, next, lo, hi, seq;
+  int32_t havefound = 0;
+
+  heliAuditGetRange(log, &first, &next);
+  if(next == 0)
+    return -1;
+
+  lo = (first + HELI_AUDIT_CHECKPOINT_EVERY - 1) / HELI_AUDIT_CHECKPOINT_EVERY;
+  hi = (next - 1) / HELI_AUDIT_CHECKPOINT_EVERY;
+
+  /* Last checkpoint with a time not after time.  Unreadable ones count as after. */
+  while(lo <= hi)
+    {
+      uint64_t mid = lo + (hi - lo) / 2;
+
+      if((heliAuditRead(log, mid * HELI_AUDIT_CHECKPOINT_EVERY, &rec) == 0) &&
+	 (rec.time <= time))
+	{
+	  found = rec;
+	  havefound = 1;
+	  lo = mid + 1;
+	}
+      else
+	{
+	  if(mid == 0)
+	    break;
+	  hi = mid - 1;
+	}
+    }
+
+  if(!havefound)
+    return -1;
+
+  for(seq = found.seq; seq < next; seq++)
+    {
+      if(heliAuditRead(log, seq, &rec) < 0)
+	continue;
+
+      if(rec.type == HELI_AUDIT_CHECKPOINT)
+	{
+	  if(rec.time > time)
+	    break;
+	  found = rec;
+	}
+      else if(rec.time <= time)
+	found.regs[rec.reg] = rec.newValue;
+    }
+
+  memcpy((void *) config, found.regs, sizeof(heliRegs));
+
+  return 0;
+}
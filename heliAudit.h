@@ -0,0 +1,85 @@
+#pragma once
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Header for the Register Audit log
+ *
+ *   The audit log is a memory mapped file shared by every process that
+ *   attaches to it.  It holds a ring of fixed size records, one for each
+ *   register write made by the library (heliSetWriteHook).
+ *
+ *   File layout:
+ *     heliAuditHeader_t                    (HELI_AUDIT_PAGE bytes)
+ *     heliAuditRecord_t[nrecords]
+ *
+ *   Records are numbered by a sequence number, taken with an atomic
+ *   increment of the header head.  Record seq is stored in slot
+ *   seq % nrecords.  Its seq field is written last, so a record left
+ *   unfinished by a crashed process is never read back.
+ *
+ *   Every HELI_AUDIT_CHECKPOINT_EVERY sequence numbers, the slot holds a
+ *   checkpoint with the full configuration.  The configuration at a time
+ *   is found by a binary search of the checkpoints, and the writes that
+ *   follow.
+ *
+ */
+
+#include <stdint.h>
+#include "heliLib.h"
+
+#define HELI_AUDIT_MAGIC            "HELIAUDT"
+#define HELI_AUDIT_VERSION          1
+#define HELI_AUDIT_PAGE             4096
+#define HELI_AUDIT_CHECKPOINT_EVERY 64
+#define HELI_AUDIT_DEFAULT_RECORDS  (1 << 16)
+#define HELI_AUDIT_CALLER_LEN       40
+
+/* Record types */
+#define HELI_AUDIT_WRITE      1 /* Register written by the library */
+#define HELI_AUDIT_CHECKPOINT 2 /* Full configuration */
+#define HELI_AUDIT_SYNC       3 /* Register found changed on the board */
+
+typedef struct
+{
+  char     magic[8];          /* HELI_AUDIT_MAGIC */
+  uint32_t version;           /* HELI_AUDIT_VERSION */
+  uint32_t recordSize;        /* sizeof(heliAuditRecord_t) */
+  uint64_t nrecords;          /* Records in the ring */
+  uint64_t head;              /* Next sequence number */
+  uint8_t  regs[sizeof(heliRegs)]; /* Last logged register values */
+  uint8_t  _blank[HELI_AUDIT_PAGE - 48];
+} heliAuditHeader_t;
+
+typedef struct
+{
+  uint64_t seq;               /* Sequence number + 1, 0 while being written */
+  uint64_t time;              /* CLOCK_REALTIME [ns] */
+  uint32_t pid;               /* Process */
+  uint8_t  type;              /* HELI_AUDIT_* */
+  uint8_t  reg;               /* Register offset in heliRegs */
+  uint8_t  oldValue;
+  uint8_t  newValue;
+  union
+  {
+    char    caller[HELI_AUDIT_CALLER_LEN]; /* Library function (write, sync) */
+    uint8_t regs[sizeof(heliRegs)];        /* Configuration (checkpoint) */
+  };
+} heliAuditRecord_t;
+
+typedef struct heliAuditLog heliAuditLog_t;
+
+heliAuditLog_t *heliAuditOpen(const char *path, uint64_t nrecords);
+int32_t heliAuditClose(heliAuditLog_t *log);
+int32_t heliAuditAttach(heliAuditLog_t *log);
+int32_t heliAuditDetach(heliAuditLog_t *log);
+
+int32_t heliAuditAppend(heliAuditLog_t *log, const char *caller, uint8_t reg, uint8_t value);
+void    heliAuditGetRange(const heliAuditLog_t *log, uint64_t *first, uint64_t *next);
+int32_t heliAuditRead(const heliAuditLog_t *log, uint64_t seq, heliAuditRecord_t *rec);
+int32_t heliAuditConfigAt(const heliAuditLog_t *log, uint64_t time, heliRegs *config);
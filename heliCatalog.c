@@ -0,0 +1,555 @@
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Run Catalog
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "heliCatalog.h"
+#include "heliPrivate.h"
+
+_Static_assert(sizeof(heliCatalogHeader_t) == 32, "heliCatalogHeader_t must be 32 bytes");
+_Static_assert(sizeof(heliCatalogRecord_t) == 32, "heliCatalogRecord_t must be 32 bytes");
+
+#define CATALOG_READ_BATCH 4096
+#define CATALOG_END_SEARCH 64  /* Rows searched back for the start of a run */
+#define CATALOG_MIN_ROWS   1024
+
+struct heliCatalog
+{
+  int      fd;
+  uint32_t nrows;
+  uint32_t capRows;           /* Rows allocated, a multiple of 64 */
+  int32_t  sorted;            /* Run numbers increase with the row */
+  uint32_t *run;
+  uint32_t *flags;
+  uint64_t *startTime;
+  uint64_t *endTime;
+  heliRegs *start;
+  heliRegs *end;
+
+  /* Bitmaps over the rows: one per field value, then one of changed runs */
+  uint32_t base[HELI_NREGFIELDS]; /* First bitmap of each field */
+  uint32_t nvalues[HELI_NREGFIELDS];
+  uint32_t changed;           /* Bitmap of HELI_CATALOG_RUN_CHANGED */
+  uint32_t nbitmaps;
+  uint64_t *bits;             /* nbitmaps * (capRows / 64) words */
+};
+
+static inline uint64_t *
+catalogBitmap(const heliCatalog_t *cat, uint32_t ibitmap)
+{
+  return &cat->bits[(uint64_t) ibitmap * (cat->capRows / 64)];
+}
+
+/* Configuration registers differ */
+static int32_t
+catalogConfigChanged(const heliRegs *a, const heliRegs *b)
+{
+  return (a->tsettle != b->tsettle) || (a->tstable != b->tstable) ||
+    (a->delay != b->delay) || (a->pattern != b->pattern) || (a->clock != b->clock);
+}
+
+static int32_t
+catalogGrow(heliCatalog_t *cat)
+{
+  uint32_t cap = (cat->capRows) ? 2 * cat->capRows : CATALOG_MIN_ROWS;
+  uint32_t oldWords = cat->capRows / 64, words = cap / 64, ibitmap;
+  uint64_t *bits;
+
+#define GROW(_arr) {							\
+    void *p = realloc(cat->_arr, (size_t) cap * sizeof(*cat->_arr));	\
+    if(p == NULL) goto NOMEM;						\
+    cat->_arr = p;							\
+  }
+  GROW(run);
+  GROW(flags);
+  GROW(startTime);
+  GROW(endTime);
+  GROW(start);
+  GROW(end);
+#undef GROW
+
+  bits = calloc((size_t) cat->nbitmaps * words, sizeof(uint64_t));
+  if(bits == NULL)
+    goto NOMEM;
+  for(ibitmap = 0; ibitmap < cat->nbitmaps; ibitmap++)
+    memcpy(&bits[(size_t) ibitmap * words], &cat->bits[(size_t) ibitmap * oldWords],
+	   oldWords * sizeof(uint64_t));
+  free(cat->bits);
+  cat->bits = bits;
+  cat->capRows = cap;
+
+  return 0;
+
+ NOMEM:
+  HELI_ERR("Unable to allocate memory\n");
+  return -1;
+}
+
+static inline void
+catalogSetBit(heliCatalog_t *cat, uint32_t ibitmap, uint32_t row, int32_t value)
+{
+  uint64_t *w = &catalogBitmap(cat, ibitmap)[row / 64];
+
+  if(value)
+    *w |= 1ULL << (row % 64);
+  else
+    *w &= ~(1ULL << (row % 64));
+}
+
+/* Set the field bitmaps of a row from its start registers */
+static void
+catalogIndexRow(heliCatalog_t *cat, uint32_t row, int32_t value)
+{
+  uint32_t ifield;
+
+  for(ifield = 0; ifield < HELI_NREGFIELDS; ifield++)
+    catalogSetBit(cat, cat->base[ifield] + heliFieldGet(&cat->start[row], ifield),
+		  row, value);
+}
+
+/* Add a record to the rows.  Returns -1 only if out of memory */
+static int32_t
+catalogAdd(heliCatalog_t *cat, const heliCatalogRecord_t *rec)
+{
+  uint32_t row, irow;
+
+  if(rec->type == HELI_CATALOG_END)
+    {
+      /* Finish the run started in one of the last rows */
+      for(irow = 0; (irow < cat->nrows) && (irow < CATALOG_END_SEARCH); irow++)
+	{
+	  row = cat->nrows - 1 - irow;
+	  if((cat->run[row] == rec->run) && !(cat->flags[row] & HELI_CATALOG_RUN_ENDED))
+	    {
+	      cat->flags[row] |= HELI_CATALOG_RUN_ENDED;
+	      cat->endTime[row] = rec->time;
+	      cat->end[row] = rec->regs;
+	      if(catalogConfigChanged(&cat->start[row], &cat->end[row]))
+		{
+		  cat->flags[row] |= HELI_CATALOG_RUN_CHANGED;
+		  catalogSetBit(cat, cat->changed, row, 1);
+		}
+	      return 0;
+	    }
+	}
+    }
+  else if(rec->type != HELI_CATALOG_START)
+    return 0;                   /* Unknown record types are skipped */
+
+  if((cat->nrows == cat->capRows) && (catalogGrow(cat) < 0))
+    return -1;
+
+  row = cat->nrows;
+  if(row && (rec->run <= cat->run[row - 1]))
+    cat->sorted = 0;
+
+  cat->run[row] = rec->run;
+  cat->start[row] = rec->regs;
+  cat->end[row] = rec->regs;
+  if(rec->type == HELI_CATALOG_START)
+    {
+      cat->flags[row] = HELI_CATALOG_RUN_STARTED;
+      cat->startTime[row] = rec->time;
+      cat->endTime[row] = 0;
+    }
+  else
+    {
+      cat->flags[row] = HELI_CATALOG_RUN_ENDED;
+      cat->startTime[row] = 0;
+      cat->endTime[row] = rec->time;
+    }
+  catalogIndexRow(cat, row, 1);
+  cat->nrows++;
+
+  return 0;
+}
+
+/**
+ * @brief Open a run catalog, and load its index
+ * @details Records appended by other processes after the open are not
+ *          seen until the catalog is opened again.
+ * @param[in] path Catalog file
+ * @param[in] create Create the file, if it does not exist
+ * @return Catalog if successful, otherwise NULL
+ */
+heliCatalog_t *
+heliCatalogOpen(const char *path, int32_t create)
+{
+  heliCatalog_t *cat;
+  heliCatalogHeader_t hdr;
+  heliCatalogRecord_t *recs;
+  struct stat sb;
+  off_t whole;
+  ssize_t n;
+  uint32_t ifield, irec;
+
+  cat = calloc(1, sizeof(*cat));
+  recs = malloc(CATALOG_READ_BATCH * sizeof(*recs));
+  if((cat == NULL) || (recs == NULL))
+    {
+      HELI_ERR("Unable to allocate memory\n");
+      free(cat);
+      free(recs);
+      return NULL;
+    }
+  cat->sorted = 1;
+
+  for(ifield = 0; ifield < HELI_NREGFIELDS; ifield++)
+    {
+      cat->base[ifield] = cat->nbitmaps;
+      cat->nvalues[ifield] = 1 << heliGetField(ifield)->width;
+      cat->nbitmaps += cat->nvalues[ifield];
+    }
+  cat->changed = cat->nbitmaps++;
+
+  cat->fd = open(path, O_RDWR | O_APPEND | ((create) ? O_CREAT : 0), 0664);
+  if(cat->fd < 0)
+    {
+      HELI_ERR("Unable to open %s\n", path);
+      goto FAIL;
+    }
+
+  n = read(cat->fd, &hdr, sizeof(hdr));
+  if(n == 0)
+    {
+      memset(&hdr, 0, sizeof(hdr));
+      memcpy(hdr.magic, HELI_CATALOG_MAGIC, sizeof(hdr.magic));
+      hdr.version = HELI_CATALOG_VERSION;
+      hdr.recordSize = sizeof(heliCatalogRecord_t);
+      if(write(cat->fd, &hdr, sizeof(hdr)) != sizeof(hdr))
+	{
+	  HELI_ERR("Unable to write %s\n", path);
+	  goto FAIL;
+	}
+    }
+  else if((n != sizeof(hdr)) || (memcmp(hdr.magic, HELI_CATALOG_MAGIC, sizeof(hdr.magic)) != 0) ||
+	  (hdr.version != HELI_CATALOG_VERSION) ||
+	  (hdr.recordSize != sizeof(heliCatalogRecord_t)))
+    {
+      HELI_ERR("%s is not a run catalog\n", path);
+      goto FAIL;
+    }
+
+  /* Drop a record cut short by a crash, so appends stay aligned */
+  if(fstat(cat->fd, &sb) != 0)
+    {
+      HELI_ERR("Unable to stat %s\n", path);
+      goto FAIL;
+    }
+  whole = sb.st_size - sizeof(hdr);
+  whole -= whole % sizeof(*recs);
+  if((off_t) (sizeof(hdr) + whole) != sb.st_size)
+    {
+      if(ftruncate(cat->fd, sizeof(hdr) + whole) != 0)
+	{
+	  HELI_ERR("Unable to truncate %s\n", path);
+	  goto FAIL;
+	}
+      printf("%s: WARNING: Dropped a partial record at the end of %s\n",
+	     __func__, path);
+    }
+
+  while((n = read(cat->fd, recs, CATALOG_READ_BATCH * sizeof(*recs))) > 0)
+    {
+      for(irec = 0; irec < n / sizeof(*recs); irec++)
+	if(catalogAdd(cat, &recs[irec]) < 0)
+	  goto FAIL;
+    }
+
+  free(recs);
+  return cat;
+
+ FAIL:
+  free(recs);
+  heliCatalogClose(cat);
+  return NULL;
+}
+
+/**
+ * @brief Close a run catalog
+ * @param[in] cat Catalog
+ */
+void
+heliCatalogClose(heliCatalog_t *cat)
+{
+  if(cat == NULL)
+    return;
+
+  if(cat->fd >= 0)
+    close(cat->fd);
+  free(cat->run);
+  free(cat->flags);
+  free(cat->startTime);
+  free(cat->endTime);
+  free(cat->start);
+  free(cat->end);
+  free(cat->bits);
+  free(cat);
+}
+
+/**
+ * @brief Record a register snapshot at the start or end of a run
+ * @details The record is appended to the file, and to the index.
+ * @param[in] cat Catalog
+ * @param[in] run Run number
+ * @param[in] type HELI_CATALOG_START or HELI_CATALOG_END
+ * @param[in] regs Register snapshot
+ * @param[in] time CLOCK_REALTIME [ns]
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliCatalogRecord(heliCatalog_t *cat, uint32_t run, uint8_t type,
+		  const heliRegs *regs, uint64_t time)
+{
+  heliCatalogRecord_t rec;
+
+  if((type != HELI_CATALOG_START) && (type != HELI_CATALOG_END))
+    {
+      HELI_ERR("Invalid type (%d)\n", type);
+      return -1;
+    }
+
+  memset(&rec, 0, sizeof(rec));
+  rec.run = run;
+  rec.type = type;
+  rec.time = time;
+  rec.regs = *regs;
+
+  /* One write of O_APPEND: records of concurrent writers do not interleave */
+  if(write(cat->fd, &rec, sizeof(rec)) != sizeof(rec))
+    {
+      HELI_ERR("Unable to write the record\n");
+      return -1;
+    }
+
+  return catalogAdd(cat, &rec);
+}
+
+/**
+ * @brief Record the register snapshot of the module at the start or end of a run
+ * @param[in] cat Catalog
+ * @param[in] run Run number
+ * @param[in] type HELI_CATALOG_START or HELI_CATALOG_END
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliCatalogRecordBoard(heliCatalog_t *cat, uint32_t run, uint8_t type)
+{
+  heliRegs regs;
+  struct timespec ts;
+
+  if(heliGetRegisterSnapshot(&regs) < 0)
+    return -1;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+
+  return heliCatalogRecord(cat, run, type, &regs,
+			   (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+/**
+ * @brief Return the number of runs (rows) in the catalog
+ * @param[in] cat Catalog
+ * @return Number of rows
+ */
+uint32_t
+heliCatalogRuns(const heliCatalog_t *cat)
+{
+  return cat->nrows;
+}
+
+/**
+ * @brief Find the row of a run
+ * @details The last row, if the run was recorded more than once.
+ * @param[in] cat Catalog
+ * @param[in] run Run number
+ * @return Row if found, otherwise -1
+ */
+int64_t
+heliCatalogFindRun(const heliCatalog_t *cat, uint32_t run)
+{
+  uint32_t lo = 0, hi = cat->nrows, mid, irow;
+
+  if(cat->sorted)
+    {
+      while(lo < hi)
+	{
+	  mid = lo + (hi - lo) / 2;
+	  if(cat->run[mid] <= run)
+	    lo = mid + 1;
+	  else
+	    hi = mid;
+	}
+      return (lo && (cat->run[lo - 1] == run)) ? (int64_t) lo - 1 : -1;
+    }
+
+  for(irow = cat->nrows; irow > 0; irow--)
+    if(cat->run[irow - 1] == run)
+      return irow - 1;
+
+  return -1;
+}
+
+/**
+ * @brief Return a run, with its derived timing
+ * @param[in] cat Catalog
+ * @param[in] row Row, from 0 to heliCatalogRuns - 1
+ * @param[out] run Run
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliCatalogGetRun(const heliCatalog_t *cat, uint32_t row, heliCatalogRun_t *run)
+{
+  if(row >= cat->nrows)
+    {
+      HELI_ERR("Invalid row (%u)\n", row);
+      return -1;
+    }
+
+  memset(run, 0, sizeof(*run));
+  run->run = cat->run[row];
+  run->flags = cat->flags[row];
+  run->startTime = cat->startTime[row];
+  run->endTime = cat->endTime[row];
+  run->start = cat->start[row];
+  run->end = cat->end[row];
+  heliCalcHelicityTiming(run->start.clock, run->start.tsettle, run->start.tstable,
+			 &run->tsettle, &run->tstable, &run->frequency);
+
+  return 0;
+}
+
+/**
+ * @brief Initialize a query that matches every run
+ * @param[out] q Query
+ */
+void
+heliCatalogQueryInit(heliCatalogQuery_t *q)
+{
+  memset(q, 0, sizeof(*q));
+}
+
+/**
+ * @brief Allow a value of a field in a query
+ * @details Values allowed for the same field are ORed, fields are ANDed.
+ * @param[inout] q Query
+ * @param[in] field Register field
+ * @param[in] value Field value
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliCatalogQueryAllow(heliCatalogQuery_t *q, heliFieldId_t field, uint32_t value)
+{
+  const heliField_t *f = heliGetField(field);
+
+  if((f == NULL) || (value >= (1u << f->width)))
+    {
+      HELI_ERR("Invalid value (%u) of field %d\n", value, field);
+      return -1;
+    }
+
+  q->values[field] |= 1u << value;
+
+  return 0;
+}
+
+/**
+ * @brief Find the runs matching a query
+ * @details Runs that match are joined into ranges of consecutive run
+ *          numbers, in row order.
+ * @param[in] cat Catalog
+ * @param[in] q Query
+ * @param[out] ranges Ranges of matching runs
+ * @param[in] maxRanges Size of ranges.  Ranges past it are counted only.
+ * @param[out] nruns Number of matching runs, if not NULL
+ * @return Number of ranges
+ */
+int64_t
+heliCatalogQuery(const heliCatalog_t *cat, const heliCatalogQuery_t *q,
+		 heliCatalogRange_t *ranges, uint32_t maxRanges, uint64_t *nruns)
+{
+  const uint64_t *sel[HELI_NREGFIELDS * 32];
+  uint32_t nsel[HELI_NREGFIELDS], nfields = 0, ifield, v, iword, nwords, row;
+  const uint64_t *changed = catalogBitmap(cat, cat->changed);
+  int64_t nranges = 0;
+  uint64_t match, count = 0;
+  uint32_t first = 0, last = 0;
+
+  /* Bitmaps of the allowed values, grouped by field */
+  for(ifield = 0; ifield < HELI_NREGFIELDS; ifield++)
+    {
+      uint32_t values = q->values[ifield];
+
+      if(cat->nvalues[ifield] < 32)
+	values &= (1u << cat->nvalues[ifield]) - 1;
+      if(q->values[ifield] == 0)
+	continue;
+
+      nsel[nfields] = 0;
+      for(v = 0; v < cat->nvalues[ifield]; v++)
+	if(values & (1u << v))
+	  sel[nfields * 32 + nsel[nfields]++] = catalogBitmap(cat, cat->base[ifield] + v);
+      nfields++;
+    }
+
+  nwords = (cat->nrows + 63) / 64;
+  for(iword = 0; iword < nwords; iword++)
+    {
+      match = ~0ULL;
+      if((iword == nwords - 1) && (cat->nrows % 64))
+	match = (1ULL << (cat->nrows % 64)) - 1;
+
+      for(ifield = 0; (ifield < nfields) && match; ifield++)
+	{
+	  uint64_t any = 0;
+	  for(v = 0; v < nsel[ifield]; v++)
+	    any |= sel[ifield * 32 + v][iword];
+	  match &= any;
+	}
+      if(q->unchanged)
+	match &= ~changed[iword];
+
+      while(match)
+	{
+	  row = iword * 64 + __builtin_ctzll(match);
+	  match &= match - 1;
+	  count++;
+
+	  if(nranges && (cat->run[row] == last + 1))
+	    {
+	      last = cat->run[row];
+	      continue;
+	    }
+
+	  if(nranges && (nranges <= maxRanges))
+	    ranges[nranges - 1].last = last;
+	  first = last = cat->run[row];
+	  nranges++;
+	  if(nranges <= maxRanges)
+	    ranges[nranges - 1].first = first;
+	}
+    }
+
+  if(nranges && (nranges <= maxRanges))
+    ranges[nranges - 1].last = last;
+
+  if(nruns)
+    *nruns = count;
+
+  return nranges;
+}
@@ -0,0 +1,103 @@
+#pragma once
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Header for the Run Catalog
+ *
+ *   The catalog records the register snapshot of the module at the start
+ *   and end of each run, and finds the runs that used given settings.
+ *
+ *   File layout:
+ *     heliCatalogHeader_t                  (32 bytes)
+ *     heliCatalogRecord_t[]                (32 bytes each, appended)
+ *
+ *   Derived timing (frequency, tsettle, tstable) follows from the
+ *   registers, so only the registers are stored.  @see heliCatalogGetRun
+ *
+ *   On open, the runs are loaded into one row each, with a bitmap per
+ *   value of each register field (heliFieldId_t) over the rows, taken at
+ *   the run start.  A query ANDs, per field, the OR of the bitmaps of the
+ *   allowed values, then joins the matching rows of consecutive run
+ *   numbers into ranges.
+ *
+ */
+
+#include <stdint.h>
+#include "heliLib.h"
+
+#define HELI_CATALOG_MAGIC   "HELICATL"
+#define HELI_CATALOG_VERSION 1
+
+/* Record types */
+#define HELI_CATALOG_START 1 /* Snapshot at run start */
+#define HELI_CATALOG_END   2 /* Snapshot at run end */
+
+typedef struct
+{
+  char     magic[8];          /* HELI_CATALOG_MAGIC */
+  uint32_t version;           /* HELI_CATALOG_VERSION */
+  uint32_t recordSize;        /* sizeof(heliCatalogRecord_t) */
+  uint8_t  _blank[16];
+} heliCatalogHeader_t;
+
+typedef struct
+{
+  uint32_t run;               /* Run number */
+  uint8_t  type;              /* HELI_CATALOG_START, HELI_CATALOG_END */
+  uint8_t  _blank[3];
+  uint64_t time;              /* CLOCK_REALTIME [ns] */
+  heliRegs regs;              /* Register snapshot */
+} heliCatalogRecord_t;
+
+typedef struct
+{
+  uint32_t run;               /* Run number */
+  uint32_t flags;             /* HELI_CATALOG_RUN_* */
+  uint64_t startTime;         /* CLOCK_REALTIME [ns], 0 if not recorded */
+  uint64_t endTime;           /* CLOCK_REALTIME [ns], 0 if not recorded */
+  heliRegs start;             /* Registers at the start (the end, if no start) */
+  heliRegs end;               /* Registers at the end */
+  double   frequency;         /* Helicity window frequency at the start [Hz] */
+  double   tsettle;           /* TSettle at the start [usec] */
+  double   tstable;           /* TStable at the start [usec] */
+} heliCatalogRun_t;
+
+/* Run flags */
+#define HELI_CATALOG_RUN_STARTED (1 << 0) /* Start recorded */
+#define HELI_CATALOG_RUN_ENDED   (1 << 1) /* End recorded */
+#define HELI_CATALOG_RUN_CHANGED (1 << 2) /* Configuration differs at the end */
+
+typedef struct
+{
+  uint32_t values[HELI_NREGFIELDS]; /* Allowed values, bit per value.  0: any */
+  uint32_t unchanged;         /* Only runs with the same configuration at the end */
+} heliCatalogQuery_t;
+
+typedef struct
+{
+  uint32_t first;             /* First run */
+  uint32_t last;              /* Last run */
+} heliCatalogRange_t;
+
+typedef struct heliCatalog heliCatalog_t;
+
+heliCatalog_t *heliCatalogOpen(const char *path, int32_t create);
+void     heliCatalogClose(heliCatalog_t *cat);
+int32_t  heliCatalogRecord(heliCatalog_t *cat, uint32_t run, uint8_t type,
+			   const heliRegs *regs, uint64_t time);
+int32_t  heliCatalogRecordBoard(heliCatalog_t *cat, uint32_t run, uint8_t type);
+
+uint32_t heliCatalogRuns(const heliCatalog_t *cat);
+int64_t  heliCatalogFindRun(const heliCatalog_t *cat, uint32_t run);
+int32_t  heliCatalogGetRun(const heliCatalog_t *cat, uint32_t row, heliCatalogRun_t *run);
+
+void     heliCatalogQueryInit(heliCatalogQuery_t *q);
+int32_t  heliCatalogQueryAllow(heliCatalogQuery_t *q, heliFieldId_t field, uint32_t value);
+int64_t  heliCatalogQuery(const heliCatalog_t *cat, const heliCatalogQuery_t *q,
+			  heliCatalogRange_t *ranges, uint32_t maxRanges, uint64_t *nruns);
@@ -0,0 +1,227 @@
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Online Helicity Checker
+ *
+ */
+
+#include <string.h>
+#include "heliLib.h"
+#include "heliCheck.h"
+
+/* Report an event to the callback */
+#define CHECK_EVENT(_chk, _window, _event) {				\
+    if((_chk)->callback) (_chk)->callback((_chk)->callbackArg, (_window), (_event)); \
+  }
+
+/**
+ * @brief Initialize the helicity checker
+ * @param[out] chk Helicity checker
+ * @param[in] pattern Helicity pattern index
+ * @param[in] delay Reporting delay [windows]
+ * @param[in] callback Function called for each discrepancy (may be NULL)
+ * @param[in] callbackArg Argument passed to the callback
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliCheckInit(heliCheck_t *chk, uint32_t pattern, uint32_t delay,
+	      heliCheckCallback_t callback, void *callbackArg)
+{
+  memset(chk, 0, sizeof(*chk));
+
+  if(heliSeqInit(&chk->seq, pattern, delay, 0, 0) < 0)
+    return -1;
+
+  chk->pattern = pattern;
+  chk->delay = delay;
+  chk->state = HELI_CHECK_RESYNC;
+  chk->callback = callback;
+  chk->callbackArg = callbackArg;
+
+  return 0;
+}
+
+/**
+ * @brief Initialize the helicity checker from the board configuration
+ * @details Read the helicity pattern and reporting delay from the board.
+ *          @see heliGetHelicityPattern, @see heliGetReportingDelay
+ * @param[out] chk Helicity checker
+ * @param[in] callback Function called for each discrepancy (may be NULL)
+ * @param[in] callbackArg Argument passed to the callback
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliCheckInitBoard(heliCheck_t *chk, heliCheckCallback_t callback, void *callbackArg)
+{
+  uint32_t pattern, delay;
+
+  if((heliGetHelicityPattern(&pattern) < 0) || (heliGetReportingDelay(&delay) < 0))
+    return -1;
+
+  return heliCheckInit(chk, pattern, delay, callback, callbackArg);
+}
+
+/* Report each mispredicted held window as a bit error */
+static void
+checkBitErrors(heliCheck_t *chk, heliSeq_t seq, const uint8_t *signals,
+	       uint32_t nwindows, uint64_t window)
+{
+  uint32_t iwin;
+
+  for(iwin = 0; iwin < nwindows; iwin++)
+    {
+      if((heliSeqNext(&seq) ^ signals[iwin]) & HELI_SEQ_SIGNALS)
+	{
+	  chk->counters.bitErrors++;
+	  CHECK_EVENT(chk, window + iwin, HELI_CHECK_BIT_ERROR);
+	}
+      else
+	chk->counters.good++;
+    }
+}
+
+/* Decide what caused the mismatch at the first held window */
+static void
+checkClassify(heliCheck_t *chk)
+{
+  const uint8_t *held = chk->pending;
+  uint32_t n = chk->npending;
+  heliSeq_t missed = chk->suspectSeq;
+  uint64_t nsame, nmissed, nextra;
+
+  heliSeqSkip(&missed, 1);
+
+  nsame = heliSeqMismatch(&chk->suspectSeq, held, n);
+  nmissed = heliSeqMismatch(&missed, held, n);
+  nextra = 1 + heliSeqMismatch(&chk->suspectSeq, held + 1, n - 1);
+
+  if(nsame <= 2)
+    {
+      checkBitErrors(chk, chk->suspectSeq, held, n, chk->suspectWindow);
+      chk->seq = chk->suspectSeq;
+      heliSeqSkip(&chk->seq, n);
+    }
+  else if(nmissed <= 1)
+    {
+      chk->counters.missed++;
+      CHECK_EVENT(chk, chk->suspectWindow, HELI_CHECK_MISSED_WINDOW);
+      checkBitErrors(chk, missed, held, n, chk->suspectWindow);
+      chk->seq = missed;
+      heliSeqSkip(&chk->seq, n);
+    }
+  else if(nextra <= 2)
+    {
+      chk->counters.extra++;
+      CHECK_EVENT(chk, chk->suspectWindow, HELI_CHECK_EXTRA_WINDOW);
+      checkBitErrors(chk, chk->suspectSeq, held + 1, n - 1, chk->suspectWindow + 1);
+      chk->seq = chk->suspectSeq;
+      heliSeqSkip(&chk->seq, n - 1);
+    }
+  else
+    {
+      /* Keep the held windows, to recover the sequence */
+      chk->counters.desyncs++;
+      CHECK_EVENT(chk, chk->suspectWindow, HELI_CHECK_DESYNC);
+      chk->state = HELI_CHECK_RESYNC;
+      return;
+    }
+
+  chk->npending = 0;
+  chk->state = HELI_CHECK_LOCKED;
+}
+
+/* Recover the sequence from the held windows */
+static void
+checkResync(heliCheck_t *chk)
+{
+  uint32_t n = chk->npending;
+  heliSeq_t trial;
+  int32_t nbad = heliSeqRecover(&trial, chk->pattern, chk->delay, chk->pending, n);
+
+  chk->counters.unlocked += n;
+  chk->npending = 0;
+
+  if((nbad >= 0) && ((uint32_t) nbad <= n / 64))
+    {
+      chk->seq = trial;
+      heliSeqSkip(&chk->seq, n);
+      chk->state = HELI_CHECK_LOCKED;
+      chk->counters.syncs++;
+      CHECK_EVENT(chk, chk->counters.windows + 1, HELI_CHECK_SYNC);
+    }
+}
+
+/**
+ * @brief Check the next window reported by the DAQ
+ * @param[inout] chk Helicity checker
+ * @param[in] signals Mask of HELI_WINDOW_* signals of the window
+ */
+void
+heliCheckWindow(heliCheck_t *chk, uint8_t signals)
+{
+  switch(chk->state)
+    {
+    case HELI_CHECK_LOCKED:
+      {
+	heliSeq_t before = chk->seq;
+	if(((heliSeqNext(&chk->seq) ^ signals) & HELI_SEQ_SIGNALS) == 0)
+	  {
+	    chk->counters.good++;
+	    break;
+	  }
+
+	chk->state = HELI_CHECK_SUSPECT;
+	chk->suspectSeq = before;
+	chk->suspectWindow = chk->counters.windows;
+	chk->pending[0] = signals;
+	chk->npending = 1;
+	break;
+      }
+
+    case HELI_CHECK_SUSPECT:
+      chk->pending[chk->npending++] = signals;
+      if(chk->npending == HELI_CHECK_LOOKAHEAD + 1)
+	checkClassify(chk);
+      break;
+
+    default:
+      chk->pending[chk->npending++] = signals;
+      if(chk->npending == HELI_CHECK_RESYNC_WINDOWS)
+	checkResync(chk);
+      break;
+    }
+
+  chk->counters.windows++;
+}
+
+/**
+ * @brief Check consecutive windows reported by the DAQ
+ * @param[inout] chk Helicity checker
+ * @param[in] signals Array of HELI_WINDOW_* masks, one per window
+ * @param[in] nwindows Number of windows
+ */
+void
+heliCheckBlock(heliCheck_t *chk, const uint8_t *signals, uint64_t nwindows)
+{
+  uint64_t iwin;
+
+  for(iwin = 0; iwin < nwindows; iwin++)
+    heliCheckWindow(chk, signals[iwin]);
+}
+
+/**
+ * @brief Return the checker counters
+ * @param[in] chk Helicity checker
+ * @param[out] counters Copy of the counters
+ */
+void
+heliCheckGetCounters(const heliCheck_t *chk, heliCheckCounters_t *counters)
+{
+  *counters = chk->counters;
+}
@@ -0,0 +1,82 @@
+#pragma once
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Header for the online Helicity Checker
+ *
+ *   The checker compares the windows reported by the DAQ against the
+ *   prediction of the helicity sequence (heliSeq_t).  A mismatch holds the
+ *   following HELI_CHECK_LOOKAHEAD windows, which decide whether it was a
+ *   bit error, a missed window, an extra window, or a loss of sync.  After
+ *   a loss of sync, the sequence is recovered from the windows that follow.
+ *
+ *   The checker allocates no memory after initialization.
+ *
+ */
+
+#include <stdint.h>
+#include "heliSeq.h"
+
+#define HELI_CHECK_LOOKAHEAD      16
+#define HELI_CHECK_RESYNC_WINDOWS 4096
+
+/* Checker states */
+enum heliCheckState
+  {
+    HELI_CHECK_RESYNC  = 0,   /* Collecting windows to recover the sequence */
+    HELI_CHECK_LOCKED  = 1,   /* Windows follow the prediction */
+    HELI_CHECK_SUSPECT = 2    /* Collecting windows after a mismatch */
+  };
+
+/* Discrepancies reported to the callback */
+enum heliCheckEvent
+  {
+    HELI_CHECK_BIT_ERROR     = 0,
+    HELI_CHECK_MISSED_WINDOW = 1,
+    HELI_CHECK_EXTRA_WINDOW  = 2,
+    HELI_CHECK_DESYNC        = 3,
+    HELI_CHECK_SYNC          = 4
+  };
+
+typedef void (*heliCheckCallback_t)(void *arg, uint64_t window, int32_t event);
+
+typedef struct
+{
+  uint64_t windows;           /* Windows checked */
+  uint64_t good;              /* Windows matching the prediction */
+  uint64_t bitErrors;         /* Windows with a wrong signal */
+  uint64_t missed;            /* Windows missing from the stream */
+  uint64_t extra;             /* Windows not in the prediction */
+  uint64_t desyncs;           /* Losses of sync */
+  uint64_t syncs;             /* Sequence recoveries */
+  uint64_t unlocked;          /* Windows checked without a prediction */
+} heliCheckCounters_t;
+
+typedef struct
+{
+  uint32_t pattern;           /* Helicity pattern index */
+  uint32_t delay;             /* Reporting delay [windows] */
+  int32_t  state;             /* enum heliCheckState */
+  heliSeq_t seq;              /* Prediction for the next window */
+  heliSeq_t suspectSeq;       /* Prediction for the first held window */
+  uint64_t suspectWindow;     /* Number of the first held window */
+  uint32_t npending;          /* Windows held */
+  uint8_t  pending[HELI_CHECK_RESYNC_WINDOWS];
+  heliCheckCallback_t callback;
+  void    *callbackArg;
+  heliCheckCounters_t counters;
+} heliCheck_t;
+
+int32_t heliCheckInit(heliCheck_t *chk, uint32_t pattern, uint32_t delay,
+		      heliCheckCallback_t callback, void *callbackArg);
+int32_t heliCheckInitBoard(heliCheck_t *chk, heliCheckCallback_t callback,
+			   void *callbackArg);
+void    heliCheckWindow(heliCheck_t *chk, uint8_t signals);
+void    heliCheckBlock(heliCheck_t *chk, const uint8_t *signals, uint64_t nwindows);
+void    heliCheckGetCounters(const heliCheck_t *chk, heliCheckCounters_t *counters);
@@ -0,0 +1,434 @@
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Seed-plus-exceptions Helicity Codec
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "heliSeq.h"
+#include "heliCodec.h"
+#include "heliPrivate.h"
+
+/* Mispredictions, out of the last 64 windows, that trigger a resync */
+#define CODEC_RESYNC_THRESHOLD 16
+/* Windows to wait after a failed resync */
+#define CODEC_RESYNC_COOLDOWN  4096
+
+typedef struct
+{
+  heliCodecSegment_t *seg;
+  uint64_t nseg, nsegAlloc;
+  heliCodecException_t *exc;
+  uint64_t nexc, nexcAlloc;
+  heliCodecToggle_t *tog;
+  uint64_t ntog, ntogAlloc;
+} codecBuild;
+
+typedef struct
+{
+  const heliCodecHeader_t *hdr;
+  const heliCodecSegment_t *seg;
+  const heliCodecException_t *exc;
+  const heliCodecToggle_t *tog;
+  uint8_t *signals;
+  uint64_t next;                /* Next segment to decode */
+  int32_t rval;
+} codecJob;
+
+/* Grow an array by doubling */
+static int32_t
+codecReserve(void **array, uint64_t *nalloc, uint64_t n, size_t size)
+{
+  if(n < *nalloc)
+    return 0;
+
+  uint64_t nnew = (*nalloc) ? 2 * (*nalloc) : 1024;
+  void *p = realloc(*array, nnew * size);
+  if(p == NULL)
+    {
+      HELI_ERR("Unable to allocate memory\n");
+      return -1;
+    }
+
+  *array = p;
+  *nalloc = nnew;
+
+  return 0;
+}
+
+static int32_t
+codecAddSegment(codecBuild *b, uint64_t firstWindow, const heliSeq_t *seq, uint8_t tsettle)
+{
+  if(codecReserve((void **) &b->seg, &b->nsegAlloc, b->nseg, sizeof(*b->seg)) < 0)
+    return -1;
+
+  heliCodecSegment_t *s = &b->seg[b->nseg++];
+  memset(s, 0, sizeof(*s));
+  s->firstWindow = firstWindow;
+  s->firstException = b->nexc;
+  s->firstToggle = b->ntog;
+  s->seed = seq->seed;
+  s->phase = seq->phase;
+  s->tsettle = tsettle;
+
+  return 0;
+}
+
+static int32_t
+codecAddException(codecBuild *b, uint32_t offset, uint8_t signals)
+{
+  if(codecReserve((void **) &b->exc, &b->nexcAlloc, b->nexc, sizeof(*b->exc)) < 0)
+    return -1;
+
+  heliCodecException_t *e = &b->exc[b->nexc++];
+  memset(e, 0, sizeof(*e));
+  e->offset = offset;
+  e->signals = signals;
+
+  return 0;
+}
+
+static int32_t
+codecAddToggle(codecBuild *b, uint32_t offset)
+{
+  if(codecReserve((void **) &b->tog, &b->ntogAlloc, b->ntog, sizeof(*b->tog)) < 0)
+    return -1;
+
+  b->tog[b->ntog++].offset = offset;
+
+  return 0;
+}
+
+/**
+ * @brief Encode a recorded window stream
+ * @details Encode a recorded window stream as segment seeds plus the windows
+ *          that differ from the prediction, plus the windows where T_settle
+ *          changes.  The encoding is lossless.
+ * @param[in] pattern Helicity pattern index
+ * @param[in] delay Reporting delay [windows]
+ * @param[in] signals Array of HELI_WINDOW_* masks, one per window
+ * @param[in] nwindows Number of windows
+ * @param[out] buf Encoded stream, allocated with malloc.  Caller must free.
+ * @param[out] buflen Size of the encoded stream [bytes]
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliCodecEncode(uint32_t pattern, uint32_t delay,
+		const uint8_t *signals, uint64_t nwindows,
+		uint8_t **buf, uint64_t *buflen)
+{
+  codecBuild b;
+  heliSeq_t seq;
+  uint64_t iwin, segStart = 0, history = 0, cooldown = 0;
+  uint8_t tsettle = 0;
+  int32_t rval = -1;
+
+  if(heliSeqPatternLength(pattern) < 0)
+    {
+      HELI_ERR("Invalid pattern (%d)\n", pattern);
+      return -1;
+    }
+
+  memset(&b, 0, sizeof(b));
+
+  if(heliSeqRecover(&seq, pattern, delay, signals, nwindows) < 0)
+    heliSeqInit(&seq, pattern, delay, 0, 0);
+
+  if(nwindows > 0)
+    {
+      tsettle = signals[0] & HELI_WINDOW_TSETTLE;
+      if(codecAddSegment(&b, 0, &seq, tsettle) < 0)
+	goto FREE;
+    }
+
+  for(iwin = 0; iwin < nwindows; iwin++)
+    {
+      if(iwin - segStart == HELI_CODEC_SEGMENT_WINDOWS)
+	{
+	  segStart = iwin;
+	  tsettle = signals[iwin] & HELI_WINDOW_TSETTLE;
+	  if(codecAddSegment(&b, segStart, &seq, tsettle) < 0)
+	    goto FREE;
+	}
+
+      if((signals[iwin] & HELI_WINDOW_TSETTLE) != tsettle)
+	{
+	  tsettle ^= HELI_WINDOW_TSETTLE;
+	  if(codecAddToggle(&b, iwin - segStart) < 0)
+	    goto FREE;
+	}
+
+      /* T_settle is not predicted, and is kept by the toggles */
+      uint8_t diff = (heliSeqNext(&seq) ^ signals[iwin]) & ~HELI_WINDOW_TSETTLE;
+      if(diff && (codecAddException(&b, iwin - segStart, signals[iwin]) < 0))
+	goto FREE;
+
+      history = (history << 1) | ((diff & HELI_SEQ_SIGNALS) ? 1 : 0);
+
+      if(cooldown)
+	{
+	  cooldown--;
+	  continue;
+	}
+      if((__builtin_popcountll(history) < CODEC_RESYNC_THRESHOLD) || (iwin + 1 == nwindows))
+	continue;
+
+      /* Lost sync: recover the sequence from the windows that follow */
+      heliSeq_t trial;
+      uint64_t nleft = nwindows - iwin - 1;
+      uint64_t ntest = (nleft < (1 << 16)) ? nleft : (1 << 16);
+      int32_t nbad = heliSeqRecover(&trial, pattern, delay, &signals[iwin + 1], nleft);
+
+      history = 0;
+      if((nbad >= 0) && ((uint64_t) nbad <= ntest / 64))
+	{
+	  seq = trial;
+	  segStart = iwin + 1;
+	  tsettle = signals[segStart] & HELI_WINDOW_TSETTLE;
+	  if(codecAddSegment(&b, segStart, &seq, tsettle) < 0)
+	    goto FREE;
+	}
+      else
+	cooldown = CODEC_RESYNC_COOLDOWN;
+    }
+
+  heliCodecHeader_t hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, HELI_CODEC_MAGIC, sizeof(hdr.magic));
+  hdr.version = HELI_CODEC_VERSION;
+  hdr.pattern = pattern;
+  hdr.delay = delay;
+  hdr.segmentWindows = HELI_CODEC_SEGMENT_WINDOWS;
+  hdr.nwindows = nwindows;
+  hdr.nsegments = b.nseg;
+  hdr.nexceptions = b.nexc;
+  hdr.ntoggles = b.ntog;
+
+  *buflen = sizeof(hdr) + b.nseg * sizeof(*b.seg) + b.nexc * sizeof(*b.exc) +
+    b.ntog * sizeof(*b.tog);
+  *buf = malloc(*buflen);
+  if(*buf == NULL)
+    {
+      HELI_ERR("Unable to allocate encoded stream\n");
+      goto FREE;
+    }
+
+  uint8_t *p = *buf;
+  memcpy(p, &hdr, sizeof(hdr));
+  p += sizeof(hdr);
+  memcpy(p, b.seg, b.nseg * sizeof(*b.seg));
+  p += b.nseg * sizeof(*b.seg);
+  memcpy(p, b.exc, b.nexc * sizeof(*b.exc));
+  p += b.nexc * sizeof(*b.exc);
+  memcpy(p, b.tog, b.ntog * sizeof(*b.tog));
+
+  rval = 0;
+
+ FREE:
+  free(b.seg);
+  free(b.exc);
+  free(b.tog);
+
+  return rval;
+}
+
+/* Take an array of n elements from the rest of the stream */
+static int32_t
+codecTake(uint64_t *left, uint64_t n, size_t size)
+{
+  if(n > *left / size)
+    return -1;
+
+  *left -= n * size;
+
+  return 0;
+}
+
+/* Check the encoded stream, and return its header */
+static const heliCodecHeader_t *
+codecCheck(const uint8_t *buf, uint64_t buflen)
+{
+  const heliCodecHeader_t *hdr = (const heliCodecHeader_t *) buf;
+  const heliCodecSegment_t *seg = (const heliCodecSegment_t *) (hdr + 1);
+  uint64_t left = buflen - sizeof(*hdr);
+
+  /* Counts are checked against the size, so the sizes cannot overflow */
+  if((buflen < sizeof(*hdr)) ||
+     (memcmp(hdr->magic, HELI_CODEC_MAGIC, sizeof(hdr->magic)) != 0) ||
+     (hdr->version != HELI_CODEC_VERSION) ||
+     (heliSeqPatternLength(hdr->pattern) < 0) ||
+     (codecTake(&left, hdr->nsegments, sizeof(heliCodecSegment_t)) < 0) ||
+     (codecTake(&left, hdr->nexceptions, sizeof(heliCodecException_t)) < 0) ||
+     (codecTake(&left, hdr->ntoggles, sizeof(heliCodecToggle_t)) < 0) ||
+     (left != 0))
+    {
+      HELI_ERR("Invalid encoded helicity stream\n");
+      return NULL;
+    }
+
+  /* The segments must cover every window */
+  if((hdr->nwindows > 0) &&
+     ((hdr->nsegments == 0) || (seg[0].firstWindow != 0)))
+    {
+      HELI_ERR("Invalid encoded helicity stream (no segment at window 0)\n");
+      return NULL;
+    }
+
+  return hdr;
+}
+
+/**
+ * @brief Return the number of windows in an encoded stream
+ * @param[in] buf Encoded stream
+ * @param[in] buflen Size of the encoded stream [bytes]
+ * @param[out] nwindows Number of windows
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliCodecGetWindows(const uint8_t *buf, uint64_t buflen, uint64_t *nwindows)
+{
+  const heliCodecHeader_t *hdr = codecCheck(buf, buflen);
+  if(hdr == NULL)
+    return -1;
+
+  *nwindows = hdr->nwindows;
+
+  return 0;
+}
+
+static int32_t
+codecDecodeSegment(codecJob *job, uint64_t iseg)
+{
+  const heliCodecHeader_t *hdr = job->hdr;
+  const heliCodecSegment_t *s = &job->seg[iseg];
+  uint64_t last = (iseg + 1 < hdr->nsegments) ? job->seg[iseg + 1].firstWindow : hdr->nwindows;
+  uint64_t lastExc = (iseg + 1 < hdr->nsegments) ? job->seg[iseg + 1].firstException : hdr->nexceptions;
+  uint64_t lastTog = (iseg + 1 < hdr->nsegments) ? job->seg[iseg + 1].firstToggle : hdr->ntoggles;
+  uint64_t iexc, itog, iwin, end;
+  uint8_t tsettle;
+  heliSeq_t seq;
+
+  if((s->firstWindow > last) || (last > hdr->nwindows) ||
+     (s->firstException > lastExc) || (lastExc > hdr->nexceptions) ||
+     (s->firstToggle > lastTog) || (lastTog > hdr->ntoggles))
+    return -1;
+
+  heliSeqInit(&seq, hdr->pattern, hdr->delay, s->seed, s->phase);
+  heliSeqGenerate(&seq, &job->signals[s->firstWindow], last - s->firstWindow);
+
+  /* T_settle, from its state at the start and the windows where it changes */
+  tsettle = s->tsettle & HELI_WINDOW_TSETTLE;
+  iwin = s->firstWindow;
+  for(itog = s->firstToggle; itog <= lastTog; itog++)
+    {
+      if(itog < lastTog)
+	{
+	  end = s->firstWindow + job->tog[itog].offset;
+	  if((end < iwin) || (end >= last))
+	    return -1;
+	}
+      else
+	end = last;
+
+      if(tsettle)
+	for(; iwin < end; iwin++)
+	  job->signals[iwin] |= HELI_WINDOW_TSETTLE;
+      iwin = end;
+      tsettle ^= HELI_WINDOW_TSETTLE;
+    }
+
+  for(iexc = s->firstException; iexc < lastExc; iexc++)
+    {
+      const heliCodecException_t *e = &job->exc[iexc];
+      if(e->offset >= last - s->firstWindow)
+	return -1;
+      job->signals[s->firstWindow + e->offset] = e->signals;
+    }
+
+  return 0;
+}
+
+static void *
+codecDecodeThread(void *arg)
+{
+  codecJob *job = arg;
+  uint64_t iseg;
+
+  while((iseg = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->hdr->nsegments)
+    {
+      if(codecDecodeSegment(job, iseg) < 0)
+	__atomic_store_n(&job->rval, -1, __ATOMIC_RELAXED);
+    }
+
+  return NULL;
+}
+
+/**
+ * @brief Decode an encoded window stream
+ * @details Regenerate each segment from its seed and its T_settle changes,
+ *          then apply its exceptions.
+ *          Segments are independent, and are decoded by nthreads threads.
+ * @param[in] buf Encoded stream
+ * @param[in] buflen Size of the encoded stream [bytes]
+ * @param[out] signals Array of HELI_WINDOW_* masks, one per window
+ * @param[in] nwindows Size of the signals array.  @see heliCodecGetWindows
+ * @param[in] nthreads Number of decoding threads
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliCodecDecode(const uint8_t *buf, uint64_t buflen,
+		uint8_t *signals, uint64_t nwindows, uint32_t nthreads)
+{
+  const heliCodecHeader_t *hdr = codecCheck(buf, buflen);
+  pthread_t threads[64];
+  uint32_t ithr, nstarted = 0;
+
+  if(hdr == NULL)
+    return -1;
+
+  if(nwindows < hdr->nwindows)
+    {
+      HELI_ERR("Output too small (%llu < %llu windows)\n",
+	       (unsigned long long) nwindows, (unsigned long long) hdr->nwindows);
+      return -1;
+    }
+
+  codecJob job;
+  job.hdr = hdr;
+  job.seg = (const heliCodecSegment_t *) (buf + sizeof(*hdr));
+  job.exc = (const heliCodecException_t *) (job.seg + hdr->nsegments);
+  job.tog = (const heliCodecToggle_t *) (job.exc + hdr->nexceptions);
+  job.signals = signals;
+  job.next = 0;
+  job.rval = 0;
+
+  if(nthreads > 64)
+    nthreads = 64;
+
+  for(ithr = 1; ithr < nthreads; ithr++)
+    {
+      if(pthread_create(&threads[nstarted], NULL, codecDecodeThread, &job) != 0)
+	break;
+      nstarted++;
+    }
+
+  codecDecodeThread(&job);
+
+  for(ithr = 0; ithr < nstarted; ithr++)
+    pthread_join(threads[ithr], NULL);
+
+  if(job.rval < 0)
+    HELI_ERR("Corrupt encoded helicity stream\n");
+
+  return job.rval;
+}
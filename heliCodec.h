@@ -0,0 +1,77 @@
+#pragma once
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Header for the Seed-plus-exceptions Helicity Codec
+ *
+ *   A recorded window stream is encoded as the helicity sequence
+ *   (heliSeq_t) at the start of each segment, plus the list of windows
+ *   whose signals differ from the prediction of that sequence.  A new
+ *   segment is started when the recording loses sync with the prediction
+ *   (e.g. a missed window), and at least every HELI_CODEC_SEGMENT_WINDOWS.
+ *
+ *   T_settle is not predicted by the sequence.  It is stored as its state
+ *   at the start of each segment, plus the windows where it changes.
+ *
+ *   Encoded layout:
+ *     heliCodecHeader_t
+ *     heliCodecSegment_t[nsegments]
+ *     heliCodecException_t[nexceptions]
+ *     heliCodecToggle_t[ntoggles]
+ *
+ */
+
+#include <stdint.h>
+
+#define HELI_CODEC_MAGIC           "HELICODC"
+#define HELI_CODEC_VERSION         2
+#define HELI_CODEC_SEGMENT_WINDOWS (1 << 20) /* Maximum windows per segment */
+
+typedef struct
+{
+  char     magic[8];          /* HELI_CODEC_MAGIC */
+  uint32_t version;           /* HELI_CODEC_VERSION */
+  uint32_t pattern;           /* Helicity pattern index */
+  uint32_t delay;             /* Reporting delay [windows] */
+  uint32_t segmentWindows;    /* Maximum windows per segment */
+  uint64_t nwindows;          /* Number of windows */
+  uint64_t nsegments;         /* Number of segments */
+  uint64_t nexceptions;       /* Number of exceptions */
+  uint64_t ntoggles;          /* Number of T_settle changes */
+} heliCodecHeader_t;
+
+typedef struct
+{
+  uint64_t firstWindow;       /* First window of the segment */
+  uint64_t firstException;    /* Index of the first exception */
+  uint64_t firstToggle;       /* Index of the first T_settle change */
+  uint32_t seed;              /* Shift register at the first window */
+  uint32_t phase;             /* Pattern phase at the first window */
+  uint8_t  tsettle;           /* T_settle at the first window */
+  uint8_t  _blank[7];
+} heliCodecSegment_t;
+
+typedef struct
+{
+  uint32_t offset;            /* Window within the segment */
+  uint8_t  signals;           /* Recorded HELI_WINDOW_* mask */
+  uint8_t  _blank[3];
+} heliCodecException_t;
+
+typedef struct
+{
+  uint32_t offset;            /* Window within the segment where T_settle changes */
+} heliCodecToggle_t;
+
+int32_t heliCodecEncode(uint32_t pattern, uint32_t delay,
+			const uint8_t *signals, uint64_t nwindows,
+			uint8_t **buf, uint64_t *buflen);
+int32_t heliCodecGetWindows(const uint8_t *buf, uint64_t buflen, uint64_t *nwindows);
+int32_t heliCodecDecode(const uint8_t *buf, uint64_t buflen,
+			uint8_t *signals, uint64_t nwindows, uint32_t nthreads);
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Synthetic helicity tagged event generator
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "heliEvent.h"
+#include "heliPrivate.h"
+
+_Static_assert(sizeof(heliEvent_t) == 16, "heliEvent_t must be 16 bytes");
+
+/* Counter based random number, uniform in (0,1) */
+static inline double
+eventUniform(heliEventGen_t *gen)
+{
+  return heliHashUniform(heliHash64(gen->model.key, ++gen->counter));
+}
+
+/* Next board edge */
+static inline const heliSimEdge_t *
+eventEdge(heliEventGen_t *gen)
+{
+  if(gen->iedge == gen->nedges)
+    {
+      gen->nedges = heliSimRun(&gen->sim, gen->edges, HELI_EVENT_EDGE_BATCH);
+      gen->iedge = 0;
+    }
+
+  return &gen->edges[gen->iedge++];
+}
+
+/* Move to the next window.  Edges come in pairs: start, T_settle end. */
+static void
+eventAdvance(heliEventGen_t *gen)
+{
+  const heliSimEdge_t *e;
+
+  gen->window++;
+  gen->start = gen->nextStart;
+  gen->signals = gen->nextSignals;
+
+  e = eventEdge(gen);
+  gen->settleEnd = e->time;
+
+  e = eventEdge(gen);
+  gen->nextStart = e->time;
+  gen->nextSignals = e->signals;
+
+  gen->trueHel = (heliSeqNext(&gen->truth) & HELI_WINDOW_HELICITY) ? 1 : 0;
+}
+
+/**
+ * @brief Fill the default event model
+ * @details 100 kHz triggers, no rate asymmetry, yield 1000 +- 100 with
+ *          a 1000 ppm asymmetry.
+ * @param[out] model Event model
+ */
+void
+heliEventDefaultModel(heliEventModel_t *model)
+{
+  memset(model, 0, sizeof(*model));
+  model->rate = 100.0e3;
+  model->rateAsym = 0;
+  model->yieldMean = 1000.0;
+  model->yieldSigma = 100.0;
+  model->yieldAsym = 1.0e-3;
+  model->key = 1;
+}
+
+/**
+ * @brief Initialize the event generator
+ * @param[out] gen Event generator
+ * @param[in] cfg Configuration register values of the simulated board
+ * @param[in] seed Shift register holding the polarity of the first pattern
+ * @param[in] jitterNs RMS jitter of line sync window starts [ns]
+ * @param[in] model Event model
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliEventInit(heliEventGen_t *gen, const heliConfig_t *cfg, uint32_t seed,
+	      double jitterNs, const heliEventModel_t *model)
+{
+  const heliSimEdge_t *e;
+
+  if((model->rate <= 0) || (fabs(model->rateAsym) >= 1) ||
+     (model->yieldMean < 0) || (model->yieldSigma < 0))
+    {
+      HELI_ERR("Invalid event model\n");
+      return -1;
+    }
+
+  memset(gen, 0, sizeof(*gen));
+  gen->model = *model;
+  gen->rateMax = model->rate * (1 + fabs(model->rateAsym));
+
+  if(heliSimInit(&gen->sim, cfg, seed, jitterNs, model->key) < 0)
+    return -1;
+
+  /* The true helicity leads the reported one by the delay */
+  gen->truth = gen->sim.seq;
+  heliSeqSkip(&gen->truth, gen->truth.delay);
+
+  /* Window 0, and the start of window 1 */
+  e = eventEdge(gen);
+  gen->start = e->time;
+  gen->signals = e->signals;
+  e = eventEdge(gen);
+  gen->settleEnd = e->time;
+  e = eventEdge(gen);
+  gen->nextStart = e->time;
+  gen->nextSignals = e->signals;
+  gen->trueHel = (heliSeqNext(&gen->truth) & HELI_WINDOW_HELICITY) ? 1 : 0;
+  gen->time = gen->start;
+
+  return 0;
+}
+
+/**
+ * @brief Generate the next events
+ * @param[inout] gen Event generator
+ * @param[out] events Events, in time order
+ * @param[in] nevents Events to generate
+ * @return Number of events
+ */
+uint32_t
+heliEventGenerate(heliEventGen_t *gen, heliEvent_t *events, uint32_t nevents)
+{
+  const double nsPerTrigger = 1.0e9 / gen->rateMax;
+  const double accept = 1.0 / (1 + fabs(gen->model.rateAsym));
+  uint32_t ievent;
+  double h, y;
+
+  for(ievent = 0; ievent < nevents; ievent++)
+    {
+      heliEvent_t *ev = &events[ievent];
+
+      while(1)
+	{
+	  gen->time += -log(eventUniform(gen)) * nsPerTrigger;
+	  while(gen->time >= gen->nextStart)
+	    eventAdvance(gen);
+
+	  h = gen->trueHel ? 1.0 : -1.0;
+	  if((gen->model.rateAsym == 0) ||
+	     (eventUniform(gen) < (1 + gen->model.rateAsym * h) * accept))
+	    break;
+	}
+
+      y = gen->model.yieldMean * (1 + gen->model.yieldAsym * h);
+      if(gen->model.yieldSigma > 0)
+	{
+	  double u1 = eventUniform(gen);
+	  double u2 = eventUniform(gen);
+	  y += gen->model.yieldSigma * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+	}
+      if(y < 0)
+	y = 0;
+      if(y > 65535)
+	y = 65535;
+
+      ev->time = (uint64_t) gen->time;
+      ev->window = (uint32_t) gen->window;
+      ev->yield = (uint16_t) (y + 0.5);
+      ev->signals = (gen->signals & ~HELI_WINDOW_TSETTLE) |
+	((gen->time < gen->settleEnd) ? HELI_WINDOW_TSETTLE : 0);
+      ev->truth = gen->trueHel;
+    }
+
+  return nevents;
+}
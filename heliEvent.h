@@ -0,0 +1,71 @@
+#pragma once
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Header for the synthetic helicity tagged event generator
+ *
+ *   Triggers arrive with Poisson timing on the virtual clock of the board
+ *   simulator (heliSim).  Each event is tagged with the board signals at
+ *   its time (reported helicity, pattern sync, pair sync, T_settle) and
+ *   the window counter, as a readout of the board would see them.
+ *
+ *   Helicity correlated physics is injected with the true (undelayed)
+ *   helicity h = +1/-1 of the window:
+ *     rate   R (1 + rateAsym h)
+ *     yield  gaussian, mean (1 + yieldAsym h), RMS yieldSigma
+ *   The true helicity is written in truth, for checking the analysis.
+ *
+ */
+
+#include <stdint.h>
+#include "heliLib.h"
+#include "heliSim.h"
+
+#define HELI_EVENT_EDGE_BATCH 256
+
+typedef struct
+{
+  uint64_t time;              /* Trigger time [ns] */
+  uint32_t window;            /* Window counter (low 32 bits) */
+  uint16_t yield;             /* Yield, ADC like */
+  uint8_t  signals;           /* HELI_WINDOW_* at the trigger */
+  uint8_t  truth;             /* True helicity: 1 (+), 0 (-) */
+} heliEvent_t;
+
+typedef struct
+{
+  double   rate;              /* Mean trigger rate [Hz] */
+  double   rateAsym;          /* Injected rate asymmetry */
+  double   yieldMean;         /* Mean yield */
+  double   yieldSigma;        /* RMS yield */
+  double   yieldAsym;         /* Injected yield asymmetry */
+  uint64_t key;               /* Random number key */
+} heliEventModel_t;
+
+typedef struct
+{
+  heliEventModel_t model;
+  heliSim_t sim;              /* Board edges */
+  heliSeq_t truth;            /* True helicity sequence */
+  heliSimEdge_t edges[HELI_EVENT_EDGE_BATCH];
+  uint32_t nedges, iedge;
+  double   rateMax;           /* Trigger rate before thinning [Hz] */
+  double   time;              /* Last trigger [ns] */
+  uint64_t counter;           /* Random numbers drawn */
+  /* Current and next window */
+  uint64_t window;
+  uint64_t start, settleEnd, nextStart;
+  uint8_t  signals, trueHel;
+  uint8_t  nextSignals;
+} heliEventGen_t;
+
+void     heliEventDefaultModel(heliEventModel_t *model);
+int32_t  heliEventInit(heliEventGen_t *gen, const heliConfig_t *cfg, uint32_t seed,
+		       double jitterNs, const heliEventModel_t *model);
+uint32_t heliEventGenerate(heliEventGen_t *gen, heliEvent_t *events, uint32_t nevents);
@@ -0,0 +1,353 @@
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Charge Asymmetry Feedback engine
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "heliFeedback.h"
+#include "heliPrivate.h"
+
+#define HOLD_MASK (HELI_FEEDBACK_HOLD - 1)
+#define SYNC_SIGNALS (HELI_WINDOW_PATTERN_SYNC | HELI_WINDOW_PAIR_SYNC)
+
+struct heliFeedbackSink
+{
+  int      fd;
+};
+
+/**
+ * @brief Fill a feedback configuration with the defaults
+ * @param[out] cfg Configuration
+ */
+void
+heliFeedbackDefaultConfig(heliFeedbackConfig_t *cfg)
+{
+  memset(cfg, 0, sizeof(*cfg));
+  cfg->patterns = 1000;
+  cfg->gain = 0.5;
+  cfg->slope = 1.0;
+  cfg->deadband = 0;
+  cfg->min = -1.0;
+  cfg->max = 1.0;
+  cfg->setpoint = 0;
+}
+
+/**
+ * @brief Initialize a feedback engine
+ * @param[out] fb Feedback engine
+ * @param[in] cfg Configuration.  @see heliFeedbackDefaultConfig
+ * @param[in] pattern Helicity pattern index
+ * @param[in] delay Reporting delay [windows]
+ * @param[in] actuate Callback applying each new setpoint
+ * @param[in] actuateArg Argument of the callback
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliFeedbackInit(heliFeedback_t *fb, const heliFeedbackConfig_t *cfg,
+		 uint32_t pattern, uint32_t delay,
+		 heliFeedbackActuate_t actuate, void *actuateArg)
+{
+  if(delay > HELI_FEEDBACK_MAX_DELAY)
+    {
+      HELI_ERR("Invalid delay (%u)\n", delay);
+      return -1;
+    }
+
+  if((cfg->patterns == 0) || (cfg->slope == 0) || (cfg->min > cfg->max) ||
+     (cfg->setpoint < cfg->min) || (cfg->setpoint > cfg->max))
+    {
+      HELI_ERR("Invalid configuration\n");
+      return -1;
+    }
+
+  if(actuate == NULL)
+    {
+      HELI_ERR("Invalid actuator\n");
+      return -1;
+    }
+
+  memset(fb, 0, sizeof(*fb));
+
+  if((heliAsymInit(&fb->iter, pattern) != 0) || (heliAsymInit(&fb->total, pattern) != 0))
+    return -1;
+
+  fb->cfg = *cfg;
+  fb->delay = delay;
+  fb->actuate = actuate;
+  fb->actuateArg = actuateArg;
+  fb->last.setpoint = cfg->setpoint;
+
+  return 0;
+}
+
+/**
+ * @brief Initialize a feedback engine for the pattern and delay of the module
+ * @param[out] fb Feedback engine
+ * @param[in] cfg Configuration.  @see heliFeedbackDefaultConfig
+ * @param[in] actuate Callback applying each new setpoint
+ * @param[in] actuateArg Argument of the callback
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliFeedbackInitBoard(heliFeedback_t *fb, const heliFeedbackConfig_t *cfg,
+		      heliFeedbackActuate_t actuate, void *actuateArg)
+{
+  uint32_t pattern, delay;
+
+  if((heliGetHelicityPattern(&pattern) < 0) || (heliGetReportingDelay(&delay) < 0))
+    return -1;
+
+  return heliFeedbackInit(fb, cfg, pattern, delay, actuate, actuateArg);
+}
+
+/* Close an iteration: compute the step, and hand the setpoint to the actuator */
+static void
+feedbackIterate(heliFeedback_t *fb)
+{
+  heliFeedbackResult_t r;
+  double setpoint;
+
+  memset(&r, 0, sizeof(r));
+  r.iteration = fb->last.iteration + 1;
+  r.patterns = fb->iter.patterns;
+  r.rejected = fb->iter.rejected;
+  heliAsymGetMean(&fb->iter.asym, &r.asym, &r.asymError);
+
+  heliAsymMerge(&fb->total, &fb->iter);
+  heliAsymGetMean(&fb->total.asym, &r.totalAsym, &r.totalError);
+
+  /* Start the next iteration, keeping the unfinished pattern */
+  fb->iter.patterns = 0;
+  fb->iter.rejected = 0;
+  memset(&fb->iter.asym, 0, sizeof(fb->iter.asym));
+  memset(&fb->iter.diff, 0, sizeof(fb->iter.diff));
+  memset(&fb->iter.yield, 0, sizeof(fb->iter.yield));
+
+  if(r.patterns == 0)
+    r.step = 0;
+  else if(fabs(r.asym) <= fb->cfg.deadband * r.asymError)
+    r.step = 0;
+  else
+    r.step = -fb->cfg.gain * r.asym / fb->cfg.slope;
+
+  setpoint = fb->last.setpoint + r.step;
+  if(setpoint < fb->cfg.min)
+    {
+      setpoint = fb->cfg.min;
+      r.clamped = 1;
+    }
+  else if(setpoint > fb->cfg.max)
+    {
+      setpoint = fb->cfg.max;
+      r.clamped = 1;
+    }
+  r.step = setpoint - fb->last.setpoint;
+  r.setpoint = setpoint;
+
+  if(fb->actuate(fb->actuateArg, &r) != 0)
+    {
+      /* Not applied: keep the previous setpoint */
+      fb->actuatorErrors++;
+      r.step = 0;
+      r.setpoint = fb->last.setpoint;
+    }
+
+  fb->last = r;
+}
+
+/**
+ * @brief Feed the next reported window, and its measured charge yield
+ * @param[inout] fb Feedback engine
+ * @param[in] signals Mask of HELI_WINDOW_* signals reported for the window
+ * @param[in] yield Charge yield measured in the window
+ * @return 1 if an iteration finished, otherwise 0
+ */
+int32_t
+heliFeedbackWindow(heliFeedback_t *fb, uint8_t signals, double yield)
+{
+  uint64_t w = fb->windows++;
+  uint64_t before;
+  uint8_t aligned;
+
+  fb->holdSignals[w & HOLD_MASK] = signals & SYNC_SIGNALS;
+  fb->holdYields[w & HOLD_MASK] = yield;
+
+  if(w < fb->delay)
+    return 0;
+
+  /* This report carries the helicity of window w - delay */
+  w -= fb->delay;
+  aligned = fb->holdSignals[w & HOLD_MASK] | (signals & HELI_WINDOW_HELICITY);
+
+  before = fb->iter.patterns + fb->iter.rejected;
+  heliAsymAccumulate(&fb->iter, &aligned, &fb->holdYields[w & HOLD_MASK], 1);
+  if((fb->iter.patterns + fb->iter.rejected == before) ||
+     (fb->iter.patterns + fb->iter.rejected < fb->cfg.patterns))
+    return 0;
+
+  feedbackIterate(fb);
+
+  return 1;
+}
+
+/**
+ * @brief Feed consecutive reported windows, and their charge yields
+ * @param[inout] fb Feedback engine
+ * @param[in] signals Array of HELI_WINDOW_* masks, one per window
+ * @param[in] yields Array of charge yields, one per window
+ * @param[in] nwindows Number of windows
+ * @return Number of iterations finished
+ */
+int32_t
+heliFeedbackBlock(heliFeedback_t *fb, const uint8_t *signals, const double *yields,
+		  uint64_t nwindows)
+{
+  uint64_t iwin;
+  int32_t n = 0;
+
+  for(iwin = 0; iwin < nwindows; iwin++)
+    n += heliFeedbackWindow(fb, signals[iwin], yields[iwin]);
+
+  return n;
+}
+
+/**
+ * @brief Open an actuator stand-in
+ * @details Each setpoint is written as one text line:
+ *            iteration setpoint step asym asymError patterns rejected
+ *          to target: "udp:{host}:{port}" or "unix:{path}" for one
+ *          datagram per line, "-" for standard out, otherwise a file
+ *          opened for append.
+ * @param[in] target Destination
+ * @return Sink if successful, otherwise NULL
+ */
+heliFeedbackSink_t *
+heliFeedbackSinkOpen(const char *target)
+{
+  heliFeedbackSink_t *sink;
+
+  sink = malloc(sizeof(*sink));
+  if(sink == NULL)
+    {
+      HELI_ERR("Unable to allocate memory\n");
+      return NULL;
+    }
+  memset(sink, 0, sizeof(*sink));
+
+  if(strncmp(target, "udp:", 4) == 0)
+    {
+      struct addrinfo hints, *res;
+      char host[256];
+      const char *port = strrchr(target + 4, ':');
+
+      if((port == NULL) || ((size_t) (port - target - 4) >= sizeof(host)))
+	{
+	  HELI_ERR("Invalid target (%s)\n", target);
+	  free(sink);
+	  return NULL;
+	}
+      memcpy(host, target + 4, port - target - 4);
+      host[port - target - 4] = 0;
+
+      memset(&hints, 0, sizeof(hints));
+      hints.ai_family = AF_UNSPEC;
+      hints.ai_socktype = SOCK_DGRAM;
+      if(getaddrinfo(host, port + 1, &hints, &res) != 0)
+	{
+	  HELI_ERR("Unable to resolve %s\n", target);
+	  free(sink);
+	  return NULL;
+	}
+
+      sink->fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+      if((sink->fd >= 0) && (connect(sink->fd, res->ai_addr, res->ai_addrlen) != 0))
+	{
+	  close(sink->fd);
+	  sink->fd = -1;
+	}
+      freeaddrinfo(res);
+    }
+  else if(strncmp(target, "unix:", 5) == 0)
+    {
+      struct sockaddr_un addr;
+
+      memset(&addr, 0, sizeof(addr));
+      addr.sun_family = AF_UNIX;
+      strncpy(addr.sun_path, target + 5, sizeof(addr.sun_path) - 1);
+
+      sink->fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+      if((sink->fd >= 0) &&
+	 (connect(sink->fd, (struct sockaddr *) &addr, sizeof(addr)) != 0))
+	{
+	  close(sink->fd);
+	  sink->fd = -1;
+	}
+    }
+  else if(strcmp(target, "-") == 0)
+    sink->fd = STDOUT_FILENO;
+  else
+    sink->fd = open(target, O_WRONLY | O_CREAT | O_APPEND, 0644);
+
+  if(sink->fd < 0)
+    {
+      HELI_ERR("Unable to open %s\n", target);
+      free(sink);
+      return NULL;
+    }
+
+  return sink;
+}
+
+/**
+ * @brief Write a setpoint to an actuator stand-in
+ * @details Use as the heliFeedbackActuate_t callback, with the sink as arg.
+ * @param[in] sink Sink from heliFeedbackSinkOpen
+ * @param[in] result Iteration result
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliFeedbackSinkActuate(void *sink, const heliFeedbackResult_t *result)
+{
+  heliFeedbackSink_t *s = (heliFeedbackSink_t *) sink;
+  char line[256];
+  int len;
+
+  len = snprintf(line, sizeof(line), "%llu %.9g %.9g %.9g %.9g %llu %llu\n",
+		 (unsigned long long) result->iteration, result->setpoint, result->step,
+		 result->asym, result->asymError,
+		 (unsigned long long) result->patterns,
+		 (unsigned long long) result->rejected);
+
+  return (write(s->fd, line, len) == len) ? 0 : -1;
+}
+
+/**
+ * @brief Close an actuator stand-in
+ * @param[in] sink Sink from heliFeedbackSinkOpen
+ */
+void
+heliFeedbackSinkClose(heliFeedbackSink_t *sink)
+{
+  if(sink == NULL)
+    return;
+
+  if(sink->fd != STDOUT_FILENO)
+    close(sink->fd);
+  free(sink);
+}
@@ -0,0 +1,98 @@
+#pragma once
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Header for the Charge Asymmetry Feedback engine
+ *
+ *   The engine is fed the reported window signals, with the charge yield
+ *   measured in each window.  The reported helicity of window w is the true
+ *   helicity of window w - delay, so the yields and pattern syncs are held
+ *   for delay windows and joined with their helicity when it is reported.
+ *   The aligned windows are grouped into patterns by a pattern asymmetry
+ *   accumulator (heliAsym).
+ *
+ *   Every cfg.patterns patterns is one iteration.  The mean asymmetry A
+ *   of the iteration moves the actuator by
+ *
+ *     step = -gain * A / slope
+ *
+ *   unless |A| is within deadband times its error.  The setpoint is kept
+ *   within [min, max], and handed to the actuator callback.
+ *
+ *   The pattern and delay are read once, at initialization.  The engine
+ *   allocates no memory, and an iteration costs a few microseconds plus
+ *   the actuator.
+ *
+ */
+
+#include <stdint.h>
+#include "heliAsym.h"
+
+#define HELI_FEEDBACK_MAX_DELAY 256
+#define HELI_FEEDBACK_HOLD      512 /* Held windows, a power of two > MAX_DELAY */
+
+typedef struct
+{
+  uint32_t patterns;          /* Patterns per iteration */
+  double   gain;              /* Fraction of the asymmetry corrected per iteration */
+  double   slope;             /* Asymmetry per actuator unit */
+  double   deadband;          /* Skip corrections within deadband errors (0: never) */
+  double   min;               /* Lowest setpoint */
+  double   max;               /* Highest setpoint */
+  double   setpoint;          /* Initial setpoint */
+} heliFeedbackConfig_t;
+
+typedef struct
+{
+  uint64_t iteration;         /* Iteration number, from 1 */
+  uint64_t patterns;          /* Patterns in the iteration */
+  uint64_t rejected;          /* Patterns rejected in the iteration */
+  double   asym;              /* Mean asymmetry of the iteration */
+  double   asymError;         /* Error of asym */
+  double   totalAsym;         /* Mean asymmetry since initialization */
+  double   totalError;        /* Error of totalAsym */
+  double   step;              /* Setpoint change */
+  double   setpoint;          /* New setpoint */
+  int32_t  clamped;           /* Setpoint held at min or max */
+} heliFeedbackResult_t;
+
+/* Apply a new setpoint.  Return 0 if successful, otherwise -1. */
+typedef int32_t (*heliFeedbackActuate_t)(void *arg, const heliFeedbackResult_t *result);
+
+typedef struct
+{
+  heliFeedbackConfig_t cfg;
+  uint32_t delay;             /* Reporting delay [windows] */
+  uint64_t windows;           /* Windows fed */
+  uint64_t actuatorErrors;    /* Failed actuator calls */
+  heliFeedbackActuate_t actuate;
+  void    *actuateArg;
+  heliFeedbackResult_t last;  /* Last iteration */
+  heliAsymAccum_t iter;       /* Patterns of the current iteration */
+  heliAsymAccum_t total;      /* Patterns of the finished iterations */
+  uint8_t  holdSignals[HELI_FEEDBACK_HOLD];
+  double   holdYields[HELI_FEEDBACK_HOLD];
+} heliFeedback_t;
+
+typedef struct heliFeedbackSink heliFeedbackSink_t;
+
+void    heliFeedbackDefaultConfig(heliFeedbackConfig_t *cfg);
+int32_t heliFeedbackInit(heliFeedback_t *fb, const heliFeedbackConfig_t *cfg,
+			 uint32_t pattern, uint32_t delay,
+			 heliFeedbackActuate_t actuate, void *actuateArg);
+int32_t heliFeedbackInitBoard(heliFeedback_t *fb, const heliFeedbackConfig_t *cfg,
+			      heliFeedbackActuate_t actuate, void *actuateArg);
+int32_t heliFeedbackWindow(heliFeedback_t *fb, uint8_t signals, double yield);
+int32_t heliFeedbackBlock(heliFeedback_t *fb, const uint8_t *signals,
+			  const double *yields, uint64_t nwindows);
+
+/* Actuator stand-in: one text line per setpoint, to a file or a socket */
+heliFeedbackSink_t *heliFeedbackSinkOpen(const char *target);
+int32_t heliFeedbackSinkActuate(void *sink, const heliFeedbackResult_t *result);
+void    heliFeedbackSinkClose(heliFeedbackSink_t *sink);
@@ -0,0 +1,286 @@
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Status formatter, text / JSON / binary, into caller buffers
+ *
+ */
+
+#include <string.h>
+#include "heliFormat.h"
+#include "heliPrivate.h"
+
+_Static_assert(sizeof(heliStatusRecord_t) == 32,
+	       "heliStatusRecord_t must be 32 bytes");
+
+/* Two digits, zero padded */
+static void
+fmtDec2(heliOut_t *o, uint8_t v)
+{
+  heliOutChar(o, '0' + (v / 10) % 10);
+  heliOutChar(o, '0' + v % 10);
+}
+
+static void
+fmtHex2(heliOut_t *o, uint8_t v)
+{
+  static const char hex[] = "0123456789abcdef";
+
+  heliOutStr(o, "0x");
+  heliOutChar(o, hex[v >> 4]);
+  heliOutChar(o, hex[v & 0xf]);
+}
+
+/* Non-negative value with two decimals */
+static void
+fmtFixed2(heliOut_t *o, double v)
+{
+  uint64_t c = (v > 0) ? (uint64_t) (v * 100.0 + 0.5) : 0;
+
+  heliOutUint(o, c / 100);
+  heliOutChar(o, '.');
+  heliOutChar(o, '0' + (c / 10) % 10);
+  heliOutChar(o, '0' + c % 10);
+}
+
+/* Start a field: separator and key */
+static void
+fmtKey(heliOut_t *o, uint32_t format, int32_t *first, const char *key)
+{
+  if(!*first)
+    heliOutChar(o, (format == HELI_FORMAT_JSON) ? ',' : ' ');
+  *first = 0;
+
+  if(format == HELI_FORMAT_JSON)
+    {
+      heliOutChar(o, '"');
+      heliOutStr(o, key);
+      heliOutStr(o, "\":");
+    }
+  else
+    {
+      heliOutStr(o, key);
+      heliOutChar(o, '=');
+    }
+}
+
+static void
+fmtQuoted(heliOut_t *o, const char *s)
+{
+  heliOutChar(o, '"');
+  heliOutStr(o, s);
+  heliOutChar(o, '"');
+}
+
+static const char *
+fmtPatternName(uint8_t pattern)
+{
+  pattern &= HELI_PATTERN_MASK;
+  if(pattern >= sizeof(sPatternVals) / sizeof(sPatternVals[0]))
+    return "Unknown";
+  return sPatternVals[pattern];
+}
+
+/**
+ * @brief Find the status fields that differ between two snapshots
+ * @param[in] prev Earlier register snapshot
+ * @param[in] cur Later register snapshot
+ * @return Mask of HELI_FIELD_* that changed
+ */
+uint32_t
+heliFormatDiff(const heliRegs *prev, const heliRegs *cur)
+{
+  uint32_t fields = 0;
+  double ps, pt, pf, cs, ct, cf;
+
+  if(prev->state != cur->state)
+    fields |= HELI_FIELD_STATE;
+  if((prev->clock ^ cur->clock) & HELI_HELICITY_CLOCK_MASK)
+    fields |= HELI_FIELD_MODE;
+  if((prev->clock ^ cur->clock) & HELI_BOARDCLOCK_10MHZ)
+    fields |= HELI_FIELD_BOARDCLOCK;
+  if((prev->pattern ^ cur->pattern) & HELI_PATTERN_MASK)
+    fields |= HELI_FIELD_PATTERN;
+  if((prev->delay ^ cur->delay) & HELI_DELAY_MASK)
+    fields |= HELI_FIELD_DELAY;
+  if((prev->month != cur->month) || (prev->day != cur->day) || (prev->year != cur->year))
+    fields |= HELI_FIELD_FIRMWARE;
+
+  heliCalcHelicityTiming(prev->clock, prev->tsettle, prev->tstable, &ps, &pt, &pf);
+  heliCalcHelicityTiming(cur->clock, cur->tsettle, cur->tstable, &cs, &ct, &cf);
+  if(ps != cs)
+    fields |= HELI_FIELD_TSETTLE;
+  if(pt != ct)
+    fields |= HELI_FIELD_TSTABLE;
+  if(pf != cf)
+    fields |= HELI_FIELD_FREQUENCY;
+
+  return fields;
+}
+
+/**
+ * @brief Render a register snapshot
+ * @details Render the selected fields of a register snapshot into buf.
+ *          Text and JSON output is one line, ending with a newline, and
+ *          not null terminated.
+ * @param[in] format HELI_FORMAT_TEXT, HELI_FORMAT_JSON or HELI_FORMAT_BIN
+ * @param[in] regs Register snapshot
+ * @param[in] fields Fields to render (HELI_FIELD_*)
+ * @param[in] time Timestamp written with the fields (e.g. ns since the epoch)
+ * @param[out] buf Output buffer
+ * @param[in] size Size of buf
+ * @return Number of bytes written if successful, otherwise -1 (including buf too small)
+ */
+int32_t
+heliFormatStatus(uint32_t format, const heliRegs *regs, uint32_t fields,
+		 uint64_t time, char *buf, uint32_t size)
+{
+  heliOut_t o = { buf, size, 0 };
+  int32_t first = 1;
+  double tsettle, tstable, freq;
+  uint8_t mode = regs->clock & HELI_HELICITY_CLOCK_MASK;
+
+  fields &= HELI_FIELD_ALL;
+
+  if(format == HELI_FORMAT_BIN)
+    {
+      heliStatusRecord_t rec;
+
+      if(size < sizeof(rec))
+	return -1;
+
+      memset(&rec, 0, sizeof(rec));
+      rec.magic = HELI_STATUS_MAGIC;
+      rec.fields = fields;
+      rec.time = time;
+      memcpy(rec.regs, regs, sizeof(rec.regs));
+      memcpy(buf, &rec, sizeof(rec));
+
+      return sizeof(rec);
+    }
+
+  if((format != HELI_FORMAT_TEXT) && (format != HELI_FORMAT_JSON))
+    return -1;
+
+  heliCalcHelicityTiming(regs->clock, regs->tsettle, regs->tstable,
+			 &tsettle, &tstable, &freq);
+
+  if(format == HELI_FORMAT_JSON)
+    heliOutChar(&o, '{');
+
+  fmtKey(&o, format, &first, "time");
+  heliOutUint(&o, time);
+
+  if(fields & HELI_FIELD_STATE)
+    {
+      fmtKey(&o, format, &first, "state");
+      if(format == HELI_FORMAT_JSON)
+	heliOutUint(&o, regs->state);
+      else
+	fmtHex2(&o, regs->state);
+    }
+
+  if(fields & HELI_FIELD_MODE)
+    {
+      fmtKey(&o, format, &first, "mode");
+      if(fClockVals[mode] < 0)
+	fmtQuoted(&o, "Free Clock");
+      else
+	{
+	  heliOutChar(&o, '"');
+	  heliOutUint(&o, (uint64_t) fClockVals[mode]);
+	  heliOutStr(&o, " Hz Line Sync\"");
+	}
+    }
+
+  if(fields & HELI_FIELD_TSETTLE)
+    {
+      fmtKey(&o, format, &first, "tsettle_us");
+      fmtFixed2(&o, tsettle);
+    }
+
+  if(fields & HELI_FIELD_TSTABLE)
+    {
+      fmtKey(&o, format, &first, "tstable_us");
+      fmtFixed2(&o, tstable);
+    }
+
+  if(fields & HELI_FIELD_FREQUENCY)
+    {
+      fmtKey(&o, format, &first, "frequency_hz");
+      fmtFixed2(&o, freq);
+    }
+
+  if(fields & HELI_FIELD_PATTERN)
+    {
+      fmtKey(&o, format, &first, "pattern");
+      fmtQuoted(&o, fmtPatternName(regs->pattern));
+    }
+
+  if(fields & HELI_FIELD_DELAY)
+    {
+      fmtKey(&o, format, &first, "delay_windows");
+      heliOutUint(&o, iDelayVals[regs->delay & HELI_DELAY_MASK]);
+    }
+
+  if(fields & HELI_FIELD_BOARDCLOCK)
+    {
+      fmtKey(&o, format, &first, "boardclock_mhz");
+      heliOutUint(&o, (regs->clock & HELI_BOARDCLOCK_10MHZ) ? 10 : 20);
+    }
+
+  if(fields & HELI_FIELD_FIRMWARE)
+    {
+      fmtKey(&o, format, &first, "firmware");
+      heliOutChar(&o, '"');
+      fmtDec2(&o, regs->month);
+      heliOutChar(&o, '/');
+      fmtDec2(&o, regs->day);
+      heliOutChar(&o, '/');
+      fmtDec2(&o, regs->year);
+      heliOutChar(&o, '"');
+    }
+
+  if(format == HELI_FORMAT_JSON)
+    heliOutChar(&o, '}');
+  heliOutChar(&o, '\n');
+
+  if(o.len > size)
+    return -1;
+
+  return o.len;
+}
+
+/**
+ * @brief Decode a binary status record
+ * @param[in] buf Record from heliFormatStatus(HELI_FORMAT_BIN, ...)
+ * @param[in] len Bytes in buf
+ * @param[out] regs Register snapshot
+ * @param[out] fields Fields of the record (HELI_FIELD_*)
+ * @param[out] time Timestamp of the record
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliFormatDecode(const void *buf, uint32_t len, heliRegs *regs,
+		 uint32_t *fields, uint64_t *time)
+{
+  heliStatusRecord_t rec;
+
+  if(len < sizeof(rec))
+    return -1;
+
+  memcpy(&rec, buf, sizeof(rec));
+  if(rec.magic != HELI_STATUS_MAGIC)
+    return -1;
+
+  memcpy(regs, rec.regs, sizeof(rec.regs));
+  *fields = rec.fields;
+  *time = rec.time;
+
+  return 0;
+}
@@ -0,0 +1,59 @@
+#pragma once
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Header for the status formatter
+ *
+ *   Render a register snapshot (heliGetRegisterSnapshot) into a caller
+ *   supplied buffer, as one line of text, one JSON object, or a fixed
+ *   size binary record.  No stdio, no allocation, no locks.
+ *
+ *   Only the fields selected by a HELI_FIELD_* mask are rendered, so a
+ *   watcher can send the fields that heliFormatDiff finds changed.
+ *
+ */
+
+#include <stdint.h>
+#include "heliLib.h"
+
+/* Output formats */
+#define HELI_FORMAT_TEXT 0    /* key=value ... \n */
+#define HELI_FORMAT_JSON 1    /* {"key":value,...}\n */
+#define HELI_FORMAT_BIN  2    /* heliStatusRecord_t */
+
+/* Status fields */
+#define HELI_FIELD_STATE      (1 << 0)
+#define HELI_FIELD_MODE       (1 << 1)
+#define HELI_FIELD_TSETTLE    (1 << 2)
+#define HELI_FIELD_TSTABLE    (1 << 3)
+#define HELI_FIELD_FREQUENCY  (1 << 4)
+#define HELI_FIELD_PATTERN    (1 << 5)
+#define HELI_FIELD_DELAY      (1 << 6)
+#define HELI_FIELD_BOARDCLOCK (1 << 7)
+#define HELI_FIELD_FIRMWARE   (1 << 8)
+#define HELI_FIELD_ALL        0x1ff
+
+#define HELI_STATUS_MAGIC 0x4853 /* "HS" */
+
+/* Binary record.  Registers are the raw snapshot; fields tells which
+   of them changed, or were selected. */
+typedef struct
+{
+  uint16_t magic;             /* HELI_STATUS_MAGIC */
+  uint16_t fields;            /* HELI_FIELD_* */
+  uint32_t _blank;
+  uint64_t time;              /* Caller timestamp */
+  uint8_t  regs[sizeof(heliRegs)];
+} heliStatusRecord_t;
+
+uint32_t heliFormatDiff(const heliRegs *prev, const heliRegs *cur);
+int32_t  heliFormatStatus(uint32_t format, const heliRegs *regs, uint32_t fields,
+			  uint64_t time, char *buf, uint32_t size);
+int32_t  heliFormatDecode(const void *buf, uint32_t len, heliRegs *regs,
+			  uint32_t *fields, uint64_t *time);
@@ -13,21 +13,50 @@
 
 #include <unistd.h>
 #include <stdio.h>
+#include <string.h>
+#include <stddef.h>
 #include <pthread.h>
+#ifndef VXWORKS
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <grp.h>
+#include <stdlib.h>
+#endif
 #include "jvme.h"
 #include "heliLib.h"
+#ifndef VXWORKS
+#include "heliAudit.h"
+#endif
+#include "heliPrivate.h"
 
 /* Macro to check for library / pointer initialization */
 #define CHECKHELI  { if(hl.initialized == 0) {HELI_ERR("Helicity Generator Library is not initialized\n"); return -1;}}
 
 #define HELI_DBG(format, ...) {if (hl.debug==1) {fprintf(stdout,"%s: DEBUG: ",__func__); fprintf(stdout,format, ## __VA_ARGS__);}}
-#define HELI_ERR(format, ...) {fprintf(stderr,"%s: ERROR: ",__func__); fprintf(stderr,format, ## __VA_ARGS__);}
 
 #ifndef __JVME_DEVADDR_T
 #define __JVME_DEVADDR_T
 typedef unsigned long devaddr_t;
 #endif
 
+/* Device lock, shared by every process using the same module */
+#define HELI_DEVLOCK_PATH  "/dev/shm/heliLib-%06x.lock"
+#define HELI_DEVLOCK_MAGIC 0x484c4b31 /* "HLK1" */
+#ifndef HELI_DEVLOCK_MODE
+#define HELI_DEVLOCK_MODE  0660       /* Owner and group: users of the module share a group */
+#endif
+#define HELI_DEVLOCK_GROUP_ENV "HELI_DEVLOCK_GROUP" /* Group of a new lock, by name */
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t ready;             /* Set once the mutex is initialized */
+  uint64_t recoveries;        /* Owners that died holding the lock */
+  pthread_mutex_t mutex;      /* Process shared, robust */
+} heliDevLockShm;
+
 /* Structure to keep track of library variables */
 typedef struct
 {
@@ -36,14 +65,33 @@ typedef struct
   devaddr_t a24_offset;       /* Offset between VME A24 and Local address space */
   pthread_mutex_t rw_mutex;   /* Local library structure Mutex */
   uint8_t  debug;             /* Whether or not to print debug messages to stdout */
+  heliWriteHook_t writeHook;  /* Called after each register write */
+  void    *writeHookArg;
+  heliCaps_t caps;            /* Firmware capabilities, from heliInit */
+  heliDevLockShm *devLock;    /* Device lock, NULL if only rw_mutex */
+  void    *audit;             /* Audit log named by HELI_AUDIT_LOG, NULL if none */
 } heliLibVars;
 
 /* Initialize the local structure */
-static heliLibVars hl = {0, NULL, 0, PTHREAD_MUTEX_INITIALIZER, 0};
+static heliLibVars hl = { .rw_mutex = PTHREAD_MUTEX_INITIALIZER };
 
 #define HLOCK   if(pthread_mutex_lock(&hl.rw_mutex)<0) perror("pthread_mutex_lock");
 #define HUNLOCK if(pthread_mutex_unlock(&hl.rw_mutex)<0) perror("pthread_mutex_unlock");
 
+/* Multi-register sequences also hold the device lock, across processes.
+   The caller returns -1 if the lock cannot be taken. */
+#define HLOCKDEV   {HLOCK; if(heliDevLock() < 0) {HUNLOCK; return -1;}}
+#define HUNLOCKDEV {heliDevUnlock(); HUNLOCK;}
+
+/* Write a register, and report the write to the hook.  Call with HLOCK held. */
+#define HWRITEOFF(_func, _off, _val) {					\
+    uint8_t _wval = (_val);						\
+    vmeWrite8(&((volatile uint8_t *) hl.dev)[_off], _wval);		\
+    if(hl.writeHook)							\
+      hl.writeHook(hl.writeHookArg, _func, _off, _wval);		\
+  }
+#define HWRITE(_reg, _val) HWRITEOFF(__func__, offsetof(heliRegs, _reg), _val)
+
 
 /* Settle Time (usec) */
 double fTSettleVals[32] = {
@@ -95,10 +143,309 @@ char sPatternVals[11][256] =
     "32-Pair"
   };
 
+#define HELI_NELEM(_a) (sizeof(_a) / sizeof((_a)[0]))
+
+/* Compile time check, without C11 */
+#define HELI_CT_ASSERT(_cond, _name) typedef char _name[(_cond) ? 1 : -1]
+
+/* Register fields.  The largest selection is the size of the value table. */
+#define HELI_FIELDDEF(_name, _reg, _shift, _width, _table)		\
+  { _name, offsetof(heliRegs, _reg), _shift, _width, HELI_NELEM(_table) - 1 }
+
+static const heliField_t heliFields[HELI_NREGFIELDS] =
+  {
+    /* HELI_REGFIELD_MODE */       HELI_FIELDDEF("mode",       clock,   0, 2, fClockVals),
+    /* HELI_REGFIELD_BOARDCLOCK */ HELI_FIELDDEF("boardclock", clock,   7, 1, fBoardClockValues),
+    /* HELI_REGFIELD_PATTERN */    HELI_FIELDDEF("pattern",    pattern, 0, 4, sPatternVals),
+    /* HELI_REGFIELD_DELAY */      HELI_FIELDDEF("delay",      delay,   0, 4, iDelayVals),
+    /* HELI_REGFIELD_TSETTLE */    HELI_FIELDDEF("tsettle",    tsettle, 0, 5, fTSettleVals),
+    /* HELI_REGFIELD_TSTABLE */    HELI_FIELDDEF("tstable",    tstable, 0, 5, fTStableVals)
+  };
+
+/* Each value table must fit its field, and each field its register mask */
+HELI_CT_ASSERT(HELI_NELEM(fClockVals) == HELI_HELICITY_CLOCK_MASK + 1, heliCheckMode);
+HELI_CT_ASSERT(HELI_NELEM(fBoardClockValues) == 2, heliCheckBoardClock);
+HELI_CT_ASSERT(HELI_BOARDCLOCK_10MHZ == (1 << 7), heliCheckBoardClockBit);
+HELI_CT_ASSERT(HELI_NELEM(sPatternVals) <= HELI_PATTERN_MASK + 1, heliCheckPattern);
+HELI_CT_ASSERT(HELI_NELEM(iDelayVals) == HELI_DELAY_MASK + 1, heliCheckDelay);
+HELI_CT_ASSERT(HELI_NELEM(fTSettleVals) == HELI_TSETTLE_MASK + 1, heliCheckTSettle);
+HELI_CT_ASSERT(HELI_NELEM(fTStableVals) == HELI_TSTABLE_MASK + 1, heliCheckTStable);
+HELI_CT_ASSERT(HELI_PATTERN_32_PAIR == HELI_NELEM(sPatternVals) - 1, heliCheckPatternEnum);
+HELI_CT_ASSERT(HELI_DELAY_256 == HELI_NELEM(iDelayVals) - 1, heliCheckDelayEnum);
+HELI_CT_ASSERT(HELI_TSETTLE_1000US == HELI_NELEM(fTSettleVals) - 1, heliCheckTSettleEnum);
+HELI_CT_ASSERT(HELI_TSTABLE_33330US == HELI_NELEM(fTStableVals) - 1, heliCheckTStableEnum);
+
+/*
+ * Supported selections by firmware date (YYMMDD, from the year, month and
+ * day registers).  The last entry not newer than the module firmware
+ * applies; older firmware gets the first.  An unreadable date gets the
+ * last, so a read error never restricts the selections.
+ */
+#define HELI_SELECT_ALL(_table) ((uint32_t) ((1ULL << HELI_NELEM(_table)) - 1))
+
+static const struct
+{
+  uint32_t date;
+  uint32_t valid[HELI_NREGFIELDS];
+} heliCapsTable[] =
+  {
+    /* Pair .. Octo-Quad and the SPARE slots */
+    { 0,
+      { HELI_SELECT_ALL(fClockVals), HELI_SELECT_ALL(fBoardClockValues), 0xff,
+	HELI_SELECT_ALL(iDelayVals), HELI_SELECT_ALL(fTSettleVals),
+	HELI_SELECT_ALL(fTStableVals) } },
+    /* Adds Thue-Morse-64, 16-Quad, 32-Pair */
+    { 230606,
+      { HELI_SELECT_ALL(fClockVals), HELI_SELECT_ALL(fBoardClockValues),
+	HELI_SELECT_ALL(sPatternVals),
+	HELI_SELECT_ALL(iDelayVals), HELI_SELECT_ALL(fTSettleVals),
+	HELI_SELECT_ALL(fTStableVals) } }
+  };
+
+/* Meaningful bits of each register, by offset */
+static const uint8_t heliRegMasks[sizeof(heliRegs)] =
+  {
+    HELI_MONTH_MASK, HELI_DAY_MASK, HELI_YEAR_MASK, 0,
+    HELI_STATE_MASK, HELI_RESET_MASK, 0, HELI_TSETTLE_MASK,
+    0, HELI_TSTABLE_MASK, 0, HELI_DELAY_MASK,
+    0, HELI_PATTERN_MASK, 0, HELI_CLOCK_MASK
+  };
+
+/* Check a field selection, reporting errors for func */
+static int32_t
+heliFieldValid(const char *func, heliFieldId_t field, uint32_t value)
+{
+  if((uint32_t) field >= HELI_NREGFIELDS)
+    {
+      fprintf(stderr, "%s: ERROR: Invalid field (%d)\n", func, field);
+      return -1;
+    }
+
+  if(value > heliFields[field].max)
+    {
+      fprintf(stderr, "%s: ERROR: Invalid %s (%d), max %d\n", func,
+	      heliFields[field].name, value, heliFields[field].max);
+      return -1;
+    }
+
+  /* Only the cached capabilities, never the module */
+  if(hl.initialized && !(hl.caps.valid[field] & (1u << value)))
+    {
+      fprintf(stderr, "%s: ERROR: %s %d not supported by firmware %02d/%02d/%02d\n", func,
+	      heliFields[field].name, value, hl.caps.month, hl.caps.day, hl.caps.year);
+      return -1;
+    }
+
+  return 0;
+}
+
+/* Check every field of a local copy of the register map */
+static int32_t
+heliRegsValid(const char *func, const heliRegs *regs)
+{
+  uint32_t ifield;
+
+  for(ifield = 0; ifield < HELI_NREGFIELDS; ifield++)
+    if(heliFieldValid(func, ifield, heliFieldGet(regs, ifield)) < 0)
+      return -1;
+
+  return 0;
+}
+
+
+/* Fill the capabilities for a firmware date (all 0 if unreadable) */
+static void
+heliCapsLookup(heliCaps_t *caps, uint8_t month, uint8_t day, uint8_t year)
+{
+  uint32_t date = year * 10000 + month * 100 + day, ient, ifield, use = 0;
+
+  for(ient = 0; ient < HELI_NELEM(heliCapsTable); ient++)
+    if((date == 0) || (heliCapsTable[ient].date <= date))
+      use = ient;
+
+  caps->month = month;
+  caps->day = day;
+  caps->year = year;
+  for(ifield = 0; ifield < HELI_NREGFIELDS; ifield++)
+    caps->valid[ifield] = heliCapsTable[use].valid[ifield];
+}
+
+#ifndef VXWORKS
+/*
+ * Map the device lock of the module at a24_addr, creating it if this is
+ * the first process.  Return NULL if it cannot be shared: the library
+ * then serializes only the threads of this process.
+ */
+static heliDevLockShm *
+heliDevLockOpen(uint32_t a24_addr)
+{
+  heliDevLockShm *shm;
+  pthread_mutexattr_t attr;
+  struct stat st;
+  char path[64];
+  int fd, created = 0, itry;
+
+  snprintf(path, sizeof(path), HELI_DEVLOCK_PATH, a24_addr);
+
+  fd = open(path, O_RDWR | O_CREAT | O_EXCL, HELI_DEVLOCK_MODE);
+  if(fd >= 0)
+    {
+      const char *group = getenv(HELI_DEVLOCK_GROUP_ENV);
+      struct group *gr = (group != NULL) ? getgrnam(group) : NULL;
+
+      created = 1;
+      if((group != NULL) && ((gr == NULL) || (fchown(fd, -1, gr->gr_gid) != 0)))
+	printf("%s: WARNING: Unable to give %s to group %s\n", __func__, path, group);
+
+      /* Every member of the group may open it, whatever the umask */
+      if((fchmod(fd, HELI_DEVLOCK_MODE) != 0) || (ftruncate(fd, sizeof(*shm)) != 0))
+	{
+	  close(fd);
+	  unlink(path);
+	  fd = -1;
+	}
+    }
+  else if(errno == EEXIST)
+    {
+      fd = open(path, O_RDWR);
+      for(itry = 0; (fd >= 0) && (itry < 100); itry++)
+	{
+	  if((fstat(fd, &st) == 0) && (st.st_size >= (off_t) sizeof(*shm)))
+	    break;
+	  usleep(10000);
+	}
+      if((fd >= 0) && (itry == 100))
+	{
+	  close(fd);
+	  fd = -1;
+	}
+    }
+
+  if(fd < 0)
+    {
+      printf("%s: WARNING: Unable to open %s, the lock is not shared with other processes\n",
+	     __func__, path);
+      return NULL;
+    }
+
+  shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(shm == MAP_FAILED)
+    {
+      printf("%s: WARNING: Unable to map %s, the lock is not shared with other processes\n",
+	     __func__, path);
+      return NULL;
+    }
+
+  if(created)
+    {
+      pthread_mutexattr_init(&attr);
+      pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+      pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+      pthread_mutex_init(&shm->mutex, &attr);
+      pthread_mutexattr_destroy(&attr);
+      shm->magic = HELI_DEVLOCK_MAGIC;
+      __atomic_store_n(&shm->ready, 1, __ATOMIC_RELEASE);
+    }
+  else
+    {
+      for(itry = 0; itry < 100; itry++)
+	{
+	  if(__atomic_load_n(&shm->ready, __ATOMIC_ACQUIRE))
+	    break;
+	  usleep(10000);
+	}
+      if((itry == 100) || (shm->magic != HELI_DEVLOCK_MAGIC))
+	{
+	  printf("%s: WARNING: %s is not a valid lock (remove it), the lock is not shared with other processes\n",
+		 __func__, path);
+	  munmap(shm, sizeof(*shm));
+	  return NULL;
+	}
+    }
+
+  return shm;
+}
+
+static void
+heliDevLockClose(heliDevLockShm *shm)
+{
+  if(shm)
+    munmap(shm, sizeof(*shm));
+}
+
+/* Take the device lock.  Recover it from an owner that died holding it.
+   Return -1, not holding the lock, if it cannot be taken. */
+static int32_t
+heliDevLock()
+{
+  int rval;
+
+  if(hl.devLock == NULL)
+    return 0;
+
+  rval = pthread_mutex_lock(&hl.devLock->mutex);
+  if(rval == EOWNERDEAD)
+    {
+      hl.devLock->recoveries++;
+      printf("%s: WARNING: Previous owner died holding the device lock, recovered\n",
+	     __func__);
+      pthread_mutex_consistent(&hl.devLock->mutex);
+    }
+  else if(rval != 0)
+    {
+      HELI_ERR("pthread_mutex_lock: %s (remove the lock in /dev/shm once no process uses the module)\n",
+	       strerror(rval));
+      return -1;
+    }
+
+  return 0;
+}
+
+static void
+heliDevUnlock()
+{
+  if(hl.devLock)
+    pthread_mutex_unlock(&hl.devLock->mutex);
+}
+
+/* Log every register write to the audit log named by HELI_AUDIT_LOG */
+static void
+heliAuditInit()
+{
+  const char *path = getenv("HELI_AUDIT_LOG");
+
+  if((path == NULL) || (hl.audit != NULL))
+    return;
+
+  hl.audit = heliAuditOpen(path, 0);
+  if((hl.audit == NULL) || (heliAuditAttach(hl.audit) != 0))
+    {
+      printf("%s: WARNING: Register writes are not logged to %s\n", __func__, path);
+      if(hl.audit)
+	heliAuditClose(hl.audit);
+      hl.audit = NULL;
+    }
+}
+#else
+#define heliAuditInit()
+#define heliDevLockOpen(_addr) NULL
+#define heliDevLockClose(_shm)
+#define heliDevLock() 0
+#define heliDevUnlock()
+#endif
 
 /**
  * @brief Initialize Helicity Generator Library
- * @details Initialize Helicity Generator Library
+ * @details Initialize Helicity Generator Library.  Multi-register
+ *          sequences are serialized with the other processes using the
+ *          module by a robust lock in /dev/shm/heliLib-{a24_addr}.lock, so
+ *          callers need not hold vmeBusLock.  The process that creates the
+ *          lock gives it mode HELI_DEVLOCK_MODE (0660), and the group named
+ *          by the HELI_DEVLOCK_GROUP environment variable if set: every
+ *          process using the module must belong to that group.
+ *          If the HELI_AUDIT_LOG environment variable names an audit log
+ *          (heliAudit.h), every register write is logged to it.
  * @param[in] a24_addr VME A24 of the Helicity Generator (0xa00000)
  * @param[in] init_flag Initialization bit mask
  *             value  what
@@ -126,6 +473,7 @@ heliInit(uint32_t a24_addr, uint16_t init_flag)
   if(res != 0)
     {
       printf("%s: ERROR in vmeBusToLocalAdrs(0x39,0x%x,&laddr) \n", __func__, a24_addr);
+      HUNLOCK;
       return (ERROR);
     }
 
@@ -150,9 +498,36 @@ heliInit(uint32_t a24_addr, uint16_t init_flag)
   /* Map the device pointer to the module registers */
   hl.dev = (volatile heliRegs *) laddr;
 
+  /* Share the lock of multi-register sequences with the other processes */
+  heliDevLockClose(hl.devLock);
+  hl.devLock = heliDevLockOpen(a24_addr);
+
+  /* Read the firmware date once, and keep its capabilities */
+  uint8_t month = 0, day = 0, year = 0;
+  if((vmeMemProbe((char *) &hl.dev->day, 1, (char *) &day) < 0) ||
+     (vmeMemProbe((char *) &hl.dev->year, 1, (char *) &year) < 0))
+    {
+      printf("%s: WARNING: Unable to read firmware date, allowing every selection\n",
+	     __func__);
+      day = year = 0;
+    }
+  else
+    {
+      /* month times out on some boards: read it as heliStatus does, not probed */
+      month = vmeRead8(&hl.dev->month) & HELI_MONTH_MASK;
+      day &= HELI_DAY_MASK;
+      year &= HELI_YEAR_MASK;
+    }
+  heliCapsLookup(&hl.caps, month, day, year);
+
+  HELI_DBG("firmware %02d/%02d/%02d\n", month, day, year);
+
   hl.initialized = 1;
 
   HUNLOCK;
+
+  heliAuditInit();
+
   return 0;
 }
 
@@ -181,7 +556,7 @@ heliStatus(int32_t print_regs)
   }
   if(print_regs)
     {
-      HLOCK;
+      HLOCKDEV;
       READHELI(month);
       READHELI(day);
       READHELI(year);
@@ -191,7 +566,7 @@ heliStatus(int32_t print_regs)
       READHELI(pattern);
       READHELI(clock);
       READHELI(state);
-      HUNLOCK;
+      HUNLOCKDEV;
 
       printf("\n");
       PREG(month);
@@ -299,6 +674,50 @@ heliGetDebug()
   return rval;
 }
 
+/**
+ * @brief Set the register write hook
+ * @details Set a function to be called after each register write by the
+ *          library, with the library mutex held.  The hook must not call
+ *          back into the library.
+ * @param[in] hook Function to call (NULL to remove)
+ * @param[in] arg Argument passed to the hook
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliSetWriteHook(heliWriteHook_t hook, void *arg)
+{
+  HLOCK;
+  hl.writeHook = hook;
+  hl.writeHookArg = arg;
+  HUNLOCK;
+
+  return 0;
+}
+
+/**
+ * @brief Remove a register write hook
+ * @details Remove the register write hook, only if it is hook with arg.
+ * @param[in] hook Function set by heliSetWriteHook
+ * @param[in] arg Argument set with it
+ * @return 0 if successful, otherwise -1 (another hook is set)
+ */
+int32_t
+heliRemoveWriteHook(heliWriteHook_t hook, void *arg)
+{
+  int32_t rval = -1;
+
+  HLOCK;
+  if((hl.writeHook == hook) && (hl.writeHookArg == arg))
+    {
+      hl.writeHook = NULL;
+      hl.writeHookArg = NULL;
+      rval = 0;
+    }
+  HUNLOCK;
+
+  return rval;
+}
+
 /**
  * @brief Set helicity generator registers
  * @details Set the values directly to helicity generator registers
@@ -345,14 +764,24 @@ heliSetRegisters(uint8_t TSETTLEin, uint8_t TSTABLEin, uint8_t DELAYin,
       return ERROR;
     }
 
-
-  HLOCK;
-  vmeWrite8(&hl.dev->tsettle, TSETTLEin);
-  vmeWrite8(&hl.dev->tstable, TSTABLEin);
-  vmeWrite8(&hl.dev->delay, DELAYin);
-  vmeWrite8(&hl.dev->pattern, PATTERNin);
-  vmeWrite8(&hl.dev->clock, CLOCKin);
-  HUNLOCK;
+  heliRegs regs;
+  memset(&regs, 0, sizeof(regs));
+  regs.tsettle = TSETTLEin;
+  regs.tstable = TSTABLEin;
+  regs.delay = DELAYin;
+  regs.pattern = PATTERNin;
+  regs.clock = CLOCKin;
+  if(heliRegsValid(__func__, &regs) < 0)
+    return ERROR;
+
+
+  HLOCKDEV;
+  HWRITE(tsettle, TSETTLEin);
+  HWRITE(tstable, TSTABLEin);
+  HWRITE(delay, DELAYin);
+  HWRITE(pattern, PATTERNin);
+  HWRITE(clock, CLOCKin);
+  HUNLOCKDEV;
 
   return 0;
 }
@@ -373,12 +802,248 @@ heliGetRegisters(uint8_t *TSETTLEout, uint8_t *TSTABLEout, uint8_t *DELAYout,
 {
   CHECKHELI;
 
-  HLOCK;
+  HLOCKDEV;
   *TSETTLEout = vmeRead8(&hl.dev->tsettle) & HELI_TSETTLE_MASK;
   *TSTABLEout = vmeRead8(&hl.dev->tstable) & HELI_TSTABLE_MASK;
   *DELAYout = vmeRead8(&hl.dev->delay) & HELI_DELAY_MASK;
   *PATTERNout = vmeRead8(&hl.dev->pattern) & HELI_PATTERN_MASK;
   *CLOCKout = vmeRead8(&hl.dev->clock) & HELI_CLOCK_MASK;
+  HUNLOCKDEV;
+
+  return 0;
+}
+
+/**
+ * @brief Read all helicity generator registers at once
+ * @details Read the firmware date, sequencer state and configuration
+ *          registers into a local copy of the register map.
+ * @param[out] snapshot Local copy of the register map
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliGetRegisterSnapshot(heliRegs *snapshot)
+{
+  CHECKHELI;
+
+  if(snapshot == NULL)
+    {
+      HELI_ERR("Invalid snapshot pointer\n");
+      return -1;
+    }
+
+  HLOCKDEV;
+  snapshot->month   = vmeRead8(&hl.dev->month) & HELI_MONTH_MASK;
+  snapshot->day     = vmeRead8(&hl.dev->day) & HELI_DAY_MASK;
+  snapshot->year    = vmeRead8(&hl.dev->year) & HELI_YEAR_MASK;
+  snapshot->state   = vmeRead8(&hl.dev->state) & HELI_STATE_MASK;
+  snapshot->reset   = 0;
+  snapshot->tsettle = vmeRead8(&hl.dev->tsettle) & HELI_TSETTLE_MASK;
+  snapshot->tstable = vmeRead8(&hl.dev->tstable) & HELI_TSTABLE_MASK;
+  snapshot->delay   = vmeRead8(&hl.dev->delay) & HELI_DELAY_MASK;
+  snapshot->pattern = vmeRead8(&hl.dev->pattern) & HELI_PATTERN_MASK;
+  snapshot->clock   = vmeRead8(&hl.dev->clock) & HELI_CLOCK_MASK;
+  HUNLOCKDEV;
+
+  return 0;
+}
+
+/**
+ * @brief Read selected registers at once
+ * @details Read the registers selected by regMask, under one lock, into
+ *          the same offsets of a local copy of the register map.  Other
+ *          registers of the copy are not changed.
+ * @param[in] regMask Registers to read (HELI_REG_BIT, within HELI_REGS_READABLE)
+ * @param[inout] regs Local copy of the register map
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliReadRegisters(uint16_t regMask, heliRegs *regs)
+{
+  volatile uint8_t *dev, *copy = (volatile uint8_t *) regs;
+  uint32_t ireg;
+  CHECKHELI;
+
+  if(regMask & ~HELI_REGS_READABLE)
+    {
+      HELI_ERR("Invalid regMask (0x%x)\n", regMask);
+      return -1;
+    }
+
+  HLOCKDEV;
+  dev = (volatile uint8_t *) hl.dev;
+  for(ireg = 0; ireg < sizeof(heliRegs); ireg++)
+    if(regMask & (1 << ireg))
+      copy[ireg] = vmeRead8(&dev[ireg]);
+  HUNLOCKDEV;
+
+  return 0;
+}
+
+/*
+ * Write field selections, merged per register: one write per register,
+ * and one read of a register only when the fields do not cover all of
+ * its bits.  All under one lock.  Writes are reported to the hook as
+ * made by func.
+ */
+static int32_t
+heliWriteFields(const char *func, const heliFieldValue_t *values, uint32_t nvalues)
+{
+  uint8_t bits[sizeof(heliRegs)], cover[sizeof(heliRegs)];
+  uint16_t regMask = 0;
+  uint32_t ival, ireg;
+
+  memset(bits, 0, sizeof(bits));
+  memset(cover, 0, sizeof(cover));
+
+  for(ival = 0; ival < nvalues; ival++)
+    {
+      const heliField_t *f;
+      uint8_t mask;
+
+      if(heliFieldValid(func, values[ival].field, values[ival].value) < 0)
+	return -1;
+
+      f = &heliFields[values[ival].field];
+      mask = ((1 << f->width) - 1) << f->shift;
+      bits[f->reg] = (bits[f->reg] & ~mask) | (values[ival].value << f->shift);
+      cover[f->reg] |= mask;
+      regMask |= (1 << f->reg);
+    }
+
+  HLOCKDEV;
+  for(ireg = 0; ireg < sizeof(heliRegs); ireg++)
+    {
+      if(!(regMask & (1 << ireg)))
+	continue;
+
+      if(cover[ireg] != heliRegMasks[ireg])
+	bits[ireg] |= vmeRead8(&((volatile uint8_t *) hl.dev)[ireg]) & ~cover[ireg];
+
+      HWRITEOFF(func, ireg, bits[ireg]);
+    }
+  HUNLOCKDEV;
+
+  return 0;
+}
+
+/**
+ * @brief Get the descriptor of a register field
+ * @param[in] field Register field
+ * @return Descriptor if field is valid, otherwise NULL
+ */
+const heliField_t *
+heliGetField(heliFieldId_t field)
+{
+  if((uint32_t) field >= HELI_NREGFIELDS)
+    return NULL;
+
+  return &heliFields[field];
+}
+
+/**
+ * @brief Check a register field selection
+ * @details Check a selection against the range of the field.  Does not
+ *          access the module.
+ * @param[in] field Register field
+ * @param[in] value Selection
+ * @return 0 if valid, otherwise -1
+ */
+int32_t
+heliFieldCheck(heliFieldId_t field, uint32_t value)
+{
+  return heliFieldValid(__func__, field, value);
+}
+
+/**
+ * @brief Get a field selection from a local copy of the register map
+ * @param[in] regs Local copy of the register map
+ * @param[in] field Register field
+ * @return Selection
+ */
+uint32_t
+heliFieldGet(const heliRegs *regs, heliFieldId_t field)
+{
+  const heliField_t *f = &heliFields[field];
+
+  return (((const volatile uint8_t *) regs)[f->reg] >> f->shift) & ((1 << f->width) - 1);
+}
+
+/**
+ * @brief Set a field selection in a local copy of the register map
+ * @param[inout] regs Local copy of the register map
+ * @param[in] field Register field
+ * @param[in] value Selection
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliFieldSet(heliRegs *regs, heliFieldId_t field, uint32_t value)
+{
+  const heliField_t *f;
+  volatile uint8_t *reg;
+  uint8_t mask;
+
+  if(heliFieldValid(__func__, field, value) < 0)
+    return -1;
+
+  f = &heliFields[field];
+  mask = ((1 << f->width) - 1) << f->shift;
+  reg = &((volatile uint8_t *) regs)[f->reg];
+  *reg = (*reg & ~mask) | (value << f->shift);
+
+  return 0;
+}
+
+/**
+ * @brief Set several register fields at once
+ * @details Validate all selections first, then write them with one write
+ *          per register.  Fields sharing a register (mode and board clock
+ *          in clock) are merged into one read-modify-write.
+ * @param[in] values Field selections
+ * @param[in] nvalues Number of selections
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliSetFields(const heliFieldValue_t *values, uint32_t nvalues)
+{
+  CHECKHELI;
+
+  return heliWriteFields(__func__, values, nvalues);
+}
+
+/**
+ * @brief Get the firmware capabilities
+ * @details Get the supported selections, looked up from the firmware
+ *          date when the library was initialized.  Does not access the
+ *          module.
+ * @param[out] caps Firmware capabilities
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliGetCapabilities(heliCaps_t *caps)
+{
+  CHECKHELI;
+
+  HLOCK;
+  *caps = hl.caps;
+  HUNLOCK;
+
+  return 0;
+}
+
+/**
+ * @brief Get the number of device lock recoveries
+ * @details Count of processes that died holding the device lock shared
+ *          by the processes using the module.  Does not access the module.
+ * @param[out] recoveries Recoveries since the lock was created, 0 if not shared
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliGetLockRecoveries(uint64_t *recoveries)
+{
+  CHECKHELI;
+
+  HLOCK;
+  *recoveries = (hl.devLock) ? hl.devLock->recoveries : 0;
   HUNLOCK;
 
   return 0;
@@ -413,22 +1078,13 @@ heliPrintModeSelections()
  * @return 0 if successful, otherwise -1
  */
 int32_t
-heliSelectMode(uint32_t CLOCKs)
+heliSelectMode(heliMode_t CLOCKs)
 {
+  heliFieldValue_t fv = { HELI_REGFIELD_MODE, CLOCKs };
   CHECKHELI;
 
-  if(CLOCKs > 3)
-    {
-      HELI_ERR("Invalid CLOCKs (%d)\n", CLOCKs);
-      return -1;
-    }
-
-  HLOCK;
-  uint8_t masked = vmeRead8(&hl.dev->clock) & ~HELI_HELICITY_CLOCK_MASK; /* Keep the any other settings (BOARDCLOCKd) */
-  vmeWrite8(&hl.dev->clock, CLOCKs | masked);
-  HUNLOCK;
-
-  return 0;
+  /* Keeps the other settings of the clock register (BOARDCLOCKd) */
+  return heliWriteFields(__func__, &fv, 1);
 }
 
 /**
@@ -463,7 +1119,9 @@ heliPrintHelicityPatternSelections()
   printf("  Index   Pattern\n");
   int32_t i;
   for(i = 0; i < 11; i++)
-    printf("     %2d   %s\n", i, sPatternVals[i]);
+    printf("     %2d   %s%s\n", i, sPatternVals[i],
+	   (hl.initialized && !(hl.caps.valid[HELI_REGFIELD_PATTERN] & (1u << i))) ?
+	   "   (not supported by firmware)" : "");
 }
 
 /**
@@ -484,21 +1142,12 @@ heliPrintHelicityPatternSelections()
  * @return 0 if successful, otherwise -1
  */
 int32_t
-heliSelectHelicityPattern(uint32_t PATTERNs)
+heliSelectHelicityPattern(heliPattern_t PATTERNs)
 {
+  heliFieldValue_t fv = { HELI_REGFIELD_PATTERN, PATTERNs };
   CHECKHELI;
 
-  if(PATTERNs > 10)
-    {
-      HELI_ERR("Invalid PATTERNs (%d)\n", PATTERNs);
-      return -1;
-    }
-
-  HLOCK;
-  vmeWrite8(&hl.dev->pattern, PATTERNs);
-  HUNLOCK;
-
-  return 0;
+  return heliWriteFields(__func__, &fv, 1);
 }
 
 /**
@@ -568,21 +1217,12 @@ heliPrintReportingDelaySelections()
  * @return 0 if successful, otherwise -1
  */
 int32_t
-heliSelectReportingDelay(uint32_t DELAYs)
+heliSelectReportingDelay(heliDelay_t DELAYs)
 {
+  heliFieldValue_t fv = { HELI_REGFIELD_DELAY, DELAYs };
   CHECKHELI;
 
-  if(DELAYs > 10)
-    {
-      HELI_ERR("Invalid DELAYs (%d)\n", DELAYs);
-      return -1;
-    }
-
-  HLOCK;
-  vmeWrite8(&hl.dev->delay, DELAYs);
-  HUNLOCK;
-
-  return 0;
+  return heliWriteFields(__func__, &fv, 1);
 }
 
 /**
@@ -604,6 +1244,42 @@ heliGetReportingDelay(uint32_t *DELAYd)
   return 0;
 }
 
+/**
+ * @brief Calculate the timing parameters of the TSettle signal
+ * @details Calculate the timing parameters of the TSettle signal from
+ *          register values.  Does not access the module.
+ * @param[in] CLOCKin CLOCK register value
+ * @param[in] TSETTLEin TSETTLE register value
+ * @param[in] TSTABLEin TSTABLE register value
+ * @param[out] fTSettleVal TSettle [usec]
+ * @param[out] fTStableVal TStable [usec]
+ * @param[out] fFreq TSettle Frequency (Hz)
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliCalcHelicityTiming(uint8_t CLOCKin, uint8_t TSETTLEin, uint8_t TSTABLEin,
+		       double *fTSettleVal, double *fTStableVal, double *fFreq)
+{
+  uint8_t iClock = CLOCKin & HELI_HELICITY_CLOCK_MASK;
+
+  /* get tsettle time */
+  *fTSettleVal = fTSettleVals[TSETTLEin & HELI_TSETTLE_MASK];
+
+  /* get tstable time and frequency */
+  if(fClockVals[iClock] > 0)
+    {
+      *fFreq = fClockVals[iClock];
+      *fTStableVal = ((1.0 / *fFreq) * 1000000.0) - *fTSettleVal;
+    }
+  else	/* free clock */
+    {
+      *fTStableVal = fTStableVals[TSTABLEin & HELI_TSTABLE_MASK];
+      *fFreq = (1.0 / (*fTSettleVal + *fTStableVal)) * 1000000.0;
+    }
+
+  return 0;
+}
+
 /**
  * @brief Get the timing parameters of the TSettle signal
  * @details Get the timing parameters of the TSettle signal
@@ -619,41 +1295,14 @@ heliGetHelcityTiming(double *fTSettleReadbackVal, double *fTStableReadbackVal, d
 
   uint8_t iClockReadback, iTSettleReadback, iTStableReadback;
 
-  HLOCK;
+  HLOCKDEV;
   iClockReadback = vmeRead8(&hl.dev->clock) & HELI_HELICITY_CLOCK_MASK;
   iTSettleReadback = vmeRead8(&hl.dev->tsettle) & HELI_TSETTLE_MASK;
   iTStableReadback = vmeRead8(&hl.dev->tstable) & HELI_TSTABLE_MASK;
+  HUNLOCKDEV;
 
-  /* get tsettle time */
-  *fTSettleReadbackVal = fTSettleVals[iTSettleReadback];
-
-  /* get tstable time and frequency */
-  switch (iClockReadback)
-    {
-    case 0:
-      *fFreqReadback = 30.0;
-      *fTStableReadbackVal = ((1.0 / *fFreqReadback) * 1000000.0) - *fTSettleReadbackVal;
-      break;
-
-    case 1:
-      *fFreqReadback = 120.0;
-      *fTStableReadbackVal = ((1.0 / *fFreqReadback) * 1000000.0) - *fTSettleReadbackVal;
-      break;
-
-    case 2:
-      *fFreqReadback = 240.0;
-      *fTStableReadbackVal = ((1.0 / *fFreqReadback) * 1000000.0) - *fTSettleReadbackVal;
-      break;
-
-    default:	/* free clock */
-      *fTStableReadbackVal = fTStableVals[iTStableReadback];
-      *fFreqReadback = (1.0 / (*fTSettleReadbackVal + *fTStableReadbackVal)) * 1000000.0;
-      break;
-    }
-
-  HUNLOCK;
-
-  return 0;
+  return heliCalcHelicityTiming(iClockReadback, iTSettleReadback, iTStableReadback,
+				fTSettleReadbackVal, fTStableReadbackVal, fFreqReadback);
 }
 
 /**
@@ -714,21 +1363,12 @@ heliPrintTSettleSelections()
  * @return 0 if successful, otherwise -1
  */
 int32_t
-heliSelectTSettle(uint8_t TSETTLEs)
+heliSelectTSettle(heliTSettle_t TSETTLEs)
 {
+  heliFieldValue_t fv = { HELI_REGFIELD_TSETTLE, TSETTLEs };
   CHECKHELI;
 
-  if(TSETTLEs > 31)
-    {
-      HELI_ERR("Invalid TSETTLEs (%d)\n", TSETTLEs);
-      return -1;
-    }
-
-  HLOCK;
-  vmeWrite8(&hl.dev->tsettle, TSETTLEs);
-  HUNLOCK;
-
-  return 0;
+  return heliWriteFields(__func__, &fv, 1);
 }
 
 /**
@@ -789,21 +1429,12 @@ heliPrintTStableSelections()
  * @return 0 if successful, otherwise -1
  */
 int32_t
-heliSelectTStable(uint8_t TSTABLEs)
+heliSelectTStable(heliTStable_t TSTABLEs)
 {
+  heliFieldValue_t fv = { HELI_REGFIELD_TSTABLE, TSTABLEs };
   CHECKHELI;
 
-  if(TSTABLEs > 31)
-    {
-      HELI_ERR("Invalid TSTABLEs (%d)\n", TSTABLEs);
-      return -1;
-    }
-
-  HLOCK;
-  vmeWrite8(&hl.dev->tstable, TSTABLEs);
-  HUNLOCK;
-
-  return 0;
+  return heliWriteFields(__func__, &fv, 1);
 }
 
 /**
@@ -850,25 +1481,12 @@ heliPrintBoardClockSelections()
  * @return 0 if successful, otherwise -1
  */
 int32_t
-heliSelectBoardClock(uint8_t BOARDCLOCKs)
+heliSelectBoardClock(heliBoardClock_t BOARDCLOCKs)
 {
+  heliFieldValue_t fv = { HELI_REGFIELD_BOARDCLOCK, BOARDCLOCKs };
   CHECKHELI;
 
-  if(BOARDCLOCKs > 1)
-    {
-      HELI_ERR("Invalid BOARDCLOCKs (%d)\n",
-	       BOARDCLOCKs);
-      return -1;
-    }
-
-  HLOCK;
-  if(BOARDCLOCKs)
-    vmeWrite8(&hl.dev->clock, vmeRead8(&hl.dev->clock) | HELI_BOARDCLOCK_10MHZ);
-  else
-    vmeWrite8(&hl.dev->clock, vmeRead8(&hl.dev->clock) & ~HELI_BOARDCLOCK_10MHZ);
-  HUNLOCK;
-
-  return 0;
+  return heliWriteFields(__func__, &fv, 1);
 }
 
 /**
@@ -902,10 +1520,11 @@ heliGetFirmwareDate(uint8_t *DAY, uint8_t *MONTH, uint8_t *YEAR)
 {
   CHECKHELI;
 
+  /* Read once, at heliInit */
   HLOCK;
-  *DAY = vmeRead8(&hl.dev->day) & HELI_DAY_MASK;
-  *MONTH = vmeRead8(&hl.dev->month) & HELI_MONTH_MASK;
-  *YEAR = vmeRead8(&hl.dev->year) & HELI_YEAR_MASK;
+  *DAY = hl.caps.day;
+  *MONTH = hl.caps.month;
+  *YEAR = hl.caps.year;
   HUNLOCK;
 
   return 0;
@@ -926,7 +1545,7 @@ heliSetReset(uint8_t RESETs)
   RESETs = (RESETs) ? 1 : 0;
 
   HLOCK;
-  vmeWrite8(&hl.dev->reset, RESETs);
+  HWRITE(reset, RESETs);
   HUNLOCK;
 
   return 0;
@@ -967,3 +1586,250 @@ heliGetSequencerState(uint8_t *STATUSin)
 
   return 0;
 }
+
+/**
+ * @brief Read the sequencer state, without locking
+ * @details One read of the bus, for readout lists, where a lock per
+ *          trigger costs too much.  Does not print an error if the
+ *          library is not initialized.  @see heliGetSequencerState
+ * @return Sequencer state if successful, otherwise -1
+ */
+int32_t
+heliReadSequencerState(void)
+{
+  if(hl.initialized == 0)
+    return -1;
+
+  return vmeRead8(&hl.dev->state) & HELI_STATE_MASK;
+}
+
+/**
+ * @brief Read the configuration registers
+ * @details Read the configuration registers, under one lock
+ * @param[out] cfg Configuration register values
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliGetConfig(heliConfig_t *cfg)
+{
+  CHECKHELI;
+
+  HLOCKDEV;
+  cfg->tsettle = vmeRead8(&hl.dev->tsettle) & HELI_TSETTLE_MASK;
+  cfg->tstable = vmeRead8(&hl.dev->tstable) & HELI_TSTABLE_MASK;
+  cfg->delay   = vmeRead8(&hl.dev->delay) & HELI_DELAY_MASK;
+  cfg->pattern = vmeRead8(&hl.dev->pattern) & HELI_PATTERN_MASK;
+  cfg->clock   = vmeRead8(&hl.dev->clock) & HELI_CLOCK_MASK;
+  HUNLOCKDEV;
+
+  return 0;
+}
+
+/**
+ * @brief Apply a configuration
+ * @details Read the configuration registers, write only those that differ
+ *          from cfg, and read back the written registers to verify them.
+ *          All under one lock.
+ * @param[in] cfg Configuration register values
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliApplyConfig(const heliConfig_t *cfg)
+{
+  heliConfig_t cur, rb;
+  heliRegs regs;
+  int32_t rval = 0, nwritten = 0;
+  CHECKHELI;
+
+  if((cfg->tsettle > HELI_TSETTLE_MASK) || (cfg->tstable > HELI_TSTABLE_MASK) ||
+     (cfg->delay > HELI_DELAY_MASK) ||
+     (cfg->pattern > heliFields[HELI_REGFIELD_PATTERN].max))
+    {
+      HELI_ERR("Invalid configuration (0x%x 0x%x 0x%x 0x%x 0x%x)\n",
+	       cfg->tsettle, cfg->tstable, cfg->delay, cfg->pattern, cfg->clock);
+      return -1;
+    }
+
+  memset(&regs, 0, sizeof(regs));
+  regs.tsettle = cfg->tsettle;
+  regs.tstable = cfg->tstable;
+  regs.delay = cfg->delay;
+  regs.pattern = cfg->pattern;
+  regs.clock = cfg->clock;
+  if(heliRegsValid(__func__, &regs) < 0)
+    return -1;
+
+  HLOCKDEV;
+  cur.tsettle = vmeRead8(&hl.dev->tsettle) & HELI_TSETTLE_MASK;
+  cur.tstable = vmeRead8(&hl.dev->tstable) & HELI_TSTABLE_MASK;
+  cur.delay   = vmeRead8(&hl.dev->delay) & HELI_DELAY_MASK;
+  cur.pattern = vmeRead8(&hl.dev->pattern) & HELI_PATTERN_MASK;
+  cur.clock   = vmeRead8(&hl.dev->clock) & HELI_CLOCK_MASK;
+
+  rb = cur;
+
+#define APPLYREG(_reg) {						\
+    if(cur._reg != cfg->_reg)						\
+      {									\
+	HWRITE(_reg, cfg->_reg);					\
+	nwritten++;							\
+      }									\
+  }
+  APPLYREG(tsettle);
+  APPLYREG(tstable);
+  APPLYREG(delay);
+  APPLYREG(pattern);
+  APPLYREG(clock);
+
+  /* Read back only what was written */
+#define READBACKREG(_reg, _mask) {					\
+    if(cur._reg != cfg->_reg)						\
+      rb._reg = vmeRead8(&hl.dev->_reg) & _mask;			\
+  }
+  READBACKREG(tsettle, HELI_TSETTLE_MASK);
+  READBACKREG(tstable, HELI_TSTABLE_MASK);
+  READBACKREG(delay, HELI_DELAY_MASK);
+  READBACKREG(pattern, HELI_PATTERN_MASK);
+  READBACKREG(clock, HELI_CLOCK_MASK);
+  HUNLOCKDEV;
+
+  HELI_DBG("%d registers written\n", nwritten);
+
+  if(memcmp(&rb, cfg, sizeof(rb)) != 0)
+    {
+      HELI_ERR("Readback (0x%x 0x%x 0x%x 0x%x 0x%x) does not match\n",
+	       rb.tsettle, rb.tstable, rb.delay, rb.pattern, rb.clock);
+      rval = -1;
+    }
+
+  return rval;
+}
+
+/* CRC-32 (IEEE 802.3) */
+static uint32_t
+heliCrc32(const uint8_t *buf, uint32_t len)
+{
+  uint32_t crc = 0xFFFFFFFF, i, bit;
+
+  for(i = 0; i < len; i++)
+    {
+      crc ^= buf[i];
+      for(bit = 0; bit < 8; bit++)
+	crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+
+  return ~crc;
+}
+
+/*
+ * Saved configuration file, 15 bytes:
+ *   magic[4], version, nregs, tsettle, tstable, delay, pattern, clock,
+ *   CRC-32 of the preceding bytes (little endian)
+ */
+#define HELI_CONFIG_NREGS 5
+#define HELI_CONFIG_SIZE  (6 + HELI_CONFIG_NREGS + 4)
+
+/**
+ * @brief Save the configuration to a file
+ * @details Read the configuration registers and write them to a file,
+ *          with a version and a checksum.  @see heliLoadConfig
+ * @param[in] path Name of the file
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliSaveConfig(const char *path)
+{
+  heliConfig_t cfg;
+  uint8_t buf[HELI_CONFIG_SIZE];
+  uint32_t crc;
+  size_t n;
+  FILE *f;
+
+  if(heliGetConfig(&cfg) < 0)
+    return -1;
+
+  memcpy(buf, HELI_CONFIG_MAGIC, 4);
+  buf[4] = HELI_CONFIG_VERSION;
+  buf[5] = HELI_CONFIG_NREGS;
+  buf[6] = cfg.tsettle;
+  buf[7] = cfg.tstable;
+  buf[8] = cfg.delay;
+  buf[9] = cfg.pattern;
+  buf[10] = cfg.clock;
+
+  crc = heliCrc32(buf, HELI_CONFIG_SIZE - 4);
+  buf[11] = crc & 0xff;
+  buf[12] = (crc >> 8) & 0xff;
+  buf[13] = (crc >> 16) & 0xff;
+  buf[14] = (crc >> 24) & 0xff;
+
+  f = fopen(path, "wb");
+  if(f == NULL)
+    {
+      HELI_ERR("Unable to open %s\n", path);
+      return -1;
+    }
+
+  n = fwrite(buf, 1, sizeof(buf), f);
+  if((fclose(f) != 0) || (n != sizeof(buf)))
+    {
+      HELI_ERR("Unable to write %s\n", path);
+      return -1;
+    }
+
+  return 0;
+}
+
+/**
+ * @brief Load a configuration from a file
+ * @details Read and check a configuration saved by heliSaveConfig.  The
+ *          module is not accessed.  @see heliApplyConfig
+ * @param[in] path Name of the file
+ * @param[out] cfg Configuration register values
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliLoadConfig(const char *path, heliConfig_t *cfg)
+{
+  uint8_t buf[HELI_CONFIG_SIZE + 1];
+  uint32_t crc;
+  size_t n;
+  FILE *f;
+
+  f = fopen(path, "rb");
+  if(f == NULL)
+    {
+      HELI_ERR("Unable to open %s\n", path);
+      return -1;
+    }
+
+  n = fread(buf, 1, sizeof(buf), f);
+  fclose(f);
+
+  if((n != HELI_CONFIG_SIZE) || (memcmp(buf, HELI_CONFIG_MAGIC, 4) != 0))
+    {
+      HELI_ERR("%s is not a saved configuration\n", path);
+      return -1;
+    }
+
+  if((buf[4] != HELI_CONFIG_VERSION) || (buf[5] != HELI_CONFIG_NREGS))
+    {
+      HELI_ERR("%s: unsupported version (%d)\n", path, buf[4]);
+      return -1;
+    }
+
+  crc = buf[11] | (buf[12] << 8) | (buf[13] << 16) | ((uint32_t) buf[14] << 24);
+  if(crc != heliCrc32(buf, HELI_CONFIG_SIZE - 4))
+    {
+      HELI_ERR("%s: checksum error\n", path);
+      return -1;
+    }
+
+  cfg->tsettle = buf[6];
+  cfg->tstable = buf[7];
+  cfg->delay   = buf[8];
+  cfg->pattern = buf[9];
+  cfg->clock   = buf[10];
+
+  return 0;
+}
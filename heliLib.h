@@ -13,6 +13,7 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
 
 #define HELI_INIT_DEBUG (0 << 1)
 
@@ -50,44 +51,193 @@ typedef struct
 #define HELI_RESET_MASK          0x01
 #define HELI_STATE_MASK          0xff
 
+/* Register bits for heliReadRegisters: bit n is the register at offset n */
+#define HELI_REG_BIT(_reg)       (1 << offsetof(heliRegs, _reg))
+#define HELI_REGS_FIRMWARE       (HELI_REG_BIT(month) | HELI_REG_BIT(day) | HELI_REG_BIT(year))
+#define HELI_REGS_CONFIG         (HELI_REG_BIT(tsettle) | HELI_REG_BIT(tstable) | \
+				  HELI_REG_BIT(delay) | HELI_REG_BIT(pattern) | HELI_REG_BIT(clock))
+#define HELI_REGS_READABLE       (HELI_REGS_FIRMWARE | HELI_REG_BIT(state) | HELI_REGS_CONFIG)
+
+/* Selections */
+typedef enum
+  {
+    HELI_MODE_LINESYNC_30  = 0,
+    HELI_MODE_LINESYNC_120 = 1,
+    HELI_MODE_LINESYNC_240 = 2,
+    HELI_MODE_FREE_CLOCK   = 3
+  } heliMode_t;
+
+typedef enum
+  {
+    HELI_PATTERN_PAIR          = 0,
+    HELI_PATTERN_QUARTET       = 1,
+    HELI_PATTERN_OCTET         = 2,
+    HELI_PATTERN_TOGGLE        = 3,
+    HELI_PATTERN_HEXO_QUAD     = 4,
+    HELI_PATTERN_OCTO_QUAD     = 5,
+    HELI_PATTERN_SPARE6        = 6,
+    HELI_PATTERN_SPARE7        = 7,
+    HELI_PATTERN_THUE_MORSE_64 = 8,
+    HELI_PATTERN_16_QUAD       = 9,
+    HELI_PATTERN_32_PAIR       = 10
+  } heliPattern_t;
+
+typedef enum
+  {
+    HELI_DELAY_0   = 0,  HELI_DELAY_1   = 1,  HELI_DELAY_2   = 2,  HELI_DELAY_4   = 3,
+    HELI_DELAY_8   = 4,  HELI_DELAY_16  = 5,  HELI_DELAY_24  = 6,  HELI_DELAY_32  = 7,
+    HELI_DELAY_40  = 8,  HELI_DELAY_48  = 9,  HELI_DELAY_64  = 10, HELI_DELAY_72  = 11,
+    HELI_DELAY_96  = 12, HELI_DELAY_112 = 13, HELI_DELAY_128 = 14, HELI_DELAY_256 = 15
+  } heliDelay_t;
+
+typedef enum
+  {
+    HELI_BOARDCLOCK_SELECT_20MHZ = 0,
+    HELI_BOARDCLOCK_SELECT_10MHZ = 1
+  } heliBoardClock_t;
+
+typedef enum
+  {
+    HELI_TSETTLE_5US = 0,     HELI_TSETTLE_10US = 1,    HELI_TSETTLE_15US = 2,    HELI_TSETTLE_20US = 3,
+    HELI_TSETTLE_25US = 4,    HELI_TSETTLE_30US = 5,    HELI_TSETTLE_35US = 6,    HELI_TSETTLE_40US = 7,
+    HELI_TSETTLE_45US = 8,    HELI_TSETTLE_50US = 9,    HELI_TSETTLE_60US = 10,   HELI_TSETTLE_70US = 11,
+    HELI_TSETTLE_80US = 12,   HELI_TSETTLE_90US = 13,   HELI_TSETTLE_100US = 14,  HELI_TSETTLE_110US = 15,
+    HELI_TSETTLE_120US = 16,  HELI_TSETTLE_130US = 17,  HELI_TSETTLE_140US = 18,  HELI_TSETTLE_150US = 19,
+    HELI_TSETTLE_160US = 20,  HELI_TSETTLE_170US = 21,  HELI_TSETTLE_180US = 22,  HELI_TSETTLE_190US = 23,
+    HELI_TSETTLE_200US = 24,  HELI_TSETTLE_250US = 25,  HELI_TSETTLE_300US = 26,  HELI_TSETTLE_350US = 27,
+    HELI_TSETTLE_400US = 28,  HELI_TSETTLE_450US = 29,  HELI_TSETTLE_500US = 30,  HELI_TSETTLE_1000US = 31
+  } heliTSettle_t;
+
+typedef enum
+  {
+    HELI_TSTABLE_240_40US = 0,   HELI_TSTABLE_245_40US = 1,   HELI_TSTABLE_250_40US = 2,
+    HELI_TSTABLE_255_40US = 3,   HELI_TSTABLE_470_85US = 4,   HELI_TSTABLE_475_85US = 5,
+    HELI_TSTABLE_480_85US = 6,   HELI_TSTABLE_485_85US = 7,   HELI_TSTABLE_490_85US = 8,
+    HELI_TSTABLE_495_85US = 9,   HELI_TSTABLE_500_85US = 10,  HELI_TSTABLE_505_85US = 11,
+    HELI_TSTABLE_510_85US = 12,  HELI_TSTABLE_515_85US = 13,  HELI_TSTABLE_900US = 14,
+    HELI_TSTABLE_971_65US = 15,  HELI_TSTABLE_1000US = 16,    HELI_TSTABLE_1001_65US = 17,
+    HELI_TSTABLE_1318_90US = 18, HELI_TSTABLE_1348_90US = 19, HELI_TSTABLE_2000US = 20,
+    HELI_TSTABLE_3000US = 21,    HELI_TSTABLE_4066_65US = 22, HELI_TSTABLE_5000US = 23,
+    HELI_TSTABLE_6000US = 24,    HELI_TSTABLE_7000US = 25,    HELI_TSTABLE_8233_35US = 26,
+    HELI_TSTABLE_8243_35US = 27, HELI_TSTABLE_16567US = 28,   HELI_TSTABLE_16667US = 29,
+    HELI_TSTABLE_33230US = 30,   HELI_TSTABLE_33330US = 31
+  } heliTStable_t;
+
+/* Register fields.  Several fields may share one register (clock). */
+typedef enum
+  {
+    HELI_REGFIELD_MODE = 0,
+    HELI_REGFIELD_BOARDCLOCK,
+    HELI_REGFIELD_PATTERN,
+    HELI_REGFIELD_DELAY,
+    HELI_REGFIELD_TSETTLE,
+    HELI_REGFIELD_TSTABLE,
+    HELI_NREGFIELDS
+  } heliFieldId_t;
+
+typedef struct
+{
+  const char *name;
+  uint8_t  reg;               /* Register offset in heliRegs */
+  uint8_t  shift;             /* Lowest bit of the field */
+  uint8_t  width;             /* Bits */
+  uint8_t  max;               /* Largest valid selection */
+} heliField_t;
+
+typedef struct
+{
+  heliFieldId_t field;
+  uint32_t value;             /* Selection: heliMode_t, heliPattern_t, ... by field */
+} heliFieldValue_t;
+
+/* Firmware capabilities, looked up from the firmware date at heliInit */
+typedef struct
+{
+  uint8_t  month, day, year;  /* Firmware date, 0 if unreadable */
+  uint32_t valid[HELI_NREGFIELDS]; /* Supported selections, bit n = selection n */
+} heliCaps_t;
+
+/* Board output signals, as recorded for each helicity window */
+#define HELI_WINDOW_HELICITY     (1 << 0) /* Reported (delayed) helicity */
+#define HELI_WINDOW_PATTERN_SYNC (1 << 1) /* First window of a pattern */
+#define HELI_WINDOW_PAIR_SYNC    (1 << 2) /* First window of a pair */
+#define HELI_WINDOW_TSETTLE      (1 << 3) /* T_settle */
+#define HELI_WINDOW_NSIGNALS     4
+
+/* Configuration register values */
+typedef struct
+{
+  uint8_t tsettle;
+  uint8_t tstable;
+  uint8_t delay;
+  uint8_t pattern;
+  uint8_t clock;
+} heliConfig_t;
+
+/* Saved configuration file */
+#define HELI_CONFIG_MAGIC   "HCFG"
+#define HELI_CONFIG_VERSION 1
+
+/* Called after each register write, with the register offset in heliRegs */
+typedef void (*heliWriteHook_t)(void *arg, const char *func, uint8_t reg, uint8_t value);
+
 
 int32_t heliInit(uint32_t a24_addr, uint16_t init_flag);
 int32_t heliStatus(int32_t print_regs);
 
 int32_t heliSetDebug(uint8_t debug_set);
 int32_t heliGetDebug();
+int32_t heliSetWriteHook(heliWriteHook_t hook, void *arg);
+int32_t heliRemoveWriteHook(heliWriteHook_t hook, void *arg);
 
 int32_t heliSetRegisters(uint8_t TSETTLEin, uint8_t TSTABLEin, uint8_t DELAYin,
 			 uint8_t PATTERNin, uint8_t CLOCKin);
 int32_t heliGetRegisters(uint8_t *TSETTLEout, uint8_t *TSTABLEout, uint8_t *DELAYout,
 			 uint8_t *PATTERNout, uint8_t *CLOCKout);
+int32_t heliGetRegisterSnapshot(heliRegs *snapshot);
+int32_t heliReadRegisters(uint16_t regMask, heliRegs *regs);
+
+const heliField_t *heliGetField(heliFieldId_t field);
+int32_t heliFieldCheck(heliFieldId_t field, uint32_t value);
+uint32_t heliFieldGet(const heliRegs *regs, heliFieldId_t field);
+int32_t heliFieldSet(heliRegs *regs, heliFieldId_t field, uint32_t value);
+int32_t heliSetFields(const heliFieldValue_t *values, uint32_t nvalues);
+int32_t heliGetCapabilities(heliCaps_t *caps);
+int32_t heliGetLockRecoveries(uint64_t *recoveries);
+
+int32_t heliGetConfig(heliConfig_t *cfg);
+int32_t heliApplyConfig(const heliConfig_t *cfg);
+int32_t heliSaveConfig(const char *path);
+int32_t heliLoadConfig(const char *path, heliConfig_t *cfg);
 
 void heliPrintModeSelections();
-int32_t heliSelectMode(uint32_t CLOCKs);
+int32_t heliSelectMode(heliMode_t CLOCKs);
 int32_t heliGetMode(uint32_t *CLOCKd);
 
 void heliPrintHelicityPatternSelections();
-int32_t heliSelectHelicityPattern(uint32_t PATTERNs);
+int32_t heliSelectHelicityPattern(heliPattern_t PATTERNs);
 int32_t heliGetHelicityPattern(uint32_t *PATTERNd);
 
 void heliPrintReportingDelaySelections();
-int32_t heliSelectReportingDelay(uint32_t DELAYs);
+int32_t heliSelectReportingDelay(heliDelay_t DELAYs);
 int32_t heliGetReportingDelay(uint32_t *DELAYd);
 
+int32_t heliCalcHelicityTiming(uint8_t CLOCKin, uint8_t TSETTLEin, uint8_t TSTABLEin,
+			       double *fTSettleVal, double *fTStableVal, double *fFreq);
 int32_t heliGetHelcityTiming(double *fTSettleReadbackVal,
 			     double *fTStableReadbackVal, double *fFreqReadback);
 int32_t heliGetHelicityBoardFrequency(double *FREQ);
 
 void heliPrintTSettleSelections();
-int32_t heliSelectTSettle(uint8_t TSETTLEs);
+int32_t heliSelectTSettle(heliTSettle_t TSETTLEs);
 int32_t heliGetTSettle(double *TSETTLEd);
 
 void heliPrintTStableSelections();
-int32_t heliSelectTStable(uint8_t TSTABLEs);
+int32_t heliSelectTStable(heliTStable_t TSTABLEs);
 int32_t heliGetTStable(double *TSTABLEd);
 
 void heliPrintBoardClockSelections();
-int32_t heliSelectBoardClock(uint8_t BOARDCLOCKs);
+int32_t heliSelectBoardClock(heliBoardClock_t BOARDCLOCKs);
 int32_t heliGetBoardClock(double *BOARDCLOCKd);
 
 int32_t heliGetFirmwareDate(uint8_t *DAY, uint8_t *MONTH, uint8_t *YEAR);
@@ -96,3 +246,4 @@ int32_t heliSetReset(uint8_t RESETs);
 int32_t heliReset();
 
 int32_t heliGetSequencerState(uint8_t *STATUSin);
+int32_t heliReadSequencerState(void);
@@ -0,0 +1,636 @@
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Prometheus metrics exporter
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include "heliMetrics.h"
+#include "heliNotify.h"
+#include "heliPrivate.h"
+
+#define METRICS_REQUEST 2048
+
+static struct
+{
+  pthread_mutex_t mutex;      /* Start, stop, and stats */
+  int32_t  running;
+  pthread_t thread;
+  int      listenFd;
+  int      wakeFd[2];         /* Pipe waking the thread to stop */
+  char     unixPath[108];     /* Unlinked at stop */
+  uint32_t refreshMs;
+  heliMetricsStats_t stats;
+
+  /* Exporter thread only */
+  heliRegs regs;              /* Cached snapshot */
+  int32_t  up;                /* Last snapshot read */
+  uint64_t snapTime;          /* Time of the last snapshot [ns, CLOCK_MONOTONIC] */
+  uint64_t stateChanges;      /* Sequencer state changes between snapshots */
+  int32_t  stalled;           /* Sequencer state unchanged since the last snapshot */
+  char     request[METRICS_REQUEST];
+  char     head[128];
+  char     body[HELI_METRICS_MAX_BODY];
+} ml =
+  {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .listenFd = -1,
+    .wakeFd = { -1, -1 }
+  };
+
+static inline uint64_t
+metricsNow()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Up to nine decimals, trailing zeros dropped */
+static void
+mDouble(heliOut_t *o, double v)
+{
+  uint64_t ipart, frac;
+  int32_t ndig = 9;
+
+  if(v < 0)
+    {
+      heliOutChar(o, '-');
+      v = -v;
+    }
+
+  ipart = (uint64_t) v;
+  frac = (uint64_t) ((v - ipart) * 1e9 + 0.5);
+  if(frac >= 1000000000ULL)
+    {
+      ipart++;
+      frac -= 1000000000ULL;
+    }
+
+  heliOutUint(o, ipart);
+  if(frac == 0)
+    return;
+
+  while((frac % 10) == 0)
+    {
+      frac /= 10;
+      ndig--;
+    }
+
+  heliOutChar(o, '.');
+  {
+    char tmp[9];
+    int32_t i;
+    for(i = ndig - 1; i >= 0; i--)
+      {
+	tmp[i] = '0' + (frac % 10);
+	frac /= 10;
+      }
+    for(i = 0; i < ndig; i++)
+      heliOutChar(o, tmp[i]);
+  }
+}
+
+/* Label value, with quotes and backslashes escaped */
+static void
+mLabel(heliOut_t *o, const char *s)
+{
+  heliOutChar(o, '"');
+  for(; *s; s++)
+    {
+      if((*s == '"') || (*s == '\\'))
+	heliOutChar(o, '\\');
+      heliOutChar(o, *s);
+    }
+  heliOutChar(o, '"');
+}
+
+static void
+mHelp(heliOut_t *o, const char *name, const char *type, const char *help)
+{
+  heliOutStr(o, "# HELP ");
+  heliOutStr(o, name);
+  heliOutChar(o, ' ');
+  heliOutStr(o, help);
+  heliOutStr(o, "\n# TYPE ");
+  heliOutStr(o, name);
+  heliOutChar(o, ' ');
+  heliOutStr(o, type);
+  heliOutChar(o, '\n');
+}
+
+static void
+mGauge(heliOut_t *o, const char *name, const char *help, double v)
+{
+  mHelp(o, name, "gauge", help);
+  heliOutStr(o, name);
+  heliOutChar(o, ' ');
+  mDouble(o, v);
+  heliOutChar(o, '\n');
+}
+
+static void
+mCounter(heliOut_t *o, const char *name, const char *help, uint64_t v)
+{
+  mHelp(o, name, "counter", help);
+  heliOutStr(o, name);
+  heliOutChar(o, ' ');
+  heliOutUint(o, v);
+  heliOutChar(o, '\n');
+}
+
+/* Render the metrics from the cached snapshot.  Return the length. */
+static uint32_t
+metricsRender(char *buf, uint32_t size)
+{
+  heliOut_t out = { buf, size, 0 }, *o = &out;
+  const heliRegs *r = &ml.regs;
+  heliNotifyStats_t nstats;
+  heliMetricsStats_t stats;
+  uint64_t recoveries = 0;
+  double tsettle, tstable, freq;
+  uint8_t mode = r->clock & HELI_HELICITY_CLOCK_MASK;
+  uint8_t pattern = r->pattern & HELI_PATTERN_MASK;
+
+  heliNotifyGetStats(&nstats);
+  heliGetLockRecoveries(&recoveries);
+  pthread_mutex_lock(&ml.mutex);
+  stats = ml.stats;
+  pthread_mutex_unlock(&ml.mutex);
+
+  mGauge(o, "heli_up", "Whether the last register snapshot was read", ml.up);
+  mGauge(o, "heli_snapshot_age_seconds", "Age of the register snapshot",
+	 (ml.snapTime) ? (metricsNow() - ml.snapTime) * 1e-9 : 0);
+
+  if(ml.snapTime)
+    {
+      heliCalcHelicityTiming(r->clock, r->tsettle, r->tstable, &tsettle, &tstable, &freq);
+
+      mGauge(o, "heli_mode", "Helicity clock mode selection", mode);
+      mGauge(o, "heli_mode_linesync_hz", "Line sync frequency of the mode, -1 for free clock",
+	     fClockVals[mode]);
+      mGauge(o, "heli_helicity_frequency_hz", "Helicity window frequency", freq);
+      mGauge(o, "heli_tsettle_seconds", "TSettle time", tsettle * 1e-6);
+      mGauge(o, "heli_tstable_seconds", "TStable time", tstable * 1e-6);
+      mGauge(o, "heli_reporting_delay_windows", "Reporting delay",
+	     iDelayVals[r->delay & HELI_DELAY_MASK]);
+      mGauge(o, "heli_board_clock_mhz", "Board clock output",
+	     fBoardClockValues[(r->clock & HELI_BOARDCLOCK_10MHZ) ? 1 : 0]);
+
+      mHelp(o, "heli_pattern", "gauge", "Helicity pattern selection");
+      heliOutStr(o, "heli_pattern{name=");
+      mLabel(o, (pattern < 11) ? sPatternVals[pattern] : "unknown");
+      heliOutStr(o, "} ");
+      heliOutUint(o, pattern);
+      heliOutChar(o, '\n');
+
+      mGauge(o, "heli_sequencer_state", "Sequencer state register", r->state);
+      mCounter(o, "heli_sequencer_state_changes_total",
+	       "Sequencer state changes seen between snapshots", ml.stateChanges);
+      mGauge(o, "heli_sequencer_stalled",
+	     "Whether the sequencer state did not change since the previous snapshot",
+	     ml.stalled);
+
+      mHelp(o, "heli_firmware_info", "gauge", "Firmware date");
+      heliOutStr(o, "heli_firmware_info{date=\"");
+      heliOutChar(o, '0' + (r->month / 10) % 10);
+      heliOutChar(o, '0' + r->month % 10);
+      heliOutChar(o, '/');
+      heliOutChar(o, '0' + (r->day / 10) % 10);
+      heliOutChar(o, '0' + r->day % 10);
+      heliOutChar(o, '/');
+      heliOutChar(o, '0' + (r->year / 10) % 10);
+      heliOutChar(o, '0' + r->year % 10);
+      heliOutStr(o, "\"} 1\n");
+    }
+
+  mCounter(o, "heli_lock_recoveries_total",
+	   "Processes that died holding the device lock", recoveries);
+  mCounter(o, "heli_notify_polls_total", "Register change notification polls", nstats.polls);
+  mCounter(o, "heli_notify_reads_total", "Register reads by the notification poller",
+	   nstats.reads);
+  mCounter(o, "heli_notify_events_total", "Register change events queued", nstats.events);
+  mCounter(o, "heli_notify_dropped_total", "Register change events dropped", nstats.dropped);
+  mCounter(o, "heli_exporter_refreshes_total", "Register snapshots read by the exporter",
+	   stats.refreshes);
+  mCounter(o, "heli_exporter_refresh_errors_total", "Register snapshots failed",
+	   stats.refreshErrors);
+  mGauge(o, "heli_exporter_refresh_seconds", "Duration of the last snapshot",
+	 stats.refreshNs * 1e-9);
+  mGauge(o, "heli_exporter_render_seconds", "Duration of the previous render",
+	 stats.renderNs * 1e-9);
+  mCounter(o, "heli_exporter_scrapes_total", "Scrapes answered", stats.scrapes);
+  mCounter(o, "heli_exporter_bad_requests_total", "Requests refused or timed out",
+	   stats.badRequests);
+
+  return out.len;
+}
+
+/* Read a new snapshot */
+static void
+metricsRefresh()
+{
+  heliRegs regs;
+  uint64_t t0 = metricsNow(), t1;
+  int32_t stat = heliGetRegisterSnapshot(&regs);
+
+  t1 = metricsNow();
+
+  if(stat == 0)
+    {
+      if(ml.snapTime)
+	{
+	  ml.stalled = (regs.state == ml.regs.state);
+	  if(!ml.stalled)
+	    ml.stateChanges++;
+	}
+      ml.regs = regs;
+      ml.snapTime = t1;
+    }
+  ml.up = (stat == 0);
+
+  pthread_mutex_lock(&ml.mutex);
+  ml.stats.refreshes++;
+  if(stat != 0)
+    ml.stats.refreshErrors++;
+  ml.stats.refreshNs = t1 - t0;
+  pthread_mutex_unlock(&ml.mutex);
+}
+
+/* Wait for fd to be ready, until the deadline.  Return -1 on timeout */
+static int32_t
+metricsWait(int fd, short events, uint64_t deadline)
+{
+  struct pollfd pfd = { fd, events, 0 };
+  uint64_t now;
+
+  while((now = metricsNow()) < deadline)
+    {
+      int n = poll(&pfd, 1, (deadline - now + 999999) / 1000000);
+      if(n > 0)
+	return 0;
+      if((n < 0) && (errno != EINTR))
+	return -1;
+    }
+
+  return -1;
+}
+
+static int32_t
+metricsWriteAll(int fd, struct iovec *iov, int32_t niov, uint64_t deadline)
+{
+  while(niov)
+    {
+      if(metricsWait(fd, POLLOUT, deadline) < 0)
+	return -1;
+
+      ssize_t n = writev(fd, iov, niov);
+      if((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)))
+	continue;
+      if(n <= 0)
+	return -1;
+
+      while(niov && ((size_t) n >= iov->iov_len))
+	{
+	  n -= iov->iov_len;
+	  iov++;
+	  niov--;
+	}
+      if(niov)
+	{
+	  iov->iov_base = (char *) iov->iov_base + n;
+	  iov->iov_len -= n;
+	}
+    }
+
+  return 0;
+}
+
+/* Answer one client */
+static void
+metricsServe(int fd)
+{
+  static const char notFound[] =
+    "HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: 10\r\n"
+    "Connection: close\r\n\r\nnot found\n";
+  struct iovec iov[2];
+  uint32_t len = 0, blen;
+  uint64_t t0, deadline;
+  heliOut_t head;
+  int32_t ok = 0;
+
+  /* One deadline for the whole request, so a slow client cannot hold the
+     thread by trickling bytes */
+  deadline = metricsNow() + HELI_METRICS_IO_TIMEOUT_MS * 1000000ULL;
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+  /* Read the request head */
+  while(len < sizeof(ml.request) - 1)
+    {
+      if(metricsWait(fd, POLLIN, deadline) < 0)
+	break;
+
+      ssize_t n = read(fd, &ml.request[len], sizeof(ml.request) - 1 - len);
+      if((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)))
+	continue;
+      if(n <= 0)
+	break;
+      len += n;
+      ml.request[len] = 0;
+      if(strstr(ml.request, "\r\n\r\n") || strstr(ml.request, "\n\n"))
+	{
+	  ok = 1;
+	  break;
+	}
+    }
+
+  if(ok && ((strncmp(ml.request, "GET /metrics ", 13) == 0) ||
+	    (strncmp(ml.request, "GET / ", 6) == 0)))
+    {
+      t0 = metricsNow();
+      blen = metricsRender(ml.body, sizeof(ml.body));
+      if(blen > sizeof(ml.body))
+	blen = sizeof(ml.body);
+
+      head.buf = ml.head;
+      head.size = sizeof(ml.head);
+      head.len = 0;
+      heliOutStr(&head, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+	   "Content-Length: ");
+      heliOutUint(&head, blen);
+      heliOutStr(&head, "\r\nConnection: close\r\n\r\n");
+
+      iov[0].iov_base = ml.head;
+      iov[0].iov_len = head.len;
+      iov[1].iov_base = ml.body;
+      iov[1].iov_len = blen;
+      ok = (metricsWriteAll(fd, iov, 2, deadline) == 0);
+
+      pthread_mutex_lock(&ml.mutex);
+      ml.stats.renderNs = metricsNow() - t0;
+      if(ok)
+	ml.stats.scrapes++;
+      else
+	ml.stats.badRequests++;
+      pthread_mutex_unlock(&ml.mutex);
+    }
+  else
+    {
+      if(ok)
+	{
+	  iov[0].iov_base = (void *) notFound;
+	  iov[0].iov_len = sizeof(notFound) - 1;
+	  metricsWriteAll(fd, iov, 1, deadline);
+	}
+
+      pthread_mutex_lock(&ml.mutex);
+      ml.stats.badRequests++;
+      pthread_mutex_unlock(&ml.mutex);
+    }
+}
+
+static void *
+metricsThread(void *arg)
+{
+  struct pollfd pfd[2];
+  uint64_t next = metricsNow(), now;
+  int timeout, fd;
+
+  pfd[0].fd = ml.listenFd;
+  pfd[0].events = POLLIN;
+  pfd[1].fd = ml.wakeFd[0];
+  pfd[1].events = POLLIN;
+
+  while(1)
+    {
+      now = metricsNow();
+      if(now >= next)
+	{
+	  metricsRefresh();
+	  next += ml.refreshMs * 1000000ULL;
+	  now = metricsNow();
+	  if(next <= now)
+	    next = now + ml.refreshMs * 1000000ULL;
+	}
+
+      timeout = (int) ((next - now) / 1000000ULL) + 1;
+      if(poll(pfd, 2, timeout) <= 0)
+	continue;
+
+      if(pfd[1].revents)
+	break;
+
+      if(pfd[0].revents & POLLIN)
+	{
+	  fd = accept(ml.listenFd, NULL, NULL);
+	  if(fd >= 0)
+	    {
+	      metricsServe(fd);
+	      close(fd);
+	    }
+	}
+    }
+
+  return NULL;
+}
+
+/* Open the listening socket: "unix:{path}", or "{host}:{port}" */
+static int
+metricsListen(const char *address)
+{
+  int fd = -1, one = 1;
+
+  ml.unixPath[0] = 0;
+
+  if(strncmp(address, "unix:", 5) == 0)
+    {
+      struct sockaddr_un addr;
+
+      memset(&addr, 0, sizeof(addr));
+      addr.sun_family = AF_UNIX;
+      if(strlen(address + 5) >= sizeof(addr.sun_path))
+	{
+	  HELI_ERR("Invalid socket path (%s)\n", address + 5);
+	  return -1;
+	}
+      strcpy(addr.sun_path, address + 5);
+      unlink(addr.sun_path);
+
+      fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if((fd >= 0) && (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0))
+	strcpy(ml.unixPath, addr.sun_path);
+      else if(fd >= 0)
+	{
+	  close(fd);
+	  fd = -1;
+	}
+    }
+  else
+    {
+      struct addrinfo hints, *res;
+      char host[256];
+      const char *port = strrchr(address, ':');
+
+      if((port == NULL) || ((size_t) (port - address) >= sizeof(host)))
+	{
+	  HELI_ERR("Invalid listen address (%s)\n", address);
+	  return -1;
+	}
+      memcpy(host, address, port - address);
+      host[port - address] = 0;
+
+      memset(&hints, 0, sizeof(hints));
+      hints.ai_family = AF_UNSPEC;
+      hints.ai_socktype = SOCK_STREAM;
+      if(getaddrinfo(host, port + 1, &hints, &res) != 0)
+	{
+	  HELI_ERR("Unable to resolve %s\n", address);
+	  return -1;
+	}
+
+      fd = socket(res->ai_family, res->ai_socktype | SOCK_CLOEXEC, res->ai_protocol);
+      if(fd >= 0)
+	{
+	  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	  if(bind(fd, res->ai_addr, res->ai_addrlen) != 0)
+	    {
+	      close(fd);
+	      fd = -1;
+	    }
+	}
+      freeaddrinfo(res);
+    }
+
+  if((fd < 0) || (listen(fd, 16) != 0))
+    {
+      HELI_ERR("Unable to listen on %s\n", address);
+      if(fd >= 0)
+	close(fd);
+      return -1;
+    }
+
+  return fd;
+}
+
+/**
+ * @brief Start the metrics exporter
+ * @details The library must be initialized.  A TCP address should be a
+ *          loopback address: the exporter has no access control.
+ * @param[in] address "{host}:{port}" or "unix:{path}"
+ *            (NULL for HELI_METRICS_DEFAULT_LISTEN)
+ * @param[in] refreshMs Register snapshot interval [ms]
+ *            (0 for HELI_METRICS_DEFAULT_REFRESH_MS)
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliMetricsStart(const char *address, uint32_t refreshMs)
+{
+  int32_t rval = -1;
+
+  pthread_mutex_lock(&ml.mutex);
+
+  if(ml.running)
+    {
+      HELI_ERR("Exporter already running\n");
+      goto DONE;
+    }
+
+  ml.listenFd = metricsListen((address) ? address : HELI_METRICS_DEFAULT_LISTEN);
+  if(ml.listenFd < 0)
+    goto DONE;
+
+  if(pipe(ml.wakeFd) != 0)
+    {
+      HELI_ERR("Unable to create pipe\n");
+      close(ml.listenFd);
+      goto DONE;
+    }
+
+  ml.refreshMs = (refreshMs) ? refreshMs : HELI_METRICS_DEFAULT_REFRESH_MS;
+  memset(&ml.stats, 0, sizeof(ml.stats));
+  ml.snapTime = 0;
+  ml.up = 0;
+  ml.stateChanges = 0;
+  ml.stalled = 0;
+
+  if(pthread_create(&ml.thread, NULL, metricsThread, NULL) != 0)
+    {
+      HELI_ERR("Unable to start exporter thread\n");
+      close(ml.listenFd);
+      close(ml.wakeFd[0]);
+      close(ml.wakeFd[1]);
+      goto DONE;
+    }
+
+  ml.running = 1;
+  rval = 0;
+
+ DONE:
+  pthread_mutex_unlock(&ml.mutex);
+
+  return rval;
+}
+
+/**
+ * @brief Stop the metrics exporter
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliMetricsStop()
+{
+  pthread_mutex_lock(&ml.mutex);
+  if(!ml.running)
+    {
+      pthread_mutex_unlock(&ml.mutex);
+      return 0;
+    }
+  ml.running = 0;
+  pthread_mutex_unlock(&ml.mutex);
+
+  if(write(ml.wakeFd[1], "", 1) != 1)
+    HELI_ERR("Unable to wake the exporter thread\n");
+  pthread_join(ml.thread, NULL);
+
+  close(ml.listenFd);
+  close(ml.wakeFd[0]);
+  close(ml.wakeFd[1]);
+  ml.listenFd = ml.wakeFd[0] = ml.wakeFd[1] = -1;
+  if(ml.unixPath[0])
+    unlink(ml.unixPath);
+
+  return 0;
+}
+
+/**
+ * @brief Return the exporter counters
+ * @param[out] stats Copy of the counters
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliMetricsGetStats(heliMetricsStats_t *stats)
+{
+  pthread_mutex_lock(&ml.mutex);
+  *stats = ml.stats;
+  pthread_mutex_unlock(&ml.mutex);
+
+  return 0;
+}
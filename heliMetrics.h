@@ -0,0 +1,42 @@
+#pragma once
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Header for the Prometheus metrics exporter
+ *
+ *   One exporter thread reads a register snapshot every refresh interval,
+ *   and answers HTTP GET /metrics on a loopback TCP port or a Unix socket
+ *   with the decoded board state and the library counters, in the
+ *   Prometheus text format.  Scrapes are rendered from the cached snapshot
+ *   into a fixed buffer: they cost no bus cycles and allocate no memory,
+ *   however many scrapers there are.
+ *
+ */
+
+#include <stdint.h>
+#include "heliLib.h"
+
+#define HELI_METRICS_DEFAULT_LISTEN     "127.0.0.1:9108"
+#define HELI_METRICS_DEFAULT_REFRESH_MS 1000
+#define HELI_METRICS_MAX_BODY           8192
+#define HELI_METRICS_IO_TIMEOUT_MS      200 /* Per client request, read and write */
+
+typedef struct
+{
+  uint64_t scrapes;           /* Requests answered with the metrics */
+  uint64_t badRequests;       /* Requests refused or timed out */
+  uint64_t refreshes;         /* Snapshots read */
+  uint64_t refreshErrors;     /* Snapshots failed */
+  uint64_t refreshNs;         /* Duration of the last snapshot [ns] */
+  uint64_t renderNs;          /* Duration of the last render [ns] */
+} heliMetricsStats_t;
+
+int32_t heliMetricsStart(const char *address, uint32_t refreshMs);
+int32_t heliMetricsStop();
+int32_t heliMetricsGetStats(heliMetricsStats_t *stats);
@@ -0,0 +1,349 @@
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Helicity Noise Monte Carlo
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "heliLib.h"
+#include "heliSeq.h"
+#include "heliAsym.h"
+#include "heliNoise.h"
+#include "heliPrivate.h"
+
+/* Windows per chunk: a multiple of every pattern length */
+#define NOISE_CHUNK_WINDOWS (192 * 512)
+
+/* Random number streams */
+enum noiseStream
+  {
+    NOISE_STREAM_HARMONIC = 1,
+    NOISE_STREAM_DRIFT    = 2,
+    NOISE_STREAM_JITTER   = 3,
+    NOISE_STREAM_WHITE    = 4,
+    NOISE_STREAM_SEED     = 5
+  };
+
+typedef struct
+{
+  const heliNoiseModel_t *model;
+  uint32_t pattern;
+  uint32_t seed;              /* Shift register at window 0 */
+  int32_t  lineSync;          /* Window starts locked to the line */
+  double   period;            /* Window period [s] */
+  double   tsettle;           /* TSettle [s] */
+  double   harmOmega[HELI_NOISE_MAX_HARMONICS];
+  double   harmPhase[HELI_NOISE_MAX_HARMONICS];
+  double   driftOmega[HELI_NOISE_DRIFT_TERMS];
+  double   driftPhase[HELI_NOISE_DRIFT_TERMS];
+  double   driftTermAmp;
+  uint64_t nwindows;
+  uint64_t nchunks;
+  uint64_t next;              /* Next chunk to simulate */
+  heliAsymAccum_t *acc;       /* One accumulator per chunk */
+  int32_t  rval;
+} noiseJob;
+
+/* Counter based random number: a hash of (key, stream, counter) */
+static uint64_t
+noiseHash(uint64_t key, uint64_t stream, uint64_t counter)
+{
+  uint64_t z = heliHash64(key ^ (stream * 0xD1B54A32D192ED03ULL), counter);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  return z ^ (z >> 31);
+}
+
+/* Uniform in (0,1) */
+static double
+noiseUniform(uint64_t key, uint64_t stream, uint64_t counter)
+{
+  return heliHashUniform(noiseHash(key, stream, counter));
+}
+
+/* Unit gaussian */
+static double
+noiseGauss(uint64_t key, uint64_t stream, uint64_t counter)
+{
+  double u1 = noiseUniform(key, stream, 2 * counter);
+  double u2 = noiseUniform(key, stream, 2 * counter + 1);
+  return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+/* Average of a*sin(w*t + phi) over [t0,t1] */
+static inline double
+noiseGateAverage(double a, double omega, double phi, double t0, double t1)
+{
+  return a * (cos(omega * t0 + phi) - cos(omega * t1 + phi)) / (omega * (t1 - t0));
+}
+
+/**
+ * @brief Fill a noise model with default values
+ * @details 60 Hz line with four harmonics, 20 usec line jitter, 1/f drift
+ *          from 1 mHz to 10 Hz, and white noise.  Amplitudes are relative
+ *          to the yield.
+ * @param[out] model Noise model
+ */
+void
+heliNoiseDefaultModel(heliNoiseModel_t *model)
+{
+  memset(model, 0, sizeof(*model));
+  model->lineFreq = 60.0;
+  model->nharmonics = 4;
+  model->harmonicAmp[0] = 1e-3;
+  model->harmonicAmp[1] = 5e-4;
+  model->harmonicAmp[2] = 2e-4;
+  model->harmonicAmp[3] = 1e-4;
+  model->lineJitter = 20e-6;
+  model->driftAmp = 1e-3;
+  model->driftFmin = 1e-3;
+  model->driftFmax = 10.0;
+  model->whiteSigma = 1e-4;
+  model->seed = 1;
+}
+
+/* Simulate the windows of one chunk */
+static void
+noiseChunk(noiseJob *job, uint64_t ichunk, uint8_t *windows, double *yields)
+{
+  const heliNoiseModel_t *m = job->model;
+  uint64_t first = ichunk * NOISE_CHUNK_WINDOWS;
+  uint64_t n = (first + NOISE_CHUNK_WINDOWS <= job->nwindows) ?
+    NOISE_CHUNK_WINDOWS : job->nwindows - first;
+  uint64_t iwin;
+  uint32_t i;
+  heliSeq_t seq;
+
+  heliSeqInit(&seq, job->pattern, 0, job->seed, 0);
+  heliSeqSkip(&seq, first);
+  heliSeqGenerate(&seq, windows, n);
+
+  for(iwin = 0; iwin < n; iwin++)
+    {
+      uint64_t k = first + iwin;
+      double start = k * job->period;
+      if(job->lineSync)
+	start += m->lineJitter * noiseGauss(m->seed, NOISE_STREAM_JITTER, k);
+
+      double t0 = start + job->tsettle, t1 = start + job->period;
+      double y = 1.0 + m->whiteSigma * noiseGauss(m->seed, NOISE_STREAM_WHITE, k);
+
+      for(i = 0; i < m->nharmonics; i++)
+	y += noiseGateAverage(m->harmonicAmp[i], job->harmOmega[i], job->harmPhase[i], t0, t1);
+      for(i = 0; i < HELI_NOISE_DRIFT_TERMS; i++)
+	y += noiseGateAverage(job->driftTermAmp, job->driftOmega[i], job->driftPhase[i], t0, t1);
+
+      yields[iwin] = y;
+    }
+
+  heliAsymAccumulate(&job->acc[ichunk], windows, yields, n);
+}
+
+static void *
+noiseThread(void *arg)
+{
+  noiseJob *job = arg;
+  uint8_t *windows = malloc(NOISE_CHUNK_WINDOWS);
+  double *yields = malloc(NOISE_CHUNK_WINDOWS * sizeof(*yields));
+  uint64_t ichunk;
+
+  if((windows == NULL) || (yields == NULL))
+    {
+      HELI_ERR("Unable to allocate memory\n");
+      __atomic_store_n(&job->rval, -1, __ATOMIC_RELAXED);
+    }
+  else
+    {
+      while((ichunk = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->nchunks)
+	noiseChunk(job, ichunk, windows, yields);
+    }
+
+  free(windows);
+  free(yields);
+
+  return NULL;
+}
+
+/**
+ * @brief Simulate the false asymmetry of one configuration
+ * @param[in] model Noise model
+ * @param[in] cfg Board configuration
+ * @param[in] nwindows Number of windows to simulate
+ * @param[in] nthreads Number of threads
+ * @param[out] result Simulated timing and false asymmetry
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliNoiseSimulate(const heliNoiseModel_t *model, const heliNoiseConfig_t *cfg,
+		  uint64_t nwindows, uint32_t nthreads, heliNoiseResult_t *result)
+{
+  noiseJob job;
+  heliAsymAccum_t total;
+  double tsettle, tstable, freq;
+  uint64_t ichunk;
+  uint32_t i, ithr, nstarted = 0;
+
+  if((heliSeqPatternLength(cfg->pattern) < 0) ||
+     (model->nharmonics > HELI_NOISE_MAX_HARMONICS) ||
+     (model->lineFreq <= 0) || (model->driftFmin <= 0) ||
+     (model->driftFmax < model->driftFmin))
+    {
+      HELI_ERR("Invalid noise model or configuration\n");
+      return -1;
+    }
+
+  heliCalcHelicityTiming(cfg->mode, cfg->tsettle, cfg->tstable, &tsettle, &tstable, &freq);
+  if(tstable <= 0)
+    {
+      HELI_ERR("TSettle %.0f usec longer than the window\n", tsettle);
+      return -1;
+    }
+
+  memset(&job, 0, sizeof(job));
+  job.model = model;
+  job.pattern = cfg->pattern;
+  job.seed = (uint32_t) noiseHash(model->seed, NOISE_STREAM_SEED, 0) & HELI_SEQ_SEED_MASK;
+  if(job.seed == 0)
+    job.seed = 1;
+  job.lineSync = ((cfg->mode & HELI_HELICITY_CLOCK_MASK) != 3);
+  /* Line sync windows follow the actual line frequency */
+  job.period = (job.lineSync) ? (60.0 / model->lineFreq) / freq : 1.0 / freq;
+  job.tsettle = tsettle * 1e-6;
+
+  for(i = 0; i < model->nharmonics; i++)
+    {
+      job.harmOmega[i] = 2.0 * M_PI * model->lineFreq * (i + 1);
+      job.harmPhase[i] = 2.0 * M_PI * noiseUniform(model->seed, NOISE_STREAM_HARMONIC, i);
+    }
+
+  /* Equal amplitude per log interval gives a 1/f spectrum */
+  for(i = 0; i < HELI_NOISE_DRIFT_TERMS; i++)
+    {
+      double f = model->driftFmin *
+	pow(model->driftFmax / model->driftFmin, (i + 0.5) / HELI_NOISE_DRIFT_TERMS);
+      job.driftOmega[i] = 2.0 * M_PI * f;
+      job.driftPhase[i] = 2.0 * M_PI * noiseUniform(model->seed, NOISE_STREAM_DRIFT, i);
+    }
+  job.driftTermAmp = model->driftAmp * sqrt(2.0 / HELI_NOISE_DRIFT_TERMS);
+
+  job.nwindows = nwindows;
+  job.nchunks = (nwindows + NOISE_CHUNK_WINDOWS - 1) / NOISE_CHUNK_WINDOWS;
+  job.acc = calloc(job.nchunks ? job.nchunks : 1, sizeof(*job.acc));
+
+  if(nthreads == 0)
+    nthreads = 1;
+  pthread_t *threads = calloc(nthreads, sizeof(*threads));
+
+  if((job.acc == NULL) || (threads == NULL))
+    {
+      HELI_ERR("Unable to allocate memory\n");
+      free(job.acc);
+      free(threads);
+      return -1;
+    }
+
+  for(ichunk = 0; ichunk < job.nchunks; ichunk++)
+    heliAsymInit(&job.acc[ichunk], cfg->pattern);
+
+  for(ithr = 1; ithr < nthreads; ithr++)
+    {
+      if(pthread_create(&threads[nstarted], NULL, noiseThread, &job) != 0)
+	break;
+      nstarted++;
+    }
+
+  noiseThread(&job);
+
+  for(ithr = 0; ithr < nstarted; ithr++)
+    pthread_join(threads[ithr], NULL);
+
+  /* Merge in chunk order, for the same result with any number of threads */
+  heliAsymInit(&total, cfg->pattern);
+  for(ichunk = 0; ichunk < job.nchunks; ichunk++)
+    heliAsymMerge(&total, &job.acc[ichunk]);
+
+  result->frequency = freq;
+  result->tsettle = tsettle;
+  result->tstable = tstable;
+  result->patterns = total.patterns;
+  result->asymMean = total.asym.mean;
+  result->asymWidth = (total.asym.n > 1) ? sqrt(total.asym.m2 / (total.asym.n - 1)) : 0;
+  result->diffWidth = (total.diff.n > 1) ? sqrt(total.diff.m2 / (total.diff.n - 1)) : 0;
+
+  free(job.acc);
+  free(threads);
+
+  return job.rval;
+}
+
+/**
+ * @brief Simulate the false asymmetry of many configurations
+ * @details Simulate every TSettle, for each selected mode and pattern.  In
+ *          free clock mode, every TStable is simulated as well.  Settings
+ *          where TSettle is longer than the window are skipped.
+ * @param[in] model Noise model
+ * @param[in] modeMask Modes to simulate (bit i = mode i)
+ * @param[in] patternMask Patterns to simulate (bit i = pattern i)
+ * @param[in] nwindows Number of windows per configuration
+ * @param[in] nthreads Number of threads
+ * @param[in] callback Function called with each result
+ * @param[in] arg Argument passed to the callback
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliNoiseSweep(const heliNoiseModel_t *model, uint32_t modeMask, uint32_t patternMask,
+	       uint64_t nwindows, uint32_t nthreads,
+	       heliNoiseCallback_t callback, void *arg)
+{
+  heliNoiseConfig_t cfg;
+  heliNoiseResult_t result;
+  uint32_t mode, pattern, tsettle, tstable;
+
+  for(mode = 0; mode < 4; mode++)
+    {
+      if(!(modeMask & (1 << mode)))
+	continue;
+
+      for(pattern = 0; pattern < HELI_SEQ_NPATTERNS; pattern++)
+	{
+	  if(!(patternMask & (1 << pattern)))
+	    continue;
+
+	  for(tsettle = 0; tsettle <= HELI_TSETTLE_MASK; tsettle++)
+	    {
+	      uint32_t ntstable = (mode == 3) ? HELI_TSTABLE_MASK + 1 : 1;
+
+	      for(tstable = 0; tstable < ntstable; tstable++)
+		{
+		  double fsettle, fstable, ffreq;
+
+		  heliCalcHelicityTiming(mode, tsettle, tstable, &fsettle, &fstable, &ffreq);
+		  if(fstable <= 0)
+		    continue;
+
+		  cfg.mode = mode;
+		  cfg.pattern = pattern;
+		  cfg.tsettle = tsettle;
+		  cfg.tstable = tstable;
+
+		  if(heliNoiseSimulate(model, &cfg, nwindows, nthreads, &result) < 0)
+		    return -1;
+
+		  callback(arg, &cfg, &result);
+		}
+	    }
+	}
+    }
+
+  return 0;
+}
@@ -0,0 +1,76 @@
+#pragma once
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Header for the Helicity Noise Monte Carlo
+ *
+ *   The relative yield of each window is 1 plus the noise averaged over
+ *   its T_stable gate.  The noise is the sum of
+ *     - line harmonics, with random phase,
+ *     - 1/f drift, as sinusoids of equal amplitude and random phase at
+ *       log spaced frequencies,
+ *     - white noise, drawn once per window.
+ *   In line sync modes, window starts are locked to the line and smeared
+ *   by the line jitter.  In free clock mode they are not.
+ *
+ *   Window yields go through the helicity sequence of the pattern and the
+ *   pattern asymmetry accumulator (heliAsym).  The width of the pattern
+ *   asymmetry is the false asymmetry width left by the noise.
+ *
+ *   Random numbers are a hash of (seed, stream, counter), so the result
+ *   does not depend on the number of threads.
+ *
+ */
+
+#include <stdint.h>
+
+#define HELI_NOISE_MAX_HARMONICS 16
+#define HELI_NOISE_DRIFT_TERMS   16
+
+typedef struct
+{
+  double   lineFreq;          /* Line frequency [Hz] */
+  uint32_t nharmonics;        /* Line harmonics in the model */
+  double   harmonicAmp[HELI_NOISE_MAX_HARMONICS]; /* Amplitude of each harmonic */
+  double   lineJitter;        /* RMS jitter of line sync window starts [s] */
+  double   driftAmp;          /* RMS amplitude of the 1/f drift */
+  double   driftFmin;         /* Frequency range of the 1/f drift [Hz] */
+  double   driftFmax;
+  double   whiteSigma;        /* RMS white noise per window */
+  uint64_t seed;              /* Random number key */
+} heliNoiseModel_t;
+
+typedef struct
+{
+  uint8_t  mode;              /* Mode index (heliSelectMode) */
+  uint8_t  pattern;           /* Helicity pattern index */
+  uint8_t  tsettle;           /* TSettle index */
+  uint8_t  tstable;           /* TStable index (free clock only) */
+} heliNoiseConfig_t;
+
+typedef struct
+{
+  double   frequency;         /* Window frequency [Hz] */
+  double   tsettle;           /* TSettle [usec] */
+  double   tstable;           /* TStable [usec] */
+  uint64_t patterns;          /* Patterns accumulated */
+  double   asymMean;          /* Mean pattern asymmetry */
+  double   asymWidth;         /* RMS width of the pattern asymmetry */
+  double   diffWidth;         /* RMS width of the pattern difference */
+} heliNoiseResult_t;
+
+typedef void (*heliNoiseCallback_t)(void *arg, const heliNoiseConfig_t *cfg,
+				    const heliNoiseResult_t *result);
+
+void    heliNoiseDefaultModel(heliNoiseModel_t *model);
+int32_t heliNoiseSimulate(const heliNoiseModel_t *model, const heliNoiseConfig_t *cfg,
+			  uint64_t nwindows, uint32_t nthreads, heliNoiseResult_t *result);
+int32_t heliNoiseSweep(const heliNoiseModel_t *model, uint32_t modeMask, uint32_t patternMask,
+		       uint64_t nwindows, uint32_t nthreads,
+		       heliNoiseCallback_t callback, void *arg);
@@ -0,0 +1,517 @@
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Register change notifications with adaptive polling
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "heliNotify.h"
+#include "heliPrivate.h"
+
+#define NOTIFY_QUEUE 64
+
+typedef struct
+{
+  uint32_t events;
+  heliRegs regs;
+} notifyEvent_t;
+
+typedef struct
+{
+  uint32_t mask;              /* 0 when the slot is free */
+  heliNotifyCallback_t callback;
+  void *arg;
+} notifySub_t;
+
+static struct
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t pollCond;    /* Wakes the poller: subscription change, stop */
+  pthread_cond_t eventCond;   /* Wakes the dispatcher: event queued, stop */
+  pthread_cond_t idleCond;    /* Signaled when a dispatch finishes */
+  int32_t running;
+  int32_t stop;
+  pthread_t poller, dispatcher;
+
+  notifySub_t sub[HELI_NOTIFY_MAX_SUBSCRIBERS];
+  uint32_t mask;              /* Union of the subscriber masks */
+  int32_t dispatching;
+
+  notifyEvent_t queue[NOTIFY_QUEUE];
+  uint32_t qhead, qcount;
+
+  uint32_t minMs, maxMs, stallMs;
+  heliNotifyStats_t stats;
+} nl =
+  {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .minMs = HELI_NOTIFY_DEFAULT_MIN_MS,
+    .maxMs = HELI_NOTIFY_DEFAULT_MAX_MS,
+    .stallMs = HELI_NOTIFY_DEFAULT_STALL_MS
+  };
+
+static inline uint64_t
+notifyNowMs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static int
+notifyRegCount(uint16_t regMask)
+{
+  return __builtin_popcount(regMask);
+}
+
+/* Queue an event for the dispatcher.  Called with nl.mutex held. */
+static void
+notifyQueue(uint32_t events, const heliRegs *regs)
+{
+  if(nl.qcount == NOTIFY_QUEUE)
+    {
+      nl.stats.dropped++;
+      return;
+    }
+
+  nl.queue[(nl.qhead + nl.qcount) % NOTIFY_QUEUE].events = events;
+  nl.queue[(nl.qhead + nl.qcount) % NOTIFY_QUEUE].regs = *regs;
+  nl.qcount++;
+  nl.stats.events++;
+  pthread_cond_signal(&nl.eventCond);
+}
+
+static void *
+notifyPoller(void *arg)
+{
+  heliRegs prev, cur;
+  uint64_t now, lastProgress = 0;
+  uint32_t interval, mask = 0, events, npoll = 0;
+  uint16_t regMask;
+  int32_t haveState = 0, haveConfig = 0, haveFirmware = 0, stalled = 0, changed;
+  struct timespec ts;
+
+  memset(&prev, 0, sizeof(prev));
+  memset(&cur, 0, sizeof(cur));
+
+  pthread_mutex_lock(&nl.mutex);
+  interval = nl.minMs;
+
+  while(!nl.stop)
+    {
+      /* No subscribers: no bus reads until one arrives */
+      if(nl.mask == 0)
+	{
+	  haveState = haveConfig = haveFirmware = stalled = 0;
+	  pthread_cond_wait(&nl.pollCond, &nl.mutex);
+	  interval = nl.minMs;
+	  continue;
+	}
+
+      /* Drop what is no longer watched, so it is read fresh as a baseline */
+      if(!(nl.mask & HELI_NOTIFY_CONFIG))
+	haveConfig = 0;
+      if(!(nl.mask & (HELI_NOTIFY_STATE | HELI_NOTIFY_STALL)))
+	haveState = stalled = 0;
+      if(!(nl.mask & HELI_NOTIFY_FIRMWARE))
+	haveFirmware = 0;
+      mask = nl.mask;
+
+      regMask = 0;
+      if(mask & HELI_NOTIFY_CONFIG)
+	regMask |= HELI_REGS_CONFIG;
+      if(mask & (HELI_NOTIFY_STATE | HELI_NOTIFY_STALL))
+	regMask |= HELI_REG_BIT(state);
+      if((mask & HELI_NOTIFY_FIRMWARE) &&
+	 (!haveFirmware || (npoll % HELI_NOTIFY_FIRMWARE_EVERY) == 0))
+	regMask |= HELI_REGS_FIRMWARE;
+      npoll++;
+
+      pthread_mutex_unlock(&nl.mutex);
+      prev = cur;
+      if(heliReadRegisters(regMask, &cur) != 0)
+	regMask = 0;
+      now = notifyNowMs();
+      pthread_mutex_lock(&nl.mutex);
+
+      nl.stats.polls++;
+      nl.stats.reads += notifyRegCount(regMask);
+
+      events = 0;
+      changed = 0;
+
+      if(regMask & HELI_REGS_CONFIG)
+	{
+	  if(haveConfig &&
+	     ((cur.tsettle != prev.tsettle) || (cur.tstable != prev.tstable) ||
+	      (cur.delay != prev.delay) || (cur.pattern != prev.pattern) ||
+	      (cur.clock != prev.clock)))
+	    {
+	      events |= HELI_NOTIFY_CONFIG;
+	      changed = 1;
+	    }
+	  haveConfig = 1;
+	}
+
+      if(regMask & HELI_REGS_FIRMWARE)
+	{
+	  if(haveFirmware &&
+	     ((cur.month != prev.month) || (cur.day != prev.day) ||
+	      (cur.year != prev.year)))
+	    {
+	      events |= HELI_NOTIFY_FIRMWARE;
+	      changed = 1;
+	    }
+	  haveFirmware = 1;
+	}
+
+      if(regMask & HELI_REG_BIT(state))
+	{
+	  if(!haveState || (cur.state != prev.state))
+	    {
+	      if(haveState)
+		events |= HELI_NOTIFY_STATE;
+	      lastProgress = now;
+	      stalled = 0;
+	    }
+	  else if(!stalled && (now - lastProgress >= nl.stallMs))
+	    {
+	      events |= HELI_NOTIFY_STALL;
+	      stalled = 1;
+	      changed = 1;
+	    }
+	  haveState = 1;
+	}
+
+      events &= mask;
+      if(events)
+	notifyQueue(events, &cur);
+
+      /* Next interval.  State progress alone is the steady condition. */
+      if(changed)
+	interval = nl.minMs;
+      else if(haveState && !stalled && (now != lastProgress))
+	{
+	  /* Looks stalled: check often enough to confirm it in time */
+	  uint32_t confirm = nl.stallMs / 4;
+	  if(confirm < nl.minMs)
+	    confirm = nl.minMs;
+	  if(interval > confirm)
+	    interval = confirm;
+	}
+      else
+	{
+	  interval *= 2;
+	  if(interval > nl.maxMs)
+	    interval = nl.maxMs;
+	  if(interval < nl.minMs)
+	    interval = nl.minMs;
+	}
+      nl.stats.intervalMs = interval;
+
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      ts.tv_sec += interval / 1000;
+      ts.tv_nsec += (interval % 1000) * 1000000L;
+      if(ts.tv_nsec >= 1000000000L)
+	{
+	  ts.tv_sec++;
+	  ts.tv_nsec -= 1000000000L;
+	}
+
+      /* A subscription change or stop wakes the poller early */
+      while(!nl.stop && (nl.mask == mask) &&
+	    (pthread_cond_timedwait(&nl.pollCond, &nl.mutex, &ts) == 0))
+	;
+      if(nl.mask != mask)
+	interval = nl.minMs;
+    }
+
+  pthread_mutex_unlock(&nl.mutex);
+
+  return NULL;
+}
+
+static void *
+notifyDispatcher(void *arg)
+{
+  notifyEvent_t ev;
+  notifySub_t sub[HELI_NOTIFY_MAX_SUBSCRIBERS];
+  uint32_t isub;
+
+  pthread_mutex_lock(&nl.mutex);
+
+  while(1)
+    {
+      while(!nl.stop && (nl.qcount == 0))
+	pthread_cond_wait(&nl.eventCond, &nl.mutex);
+      if(nl.stop)
+	break;
+
+      ev = nl.queue[nl.qhead];
+      nl.qhead = (nl.qhead + 1) % NOTIFY_QUEUE;
+      nl.qcount--;
+
+      memcpy(sub, nl.sub, sizeof(sub));
+      nl.dispatching = 1;
+      pthread_mutex_unlock(&nl.mutex);
+
+      for(isub = 0; isub < HELI_NOTIFY_MAX_SUBSCRIBERS; isub++)
+	{
+	  if(sub[isub].mask & ev.events)
+	    (*sub[isub].callback) (sub[isub].arg, sub[isub].mask & ev.events, &ev.regs);
+	}
+
+      pthread_mutex_lock(&nl.mutex);
+      nl.dispatching = 0;
+      pthread_cond_broadcast(&nl.idleCond);
+    }
+
+  pthread_mutex_unlock(&nl.mutex);
+
+  return NULL;
+}
+
+/* Start the poller and dispatcher.  Called with nl.mutex held. */
+static int32_t
+notifyStart()
+{
+  pthread_condattr_t attr;
+
+  if(nl.running)
+    return 0;
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&nl.pollCond, &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_cond_init(&nl.eventCond, NULL);
+  pthread_cond_init(&nl.idleCond, NULL);
+
+  nl.stop = 0;
+  nl.qhead = nl.qcount = 0;
+
+  if(pthread_create(&nl.dispatcher, NULL, notifyDispatcher, NULL) != 0)
+    {
+      HELI_ERR("Unable to start dispatcher thread\n");
+      return -1;
+    }
+
+  if(pthread_create(&nl.poller, NULL, notifyPoller, NULL) != 0)
+    {
+      HELI_ERR("Unable to start poller thread\n");
+      nl.stop = 1;
+      pthread_cond_broadcast(&nl.eventCond);
+      pthread_mutex_unlock(&nl.mutex);
+      pthread_join(nl.dispatcher, NULL);
+      pthread_mutex_lock(&nl.mutex);
+      return -1;
+    }
+
+  nl.running = 1;
+
+  return 0;
+}
+
+static void
+notifyUpdateMask()
+{
+  uint32_t isub;
+
+  nl.mask = 0;
+  for(isub = 0; isub < HELI_NOTIFY_MAX_SUBSCRIBERS; isub++)
+    nl.mask |= nl.sub[isub].mask;
+}
+
+/**
+ * @brief Subscribe to register changes
+ * @details Start watching the registers for the events in mask.  The
+ *          callback runs on the dispatcher thread, only when an event in
+ *          mask occurs.  The poller and dispatcher threads are started
+ *          by the first subscription.
+ * @param[in] mask Events to watch (HELI_NOTIFY_*)
+ * @param[in] callback Function called on the events
+ * @param[in] arg Argument passed to callback
+ * @return Subscription id if successful, otherwise -1
+ */
+int32_t
+heliSubscribe(uint32_t mask, heliNotifyCallback_t callback, void *arg)
+{
+  int32_t id = -1, isub;
+
+  if((mask == 0) || (mask & ~HELI_NOTIFY_ALL))
+    {
+      HELI_ERR("Invalid mask (0x%x)\n", mask);
+      return -1;
+    }
+
+  if(callback == NULL)
+    {
+      HELI_ERR("Invalid callback\n");
+      return -1;
+    }
+
+  pthread_mutex_lock(&nl.mutex);
+
+  for(isub = 0; isub < HELI_NOTIFY_MAX_SUBSCRIBERS; isub++)
+    {
+      if(nl.sub[isub].mask == 0)
+	{
+	  id = isub;
+	  break;
+	}
+    }
+
+  if(id < 0)
+    {
+      HELI_ERR("No free subscriptions (max %d)\n", HELI_NOTIFY_MAX_SUBSCRIBERS);
+    }
+  else if(notifyStart() < 0)
+    {
+      id = -1;
+    }
+  else
+    {
+      nl.sub[id].callback = callback;
+      nl.sub[id].arg = arg;
+      nl.sub[id].mask = mask;
+      notifyUpdateMask();
+      pthread_cond_signal(&nl.pollCond);
+    }
+
+  pthread_mutex_unlock(&nl.mutex);
+
+  return id;
+}
+
+/**
+ * @brief Remove a subscription
+ * @details When called outside of a callback, waits for a dispatch in
+ *          progress, so the callback is not running on return.
+ * @param[in] id Subscription id from heliSubscribe
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliUnsubscribe(int32_t id)
+{
+  if((id < 0) || (id >= HELI_NOTIFY_MAX_SUBSCRIBERS))
+    {
+      HELI_ERR("Invalid id (%d)\n", id);
+      return -1;
+    }
+
+  pthread_mutex_lock(&nl.mutex);
+
+  if(nl.sub[id].mask == 0)
+    {
+      HELI_ERR("Subscription %d not in use\n", id);
+      pthread_mutex_unlock(&nl.mutex);
+      return -1;
+    }
+
+  memset(&nl.sub[id], 0, sizeof(nl.sub[id]));
+  notifyUpdateMask();
+  pthread_cond_signal(&nl.pollCond);
+
+  if(nl.running && !pthread_equal(pthread_self(), nl.dispatcher))
+    {
+      while(nl.dispatching)
+	pthread_cond_wait(&nl.idleCond, &nl.mutex);
+    }
+
+  pthread_mutex_unlock(&nl.mutex);
+
+  return 0;
+}
+
+/**
+ * @brief Set the poll intervals
+ * @param[in] minMs Interval after a change [ms]
+ * @param[in] maxMs Interval when nothing changes [ms]
+ * @param[in] stallMs Time without state progress reported as a stall [ms]
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliNotifySetInterval(uint32_t minMs, uint32_t maxMs, uint32_t stallMs)
+{
+  if((minMs == 0) || (maxMs < minMs) || (stallMs < minMs))
+    {
+      HELI_ERR("Invalid intervals (min %u, max %u, stall %u)\n", minMs, maxMs, stallMs);
+      return -1;
+    }
+
+  pthread_mutex_lock(&nl.mutex);
+  nl.minMs = minMs;
+  nl.maxMs = maxMs;
+  nl.stallMs = stallMs;
+  pthread_mutex_unlock(&nl.mutex);
+
+  return 0;
+}
+
+/**
+ * @brief Get the poller counters
+ * @param[out] stats Counters
+ * @return 0
+ */
+int32_t
+heliNotifyGetStats(heliNotifyStats_t *stats)
+{
+  pthread_mutex_lock(&nl.mutex);
+  *stats = nl.stats;
+  pthread_mutex_unlock(&nl.mutex);
+
+  return 0;
+}
+
+/**
+ * @brief Stop the poller and dispatcher threads
+ * @details Subscriptions are removed.  Must not be called from a callback.
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliNotifyStop()
+{
+  pthread_mutex_lock(&nl.mutex);
+
+  if(!nl.running)
+    {
+      pthread_mutex_unlock(&nl.mutex);
+      return 0;
+    }
+
+  if(pthread_equal(pthread_self(), nl.dispatcher))
+    {
+      HELI_ERR("Called from a callback\n");
+      pthread_mutex_unlock(&nl.mutex);
+      return -1;
+    }
+
+  nl.stop = 1;
+  memset(nl.sub, 0, sizeof(nl.sub));
+  nl.mask = 0;
+  pthread_cond_broadcast(&nl.pollCond);
+  pthread_cond_broadcast(&nl.eventCond);
+  pthread_mutex_unlock(&nl.mutex);
+
+  pthread_join(nl.poller, NULL);
+  pthread_join(nl.dispatcher, NULL);
+
+  pthread_mutex_lock(&nl.mutex);
+  nl.running = 0;
+  pthread_cond_destroy(&nl.pollCond);
+  pthread_cond_destroy(&nl.eventCond);
+  pthread_cond_destroy(&nl.idleCond);
+  pthread_mutex_unlock(&nl.mutex);
+
+  return 0;
+}
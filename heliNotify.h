@@ -0,0 +1,59 @@
+#pragma once
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Header for the register change notifications
+ *
+ *   One poller thread reads only the registers that the subscribers
+ *   asked for, and queues the changes to one dispatcher thread that
+ *   runs the callbacks.
+ *
+ *   The poll interval adapts: it drops to the minimum after a change,
+ *   shortens while the sequencer state looks stalled, and doubles up to
+ *   the maximum while nothing changes.  The firmware date is read once
+ *   every HELI_NOTIFY_FIRMWARE_EVERY polls.
+ *
+ */
+
+#include <stdint.h>
+#include "heliLib.h"
+
+#define HELI_NOTIFY_MAX_SUBSCRIBERS 16
+#define HELI_NOTIFY_FIRMWARE_EVERY  16
+
+/* Default poll intervals [ms] */
+#define HELI_NOTIFY_DEFAULT_MIN_MS   20
+#define HELI_NOTIFY_DEFAULT_MAX_MS   1000
+#define HELI_NOTIFY_DEFAULT_STALL_MS 500
+
+/* Subscription mask / event bits */
+#define HELI_NOTIFY_CONFIG   (1 << 0) /* tsettle, tstable, delay, pattern, clock changed */
+#define HELI_NOTIFY_STATE    (1 << 1) /* Sequencer state progressed */
+#define HELI_NOTIFY_STALL    (1 << 2) /* Sequencer state did not change for the stall time */
+#define HELI_NOTIFY_FIRMWARE (1 << 3) /* Firmware date changed */
+#define HELI_NOTIFY_ALL      0xf
+
+/* Called on the dispatcher thread.  regs holds the last read value of
+   every register in the subscription mask. */
+typedef void (*heliNotifyCallback_t)(void *arg, uint32_t events, const heliRegs *regs);
+
+typedef struct
+{
+  uint64_t polls;             /* Poll cycles */
+  uint64_t reads;             /* Register reads */
+  uint64_t events;            /* Events queued */
+  uint64_t dropped;           /* Events dropped, dispatcher queue full */
+  uint32_t intervalMs;        /* Current poll interval */
+} heliNotifyStats_t;
+
+int32_t heliSubscribe(uint32_t mask, heliNotifyCallback_t callback, void *arg);
+int32_t heliUnsubscribe(int32_t id);
+int32_t heliNotifySetInterval(uint32_t minMs, uint32_t maxMs, uint32_t stallMs);
+int32_t heliNotifyGetStats(heliNotifyStats_t *stats);
+int32_t heliNotifyStop();
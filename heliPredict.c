@@ -0,0 +1,291 @@
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: True helicity predictor
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "heliPredict.h"
+#include "heliPrivate.h"
+
+#define PREDICT_LINE 64
+
+/* Slot: window number in the upper 56 bits, signals in the lower 8 */
+#define SLOT(_window, _signals) (((uint64_t) (_window) << 8) | (_signals))
+#define SLOT_WINDOW(_slot)      ((_slot) >> 8)
+#define SLOT_SIGNALS(_slot)     ((uint8_t) ((_slot) & 0xff))
+#define SLOT_EMPTY              (~0ULL)
+
+struct heliPredict
+{
+  /* Shared with the readers */
+  int64_t  current;           /* Last window fed, -1 before the first */
+  uint64_t mask;              /* Slots - 1 */
+  uint8_t  _pad0[PREDICT_LINE - 16];
+  uint64_t *slots;
+  /* Writer only */
+  uint32_t delay;
+  uint32_t horizon;
+  int32_t  state;             /* Checker state after the last window */
+  uint64_t fillWindow;        /* Next window to predict */
+  heliSeq_t fillSeq;          /* True sequence at fillWindow */
+  heliCheck_t chk;
+};
+
+/**
+ * @brief Create a predictor
+ * @param[in] pattern Helicity pattern index
+ * @param[in] delay Reporting delay [windows]
+ * @param[in] horizon Windows predicted past the last window fed
+ * @param[in] nslots Windows kept, a power of two larger than horizon + delay
+ * @return Predictor if successful, otherwise NULL
+ */
+heliPredict_t *
+heliPredictCreate(uint32_t pattern, uint32_t delay, uint32_t horizon, uint32_t nslots)
+{
+  heliPredict_t *p;
+  uint32_t islot;
+
+  if((nslots == 0) || (nslots & (nslots - 1)) ||
+     ((uint64_t) horizon + delay >= nslots))
+    {
+      HELI_ERR("Invalid slots (%u) for horizon (%u) and delay (%u)\n",
+	       nslots, horizon, delay);
+      return NULL;
+    }
+
+  if(posix_memalign((void **) &p, PREDICT_LINE, sizeof(*p)) != 0)
+    {
+      HELI_ERR("Unable to allocate memory\n");
+      return NULL;
+    }
+  memset(p, 0, sizeof(*p));
+
+  if(heliCheckInit(&p->chk, pattern, delay, NULL, NULL) != 0)
+    {
+      free(p);
+      return NULL;
+    }
+
+  if(posix_memalign((void **) &p->slots, PREDICT_LINE, nslots * sizeof(uint64_t)) != 0)
+    {
+      HELI_ERR("Unable to allocate memory\n");
+      free(p);
+      return NULL;
+    }
+  for(islot = 0; islot < nslots; islot++)
+    p->slots[islot] = SLOT_EMPTY;
+
+  p->current = -1;
+  p->mask = nslots - 1;
+  p->delay = delay;
+  p->horizon = horizon;
+  p->state = p->chk.state;
+
+  return p;
+}
+
+/**
+ * @brief Create a predictor for the pattern and delay of the module
+ * @param[in] horizon Windows predicted past the last window fed
+ * @param[in] nslots Windows kept, a power of two larger than horizon + delay
+ * @return Predictor if successful, otherwise NULL
+ */
+heliPredict_t *
+heliPredictCreateBoard(uint32_t horizon, uint32_t nslots)
+{
+  uint32_t pattern, delay;
+
+  if((heliGetHelicityPattern(&pattern) < 0) || (heliGetReportingDelay(&delay) < 0))
+    return NULL;
+
+  return heliPredictCreate(pattern, delay, horizon, nslots);
+}
+
+/**
+ * @brief Free a predictor
+ * @param[in] p Predictor
+ */
+void
+heliPredictDestroy(heliPredict_t *p)
+{
+  if(p == NULL)
+    return;
+
+  free(p->slots);
+  free(p);
+}
+
+static inline void
+predictStore(heliPredict_t *p, uint64_t window, uint64_t slot)
+{
+  __atomic_store_n(&p->slots[window & p->mask], slot, __ATOMIC_RELEASE);
+}
+
+/* Restart the prediction from the checker, after the window fed */
+static void
+predictRebuild(heliPredict_t *p, uint64_t window)
+{
+  /* The report of window + 1 carries the true helicity of window + 1 - delay */
+  heliSeqInit(&p->fillSeq, p->chk.pattern, 0, p->chk.seq.seed, p->chk.seq.phase);
+  if(window + 1 >= p->delay)
+    p->fillWindow = window + 1 - p->delay;
+  else
+    {
+      heliSeqSkip(&p->fillSeq, p->delay - window - 1);
+      p->fillWindow = 0;
+    }
+}
+
+/* Drop the predictions not yet confirmed */
+static void
+predictInvalidate(heliPredict_t *p, uint64_t window)
+{
+  uint64_t w = (window >= p->delay) ? window - p->delay + 1 : 0;
+
+  for(; w < p->fillWindow; w++)
+    predictStore(p, w, SLOT_EMPTY);
+  p->fillWindow = 0;
+}
+
+/**
+ * @brief Feed the next window reported by the DAQ
+ * @details Only one thread may feed windows.
+ * @param[inout] p Predictor
+ * @param[in] signals Mask of HELI_WINDOW_* signals of the window
+ */
+void
+heliPredictWindow(heliPredict_t *p, uint8_t signals)
+{
+  uint64_t window = p->chk.counters.windows;
+  uint64_t slot, last;
+  int32_t before = p->state;
+
+  heliCheckWindow(&p->chk, signals);
+  p->state = p->chk.state;
+
+  if(p->state == HELI_CHECK_LOCKED)
+    {
+      if(before != HELI_CHECK_LOCKED)
+	predictRebuild(p, window);
+      else if(window >= p->delay)
+	{
+	  /* Confirm the true helicity reported by this window */
+	  uint64_t w = window - p->delay;
+
+	  slot = __atomic_load_n(&p->slots[w & p->mask], __ATOMIC_RELAXED);
+	  if(SLOT_WINDOW(slot) == w)
+	    predictStore(p, w, SLOT(w, (SLOT_SIGNALS(slot) & ~HELI_WINDOW_HELICITY) |
+				    (signals & HELI_WINDOW_HELICITY) |
+				    HELI_PREDICT_CONFIRMED));
+	}
+
+      last = window + p->horizon;
+      while(p->fillWindow <= last)
+	{
+	  predictStore(p, p->fillWindow, SLOT(p->fillWindow, heliSeqNext(&p->fillSeq)));
+	  p->fillWindow++;
+	}
+    }
+  else if((p->state == HELI_CHECK_RESYNC) && (before != HELI_CHECK_RESYNC))
+    predictInvalidate(p, window);
+
+  __atomic_store_n(&p->current, (int64_t) window, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Feed consecutive windows reported by the DAQ
+ * @param[inout] p Predictor
+ * @param[in] signals Array of HELI_WINDOW_* masks, one per window
+ * @param[in] nwindows Number of windows
+ */
+void
+heliPredictBlock(heliPredict_t *p, const uint8_t *signals, uint64_t nwindows)
+{
+  uint64_t iwin;
+
+  for(iwin = 0; iwin < nwindows; iwin++)
+    heliPredictWindow(p, signals[iwin]);
+}
+
+/**
+ * @brief Return the checker of the predictor, for its state and counters
+ * @details Only valid in the thread feeding windows.
+ * @param[in] p Predictor
+ * @return Helicity checker
+ */
+const heliCheck_t *
+heliPredictGetCheck(const heliPredict_t *p)
+{
+  return &p->chk;
+}
+
+/**
+ * @brief Return the last window fed
+ * @param[in] p Predictor
+ * @return Window number, -1 if none was fed
+ */
+int64_t
+heliPredictCurrent(const heliPredict_t *p)
+{
+  return __atomic_load_n(&p->current, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Return the true signals of a window
+ * @details Wait-free, from any thread.
+ * @param[in] p Predictor
+ * @param[in] window Window number
+ * @param[out] signals Mask of HELI_WINDOW_* signals, and HELI_PREDICT_CONFIRMED
+ * @return HELI_PREDICT_CONFIRMED_WINDOW if confirmed by its report,
+ *         HELI_PREDICT_PREDICTED if predicted, otherwise
+ *         HELI_PREDICT_UNAVAILABLE (too old, too far ahead, or not locked)
+ */
+int32_t
+heliPredictGet(const heliPredict_t *p, uint64_t window, uint8_t *signals)
+{
+  uint64_t slot = __atomic_load_n(&p->slots[window & p->mask], __ATOMIC_ACQUIRE);
+
+  if(SLOT_WINDOW(slot) != (window & (SLOT_EMPTY >> 8)))
+    return HELI_PREDICT_UNAVAILABLE;
+
+  *signals = SLOT_SIGNALS(slot);
+
+  return (*signals & HELI_PREDICT_CONFIRMED) ?
+    HELI_PREDICT_CONFIRMED_WINDOW : HELI_PREDICT_PREDICTED;
+}
+
+/**
+ * @brief Return the true signals of the windows after the last window fed
+ * @details Wait-free, from any thread.  Stops at the first window not
+ *          available.
+ * @param[in] p Predictor
+ * @param[in] n Most windows wanted
+ * @param[out] signals Masks of HELI_WINDOW_* signals, one per window
+ * @param[out] first Number of the first window, if not NULL
+ * @return Number of windows returned
+ */
+uint32_t
+heliPredictNext(const heliPredict_t *p, uint32_t n, uint8_t *signals, uint64_t *first)
+{
+  uint64_t window = (uint64_t) (heliPredictCurrent(p) + 1);
+  uint32_t iwin;
+
+  if(first)
+    *first = window;
+
+  for(iwin = 0; iwin < n; iwin++)
+    if(heliPredictGet(p, window + iwin, &signals[iwin]) == HELI_PREDICT_UNAVAILABLE)
+      break;
+
+  return iwin;
+}
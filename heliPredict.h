@@ -0,0 +1,56 @@
+#pragma once
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Header for the true helicity predictor
+ *
+ *   The reported helicity of window r is the true helicity of window
+ *   r - delay.  Once the online checker (heliCheck) is locked to the
+ *   sequence, the predictor lays out the true helicity, pattern sync and
+ *   pair sync of every window up to r + horizon, in a ring indexed by
+ *   window number.  Each report then confirms the window delay windows
+ *   back.  Windows are numbered by the count of reported windows fed.
+ *
+ *   One thread feeds the reported windows.  Any number of threads read
+ *   the ring: a slot is one 64 bit word, holding the window number with
+ *   the signals, so a read is one atomic load and never waits or retries.
+ *   A slot that holds another window number is not available.
+ *
+ */
+
+#include <stdint.h>
+#include "heliCheck.h"
+
+#define HELI_PREDICT_CONFIRMED (1 << 7) /* Confirmed by the delayed report */
+
+#define HELI_PREDICT_DEFAULT_HORIZON 1024
+#define HELI_PREDICT_DEFAULT_SLOTS   (1 << 14)
+
+/* Return values of heliPredictGet */
+#define HELI_PREDICT_UNAVAILABLE -1
+#define HELI_PREDICT_PREDICTED    0
+#define HELI_PREDICT_CONFIRMED_WINDOW 1
+
+typedef struct heliPredict heliPredict_t;
+
+heliPredict_t *heliPredictCreate(uint32_t pattern, uint32_t delay,
+				 uint32_t horizon, uint32_t nslots);
+heliPredict_t *heliPredictCreateBoard(uint32_t horizon, uint32_t nslots);
+void     heliPredictDestroy(heliPredict_t *p);
+
+/* Writer */
+void     heliPredictWindow(heliPredict_t *p, uint8_t signals);
+void     heliPredictBlock(heliPredict_t *p, const uint8_t *signals, uint64_t nwindows);
+const heliCheck_t *heliPredictGetCheck(const heliPredict_t *p);
+
+/* Readers */
+int64_t  heliPredictCurrent(const heliPredict_t *p);
+int32_t  heliPredictGet(const heliPredict_t *p, uint64_t window, uint8_t *signals);
+uint32_t heliPredictNext(const heliPredict_t *p, uint32_t n, uint8_t *signals,
+			 uint64_t *first);
@@ -0,0 +1,83 @@
+#pragma once
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Macros shared by the library modules.  Not installed.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define HELI_ERR(format, ...) {fprintf(stderr,"%s: ERROR: ",__func__); fprintf(stderr,format, ## __VA_ARGS__);}
+
+/* Selection tables, defined in heliLib.c */
+extern double fTSettleVals[32];
+extern double fTStableVals[32];
+extern double fClockVals[4];
+extern double fBoardClockValues[2];
+extern uint32_t iDelayVals[16];
+extern char sPatternVals[11][256];
+
+/* Text output buffer.  Writes past the end are counted, not stored. */
+typedef struct
+{
+  char *buf;
+  uint32_t size;
+  uint32_t len;
+} heliOut_t;
+
+static inline void
+heliOutChar(heliOut_t *o, char c)
+{
+  if(o->len < o->size)
+    o->buf[o->len] = c;
+  o->len++;
+}
+
+static inline void
+heliOutStr(heliOut_t *o, const char *s)
+{
+  while(*s)
+    heliOutChar(o, *s++);
+}
+
+static inline void
+heliOutUint(heliOut_t *o, uint64_t v)
+{
+  char tmp[20];
+  int32_t n = 0;
+
+  do
+    {
+      tmp[n++] = '0' + (v % 10);
+      v /= 10;
+    }
+  while(v);
+
+  while(n)
+    heliOutChar(o, tmp[--n]);
+}
+
+/* Counter based random number: splitmix64 of (key, counter) */
+static inline uint64_t
+heliHash64(uint64_t key, uint64_t counter)
+{
+  uint64_t z = key ^ (counter * 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+/* Top 53 bits of a hash, uniform in (0,1) */
+static inline double
+heliHashUniform(uint64_t hash)
+{
+  return ((hash >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
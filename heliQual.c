@@ -0,0 +1,772 @@
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Helicity Sequence Quality tests
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "heliQual.h"
+#include "heliPrivate.h"
+
+/* Bits per chunk of the tests: a multiple of every block size */
+#define QUAL_CHUNK_BITS    (1 << 20)
+/* Patterns per chunk of the generator */
+#define QUAL_GEN_PATTERNS  (1 << 16)
+/* Fraction of DFT peaks expected below the threshold */
+#define QUAL_SPECTRAL_FRAC 0.95
+
+static const char *qualTestNames[HELI_QUAL_NTESTS] =
+  {
+    "frequency",
+    "runs",
+    "serial",
+    "spectral",
+    "linear_complexity",
+    "phase_balance"
+  };
+
+/* DFT tables */
+static double qualCos[HELI_QUAL_SPECTRAL_BITS / 2];
+static double qualSin[HELI_QUAL_SPECTRAL_BITS / 2];
+static uint16_t qualReverse[HELI_QUAL_SPECTRAL_BITS];
+static pthread_once_t qualOnce = PTHREAD_ONCE_INIT;
+
+typedef struct
+{
+  uint64_t ones;
+  uint64_t disagree[HELI_QUAL_NLAGS]; /* Pairs that differ, at each lag */
+  uint64_t spectralBlocks;
+  uint64_t spectralBelow;             /* DFT peaks below the threshold */
+  uint64_t lcBlocks;
+  uint64_t lcBad;                     /* Blocks without the expected complexity */
+  uint32_t lcMin;
+  uint32_t lcMax;
+} qualCounts;
+
+typedef struct
+{
+  const uint64_t *bits;
+  uint64_t nbits;
+  uint64_t spectralStride;    /* Test one spectral block in this many */
+  uint64_t lcStride;          /* Test one complexity block in this many */
+  uint64_t nchunks;
+  uint64_t next;              /* Next chunk to test */
+} qualJob;
+
+typedef struct
+{
+  qualJob *job;
+  qualCounts counts;
+} qualThreadArg;
+
+typedef struct
+{
+  uint32_t pattern;
+  uint32_t seed;
+  uint64_t nwindows;
+  uint64_t *bits;
+  uint64_t nchunks;
+  uint64_t next;              /* Next chunk to generate */
+  int32_t  rval;
+} qualGenJob;
+
+typedef struct
+{
+  qualGenJob *job;
+  heliQualPhase_t phase;
+  uint64_t nbits;
+} qualGenThreadArg;
+
+static void
+qualTablesInit()
+{
+  const uint32_t n = HELI_QUAL_SPECTRAL_BITS;
+  uint32_t i, bit, nbits = __builtin_ctz(n);
+
+  for(i = 0; i < n / 2; i++)
+    {
+      qualCos[i] = cos(2.0 * M_PI * i / n);
+      qualSin[i] = sin(2.0 * M_PI * i / n);
+    }
+
+  for(i = 0; i < n; i++)
+    {
+      uint32_t r = 0;
+      for(bit = 0; bit < nbits; bit++)
+	r |= ((i >> bit) & 1) << (nbits - 1 - bit);
+      qualReverse[i] = r;
+    }
+}
+
+/* Mask of the lowest n bits */
+static inline uint64_t
+qualMask(uint64_t n)
+{
+  return (n >= 64) ? ~0ULL : ((1ULL << n) - 1);
+}
+
+/* 64 bits starting at bit pos.  Bits past nbits are undefined. */
+static inline uint64_t
+qualWord(const uint64_t *bits, uint64_t nbits, uint64_t pos)
+{
+  uint64_t w = pos >> 6, s = pos & 63;
+  uint64_t x = bits[w] >> s;
+
+  if(s && ((w + 1) << 6) < nbits)
+    x |= bits[w + 1] << (64 - s);
+
+  return x;
+}
+
+/* Set bits that differ between [pos, pos+n) and [pos+lag, pos+lag+n) */
+static uint64_t
+qualDisagree(const uint64_t *bits, uint64_t nbits, uint64_t pos, uint64_t n, uint64_t lag)
+{
+  uint64_t p, count = 0;
+
+  for(p = pos; p < pos + n; p += 64)
+    {
+      uint64_t x = qualWord(bits, nbits, p) ^ qualWord(bits, nbits, p + lag);
+      count += __builtin_popcountll(x & qualMask(pos + n - p));
+    }
+
+  return count;
+}
+
+/* Number of DFT peaks below the 95% threshold, in one block */
+static uint64_t
+qualSpectralBlock(const uint64_t *bits, uint64_t pos, double *re, double *im)
+{
+  const uint32_t n = HELI_QUAL_SPECTRAL_BITS;
+  const double threshold = log(1.0 / (1.0 - QUAL_SPECTRAL_FRAC)) * n;
+  uint32_t i, j, len;
+  uint64_t below = 0;
+
+  for(i = 0; i < n; i++)
+    {
+      uint64_t b = pos + qualReverse[i];
+      re[i] = ((bits[b >> 6] >> (b & 63)) & 1) ? 1.0 : -1.0;
+      im[i] = 0;
+    }
+
+  for(len = 2; len <= n; len <<= 1)
+    {
+      uint32_t half = len / 2, step = n / len;
+      for(i = 0; i < n; i += len)
+	for(j = 0; j < half; j++)
+	  {
+	    double wr = qualCos[j * step], wi = -qualSin[j * step];
+	    double *ar = &re[i + j], *ai = &im[i + j];
+	    double *br = &re[i + j + half], *bi = &im[i + j + half];
+	    double tr = *br * wr - *bi * wi;
+	    double ti = *br * wi + *bi * wr;
+	    *br = *ar - tr;
+	    *bi = *ai - ti;
+	    *ar += tr;
+	    *ai += ti;
+	  }
+    }
+
+  /* Skip the DC term, whose modulus is not exponential */
+  for(i = 1; i < n / 2; i++)
+    if(re[i] * re[i] + im[i] * im[i] < threshold)
+      below++;
+
+  return below;
+}
+
+/* c ^= b << shift, over 3 words */
+static inline void
+qualShiftXor(uint64_t *c, const uint64_t *b, uint32_t shift)
+{
+  int32_t ws = shift >> 6, bs = shift & 63, i;
+
+  for(i = 2; i >= ws; i--)
+    {
+      uint64_t v = b[i - ws] << bs;
+      if(bs && (i - ws > 0))
+	v |= b[i - ws - 1] >> (64 - bs);
+      c[i] ^= v;
+    }
+}
+
+/* Linear complexity of one block, by Berlekamp-Massey */
+static uint32_t
+qualLinearComplexity(const uint64_t *bits, uint64_t pos)
+{
+  uint64_t c[3] = { 1, 0, 0 }, b[3] = { 1, 0, 0 }, t[3];
+  uint64_t r[3] = { 0, 0, 0 };       /* Bit i is s(n - i) */
+  int32_t L = 0, m = -1, n;
+
+  for(n = 0; n < HELI_QUAL_LC_BITS; n++)
+    {
+      uint64_t p = pos + n;
+      r[2] = (r[2] << 1) | (r[1] >> 63);
+      r[1] = (r[1] << 1) | (r[0] >> 63);
+      r[0] = (r[0] << 1) | ((bits[p >> 6] >> (p & 63)) & 1);
+
+      if(__builtin_parityll((c[0] & r[0]) ^ (c[1] & r[1]) ^ (c[2] & r[2])))
+	{
+	  memcpy(t, c, sizeof(t));
+	  qualShiftXor(c, b, n - m);
+	  if(2 * L <= n)
+	    {
+	      L = n + 1 - L;
+	      m = n;
+	      memcpy(b, t, sizeof(b));
+	    }
+	}
+    }
+
+  return L;
+}
+
+/* Run all tests on one chunk */
+static void
+qualChunk(const qualJob *job, uint64_t ichunk, qualCounts *c, double *re, double *im)
+{
+  const uint64_t *bits = job->bits;
+  const uint64_t nbits = job->nbits;
+  uint64_t first = ichunk * QUAL_CHUNK_BITS;
+  uint64_t last = (first + QUAL_CHUNK_BITS < nbits) ? first + QUAL_CHUNK_BITS : nbits;
+  uint64_t p, blk;
+  uint32_t ilag;
+
+  for(p = first; p < last; p += 64)
+    c->ones += __builtin_popcountll(bits[p >> 6] & qualMask(last - p));
+
+  for(ilag = 0; ilag < HELI_QUAL_NLAGS; ilag++)
+    {
+      uint64_t lag = heliQualLag(ilag);
+      uint64_t end = (nbits > lag) ? nbits - lag : 0;
+      if(end > last)
+	end = last;
+      if(end > first)
+	c->disagree[ilag] += qualDisagree(bits, nbits, first, end - first, lag);
+    }
+
+  for(blk = first / HELI_QUAL_SPECTRAL_BITS;
+      (blk + 1) * HELI_QUAL_SPECTRAL_BITS <= last; blk++)
+    {
+      if(blk % job->spectralStride)
+	continue;
+      c->spectralBelow += qualSpectralBlock(bits, blk * HELI_QUAL_SPECTRAL_BITS, re, im);
+      c->spectralBlocks++;
+    }
+
+  for(blk = first / HELI_QUAL_LC_BITS; (blk + 1) * HELI_QUAL_LC_BITS <= last; blk++)
+    {
+      if(blk % job->lcStride)
+	continue;
+
+      uint32_t L = qualLinearComplexity(bits, blk * HELI_QUAL_LC_BITS);
+      if(L != HELI_QUAL_LC_EXPECTED)
+	c->lcBad++;
+      if(L < c->lcMin)
+	c->lcMin = L;
+      if(L > c->lcMax)
+	c->lcMax = L;
+      c->lcBlocks++;
+    }
+}
+
+static void *
+qualThread(void *arg)
+{
+  qualThreadArg *targ = arg;
+  qualJob *job = targ->job;
+  double *re = malloc(HELI_QUAL_SPECTRAL_BITS * sizeof(*re));
+  double *im = malloc(HELI_QUAL_SPECTRAL_BITS * sizeof(*im));
+  uint64_t ichunk;
+
+  memset(&targ->counts, 0, sizeof(targ->counts));
+  targ->counts.lcMin = UINT32_MAX;
+
+  if((re == NULL) || (im == NULL))
+    {
+      HELI_ERR("Unable to allocate memory\n");
+      targ->job = NULL;
+    }
+  else
+    {
+      while((ichunk = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->nchunks)
+	qualChunk(job, ichunk, &targ->counts, re, im);
+    }
+
+  free(re);
+  free(im);
+
+  return NULL;
+}
+
+/* Result from a normal deviate, with a Bonferroni correction for ntries */
+static void
+qualNormal(heliQualResult_t *r, double z, uint32_t ntries, double alpha)
+{
+  double p = erfc(fabs(z) / M_SQRT2) * ntries;
+
+  r->run = 1;
+  r->statistic = z;
+  r->pvalue = (p < 1.0) ? p : 1.0;
+  r->pass = (r->pvalue >= alpha);
+}
+
+/**
+ * @brief Fill a quality test configuration with default values
+ * @details Significance level 0.01, at most 4096 spectral blocks, and
+ *          every linear complexity block.
+ * @param[out] cfg Test configuration
+ */
+void
+heliQualDefaultConfig(heliQualConfig_t *cfg)
+{
+  cfg->alpha = 0.01;
+  cfg->spectralBlocks = 4096;
+  cfg->lcBlocks = 0;
+}
+
+/**
+ * @brief Return the name of a test
+ * @param[in] test Test index (enum heliQualTests)
+ * @return Name of the test, or NULL if invalid
+ */
+const char *
+heliQualTestName(uint32_t test)
+{
+  return (test < HELI_QUAL_NTESTS) ? qualTestNames[test] : NULL;
+}
+
+/**
+ * @brief Return a lag of the serial test
+ * @param[in] ilag Lag index, less than HELI_QUAL_NLAGS
+ * @return Lag [bits]
+ */
+uint32_t
+heliQualLag(uint32_t ilag)
+{
+  return (ilag < 64) ? ilag + 1 : 1u << (ilag - 64 + 7);
+}
+
+/**
+ * @brief Initialize window counts at each phase of a pattern
+ * @param[out] phase Window counts
+ * @param[in] pattern Helicity pattern index
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliQualPhaseInit(heliQualPhase_t *phase, uint32_t pattern)
+{
+  int32_t len = heliSeqPatternLength(pattern);
+
+  if(len < 0)
+    {
+      HELI_ERR("Invalid pattern (%d)\n", pattern);
+      return -1;
+    }
+
+  memset(phase, 0, sizeof(*phase));
+  phase->length = len;
+
+  return 0;
+}
+
+/**
+ * @brief Extract pattern polarities from recorded windows
+ * @details Append the polarity of each pattern to a packed bit array, and
+ *          count the helicity at each window of the pattern.  Extraction
+ *          stops before a pattern whose windows (including the reporting
+ *          delay) are not all present, or when the bit array is full.  The
+ *          windows that were not used should be passed again, with more
+ *          windows, on the next call.
+ * @param[in] pattern Helicity pattern index (random patterns only)
+ * @param[in] delay Reporting delay [windows]
+ * @param[in] signals Array of recorded HELI_WINDOW_* masks, one per window
+ * @param[in] nwindows Number of windows
+ * @param[inout] bits Packed polarity bits
+ * @param[inout] nbits Number of bits in the array
+ * @param[in] maxbits Size of the array [bits]
+ * @param[inout] phase Window counts (may be NULL)
+ * @return Number of windows used, or -1 on error
+ */
+int64_t
+heliQualExtract(uint32_t pattern, uint32_t delay,
+		const uint8_t *signals, uint64_t nwindows,
+		uint64_t *bits, uint64_t *nbits, uint64_t maxbits,
+		heliQualPhase_t *phase)
+{
+  int32_t len = heliSeqPatternLength(pattern);
+  uint64_t iwin = 0, nb = *nbits;
+  int32_t j;
+
+  if((len < 0) || !heliSeqPatternIsRandom(pattern))
+    {
+      HELI_ERR("Pattern (%d) has no random polarity\n", pattern);
+      return -1;
+    }
+
+  while((iwin + delay + len <= nwindows) && (nb < maxbits))
+    {
+      if(!(signals[iwin] & HELI_WINDOW_PATTERN_SYNC))
+	{
+	  iwin++;
+	  continue;
+	}
+
+      const uint8_t *w = &signals[iwin + delay];
+      uint64_t bit = w[0] & HELI_WINDOW_HELICITY;
+
+      if((nb & 63) == 0)
+	bits[nb >> 6] = 0;
+      bits[nb >> 6] |= bit << (nb & 63);
+      nb++;
+
+      if(phase)
+	{
+	  for(j = 0; j < len; j++)
+	    {
+	      phase->windows[j]++;
+	      phase->ones[j] += w[j] & HELI_WINDOW_HELICITY;
+	    }
+	}
+
+      iwin += len;
+    }
+
+  *nbits = nb;
+
+  return iwin;
+}
+
+static void *
+qualGenThread(void *arg)
+{
+  qualGenThreadArg *targ = arg;
+  qualGenJob *job = targ->job;
+  const uint64_t len = heliSeqPatternLength(job->pattern);
+  uint8_t *signals = malloc(QUAL_GEN_PATTERNS * len);
+  uint64_t ichunk;
+
+  if(signals == NULL)
+    {
+      HELI_ERR("Unable to allocate memory\n");
+      __atomic_store_n(&job->rval, -1, __ATOMIC_RELAXED);
+      return NULL;
+    }
+
+  while((ichunk = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->nchunks)
+    {
+      uint64_t first = ichunk * QUAL_GEN_PATTERNS * len;
+      uint64_t n = job->nwindows - first;
+      uint64_t nb = ichunk * QUAL_GEN_PATTERNS, start = nb;
+      heliSeq_t seq;
+
+      if(n > QUAL_GEN_PATTERNS * len)
+	n = QUAL_GEN_PATTERNS * len;
+
+      heliSeqInit(&seq, job->pattern, 0, job->seed, 0);
+      heliSeqSkip(&seq, first);
+      heliSeqGenerate(&seq, signals, n);
+      heliQualExtract(job->pattern, 0, signals, n, job->bits, &nb,
+		      start + QUAL_GEN_PATTERNS, &targ->phase);
+      targ->nbits += nb - start;
+    }
+
+  free(signals);
+
+  return NULL;
+}
+
+/**
+ * @brief Generate pattern polarities with the library generator
+ * @details Generate windows from the start of a pattern, and extract the
+ *          polarity of each complete pattern, using nthreads threads.
+ * @param[in] pattern Helicity pattern index (random patterns only)
+ * @param[in] seed Shift register at the first window
+ * @param[in] nwindows Number of windows
+ * @param[out] bits Packed polarity bits, nwindows / length bits
+ * @param[out] phase Window counts (may be NULL)
+ * @param[in] nthreads Number of threads
+ * @return Number of bits, or -1 on error
+ */
+int64_t
+heliQualGenerate(uint32_t pattern, uint32_t seed, uint64_t nwindows,
+		 uint64_t *bits, heliQualPhase_t *phase, uint32_t nthreads)
+{
+  qualGenJob job;
+  heliQualPhase_t unused;
+  uint64_t nbits = 0;
+  uint32_t ithr, j;
+  int32_t len = heliSeqPatternLength(pattern);
+
+  if((len < 0) || !heliSeqPatternIsRandom(pattern))
+    {
+      HELI_ERR("Pattern (%d) has no random polarity\n", pattern);
+      return -1;
+    }
+
+  if(phase == NULL)
+    phase = &unused;
+  heliQualPhaseInit(phase, pattern);
+
+  if(nthreads == 0)
+    nthreads = 1;
+
+  memset(&job, 0, sizeof(job));
+  job.pattern = pattern;
+  job.seed = seed & HELI_SEQ_SEED_MASK;
+  job.nwindows = nwindows;
+  job.bits = bits;
+  job.nchunks = (nwindows + QUAL_GEN_PATTERNS * len - 1) / (QUAL_GEN_PATTERNS * len);
+
+  qualGenThreadArg *targ = calloc(nthreads, sizeof(*targ));
+  pthread_t *threads = calloc(nthreads, sizeof(*threads));
+  int8_t *started = calloc(nthreads, sizeof(*started));
+  if((targ == NULL) || (threads == NULL) || (started == NULL))
+    {
+      HELI_ERR("Unable to allocate memory\n");
+      free(targ);
+      free(threads);
+      free(started);
+      return -1;
+    }
+
+  for(ithr = 0; ithr < nthreads; ithr++)
+    {
+      targ[ithr].job = &job;
+      heliQualPhaseInit(&targ[ithr].phase, pattern);
+      if(ithr > 0)
+	started[ithr] = (pthread_create(&threads[ithr], NULL, qualGenThread, &targ[ithr]) == 0);
+    }
+
+  qualGenThread(&targ[0]);
+
+  for(ithr = 0; ithr < nthreads; ithr++)
+    {
+      if(started[ithr])
+	pthread_join(threads[ithr], NULL);
+
+      nbits += targ[ithr].nbits;
+      for(j = 0; j < (uint32_t) len; j++)
+	{
+	  phase->windows[j] += targ[ithr].phase.windows[j];
+	  phase->ones[j] += targ[ithr].phase.ones[j];
+	}
+    }
+
+  free(targ);
+  free(threads);
+  free(started);
+
+  return (job.rval < 0) ? -1 : (int64_t) nbits;
+}
+
+/**
+ * @brief Run the quality tests
+ * @details Run the quality tests on packed pattern polarities, in chunks,
+ *          using nthreads threads.
+ * @param[in] cfg Test configuration (NULL for heliQualDefaultConfig)
+ * @param[in] bits Packed polarity bits
+ * @param[in] nbits Number of bits
+ * @param[in] phase Window counts (NULL to skip the phase balance test)
+ * @param[in] nthreads Number of threads
+ * @param[out] report Test results
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliQualRun(const heliQualConfig_t *cfg, const uint64_t *bits, uint64_t nbits,
+	    const heliQualPhase_t *phase, uint32_t nthreads,
+	    heliQualReport_t *report)
+{
+  heliQualConfig_t defaults;
+  qualJob job;
+  qualCounts total;
+  uint32_t ithr, ilag, j;
+  int32_t rval = 0;
+
+  if(cfg == NULL)
+    {
+      heliQualDefaultConfig(&defaults);
+      cfg = &defaults;
+    }
+
+  if(nbits < HELI_QUAL_SPECTRAL_BITS)
+    {
+      HELI_ERR("Need at least %d bits (%llu)\n", HELI_QUAL_SPECTRAL_BITS,
+	       (unsigned long long) nbits);
+      return -1;
+    }
+
+  pthread_once(&qualOnce, qualTablesInit);
+
+  if(nthreads == 0)
+    nthreads = 1;
+
+  uint64_t nspectral = nbits / HELI_QUAL_SPECTRAL_BITS;
+  uint64_t nlc = nbits / HELI_QUAL_LC_BITS;
+
+  memset(&job, 0, sizeof(job));
+  job.bits = bits;
+  job.nbits = nbits;
+  job.nchunks = (nbits + QUAL_CHUNK_BITS - 1) / QUAL_CHUNK_BITS;
+  job.spectralStride = ((cfg->spectralBlocks == 0) || (nspectral <= cfg->spectralBlocks)) ? 1 :
+    (nspectral + cfg->spectralBlocks - 1) / cfg->spectralBlocks;
+  job.lcStride = ((cfg->lcBlocks == 0) || (nlc <= cfg->lcBlocks)) ? 1 :
+    (nlc + cfg->lcBlocks - 1) / cfg->lcBlocks;
+
+  qualThreadArg *targ = calloc(nthreads, sizeof(*targ));
+  pthread_t *threads = calloc(nthreads, sizeof(*threads));
+  int8_t *started = calloc(nthreads, sizeof(*started));
+  if((targ == NULL) || (threads == NULL) || (started == NULL))
+    {
+      HELI_ERR("Unable to allocate memory\n");
+      free(targ);
+      free(threads);
+      free(started);
+      return -1;
+    }
+
+  for(ithr = 0; ithr < nthreads; ithr++)
+    {
+      targ[ithr].job = &job;
+      if(ithr > 0)
+	started[ithr] = (pthread_create(&threads[ithr], NULL, qualThread, &targ[ithr]) == 0);
+    }
+
+  qualThread(&targ[0]);
+
+  memset(&total, 0, sizeof(total));
+  total.lcMin = UINT32_MAX;
+  for(ithr = 0; ithr < nthreads; ithr++)
+    {
+      const qualCounts *c = &targ[ithr].counts;
+
+      if(started[ithr])
+	pthread_join(threads[ithr], NULL);
+      else if(ithr > 0)
+	continue;
+
+      if(targ[ithr].job == NULL)
+	rval = -1;
+
+      total.ones += c->ones;
+      for(ilag = 0; ilag < HELI_QUAL_NLAGS; ilag++)
+	total.disagree[ilag] += c->disagree[ilag];
+      total.spectralBlocks += c->spectralBlocks;
+      total.spectralBelow += c->spectralBelow;
+      total.lcBlocks += c->lcBlocks;
+      total.lcBad += c->lcBad;
+      if(c->lcMin < total.lcMin)
+	total.lcMin = c->lcMin;
+      if(c->lcMax > total.lcMax)
+	total.lcMax = c->lcMax;
+    }
+
+  free(targ);
+  free(threads);
+  free(started);
+
+  if(rval < 0)
+    return -1;
+
+  memset(report, 0, sizeof(*report));
+  report->nbits = nbits;
+  report->ones = total.ones;
+  report->spectralBlocks = total.spectralBlocks;
+  report->lcBlocks = total.lcBlocks;
+  report->lcMin = (total.lcBlocks) ? total.lcMin : 0;
+  report->lcMax = total.lcMax;
+
+  /* Frequency */
+  qualNormal(&report->test[HELI_QUAL_FREQUENCY],
+	     (2.0 * total.ones - nbits) / sqrt(nbits), 1, cfg->alpha);
+
+  /* Runs: the lag 1 disagreements are the run boundaries */
+  {
+    heliQualResult_t *r = &report->test[HELI_QUAL_RUNS];
+    double pi = (double) total.ones / nbits;
+    double runs = total.disagree[0] + 1;
+
+    if(fabs(pi - 0.5) >= 2.0 / sqrt(nbits))
+      {
+	r->run = 1;
+	r->statistic = INFINITY;
+	r->pvalue = 0;
+	r->pass = 0;
+      }
+    else
+      qualNormal(r, (runs - 2.0 * nbits * pi * (1 - pi)) /
+		 (2.0 * sqrt(nbits) * pi * (1 - pi)), 1, cfg->alpha);
+  }
+
+  /* Serial correlation: worst lag */
+  {
+    double zworst = 0;
+    for(ilag = 0; ilag < HELI_QUAL_NLAGS; ilag++)
+      {
+	uint64_t lag = heliQualLag(ilag);
+	if(nbits <= lag)
+	  continue;
+	double m = nbits - lag;
+	double z = (m - 2.0 * total.disagree[ilag]) / sqrt(m);
+	if(fabs(z) >= fabs(zworst))
+	  {
+	    zworst = z;
+	    report->worstLag = lag;
+	  }
+      }
+    qualNormal(&report->test[HELI_QUAL_SERIAL], zworst, HELI_QUAL_NLAGS, cfg->alpha);
+  }
+
+  /* Spectral */
+  {
+    double npeaks = (double) total.spectralBlocks * (HELI_QUAL_SPECTRAL_BITS / 2 - 1);
+    double expect = npeaks * QUAL_SPECTRAL_FRAC;
+    double sigma = sqrt(npeaks * QUAL_SPECTRAL_FRAC * (1 - QUAL_SPECTRAL_FRAC));
+    qualNormal(&report->test[HELI_QUAL_SPECTRAL],
+	       (total.spectralBelow - expect) / sigma, 1, cfg->alpha);
+  }
+
+  /* Linear complexity */
+  {
+    heliQualResult_t *r = &report->test[HELI_QUAL_LINEAR_COMPLEXITY];
+    r->run = 1;
+    r->statistic = total.lcBad;
+    r->pvalue = (total.lcBad == 0) ? 1.0 : 0.0;
+    r->pass = (total.lcBad == 0);
+  }
+
+  /* Phase balance: worst phase */
+  if(phase && phase->length && phase->windows[0])
+    {
+      double zworst = 0;
+      for(j = 0; j < phase->length; j++)
+	{
+	  double w = phase->windows[j];
+	  double z = (2.0 * phase->ones[j] - w) / sqrt(w);
+	  if(fabs(z) >= fabs(zworst))
+	    {
+	      zworst = z;
+	      report->worstPhase = j;
+	    }
+	}
+      qualNormal(&report->test[HELI_QUAL_PHASE_BALANCE], zworst, phase->length, cfg->alpha);
+    }
+
+  report->pass = 1;
+  for(j = 0; j < HELI_QUAL_NTESTS; j++)
+    if(report->test[j].run && !report->test[j].pass)
+      report->pass = 0;
+
+  return 0;
+}
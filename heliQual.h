@@ -0,0 +1,109 @@
+#pragma once
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Header for the Helicity Sequence Quality tests
+ *
+ *   The tests run on the polarity of successive patterns, packed one bit
+ *   per pattern, least significant bit first.  Polarity bits are taken
+ *   from recorded windows (heliQualExtract) or from the generator
+ *   (heliQualGenerate).
+ *
+ *   Tests:
+ *     FREQUENCY     Balance of ones and zeros
+ *     RUNS          Number of runs of identical bits
+ *     SERIAL        Agreement of bits HELI_QUAL_NLAGS lags apart
+ *                   (worst lag, Bonferroni corrected)
+ *     SPECTRAL      Periodic features: DFT peaks below the 95% threshold
+ *                   in blocks of HELI_QUAL_SPECTRAL_BITS
+ *     LINEAR_COMPLEXITY
+ *                   Linear complexity of blocks of HELI_QUAL_LC_BITS, by
+ *                   Berlekamp-Massey.  The board generates a 30 bit
+ *                   maximal length shift register sequence, so every
+ *                   block must have complexity HELI_QUAL_LC_EXPECTED.
+ *                   Anything else is a sequence the board did not make.
+ *     PHASE_BALANCE Helicity balance at each window of the pattern
+ *                   (worst phase, Bonferroni corrected).  Needs window
+ *                   counts from heliQualExtract or heliQualGenerate.
+ *
+ *   Counts are integers summed over fixed chunks, so the report is the
+ *   same for any number of threads.
+ *
+ */
+
+#include <stdint.h>
+#include "heliSeq.h"
+
+#define HELI_QUAL_NLAGS          78      /* Lags 1 to 64, then 2^7 to 2^20 */
+#define HELI_QUAL_SPECTRAL_BITS  4096
+#define HELI_QUAL_LC_BITS        128
+#define HELI_QUAL_LC_EXPECTED    30
+
+enum heliQualTests
+  {
+    HELI_QUAL_FREQUENCY = 0,
+    HELI_QUAL_RUNS,
+    HELI_QUAL_SERIAL,
+    HELI_QUAL_SPECTRAL,
+    HELI_QUAL_LINEAR_COMPLEXITY,
+    HELI_QUAL_PHASE_BALANCE,
+    HELI_QUAL_NTESTS
+  };
+
+typedef struct
+{
+  double   alpha;             /* Significance level */
+  uint32_t spectralBlocks;    /* Most blocks in the spectral test (0 for all) */
+  uint32_t lcBlocks;          /* Most blocks in the linear complexity test (0 for all) */
+} heliQualConfig_t;
+
+typedef struct
+{
+  uint32_t length;            /* Windows per pattern */
+  uint64_t windows[64];       /* Windows at each phase */
+  uint64_t ones[64];          /* Windows with helicity 1 at each phase */
+} heliQualPhase_t;
+
+typedef struct
+{
+  int32_t  run;               /* 1 if the test was run */
+  int32_t  pass;              /* 1 if the test passed */
+  double   statistic;         /* Test statistic */
+  double   pvalue;            /* p-value */
+} heliQualResult_t;
+
+typedef struct
+{
+  uint64_t nbits;             /* Polarity bits tested */
+  uint64_t ones;              /* Polarity bits set */
+  uint32_t worstLag;          /* Lag of the worst serial correlation */
+  uint32_t worstPhase;        /* Phase of the worst balance */
+  uint64_t spectralBlocks;    /* Blocks in the spectral test */
+  uint64_t lcBlocks;          /* Blocks in the linear complexity test */
+  uint32_t lcMin;             /* Lowest and highest block complexity */
+  uint32_t lcMax;
+  heliQualResult_t test[HELI_QUAL_NTESTS];
+  int32_t  pass;              /* 1 if every test run passed */
+} heliQualReport_t;
+
+void        heliQualDefaultConfig(heliQualConfig_t *cfg);
+const char *heliQualTestName(uint32_t test);
+uint32_t    heliQualLag(uint32_t ilag);
+
+int32_t heliQualPhaseInit(heliQualPhase_t *phase, uint32_t pattern);
+int64_t heliQualExtract(uint32_t pattern, uint32_t delay,
+			const uint8_t *signals, uint64_t nwindows,
+			uint64_t *bits, uint64_t *nbits, uint64_t maxbits,
+			heliQualPhase_t *phase);
+int64_t heliQualGenerate(uint32_t pattern, uint32_t seed, uint64_t nwindows,
+			 uint64_t *bits, heliQualPhase_t *phase, uint32_t nthreads);
+
+int32_t heliQualRun(const heliQualConfig_t *cfg, const uint64_t *bits, uint64_t nbits,
+		    const heliQualPhase_t *phase, uint32_t nthreads,
+		    heliQualReport_t *report);
@@ -0,0 +1,203 @@
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Readout list helicity bank
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "heliReadout.h"
+#include "heliPrivate.h"
+
+#define READOUT_HEADER \
+  ((HELI_READOUT_TAG << 16) | (HELI_READOUT_VERSION << 8) | HELI_READOUT_NWORDS)
+
+static inline uint64_t
+readoutNow(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Fingerprint of the configuration
+ * @details FNV-1a hash of the configuration registers and the firmware
+ *          date.  The state and reset registers are not included.
+ * @param[in] regs Register snapshot
+ * @return Fingerprint
+ */
+uint32_t
+heliReadoutFingerprint(const heliRegs *regs)
+{
+  const uint8_t bytes[] =
+    {
+      regs->tsettle & HELI_TSETTLE_MASK, regs->tstable & HELI_TSTABLE_MASK,
+      regs->delay & HELI_DELAY_MASK, regs->pattern & HELI_PATTERN_MASK,
+      regs->clock & HELI_CLOCK_MASK,
+      regs->month, regs->day, regs->year
+    };
+  uint32_t hash = 2166136261u, ibyte;
+
+  for(ibyte = 0; ibyte < sizeof(bytes); ibyte++)
+    {
+      hash ^= bytes[ibyte];
+      hash *= 16777619u;
+    }
+
+  return hash;
+}
+
+/**
+ * @brief Initialize the helicity bank writer from a register snapshot
+ * @details The window counter starts at 0 at the state of the snapshot.
+ * @param[out] ro Bank writer
+ * @param[in] regs Register snapshot
+ * @param[in] time CLOCK_MONOTONIC of the snapshot [ns]
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliReadoutInitRegs(heliReadout_t *ro, const heliRegs *regs, uint64_t time)
+{
+  double tsettle, tstable, freq = 0;
+
+  memset(ro, 0, sizeof(*ro));
+  ro->config = heliReadoutFingerprint(regs);
+  ro->lastState = regs->state & HELI_STATE_MASK;
+  ro->lastTime = time;
+
+  if((heliCalcHelicityTiming(regs->clock, regs->tsettle, regs->tstable,
+			     &tsettle, &tstable, &freq) == 0) && (freq > 0))
+    ro->windowNs = 1e9 / freq;
+
+  return 0;
+}
+
+/**
+ * @brief Initialize the helicity bank writer from the module
+ * @details Call once per run (e.g. at Prestart).  Reads the registers
+ *          under the library lock.
+ * @param[out] ro Bank writer
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliReadoutInit(heliReadout_t *ro)
+{
+  heliRegs regs;
+
+  if(heliGetRegisterSnapshot(&regs) != 0)
+    return -1;
+
+  return heliReadoutInitRegs(ro, &regs, readoutNow());
+}
+
+/**
+ * @brief Write the helicity bank for a given sequencer state
+ * @param[inout] ro Bank writer
+ * @param[out] buf Event buffer, at least HELI_READOUT_NWORDS words
+ * @param[in] state Sequencer state, or -1 if not read
+ * @param[in] time CLOCK_MONOTONIC of the state read [ns]
+ * @return Number of words written (HELI_READOUT_NWORDS)
+ */
+uint32_t
+heliReadoutWriteState(heliReadout_t *ro, volatile uint32_t *buf,
+		      int32_t state, uint64_t time)
+{
+  uint32_t flags = 0;
+  uint64_t delta;
+  double expected;
+
+  if(state < 0)
+    {
+      flags |= HELI_READOUT_NOSTATE;
+      state = ro->lastState;
+    }
+  else
+    {
+      delta = (state - ro->lastState) & HELI_STATE_MASK;
+
+      /* Add the wraps of the state register that the elapsed time implies */
+      if(ro->windowNs > 0)
+	{
+	  expected = (double) (time - ro->lastTime) / ro->windowNs;
+	  if(expected - delta > 128)
+	    {
+	      delta += 256 * (uint64_t) floor((expected - delta) / 256 + 0.5);
+	      flags |= HELI_READOUT_WRAPPED;
+	    }
+	}
+
+      ro->window += delta;
+      ro->lastState = state;
+      ro->lastTime = time;
+    }
+
+  buf[0] = READOUT_HEADER;
+  buf[1] = ro->config;
+  buf[2] = (flags << 8) | (state & HELI_STATE_MASK);
+  buf[3] = ro->window & 0xffffffff;
+  buf[4] = ro->window >> 32;
+
+  return HELI_READOUT_NWORDS;
+}
+
+/**
+ * @brief Write the helicity bank into the event buffer
+ * @details One read of the sequencer state register, without locking.
+ * @param[inout] ro Bank writer
+ * @param[out] buf Event buffer, at least HELI_READOUT_NWORDS words
+ * @return Number of words written (HELI_READOUT_NWORDS)
+ */
+uint32_t
+heliReadoutWrite(heliReadout_t *ro, volatile uint32_t *buf)
+{
+  int32_t state = heliReadSequencerState();
+
+  return heliReadoutWriteState(ro, buf, state, readoutNow());
+}
+
+/**
+ * @brief Decode a helicity bank
+ * @param[in] buf Bank words
+ * @param[in] nwords Words available in buf
+ * @param[out] bank Decoded bank
+ * @return Number of words of the bank if successful, otherwise -1
+ */
+int32_t
+heliReadoutDecode(const uint32_t *buf, uint32_t nwords, heliReadoutBank_t *bank)
+{
+  uint32_t banklen;
+
+  if((nwords < 1) || ((buf[0] >> 16) != HELI_READOUT_TAG))
+    {
+      HELI_ERR("Not a helicity bank\n");
+      return -1;
+    }
+
+  /* Later versions may append words */
+  banklen = buf[0] & 0xff;
+  if((banklen < HELI_READOUT_NWORDS) || (banklen > nwords))
+    {
+      HELI_ERR("Invalid bank length (%u of %u words)\n", banklen, nwords);
+      return -1;
+    }
+
+  bank->version = (buf[0] >> 8) & 0xff;
+  bank->config = buf[1];
+  bank->state = buf[2] & HELI_STATE_MASK;
+  bank->flags = buf[2] >> 8;
+  bank->window = ((uint64_t) buf[4] << 32) | buf[3];
+
+  return banklen;
+}
@@ -0,0 +1,73 @@
+#pragma once
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Header for the readout list helicity bank
+ *
+ *   At Prestart, heliReadoutInit reads the registers once (under the
+ *   library lock) and keeps a fingerprint of the configuration.  Per
+ *   trigger, heliReadoutWrite reads the sequencer state register (one
+ *   bus read, no lock), extends it into a 64 bit window counter, and
+ *   writes a fixed bank into the event buffer:
+ *
+ *     dma_dabufp += heliReadoutWrite(&ro, dma_dabufp);
+ *
+ *   Bank layout (HELI_READOUT_NWORDS 32 bit words):
+ *     0  header   HELI_READOUT_TAG << 16 | version << 8 | nwords
+ *     1  config   configuration fingerprint
+ *     2  state    flags << 8 | sequencer state
+ *     3  window   window counter, low 32 bits
+ *     4  window   window counter, high 32 bits
+ *
+ *   The state register counts windows modulo 256.  If more than half of
+ *   that passed since the last trigger, the elapsed time at the window
+ *   frequency picks the number of wraps, and the bank is flagged.
+ *
+ *   One thread per heliReadout_t.
+ *
+ */
+
+#include <stdint.h>
+#include "heliLib.h"
+
+#define HELI_READOUT_TAG     0x4842 /* "HB" */
+#define HELI_READOUT_VERSION 1
+#define HELI_READOUT_NWORDS  5
+
+/* Bank flags */
+#define HELI_READOUT_NOSTATE (1 << 0) /* State not read: window counter not advanced */
+#define HELI_READOUT_WRAPPED (1 << 1) /* Window counter wraps estimated from time */
+
+typedef struct
+{
+  uint32_t config;            /* Configuration fingerprint */
+  uint64_t window;            /* Extended window counter */
+  uint64_t lastTime;          /* CLOCK_MONOTONIC of the last state read [ns] */
+  double   windowNs;          /* Window period [ns], 0 if unknown */
+  uint8_t  lastState;         /* Last sequencer state read */
+} heliReadout_t;
+
+typedef struct
+{
+  uint32_t version;           /* Bank version */
+  uint32_t config;            /* Configuration fingerprint */
+  uint8_t  state;             /* Sequencer state */
+  uint32_t flags;             /* HELI_READOUT_* flags */
+  uint64_t window;            /* Extended window counter */
+} heliReadoutBank_t;
+
+uint32_t heliReadoutFingerprint(const heliRegs *regs);
+
+int32_t  heliReadoutInit(heliReadout_t *ro);
+int32_t  heliReadoutInitRegs(heliReadout_t *ro, const heliRegs *regs, uint64_t time);
+uint32_t heliReadoutWrite(heliReadout_t *ro, volatile uint32_t *buf);
+uint32_t heliReadoutWriteState(heliReadout_t *ro, volatile uint32_t *buf,
+			       int32_t state, uint64_t time);
+
+int32_t  heliReadoutDecode(const uint32_t *buf, uint32_t nwords, heliReadoutBank_t *bank);
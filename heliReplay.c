@@ -0,0 +1,421 @@
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Offline Helicity Replay
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "heliReplay.h"
+#include "heliPrivate.h"
+
+/* Windows after a mismatch that decide what caused it, as heliCheck */
+#define REPLAY_LOOKAHEAD        16
+/* Patterns used to recover the sequence */
+#define REPLAY_RECOVER_PATTERNS 32
+/* Windows between the decode states kept to splice a chunk at its seam */
+#define REPLAY_CHECKPOINT_WINDOWS 1024
+
+typedef struct
+{
+  heliSeq_t seq;              /* Sequence of the reported helicity */
+  int32_t  locked;
+  uint64_t cooldown;          /* Windows to wait before the next recovery */
+} replayState;
+
+typedef struct
+{
+  replayState st;             /* State before the window */
+  heliReplayStats_t stats;    /* Statistics of the windows before it */
+} replayCheckpoint;
+
+typedef struct
+{
+  uint64_t first;             /* First window of the chunk */
+  uint64_t n;                 /* Windows in the chunk */
+  replayState start;          /* State at the first window */
+  replayState end;            /* State after the last window */
+  int32_t  recovered;         /* Sequence recovered at the first window */
+  heliSeq_t firstSeq;         /* Sequence recovered at the first window */
+  replayCheckpoint *check;    /* Every REPLAY_CHECKPOINT_WINDOWS windows */
+  heliReplayStats_t stats;
+} replayChunk;
+
+typedef struct
+{
+  uint32_t pattern;
+  uint32_t delay;
+  uint32_t span;              /* Windows used to recover the sequence */
+  const uint8_t *signals;
+  uint8_t *decoded;
+  uint64_t nwindows;
+  replayChunk *chunk;
+  uint64_t nchunks;
+  uint64_t next;              /* Next chunk to decode */
+} replayJob;
+
+/*
+ * Recover the sequence at window.  The sequence must predict the first
+ * half of the windows used, so that a missed or extra window later on
+ * is left to the classification.
+ */
+static int32_t
+replayRecover(const replayJob *job, uint64_t window, heliSeq_t *seq)
+{
+  uint64_t nleft = job->nwindows - window;
+  uint64_t n = (nleft < job->span) ? nleft : job->span;
+  int32_t nbad;
+
+  if(n < job->span / 2)
+    return -1;
+
+  nbad = heliSeqRecover(seq, job->pattern, job->delay, &job->signals[window], n);
+  if(nbad < 0)
+    return -1;
+
+  return (heliSeqMismatch(seq, &job->signals[window], n / 2) <= n / 128) ? 0 : -1;
+}
+
+/* Sequence of the true helicity, from the sequence of the reported helicity */
+static void
+replayTrueSeq(heliSeq_t *tru, const heliSeq_t *seq)
+{
+  *tru = *seq;
+  heliSeqSkip(tru, seq->delay);
+  tru->delay = 0;
+  tru->syncPhase = tru->phase;
+}
+
+/* Window classification, as heliCheck */
+enum replayClass
+  {
+    REPLAY_BIT_ERROR,
+    REPLAY_MISSED,
+    REPLAY_EXTRA,
+    REPLAY_DESYNC
+  };
+
+/* Decide what caused the mismatch at window */
+static int32_t
+replayClassify(const replayJob *job, const heliSeq_t *seq, uint64_t window)
+{
+  const uint8_t *held = &job->signals[window];
+  uint64_t n = job->nwindows - window;
+  heliSeq_t missed = *seq;
+
+  if(n > REPLAY_LOOKAHEAD + 1)
+    n = REPLAY_LOOKAHEAD + 1;
+
+  heliSeqSkip(&missed, 1);
+
+  if(heliSeqMismatch(seq, held, n) <= 2)
+    return REPLAY_BIT_ERROR;
+  if(heliSeqMismatch(&missed, held, n) <= 1)
+    return REPLAY_MISSED;
+  if(1 + heliSeqMismatch(seq, held + 1, n - 1) <= 2)
+    return REPLAY_EXTRA;
+
+  return REPLAY_DESYNC;
+}
+
+/* Same decode from here on */
+static int32_t
+replaySameState(const replayState *a, const replayState *b)
+{
+  if(a->locked != b->locked)
+    return 0;
+  if(a->locked)
+    return memcmp(&a->seq, &b->seq, sizeof(heliSeq_t)) == 0;
+
+  return a->cooldown == b->cooldown;
+}
+
+/*
+ * Decode the windows of a chunk, starting from its start state.  The first
+ * decode keeps a checkpoint every REPLAY_CHECKPOINT_WINDOWS windows.  A
+ * decode again from the previous chunk (splice) stops at the first
+ * checkpoint it agrees with, and keeps the rest of the first decode.
+ */
+static void
+replayDecodeChunk(const replayJob *job, replayChunk *c, int32_t splice)
+{
+  replayState st = c->start;
+  heliReplayStats_t first = c->stats;
+  heliSeq_t tru, peek;
+  uint64_t iwin, recoveredAt = UINT64_MAX, checked = c->first;
+  uint8_t diff;
+
+  memset(&c->stats, 0, sizeof(c->stats));
+  c->stats.windows = c->n;
+  c->recovered = 0;
+
+  if(st.locked)
+    replayTrueSeq(&tru, &st.seq);
+
+  for(iwin = c->first; iwin < c->first + c->n; iwin++)
+    {
+      /* Once per window: a loss of sync decodes the window again */
+      if((iwin != checked) && (((iwin - c->first) % REPLAY_CHECKPOINT_WINDOWS) == 0))
+	{
+	  replayCheckpoint *chk = &c->check[(iwin - c->first) / REPLAY_CHECKPOINT_WINDOWS - 1];
+
+	  checked = iwin;
+
+	  if(!splice)
+	    {
+	      chk->st = st;
+	      chk->stats = c->stats;
+	    }
+	  else if(replaySameState(&st, &chk->st))
+	    {
+	      c->stats.mismatches += first.mismatches - chk->stats.mismatches;
+	      c->stats.unlocked += first.unlocked - chk->stats.unlocked;
+	      c->stats.resyncs += first.resyncs - chk->stats.resyncs;
+	      c->stats.missed += first.missed - chk->stats.missed;
+	      c->stats.extra += first.extra - chk->stats.extra;
+	      return;
+	    }
+	}
+
+      if(!st.locked)
+	{
+	  if(st.cooldown == 0)
+	    {
+	      if(replayRecover(job, iwin, &st.seq) == 0)
+		{
+		  st.locked = 1;
+		  replayTrueSeq(&tru, &st.seq);
+		  c->stats.resyncs++;
+		  recoveredAt = iwin;
+		  if(iwin == c->first)
+		    {
+		      c->recovered = 1;
+		      c->firstSeq = st.seq;
+		    }
+		}
+	      else
+		st.cooldown = job->span / 4;
+	    }
+
+	  if(!st.locked)
+	    {
+	      job->decoded[iwin] = HELI_REPLAY_UNLOCKED;
+	      c->stats.unlocked++;
+	      st.cooldown--;
+	      continue;
+	    }
+	}
+
+      peek = st.seq;
+      if((heliSeqNext(&peek) ^ job->signals[iwin]) & HELI_SEQ_SIGNALS)
+	{
+	  int32_t cls = replayClassify(job, &st.seq, iwin);
+
+	  /* A sequence just recovered here is kept */
+	  if((cls == REPLAY_DESYNC) && (recoveredAt == iwin))
+	    cls = REPLAY_BIT_ERROR;
+
+	  switch(cls)
+	    {
+	    case REPLAY_MISSED:
+	      heliSeqSkip(&st.seq, 1);
+	      heliSeqSkip(&tru, 1);
+	      c->stats.missed++;
+	      break;
+
+	    case REPLAY_EXTRA:
+	      job->decoded[iwin] = HELI_REPLAY_UNLOCKED;
+	      c->stats.extra++;
+	      c->stats.unlocked++;
+	      continue;
+
+	    case REPLAY_DESYNC:
+	      /* Recover again from this window */
+	      st.locked = 0;
+	      st.cooldown = 0;
+	      iwin--;
+	      continue;
+
+	    default:
+	      break;
+	    }
+	}
+
+      diff = (heliSeqNext(&st.seq) ^ job->signals[iwin]) & HELI_SEQ_SIGNALS;
+      job->decoded[iwin] = (heliSeqNext(&tru) & HELI_SEQ_SIGNALS) | (diff ? HELI_REPLAY_MISMATCH : 0);
+
+      if(diff)
+	c->stats.mismatches++;
+    }
+
+  c->end = st;
+}
+
+static void *
+replayThread(void *arg)
+{
+  replayJob *job = arg;
+  uint64_t ichunk;
+
+  while((ichunk = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->nchunks)
+    {
+      replayChunk *c = &job->chunk[ichunk];
+
+      memset(&c->start, 0, sizeof(c->start));
+      replayDecodeChunk(job, c, 0);
+    }
+
+  return NULL;
+}
+
+/*
+ * Check the seams between chunks, in order.  Each chunk starts unlocked,
+ * so it matches a serial decode if the previous chunk ends unlocked with
+ * no cooldown, or locked to the sequence recovered at its first window.
+ * Otherwise it is decoded again from the end state of the previous chunk,
+ * up to where the two decodes agree.
+ */
+static void
+replayStitch(replayJob *job, heliReplayStats_t *stats)
+{
+  uint64_t ichunk;
+
+  for(ichunk = 1; ichunk < job->nchunks; ichunk++)
+    {
+      const replayChunk *prev = &job->chunk[ichunk - 1];
+      replayChunk *c = &job->chunk[ichunk];
+
+      if(!prev->end.locked && (prev->end.cooldown == 0))
+	continue;
+
+      if(prev->end.locked && c->recovered &&
+	 (memcmp(&c->firstSeq, &prev->end.seq, sizeof(heliSeq_t)) == 0))
+	{
+	  /* Not a resync in a serial decode */
+	  c->stats.resyncs--;
+	  continue;
+	}
+
+      if(prev->end.locked && c->recovered)
+	stats->seams++;
+
+      c->start = prev->end;
+      replayDecodeChunk(job, c, 1);
+      stats->stitched++;
+    }
+}
+
+/**
+ * @brief Decode the true helicity of recorded windows
+ * @details Decode the true helicity of recorded windows, in chunks, using
+ *          nthreads threads.
+ * @param[in] pattern Helicity pattern index
+ * @param[in] delay Reporting delay [windows]
+ * @param[in] signals Array of recorded HELI_WINDOW_* masks, one per window
+ * @param[out] decoded Array of decoded windows: the true HELI_WINDOW_*
+ *             signals, with HELI_REPLAY_MISMATCH and HELI_REPLAY_UNLOCKED
+ * @param[in] nwindows Number of windows
+ * @param[in] chunkWindows Windows per chunk (0 for HELI_REPLAY_CHUNK_WINDOWS)
+ * @param[in] nthreads Number of threads
+ * @param[out] stats Replay statistics (may be NULL)
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliReplay(uint32_t pattern, uint32_t delay,
+	   const uint8_t *signals, uint8_t *decoded, uint64_t nwindows,
+	   uint32_t chunkWindows, uint32_t nthreads, heliReplayStats_t *stats)
+{
+  replayJob job;
+  heliReplayStats_t total;
+  pthread_t *threads = NULL;
+  replayCheckpoint *check = NULL;
+  uint64_t ichunk, ncheck;
+  uint32_t ithr, nstarted = 0;
+
+  if(heliSeqPatternLength(pattern) < 0)
+    {
+      HELI_ERR("Invalid pattern (%d)\n", pattern);
+      return -1;
+    }
+
+  if(chunkWindows == 0)
+    chunkWindows = HELI_REPLAY_CHUNK_WINDOWS;
+  if(nthreads == 0)
+    nthreads = 1;
+
+  memset(&job, 0, sizeof(job));
+  job.pattern = pattern;
+  job.delay = delay;
+  job.signals = signals;
+  job.decoded = decoded;
+  job.nwindows = nwindows;
+  job.span = REPLAY_RECOVER_PATTERNS * heliSeqPatternLength(pattern) + delay;
+  job.nchunks = (nwindows + chunkWindows - 1) / chunkWindows;
+
+  ncheck = (chunkWindows - 1) / REPLAY_CHECKPOINT_WINDOWS;
+
+  job.chunk = calloc(job.nchunks ? job.nchunks : 1, sizeof(*job.chunk));
+  threads = calloc(nthreads, sizeof(*threads));
+  if(ncheck && job.nchunks)
+    check = calloc(job.nchunks * ncheck, sizeof(*check));
+  if((job.chunk == NULL) || (threads == NULL) || (ncheck && job.nchunks && (check == NULL)))
+    {
+      HELI_ERR("Unable to allocate memory\n");
+      free(job.chunk);
+      free(threads);
+      free(check);
+      return -1;
+    }
+
+  for(ichunk = 0; ichunk < job.nchunks; ichunk++)
+    {
+      job.chunk[ichunk].first = ichunk * chunkWindows;
+      job.chunk[ichunk].n = ((ichunk + 1) * chunkWindows < nwindows) ?
+	chunkWindows : nwindows - ichunk * chunkWindows;
+      job.chunk[ichunk].check = &check[ichunk * ncheck];
+    }
+
+  for(ithr = 1; ithr < nthreads; ithr++)
+    {
+      if(pthread_create(&threads[nstarted], NULL, replayThread, &job) != 0)
+	break;
+      nstarted++;
+    }
+
+  replayThread(&job);
+
+  for(ithr = 0; ithr < nstarted; ithr++)
+    pthread_join(threads[ithr], NULL);
+
+  memset(&total, 0, sizeof(total));
+  replayStitch(&job, &total);
+
+  for(ichunk = 0; ichunk < job.nchunks; ichunk++)
+    {
+      const heliReplayStats_t *s = &job.chunk[ichunk].stats;
+      total.windows += s->windows;
+      total.mismatches += s->mismatches;
+      total.unlocked += s->unlocked;
+      total.resyncs += s->resyncs;
+      total.missed += s->missed;
+      total.extra += s->extra;
+    }
+
+  if(stats)
+    *stats = total;
+
+  free(job.chunk);
+  free(threads);
+  free(check);
+
+  return 0;
+}
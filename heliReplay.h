@@ -0,0 +1,52 @@
+#pragma once
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Header for the offline Helicity Replay
+ *
+ *   The replay decodes the true (undelayed) helicity of every recorded
+ *   window.  A mismatch is classified from the windows that follow it,
+ *   as in heliCheck: a bit error, a missed window (the sequence skips
+ *   one), an extra window (flagged unlocked, the sequence holds), or a
+ *   loss of sync, after which the sequence is recovered again.
+ *
+ *   The run is split into chunks of a fixed number of windows, decoded
+ *   in parallel, each starting unlocked.  The seams between chunks are
+ *   then checked in order, and a chunk whose start differs from the end
+ *   of the previous chunk is decoded again from that end, until the two
+ *   decodes of the chunk agree (checked every thousand windows or so).
+ *   The result is the same as a decode of the run as one chunk, for any
+ *   number of threads and any chunk size.
+ *
+ */
+
+#include <stdint.h>
+#include "heliSeq.h"
+
+#define HELI_REPLAY_CHUNK_WINDOWS (1 << 20)
+
+/* Decoded window flags, in addition to the HELI_WINDOW_* signals */
+#define HELI_REPLAY_MISMATCH (1 << 6) /* Recorded window differs from the prediction */
+#define HELI_REPLAY_UNLOCKED (1 << 7) /* No prediction for the window */
+
+typedef struct
+{
+  uint64_t windows;           /* Windows decoded */
+  uint64_t mismatches;        /* Windows that differ from the prediction */
+  uint64_t unlocked;          /* Windows without a prediction */
+  uint64_t resyncs;           /* Sequence recoveries */
+  uint64_t stitched;          /* Chunks decoded again from the previous chunk */
+  uint64_t seams;             /* Chunk boundaries where the sequence changes */
+  uint64_t missed;            /* Windows missing from the recording */
+  uint64_t extra;             /* Windows recorded, not in the sequence */
+} heliReplayStats_t;
+
+int32_t heliReplay(uint32_t pattern, uint32_t delay,
+		   const uint8_t *signals, uint8_t *decoded, uint64_t nwindows,
+		   uint32_t chunkWindows, uint32_t nthreads, heliReplayStats_t *stats);
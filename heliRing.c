@@ -0,0 +1,187 @@
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Lock-free single producer / single consumer ring
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "heliRing.h"
+#include "heliPrivate.h"
+
+#define RING_LINE 64
+
+struct heliRing
+{
+  /* Producer line */
+  uint64_t head;              /* Records committed */
+  uint64_t tailCache;         /* Producer copy of tail */
+  uint8_t  _pad0[RING_LINE - 16];
+  /* Consumer line */
+  uint64_t tail;              /* Records released */
+  uint64_t headCache;         /* Consumer copy of head */
+  uint8_t  _pad1[RING_LINE - 16];
+  /* Read only */
+  uint32_t recordSize;
+  uint32_t nrecords;
+  uint64_t mask;
+  uint8_t  *data;
+};
+
+/**
+ * @brief Create a ring
+ * @param[in] recordSize Bytes per record
+ * @param[in] nrecords Records in the ring, a power of two
+ * @return Ring if successful, otherwise NULL
+ */
+heliRing_t *
+heliRingCreate(uint32_t recordSize, uint32_t nrecords)
+{
+  heliRing_t *ring;
+
+  if((recordSize == 0) || (nrecords == 0) || (nrecords & (nrecords - 1)))
+    {
+      HELI_ERR("Invalid ring size (%u records of %u bytes)\n", nrecords, recordSize);
+      return NULL;
+    }
+
+  if(posix_memalign((void **) &ring, RING_LINE, sizeof(*ring)) != 0)
+    {
+      HELI_ERR("Unable to allocate memory\n");
+      return NULL;
+    }
+  memset(ring, 0, sizeof(*ring));
+
+  if(posix_memalign((void **) &ring->data, RING_LINE, (size_t) recordSize * nrecords) != 0)
+    {
+      HELI_ERR("Unable to allocate memory\n");
+      free(ring);
+      return NULL;
+    }
+
+  ring->recordSize = recordSize;
+  ring->nrecords = nrecords;
+  ring->mask = nrecords - 1;
+
+  return ring;
+}
+
+/**
+ * @brief Free a ring
+ * @param[in] ring Ring
+ */
+void
+heliRingDestroy(heliRing_t *ring)
+{
+  if(ring == NULL)
+    return;
+
+  free(ring->data);
+  free(ring);
+}
+
+/**
+ * @brief Reserve free records (producer)
+ * @details The records are contiguous, so fewer than max may be returned
+ *          at the end of the ring.
+ * @param[in] ring Ring
+ * @param[in] max Most records wanted
+ * @param[out] records First reserved record
+ * @return Number of reserved records, 0 if the ring is full
+ */
+uint32_t
+heliRingReserve(heliRing_t *ring, uint32_t max, void **records)
+{
+  uint64_t head = ring->head, space, toEnd;
+
+  space = ring->nrecords - (head - ring->tailCache);
+  if(space < max)
+    {
+      ring->tailCache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+      space = ring->nrecords - (head - ring->tailCache);
+    }
+
+  toEnd = ring->nrecords - (head & ring->mask);
+  if(space > toEnd)
+    space = toEnd;
+  if(space > max)
+    space = max;
+
+  *records = &ring->data[(head & ring->mask) * ring->recordSize];
+
+  return space;
+}
+
+/**
+ * @brief Publish reserved records (producer)
+ * @param[in] ring Ring
+ * @param[in] n Records filled, at most the number reserved
+ */
+void
+heliRingCommit(heliRing_t *ring, uint32_t n)
+{
+  __atomic_store_n(&ring->head, ring->head + n, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Get filled records (consumer)
+ * @details The records are contiguous, so fewer than max may be returned
+ *          at the end of the ring.
+ * @param[in] ring Ring
+ * @param[in] max Most records wanted
+ * @param[out] records First filled record
+ * @return Number of filled records, 0 if the ring is empty
+ */
+uint32_t
+heliRingPeek(heliRing_t *ring, uint32_t max, void **records)
+{
+  uint64_t tail = ring->tail, avail, toEnd;
+
+  avail = ring->headCache - tail;
+  if(avail < max)
+    {
+      ring->headCache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+      avail = ring->headCache - tail;
+    }
+
+  toEnd = ring->nrecords - (tail & ring->mask);
+  if(avail > toEnd)
+    avail = toEnd;
+  if(avail > max)
+    avail = max;
+
+  *records = &ring->data[(tail & ring->mask) * ring->recordSize];
+
+  return avail;
+}
+
+/**
+ * @brief Return read records to the producer (consumer)
+ * @param[in] ring Ring
+ * @param[in] n Records read, at most the number peeked
+ */
+void
+heliRingRelease(heliRing_t *ring, uint32_t n)
+{
+  __atomic_store_n(&ring->tail, ring->tail + n, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Records in the ring
+ * @param[in] ring Ring
+ * @return Committed records not yet released
+ */
+uint64_t
+heliRingCount(const heliRing_t *ring)
+{
+  return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) -
+    __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,33 @@
+#pragma once
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Header for the lock-free single producer / single consumer ring
+ *
+ *   Fixed size records, in a power of two ring.  The producer reserves a
+ *   contiguous batch of free slots, fills them in place and commits it.
+ *   The consumer peeks at a contiguous batch of filled slots, reads them
+ *   in place and releases it.  Nothing is copied and nothing is locked.
+ *
+ */
+
+#include <stdint.h>
+
+typedef struct heliRing heliRing_t;
+
+heliRing_t *heliRingCreate(uint32_t recordSize, uint32_t nrecords);
+void     heliRingDestroy(heliRing_t *ring);
+
+uint32_t heliRingReserve(heliRing_t *ring, uint32_t max, void **records);
+void     heliRingCommit(heliRing_t *ring, uint32_t n);
+
+uint32_t heliRingPeek(heliRing_t *ring, uint32_t max, void **records);
+void     heliRingRelease(heliRing_t *ring, uint32_t n);
+
+uint64_t heliRingCount(const heliRing_t *ring);
@@ -0,0 +1,357 @@
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Window synchronous sampler
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "heliSampler.h"
+#include "heliReadout.h"
+#include "heliRing.h"
+#include "heliPrivate.h"
+
+_Static_assert(sizeof(heliSample_t) == 24, "heliSample_t must be 24 bytes");
+
+#define SAMPLER_MAX_SLEEP_NS  100000000ULL /* Longest sleep between checks for stop */
+#define SAMPLER_MIN_POLL_NS   10000ULL     /* Shortest poll interval of an edge search */
+#define SAMPLER_EDGE_POLLS    16           /* Polls per window of an edge search */
+#define SAMPLER_EDGE_WINDOWS  4            /* Windows polled for an edge */
+
+#define STAT_ADD(_s, _stat, _n) __atomic_fetch_add(&(_s)->stats._stat, (_n), __ATOMIC_RELAXED)
+
+struct heliSampler
+{
+  uint32_t every;             /* Windows per sample */
+  heliRing_t *ring;
+  pthread_t thread;
+  int32_t  stop;
+  heliReadout_t ro;           /* Window counter, and window period */
+  double   nominalNs;         /* Window period of the configured timing [ns] */
+  heliSamplerStats_t stats;
+};
+
+static inline uint64_t
+samplerNow(clockid_t clock)
+{
+  struct timespec ts;
+
+  clock_gettime(clock, &ts);
+
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Sleep until time (CLOCK_MONOTONIC), or stop.  Returns 0 if stopped */
+static int32_t
+samplerSleepUntil(heliSampler_t *s, uint64_t time)
+{
+  struct timespec ts;
+  uint64_t now, until;
+
+  while(!__atomic_load_n(&s->stop, __ATOMIC_ACQUIRE))
+    {
+      now = samplerNow(CLOCK_MONOTONIC);
+      if(now >= time)
+	return 1;
+
+      until = (time - now > SAMPLER_MAX_SLEEP_NS) ? now + SAMPLER_MAX_SLEEP_NS : time;
+      ts.tv_sec = until / 1000000000ULL;
+      ts.tv_nsec = until % 1000000000ULL;
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    }
+
+  return 0;
+}
+
+/* Read the state register, and extend the window counter.  Returns the windows counted */
+static int64_t
+samplerRead(heliSampler_t *s, uint64_t *time)
+{
+  uint32_t bank[HELI_READOUT_NWORDS];
+  uint64_t before = s->ro.window;
+  int32_t state = heliReadSequencerState();
+
+  *time = samplerNow(CLOCK_MONOTONIC);
+  STAT_ADD(s, reads, 1);
+  if(state < 0)
+    return -1;
+
+  heliReadoutWriteState(&s->ro, bank, state, *time);
+
+  return s->ro.window - before;
+}
+
+/*
+ * Poll the state register for a window edge.  Returns 1 with the time
+ * of the edge, 0 if none was found, -1 if stopped or on error.
+ */
+static int32_t
+samplerFindEdge(heliSampler_t *s, uint64_t *edge)
+{
+  uint64_t step, prev, t;
+  int64_t n;
+  uint32_t ipoll;
+
+  step = s->ro.windowNs / SAMPLER_EDGE_POLLS;
+  if(step < SAMPLER_MIN_POLL_NS)
+    step = SAMPLER_MIN_POLL_NS;
+
+  if(samplerRead(s, &prev) < 0)
+    return -1;
+
+  for(ipoll = 0; ipoll < SAMPLER_EDGE_WINDOWS * SAMPLER_EDGE_POLLS; ipoll++)
+    {
+      if(!samplerSleepUntil(s, prev + step))
+	return -1;
+
+      n = samplerRead(s, &t);
+      if(n < 0)
+	return -1;
+      if(n > 0)
+	{
+	  *edge = prev + (t - prev) / 2;
+	  return 1;
+	}
+      prev = t;
+    }
+
+  return 0;
+}
+
+static void
+samplerPublish(heliSampler_t *s, uint64_t time, uint8_t flags, uint64_t windows)
+{
+  heliSample_t *sample;
+
+  if(heliRingReserve(s->ring, 1, (void **) &sample) == 0)
+    {
+      STAT_ADD(s, overruns, 1);
+      return;
+    }
+
+  sample->window = s->ro.window;
+  sample->time = time;
+  sample->state = s->ro.lastState;
+  sample->flags = flags;
+  sample->_blank[0] = sample->_blank[1] = 0;
+  sample->windows = (windows > UINT32_MAX) ? UINT32_MAX : windows;
+  heliRingCommit(s->ring, 1);
+
+  STAT_ADD(s, samples, 1);
+}
+
+static void *
+samplerThread(void *arg)
+{
+  heliSampler_t *s = arg;
+  uint64_t edge = 0, next = 0, period = 0, expected = 0, last = 0, t, wall, slots;
+  uint64_t prevEdge = 0, prevEdgeWindow = 0;
+  double measured;
+  uint8_t flags = 0;
+  int32_t lock = 1, first = 1, stat;
+  int64_t n;
+
+  while(!__atomic_load_n(&s->stop, __ATOMIC_ACQUIRE))
+    {
+      if(lock)
+	{
+	  stat = samplerFindEdge(s, &edge);
+	  if(stat < 0)
+	    break;
+
+	  lock = 0;
+	  if(stat == 0)
+	    {
+	      /* No edge: flag the stall, and search again after a period */
+	      period = s->every * s->ro.windowNs;
+	      samplerPublish(s, samplerNow(CLOCK_REALTIME), HELI_SAMPLE_STALLED,
+			     s->ro.window - last);
+	      last = s->ro.window;
+	      STAT_ADD(s, stalls, 1);
+	      lock = samplerSleepUntil(s, samplerNow(CLOCK_MONOTONIC) + period);
+	      continue;
+	    }
+
+	  /* The board period, from the edges, if near the configured timing */
+	  if(!first)
+	    {
+	      STAT_ADD(s, relocks, 1);
+	      measured = (double) (edge - prevEdge) / (s->ro.window - prevEdgeWindow);
+	      if((s->ro.window > prevEdgeWindow) &&
+		 (measured > 0.9 * s->nominalNs) && (measured < 1.1 * s->nominalNs))
+		s->ro.windowNs = measured;
+	    }
+	  first = 0;
+	  prevEdge = edge;
+	  prevEdgeWindow = s->ro.window;
+	  period = s->every * s->ro.windowNs;
+	  flags = HELI_SAMPLE_RELOCK;
+
+	  /* The middle of the window, N windows after the one at the edge */
+	  next = edge + s->ro.windowNs / 2 + period;
+	  expected = s->ro.window + s->every;
+	}
+
+      if(!samplerSleepUntil(s, next))
+	break;
+
+      n = samplerRead(s, &t);
+      wall = samplerNow(CLOCK_REALTIME);
+      if(n < 0)
+	{
+	  HELI_ERR("Unable to read the sequencer state\n");
+	  break;
+	}
+
+      if((n == 0) && (s->ro.window < expected))
+	{
+	  flags |= HELI_SAMPLE_STALLED;
+	  STAT_ADD(s, stalls, 1);
+	}
+
+      /* Late: past the window scheduled.  Count the windows not sampled */
+      slots = (t - next) / period;
+      if(t - next >= s->ro.windowNs / 2)
+	{
+	  flags |= HELI_SAMPLE_SKIPPED;
+	  if(s->ro.window > expected)
+	    STAT_ADD(s, skipped, s->ro.window - expected);
+	}
+      else if((n != 0) && (s->ro.window != expected))
+	lock = 1;               /* On time, another window: the schedule drifted */
+
+      samplerPublish(s, wall, flags, s->ro.window - last);
+      last = s->ro.window;
+      flags = 0;
+
+      next += (slots + 1) * period;
+      expected += (slots + 1) * s->every;
+    }
+
+  return NULL;
+}
+
+/**
+ * @brief Create a sampler, and start its thread
+ * @details Requires an initialized library.  Recreate the sampler after
+ *          a change of the timing configuration.
+ * @param[in] every Windows per sample
+ * @param[in] nrecords Samples kept for the consumer, a power of two
+ * @return Sampler if successful, otherwise NULL
+ */
+heliSampler_t *
+heliSamplerCreate(uint32_t every, uint32_t nrecords)
+{
+  heliSampler_t *s;
+  heliRegs regs;
+  double tsettle, tstable, freq = 0;
+
+  if(every == 0)
+    {
+      HELI_ERR("Invalid windows per sample (%u)\n", every);
+      return NULL;
+    }
+
+  if(heliGetRegisterSnapshot(&regs) != 0)
+    return NULL;
+
+  if((heliGetHelcityTiming(&tsettle, &tstable, &freq) != 0) || (freq <= 0))
+    {
+      HELI_ERR("Unable to get the helicity timing\n");
+      return NULL;
+    }
+
+  s = calloc(1, sizeof(*s));
+  if(s == NULL)
+    {
+      HELI_ERR("Unable to allocate memory\n");
+      return NULL;
+    }
+  s->every = every;
+  heliReadoutInitRegs(&s->ro, &regs, samplerNow(CLOCK_MONOTONIC));
+  s->nominalNs = s->ro.windowNs = 1e9 / freq;
+
+  s->ring = heliRingCreate(sizeof(heliSample_t), nrecords);
+  if(s->ring == NULL)
+    {
+      free(s);
+      return NULL;
+    }
+
+  if(pthread_create(&s->thread, NULL, samplerThread, s) != 0)
+    {
+      HELI_ERR("Unable to start the sampler thread\n");
+      heliRingDestroy(s->ring);
+      free(s);
+      return NULL;
+    }
+
+  return s;
+}
+
+/**
+ * @brief Stop the sampler thread, and destroy the sampler
+ * @param[in] s Sampler
+ */
+void
+heliSamplerDestroy(heliSampler_t *s)
+{
+  if(s == NULL)
+    return;
+
+  __atomic_store_n(&s->stop, 1, __ATOMIC_RELEASE);
+  pthread_join(s->thread, NULL);
+
+  heliRingDestroy(s->ring);
+  free(s);
+}
+
+/**
+ * @brief Peek at the samples published, without copying
+ * @param[in] s Sampler
+ * @param[in] max Most samples returned
+ * @param[out] samples First sample
+ * @return Number of contiguous samples
+ */
+uint32_t
+heliSamplerPeek(heliSampler_t *s, uint32_t max, heliSample_t **samples)
+{
+  return heliRingPeek(s->ring, max, (void **) samples);
+}
+
+/**
+ * @brief Release samples, after heliSamplerPeek
+ * @param[in] s Sampler
+ * @param[in] n Number of samples
+ */
+void
+heliSamplerRelease(heliSampler_t *s, uint32_t n)
+{
+  heliRingRelease(s->ring, n);
+}
+
+/**
+ * @brief Get the sampler statistics
+ * @param[in] s Sampler
+ * @param[out] stats Statistics
+ */
+void
+heliSamplerGetStats(const heliSampler_t *s, heliSamplerStats_t *stats)
+{
+  stats->samples = __atomic_load_n(&s->stats.samples, __ATOMIC_RELAXED);
+  stats->reads = __atomic_load_n(&s->stats.reads, __ATOMIC_RELAXED);
+  stats->skipped = __atomic_load_n(&s->stats.skipped, __ATOMIC_RELAXED);
+  stats->stalls = __atomic_load_n(&s->stats.stalls, __ATOMIC_RELAXED);
+  stats->relocks = __atomic_load_n(&s->stats.relocks, __ATOMIC_RELAXED);
+  stats->overruns = __atomic_load_n(&s->stats.overruns, __ATOMIC_RELAXED);
+}
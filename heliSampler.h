@@ -0,0 +1,68 @@
+#pragma once
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Header for the window synchronous sampler
+ *
+ *   A thread reads the sequencer state register once every N windows,
+ *   in the middle of a window, on the schedule of the configured timing
+ *   (heliGetHelcityTiming) with clock_nanosleep.  The 8 bit state is
+ *   extended into a 64 bit window counter (as in heliReadout), and each
+ *   read is published as a heliSample_t through a heliRing, for one
+ *   consumer.
+ *
+ *   To find the middle of a window, the sampler polls the state register
+ *   for one edge at start, and again (a relock) whenever a read on time
+ *   finds another window than scheduled.  A read that finds no window
+ *   since the last is flagged stalled.  A read past the window scheduled
+ *   (e.g. the thread was not run in time) is flagged skipped; the window
+ *   counter still counts the windows passed.  The window period is
+ *   refined at each relock from the time between edges, within 10% of
+ *   the configured timing.
+ *
+ */
+
+#include <stdint.h>
+#include "heliLib.h"
+
+/* Sample flags */
+#define HELI_SAMPLE_SKIPPED (1 << 0) /* Read past the window scheduled */
+#define HELI_SAMPLE_STALLED (1 << 1) /* No window since the last sample, behind schedule */
+#define HELI_SAMPLE_RELOCK  (1 << 2) /* First sample after finding the window edge */
+
+#define HELI_SAMPLER_DEFAULT_RECORDS 4096
+
+typedef struct
+{
+  uint64_t window;            /* Extended window counter */
+  uint64_t time;              /* CLOCK_REALTIME of the read [ns] */
+  uint8_t  state;             /* Sequencer state */
+  uint8_t  flags;             /* HELI_SAMPLE_* flags */
+  uint8_t  _blank[2];
+  uint32_t windows;           /* Windows since the last sample */
+} heliSample_t;
+
+typedef struct
+{
+  uint64_t samples;           /* Samples published */
+  uint64_t reads;             /* Reads of the state register */
+  uint64_t skipped;           /* Windows past those scheduled, at skipped reads */
+  uint64_t stalls;            /* Stalled samples */
+  uint64_t relocks;           /* Edge searches after the first */
+  uint64_t overruns;          /* Samples dropped, ring full */
+} heliSamplerStats_t;
+
+typedef struct heliSampler heliSampler_t;
+
+heliSampler_t *heliSamplerCreate(uint32_t every, uint32_t nrecords);
+void     heliSamplerDestroy(heliSampler_t *s);
+
+uint32_t heliSamplerPeek(heliSampler_t *s, uint32_t max, heliSample_t **samples);
+void     heliSamplerRelease(heliSampler_t *s, uint32_t n);
+void     heliSamplerGetStats(const heliSampler_t *s, heliSamplerStats_t *stats);
@@ -0,0 +1,501 @@
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Helicity Sequence model
+ *
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+#include "heliSeq.h"
+#include "heliPrivate.h"
+
+/* Windows per pattern, indexed by pattern */
+static const uint32_t patternLength[HELI_SEQ_NPATTERNS] =
+  {
+    2, 4, 8, 2, 24, 32, 2, 2, 64, 64, 64
+  };
+
+/* Window signs of each pattern (bit i = heliSeqPatternSign of window i) */
+#define SIGN_PAIR       0x2ULL
+#define SIGN_QUARTET    0x6ULL
+#define SIGN_OCTET      0x96ULL
+#define SIGN_HEXO_QUAD  0x969696ULL
+#define SIGN_OCTO_QUAD  0x96969696ULL
+#define SIGN_THUE_MORSE 0x6996966996696996ULL
+#define SIGN_16_QUAD    0x9696969696969696ULL
+#define SIGN_32_PAIR    0x6666666666666666ULL
+
+static const uint64_t patternSignMask[HELI_SEQ_NPATTERNS] =
+  {
+    SIGN_PAIR, SIGN_QUARTET, SIGN_OCTET, SIGN_PAIR, SIGN_HEXO_QUAD,
+    SIGN_OCTO_QUAD, SIGN_PAIR, SIGN_PAIR, SIGN_THUE_MORSE, SIGN_16_QUAD,
+    SIGN_32_PAIR
+  };
+
+/* Shift register advance by 2^k bits, as GF(2) matrix columns */
+static uint32_t jumpMatrix[30][30];
+static pthread_once_t jumpOnce = PTHREAD_ONCE_INIT;
+
+static uint32_t
+matrixApply(const uint32_t *m, uint32_t v)
+{
+  uint32_t r = 0;
+  while(v)
+    {
+      r ^= m[__builtin_ctz(v)];
+      v &= v - 1;
+    }
+  return r;
+}
+
+static void
+jumpInit()
+{
+  uint32_t j, k;
+
+  /* Single step: shift up, feed back taps 7, 28, 29, 30 into bit 0 */
+  for(j = 0; j < 30; j++)
+    {
+      jumpMatrix[0][j] = (1u << (j + 1)) & HELI_SEQ_SEED_MASK;
+      if((j == 6) || (j == 27) || (j == 28) || (j == 29))
+	jumpMatrix[0][j] |= 1;
+    }
+
+  for(k = 1; k < 30; k++)
+    for(j = 0; j < 30; j++)
+      jumpMatrix[k][j] = matrixApply(jumpMatrix[k - 1], jumpMatrix[k - 1][j]);
+}
+
+/**
+ * @brief Advance the shift register by one bit
+ * @param[inout] seed Shift register
+ * @return The new pseudo-random bit
+ */
+uint8_t
+heliSeqRanBit(uint32_t *seed)
+{
+  uint32_t s = *seed;
+  uint32_t bit = ((s >> 6) ^ (s >> 27) ^ (s >> 28) ^ (s >> 29)) & 1;
+
+  *seed = ((s << 1) | bit) & HELI_SEQ_SEED_MASK;
+
+  return bit;
+}
+
+/**
+ * @brief Advance the shift register by many bits
+ * @details Advance (or, for negative nbits, rewind) the shift register in
+ *          at most 30 matrix products.
+ * @param[in] seed Shift register
+ * @param[in] nbits Number of bits to advance
+ * @return The shift register after nbits
+ */
+uint32_t
+heliSeqJump(uint32_t seed, int64_t nbits)
+{
+  uint64_t n = ((nbits % HELI_SEQ_PERIOD) + HELI_SEQ_PERIOD) % HELI_SEQ_PERIOD;
+  uint32_t k;
+
+  pthread_once(&jumpOnce, jumpInit);
+
+  for(k = 0; n; k++, n >>= 1)
+    {
+      if(n & 1)
+	seed = matrixApply(jumpMatrix[k], seed);
+    }
+
+  return seed;
+}
+
+/**
+ * @brief Return the number of windows in a helicity pattern
+ * @param[in] pattern Helicity pattern index
+ * @return Number of windows if successful, otherwise -1
+ */
+int32_t
+heliSeqPatternLength(uint32_t pattern)
+{
+  if(pattern >= HELI_SEQ_NPATTERNS)
+    return -1;
+
+  return patternLength[pattern];
+}
+
+/**
+ * @brief Return whether a helicity pattern has a pseudo-random polarity
+ * @param[in] pattern Helicity pattern index
+ * @return 1 if pseudo-random, 0 if not, -1 for an invalid pattern
+ */
+int32_t
+heliSeqPatternIsRandom(uint32_t pattern)
+{
+  if(pattern >= HELI_SEQ_NPATTERNS)
+    return -1;
+
+  return ((pattern == 3) || (pattern == 6) || (pattern == 7)) ? 0 : 1;
+}
+
+/**
+ * @brief Return the sign of a window within a helicity pattern
+ * @param[in] pattern Helicity pattern index
+ * @param[in] phase Window within the pattern
+ * @return 0 if the window has the polarity of the pattern, 1 if opposite
+ */
+uint8_t
+heliSeqPatternSign(uint32_t pattern, uint32_t phase)
+{
+  switch(pattern)
+    {
+    case 1: /* Quartet */
+    case 2: /* Octet */
+    case 8: /* Thue-Morse-64 */
+      return __builtin_parity(phase);
+
+    case 4: /* Hexo-Quad */
+    case 5: /* Octo-Quad */
+    case 9: /* 16-Quad */
+      return __builtin_parity(phase & 0x3) ^ ((phase >> 2) & 1);
+
+    case 10: /* 32-Pair */
+      return (phase ^ (phase >> 1)) & 1;
+
+    default: /* Pair, Toggle */
+      return phase & 1;
+    }
+}
+
+/**
+ * @brief Return the signs of all windows of a helicity pattern
+ * @param[in] pattern Helicity pattern index
+ * @return Bit i is the sign of window i.  @see heliSeqPatternSign
+ */
+uint64_t
+heliSeqPatternSignMask(uint32_t pattern)
+{
+  if(pattern >= HELI_SEQ_NPATTERNS)
+    return 0;
+
+  return patternSignMask[pattern];
+}
+
+/**
+ * @brief Initialize a helicity sequence
+ * @param[out] seq Helicity sequence
+ * @param[in] pattern Helicity pattern index
+ * @param[in] delay Reporting delay [windows]
+ * @param[in] seed Shift register holding the polarity of the current pattern
+ *            of the reported helicity in bit 0
+ * @param[in] phase Window of the reported helicity within its pattern
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliSeqInit(heliSeq_t *seq, uint32_t pattern, uint32_t delay,
+	    uint32_t seed, uint32_t phase)
+{
+  if(pattern >= HELI_SEQ_NPATTERNS)
+    {
+      HELI_ERR("Invalid pattern (%d)\n", pattern);
+      return -1;
+    }
+
+  seq->pattern = pattern;
+  seq->length = patternLength[pattern];
+  seq->delay = delay;
+  seq->seed = (heliSeqPatternIsRandom(pattern)) ? (seed & HELI_SEQ_SEED_MASK) : 0;
+  seq->phase = phase % seq->length;
+  seq->syncPhase = (seq->phase + delay) % seq->length;
+
+  return 0;
+}
+
+/**
+ * @brief Return the signals of the current window, and advance one window
+ * @param[inout] seq Helicity sequence
+ * @return Mask of HELI_WINDOW_* signals
+ */
+uint8_t
+heliSeqNext(heliSeq_t *seq)
+{
+  uint8_t signals = ((seq->seed ^ (patternSignMask[seq->pattern] >> seq->phase)) & 1) ?
+    HELI_WINDOW_HELICITY : 0;
+
+  if(seq->syncPhase == 0)
+    signals |= HELI_WINDOW_PATTERN_SYNC;
+  if((seq->syncPhase & 1) == 0)
+    signals |= HELI_WINDOW_PAIR_SYNC;
+
+  if(++seq->phase == seq->length)
+    {
+      seq->phase = 0;
+      if(seq->seed)
+	heliSeqRanBit(&seq->seed);
+    }
+  if(++seq->syncPhase == seq->length)
+    seq->syncPhase = 0;
+
+  return signals;
+}
+
+/**
+ * @brief Move a helicity sequence forward (or back) by a number of windows
+ * @param[inout] seq Helicity sequence
+ * @param[in] nwindows Number of windows to skip, negative to rewind
+ */
+void
+heliSeqSkip(heliSeq_t *seq, int64_t nwindows)
+{
+  int64_t len = seq->length;
+  int64_t t = (int64_t) seq->phase + nwindows;
+  int64_t npatterns = (t >= 0) ? (t / len) : -((len - 1 - t) / len);
+
+  seq->phase = t - npatterns * len;
+  seq->syncPhase = (seq->phase + seq->delay) % len;
+  if(seq->seed && npatterns)
+    seq->seed = heliSeqJump(seq->seed, npatterns);
+}
+
+/*
+ * Generator kernels, one per pattern.  Windows up to the next pattern
+ * boundary go through heliSeqNext.  Whole patterns are then laid out
+ * from the compile-time sign mask, flipped by the pattern polarity, with
+ * no branch on the pattern type.
+ */
+typedef void (*seqKernel)(heliSeq_t *seq, uint8_t *signals, uint64_t nwindows);
+typedef void (*seqBitsKernel)(heliSeq_t *seq, uint64_t *bits, uint64_t nwindows);
+
+_Static_assert(HELI_WINDOW_HELICITY == 1, "kernels expect helicity in bit 0");
+
+/* Append nbits (<= 64) to a packed bit stream */
+typedef struct
+{
+  uint64_t *out;
+  uint64_t acc;
+  uint32_t n;
+} seqBitWriter;
+
+static inline void
+seqBitAppend(seqBitWriter *w, uint64_t bits, uint32_t nbits)
+{
+  w->acc |= bits << w->n;
+  if(w->n + nbits >= 64)
+    {
+      uint32_t used = 64 - w->n;
+      *w->out++ = w->acc;
+      w->acc = (used < 64) ? (bits >> used) : 0;
+      w->n = w->n + nbits - 64;
+    }
+  else
+    w->n += nbits;
+}
+
+#define SEQ_KERNEL(_name, _len, _mask, _random)				\
+  static void								\
+  seqGenerate##_name(heliSeq_t *seq, uint8_t *signals, uint64_t nwindows) \
+  {									\
+    uint8_t sync[_len];							\
+    uint64_t iwin = 0;							\
+    uint32_t i;								\
+									\
+    while((iwin < nwindows) && (seq->phase != 0))			\
+      signals[iwin++] = heliSeqNext(seq);				\
+									\
+    for(i = 0; i < (_len); i++)						\
+      {									\
+	uint32_t sp = (i + seq->syncPhase) % (_len);			\
+	sync[i] = ((sp == 0) ? HELI_WINDOW_PATTERN_SYNC : 0) |		\
+	  (((sp & 1) == 0) ? HELI_WINDOW_PAIR_SYNC : 0);		\
+      }									\
+									\
+    for(; iwin + (_len) <= nwindows; iwin += (_len))			\
+      {									\
+	uint64_t hel = (_mask) ^ (0 - (uint64_t) (seq->seed & 1));	\
+	for(i = 0; i < (_len); i++)					\
+	  signals[iwin + i] = ((hel >> i) & 1) | sync[i];		\
+	if(_random)							\
+	  heliSeqRanBit(&seq->seed);					\
+      }									\
+									\
+    while(iwin < nwindows)						\
+      signals[iwin++] = heliSeqNext(seq);				\
+  }									\
+									\
+  static void								\
+  seqGenerateBits##_name(heliSeq_t *seq, uint64_t *bits, uint64_t nwindows) \
+  {									\
+    const uint64_t lenMask = ((_len) == 64) ? ~0ULL : ((1ULL << ((_len) & 63)) - 1); \
+    seqBitWriter w = { bits, 0, 0 };					\
+    uint64_t iwin = 0;							\
+									\
+    while((iwin < nwindows) && (seq->phase != 0))			\
+      {									\
+	seqBitAppend(&w, heliSeqNext(seq) & HELI_WINDOW_HELICITY, 1);	\
+	iwin++;								\
+      }									\
+									\
+    for(; iwin + (_len) <= nwindows; iwin += (_len))			\
+      {									\
+	seqBitAppend(&w, ((_mask) ^ (0 - (uint64_t) (seq->seed & 1))) & lenMask, (_len)); \
+	if(_random)							\
+	  heliSeqRanBit(&seq->seed);					\
+      }									\
+									\
+    while(iwin < nwindows)						\
+      {									\
+	seqBitAppend(&w, heliSeqNext(seq) & HELI_WINDOW_HELICITY, 1);	\
+	iwin++;								\
+      }									\
+									\
+    if(w.n)								\
+      *w.out = w.acc;							\
+  }
+
+SEQ_KERNEL(Pair,       2,  SIGN_PAIR,       1)
+SEQ_KERNEL(Quartet,    4,  SIGN_QUARTET,    1)
+SEQ_KERNEL(Octet,      8,  SIGN_OCTET,      1)
+SEQ_KERNEL(Toggle,     2,  SIGN_PAIR,       0)
+SEQ_KERNEL(HexoQuad,   24, SIGN_HEXO_QUAD,  1)
+SEQ_KERNEL(OctoQuad,   32, SIGN_OCTO_QUAD,  1)
+SEQ_KERNEL(ThueMorse,  64, SIGN_THUE_MORSE, 1)
+SEQ_KERNEL(Quad16,     64, SIGN_16_QUAD,    1)
+SEQ_KERNEL(Pair32,     64, SIGN_32_PAIR,    1)
+
+static const seqKernel seqKernels[HELI_SEQ_NPATTERNS] =
+  {
+    seqGeneratePair, seqGenerateQuartet, seqGenerateOctet, seqGenerateToggle,
+    seqGenerateHexoQuad, seqGenerateOctoQuad, seqGenerateToggle, seqGenerateToggle,
+    seqGenerateThueMorse, seqGenerateQuad16, seqGeneratePair32
+  };
+
+static const seqBitsKernel seqBitsKernels[HELI_SEQ_NPATTERNS] =
+  {
+    seqGenerateBitsPair, seqGenerateBitsQuartet, seqGenerateBitsOctet, seqGenerateBitsToggle,
+    seqGenerateBitsHexoQuad, seqGenerateBitsOctoQuad, seqGenerateBitsToggle, seqGenerateBitsToggle,
+    seqGenerateBitsThueMorse, seqGenerateBitsQuad16, seqGenerateBitsPair32
+  };
+
+/**
+ * @brief Generate the signals of consecutive windows
+ * @param[inout] seq Helicity sequence
+ * @param[out] signals Array of HELI_WINDOW_* masks, one per window
+ * @param[in] nwindows Number of windows
+ */
+void
+heliSeqGenerate(heliSeq_t *seq, uint8_t *signals, uint64_t nwindows)
+{
+  seqKernels[seq->pattern](seq, signals, nwindows);
+}
+
+/**
+ * @brief Generate the reported helicity of consecutive windows, bit packed
+ * @details Window i is bit (i % 64) of bits[i / 64].  Unused bits of the
+ *          last word are zero.
+ * @param[inout] seq Helicity sequence
+ * @param[out] bits Array of (nwindows + 63) / 64 words
+ * @param[in] nwindows Number of windows
+ */
+void
+heliSeqGenerateBits(heliSeq_t *seq, uint64_t *bits, uint64_t nwindows)
+{
+  seqBitsKernels[seq->pattern](seq, bits, nwindows);
+}
+
+/**
+ * @brief Count the windows that a sequence does not predict
+ * @details Compare the HELI_SEQ_SIGNALS of recorded windows with the
+ *          prediction.  The sequence itself is not advanced.
+ * @param[in] seq Helicity sequence, positioned at the first recorded window
+ * @param[in] signals Array of recorded HELI_WINDOW_* masks
+ * @param[in] nwindows Number of recorded windows
+ * @return Number of mispredicted windows
+ */
+uint64_t
+heliSeqMismatch(const heliSeq_t *seq, const uint8_t *signals, uint64_t nwindows)
+{
+  heliSeq_t s = *seq;
+  uint64_t iwin, nbad = 0;
+
+  for(iwin = 0; iwin < nwindows; iwin++)
+    nbad += ((heliSeqNext(&s) ^ signals[iwin]) & HELI_SEQ_SIGNALS) ? 1 : 0;
+
+  return nbad;
+}
+
+/**
+ * @brief Recover a helicity sequence from recorded windows
+ * @details Find the pattern phase from the pattern sync, and the shift
+ *          register from the polarity of 30 consecutive patterns.  Several
+ *          starting points are tried, and the one that best predicts the
+ *          recorded windows is kept.
+ * @param[out] seq Helicity sequence, positioned at the first recorded window
+ * @param[in] pattern Helicity pattern index
+ * @param[in] delay Reporting delay [windows]
+ * @param[in] signals Array of recorded HELI_WINDOW_* masks
+ * @param[in] nwindows Number of recorded windows
+ * @return Number of mispredicted windows (within the tested range) if
+ *         successful, -2 if there are not enough windows (no message is
+ *         printed, the caller decides), otherwise -1
+ */
+int32_t
+heliSeqRecover(heliSeq_t *seq, uint32_t pattern, uint32_t delay,
+	       const uint8_t *signals, uint64_t nwindows)
+{
+  const uint64_t ntest = (nwindows < (1 << 16)) ? nwindows : (1 << 16);
+  const uint32_t maxtries = 8;
+  int32_t len = heliSeqPatternLength(pattern);
+  int64_t best = -1;
+  uint64_t iwin = 0;
+  uint32_t itry;
+
+  if(len < 0)
+    {
+      HELI_ERR("Invalid pattern (%d)\n", pattern);
+      return -1;
+    }
+
+  for(itry = 0; itry < maxtries; itry++)
+    {
+      heliSeq_t trial;
+      uint32_t seed = 0, ipat;
+
+      /* Next pattern sync marks the start of a true pattern */
+      while((iwin < nwindows) && !(signals[iwin] & HELI_WINDOW_PATTERN_SYNC))
+	iwin++;
+
+      /* First window of the reported pattern */
+      uint64_t first = iwin + (delay % len);
+      uint32_t npat = heliSeqPatternIsRandom(pattern) ? 30 : 1;
+      if(first + (uint64_t) (npat - 1) * len >= nwindows)
+	break;
+
+      for(ipat = 0; ipat < npat; ipat++)
+	seed = (seed << 1) |
+	  ((signals[first + (uint64_t) ipat * len] & HELI_WINDOW_HELICITY) ? 1 : 0);
+
+      heliSeqInit(&trial, pattern, delay, seed, 0);
+      heliSeqSkip(&trial, -(int64_t) (first + (uint64_t) (npat - 1) * len));
+
+      int64_t nbad = heliSeqMismatch(&trial, signals, ntest);
+      if((best < 0) || (nbad < best))
+	{
+	  best = nbad;
+	  *seq = trial;
+	}
+      if(nbad == 0)
+	break;
+
+      /* Start again past the patterns just used */
+      iwin = first + (uint64_t) npat * len;
+    }
+
+  if(best < 0)
+    return -2;
+
+  return (int32_t) best;
+}
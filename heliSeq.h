@@ -0,0 +1,69 @@
+#pragma once
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Header for the Helicity Sequence model
+ *
+ *   The polarity of each pattern is drawn from a 30 bit maximal length
+ *   shift register (taps 7, 28, 29, 30).  The windows of the pattern
+ *   follow the sign layout of the selected helicity pattern:
+ *
+ *     Pair           +-
+ *     Quartet        +--+
+ *     Octet          +--+-++-
+ *     Toggle         +-          (not pseudo-random)
+ *     Hexo-Quad      6 Quartets, alternating sign
+ *     Octo-Quad      8 Quartets, alternating sign
+ *     Thue-Morse-64  64 windows, sign = parity of the window number
+ *     16-Quad        16 Quartets, alternating sign
+ *     32-Pair        32 Pairs, alternating sign
+ *
+ *   The reported helicity is delayed by the reporting delay, while the
+ *   pattern sync and pair sync follow the true sequence.
+ *
+ */
+
+#include <stdint.h>
+#include "heliLib.h"
+
+/* Signals predicted by the sequence */
+#define HELI_SEQ_SIGNALS   (HELI_WINDOW_HELICITY | HELI_WINDOW_PATTERN_SYNC | HELI_WINDOW_PAIR_SYNC)
+
+#define HELI_SEQ_SEED_MASK 0x3FFFFFFF
+#define HELI_SEQ_PERIOD    0x3FFFFFFF /* 2^30 - 1 */
+#define HELI_SEQ_NPATTERNS 11
+
+typedef struct
+{
+  uint32_t pattern;   /* Helicity pattern index */
+  uint32_t length;    /* Windows per pattern */
+  uint32_t delay;     /* Reporting delay [windows] */
+  uint32_t seed;      /* Shift register, after drawing the current polarity */
+  uint32_t phase;     /* Window of the reported helicity within its pattern */
+  uint32_t syncPhase; /* Window of the true sequence within its pattern */
+} heliSeq_t;
+
+uint8_t  heliSeqRanBit(uint32_t *seed);
+uint32_t heliSeqJump(uint32_t seed, int64_t nbits);
+
+int32_t  heliSeqPatternLength(uint32_t pattern);
+int32_t  heliSeqPatternIsRandom(uint32_t pattern);
+uint8_t  heliSeqPatternSign(uint32_t pattern, uint32_t phase);
+uint64_t heliSeqPatternSignMask(uint32_t pattern);
+
+int32_t  heliSeqInit(heliSeq_t *seq, uint32_t pattern, uint32_t delay,
+		     uint32_t seed, uint32_t phase);
+uint8_t  heliSeqNext(heliSeq_t *seq);
+void     heliSeqSkip(heliSeq_t *seq, int64_t nwindows);
+void     heliSeqGenerate(heliSeq_t *seq, uint8_t *signals, uint64_t nwindows);
+void     heliSeqGenerateBits(heliSeq_t *seq, uint64_t *bits, uint64_t nwindows);
+uint64_t heliSeqMismatch(const heliSeq_t *seq, const uint8_t *signals, uint64_t nwindows);
+
+int32_t  heliSeqRecover(heliSeq_t *seq, uint32_t pattern, uint32_t delay,
+			const uint8_t *signals, uint64_t nwindows);
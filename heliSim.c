@@ -0,0 +1,155 @@
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Virtual time board simulator
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "heliSim.h"
+#include "heliPrivate.h"
+
+_Static_assert(sizeof(heliSimEdge_t) == 24, "heliSimEdge_t must be 24 bytes");
+
+/* Unit gaussian for a window */
+static double
+simGauss(uint64_t key, uint64_t window)
+{
+  double u1 = heliHashUniform(heliHash64(key, 2 * window));
+  double u2 = heliHashUniform(heliHash64(key, 2 * window + 1));
+  return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+/* Round a time to the output clock */
+static inline uint64_t
+simTick(const heliSim_t *sim, double t)
+{
+  if(t < 0)
+    return 0;
+  return (uint64_t) (t / sim->tickNs + 0.5) * sim->tickNs;
+}
+
+/**
+ * @brief Initialize the simulator
+ * @param[out] sim Simulator
+ * @param[in] cfg Configuration register values
+ * @param[in] seed Shift register holding the polarity of the first pattern
+ * @param[in] jitterNs RMS jitter of line sync window starts [ns]
+ * @param[in] key Jitter random number key
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliSimInit(heliSim_t *sim, const heliConfig_t *cfg, uint32_t seed,
+	    double jitterNs, uint64_t key)
+{
+  double tsettle, tstable, freq;
+  uint8_t mode = cfg->clock & HELI_HELICITY_CLOCK_MASK;
+
+  if((cfg->pattern & HELI_PATTERN_MASK) >= HELI_SEQ_NPATTERNS)
+    {
+      HELI_ERR("Invalid pattern (%d)\n", cfg->pattern);
+      return -1;
+    }
+
+  if(jitterNs < 0)
+    {
+      HELI_ERR("Invalid jitter (%g)\n", jitterNs);
+      return -1;
+    }
+
+  memset(sim, 0, sizeof(*sim));
+  sim->cfg = *cfg;
+
+  if(heliSeqInit(&sim->seq, cfg->pattern & HELI_PATTERN_MASK,
+		 iDelayVals[cfg->delay & HELI_DELAY_MASK], seed, 0) < 0)
+    return -1;
+
+  heliCalcHelicityTiming(cfg->clock, cfg->tsettle, cfg->tstable, &tsettle, &tstable, &freq);
+
+  sim->lineSync = (fClockVals[mode] > 0);
+  sim->periodNs = 1.0e9 / freq;
+  sim->tsettleNs = tsettle * 1000.0;
+  sim->jitterNs = sim->lineSync ? jitterNs : 0;
+  sim->tickNs = (cfg->clock & HELI_BOARDCLOCK_10MHZ) ? 100 : 50;
+  sim->key = key;
+
+  return 0;
+}
+
+/**
+ * @brief Step the virtual clock through the next edges
+ * @param[inout] sim Simulator
+ * @param[out] edges Edges, in time order
+ * @param[in] maxEdges Size of edges
+ * @return Number of edges
+ */
+uint32_t
+heliSimRun(heliSim_t *sim, heliSimEdge_t *edges, uint32_t maxEdges)
+{
+  uint32_t n = 0;
+  uint64_t t;
+  uint8_t signals;
+
+  while(n < maxEdges)
+    {
+      heliSimEdge_t *e = &edges[n++];
+
+      if(sim->settleEnd)
+	{
+	  /* End of T_settle of the last window */
+	  e->time = sim->settleEnd;
+	  e->window = sim->window - 1;
+	  e->changed = HELI_WINDOW_TSETTLE;
+	  sim->signals &= ~HELI_WINDOW_TSETTLE;
+	  e->signals = sim->signals;
+	  sim->settleEnd = 0;
+	}
+      else
+	{
+	  /* Window start */
+	  double start = sim->window * sim->periodNs;
+	  if(sim->jitterNs > 0)
+	    start += sim->jitterNs * simGauss(sim->key, sim->window);
+
+	  t = simTick(sim, start);
+	  if((sim->window > 0) && (t <= sim->lastTime))
+	    t = sim->lastTime + sim->tickNs;
+
+	  signals = heliSeqNext(&sim->seq) | HELI_WINDOW_TSETTLE;
+	  e->time = t;
+	  e->window = sim->window;
+	  e->changed = (signals ^ sim->signals) | HELI_WINDOW_TSETTLE;
+	  e->signals = signals;
+	  sim->signals = signals;
+
+	  sim->settleEnd = simTick(sim, t + sim->tsettleNs);
+	  if(sim->settleEnd <= t)
+	    sim->settleEnd = t + sim->tickNs;
+	  sim->window++;
+	}
+
+      memset(e->_blank, 0, sizeof(e->_blank));
+      sim->lastTime = e->time;
+    }
+
+  return n;
+}
+
+/**
+ * @brief Virtual time of the last edge
+ * @param[in] sim Simulator
+ * @return Time [ns]
+ */
+uint64_t
+heliSimTime(const heliSim_t *sim)
+{
+  return sim->lastTime;
+}
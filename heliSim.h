@@ -0,0 +1,62 @@
+#pragma once
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Header for the virtual time board simulator
+ *
+ *   The simulator steps a virtual clock through the output edges of the
+ *   board for a configuration (heliConfig_t).  Each window makes two
+ *   edges:
+ *     window start   T_settle rises, and the reported helicity, pattern
+ *                    sync and pair sync take the values of the window
+ *     T_settle end   T_settle falls
+ *
+ *   In free clock mode the window period is T_settle + T_stable.  In line
+ *   sync modes window starts are locked to the line, smeared by a
+ *   gaussian jitter, and T_stable fills the rest of the line period.
+ *   Edge times are rounded to the output (board) clock period.
+ *
+ *   Jitter random numbers are a hash of (key, window), so a run is
+ *   reproducible, and does not depend on how it is split into calls.
+ *
+ */
+
+#include <stdint.h>
+#include "heliLib.h"
+#include "heliSeq.h"
+
+typedef struct
+{
+  uint64_t time;              /* Virtual time [ns] */
+  uint64_t window;            /* Window number */
+  uint8_t  signals;           /* HELI_WINDOW_* levels after the edge */
+  uint8_t  changed;           /* HELI_WINDOW_* signals that changed */
+  uint8_t  _blank[6];
+} heliSimEdge_t;
+
+typedef struct
+{
+  heliConfig_t cfg;           /* Simulated configuration */
+  heliSeq_t seq;              /* Helicity sequence */
+  double   periodNs;          /* Window (free clock) or line period [ns] */
+  double   tsettleNs;         /* T_settle [ns] */
+  double   jitterNs;          /* RMS jitter of line sync window starts [ns] */
+  uint32_t tickNs;            /* Output clock period [ns] */
+  int32_t  lineSync;          /* Window starts locked to the line */
+  uint64_t key;               /* Jitter random number key */
+  uint64_t window;            /* Window of the next start edge */
+  uint64_t settleEnd;         /* Time of the pending T_settle end, 0 if none */
+  uint64_t lastTime;          /* Time of the last edge */
+  uint8_t  signals;           /* Current levels */
+} heliSim_t;
+
+int32_t  heliSimInit(heliSim_t *sim, const heliConfig_t *cfg, uint32_t seed,
+		     double jitterNs, uint64_t key);
+uint32_t heliSimRun(heliSim_t *sim, heliSimEdge_t *edges, uint32_t maxEdges);
+uint64_t heliSimTime(const heliSim_t *sim);
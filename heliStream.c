@@ -0,0 +1,661 @@
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Writer and reader for Helicity Stream files
+ *
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "heliStream.h"
+#include "heliPrivate.h"
+
+_Static_assert(sizeof(heliStreamHeader_t) == HELI_STREAM_PAGE,
+	       "heliStreamHeader_t must fill one page");
+_Static_assert(sizeof(heliStreamIndex_t) == 16,
+	       "heliStreamIndex_t must be 16 bytes");
+_Static_assert(sizeof(heliStreamGap_t) == 16,
+	       "heliStreamGap_t must be 16 bytes");
+
+struct heliStreamWriter
+{
+  int fd;                       /* Output file descriptor */
+  heliStreamHeader_t hdr;       /* Header, final on close */
+  uint8_t chunk[HELI_STREAM_PAGE]; /* Chunk being filled */
+  heliStreamIndex_t current;    /* Index entry of the chunk being filled */
+  heliStreamIndex_t *index;     /* Index entries of written chunks */
+  uint64_t nalloc;              /* Allocated index entries */
+  uint32_t missing;             /* Windows of the chunk in gaps */
+  heliStreamGap_t *gaps;        /* Gaps within chunks */
+  uint64_t ngapAlloc;           /* Allocated gaps */
+  uint64_t nextWindow;          /* Window after the last one written */
+};
+
+struct heliStreamReader
+{
+  uint8_t *map;                 /* Mapped file */
+  size_t size;                  /* Size of the mapping */
+  const heliStreamHeader_t *hdr;
+  const heliStreamIndex_t *index;
+  const heliStreamGap_t *gaps;
+  heliStreamIndex_t *recovered; /* Index rebuilt for an unfinished file */
+};
+
+/* Write the whole buffer at the given offset */
+static int32_t
+streamPwrite(int fd, const void *buf, size_t len, off_t offset)
+{
+  const uint8_t *p = buf;
+  while(len > 0)
+    {
+      ssize_t n = pwrite(fd, p, len, offset);
+      if(n < 0)
+	{
+	  perror("pwrite");
+	  return -1;
+	}
+      p += n;
+      len -= n;
+      offset += n;
+    }
+  return 0;
+}
+
+/* Write out the chunk being filled, and add it to the index */
+static int32_t
+streamFlushChunk(heliStreamWriter_t *w)
+{
+  heliStreamHeader_t *hdr = &w->hdr;
+
+  if(w->current.nwindows == 0)
+    return 0;
+
+  if(hdr->nchunks == w->nalloc)
+    {
+      uint64_t nalloc = (w->nalloc) ? 2 * w->nalloc : 1024;
+      heliStreamIndex_t *index = realloc(w->index, nalloc * sizeof(*index));
+      if(index == NULL)
+	{
+	  HELI_ERR("Unable to allocate chunk index\n");
+	  return -1;
+	}
+      w->index = index;
+      w->nalloc = nalloc;
+    }
+
+  if(hdr->nchunks == 0)
+    hdr->firstWindow = w->current.firstWindow;
+  else
+    {
+      const heliStreamIndex_t *prev = &w->index[hdr->nchunks - 1];
+      if((prev->nwindows != hdr->chunkWindows) ||
+	 (w->current.firstWindow != prev->firstWindow + prev->nwindows))
+	hdr->flags &= ~HELI_STREAM_CONTIGUOUS;
+    }
+
+  if(streamPwrite(w->fd, w->chunk, HELI_STREAM_PAGE,
+		  (off_t) HELI_STREAM_PAGE * (1 + hdr->nchunks)) < 0)
+    return -1;
+
+  w->index[hdr->nchunks++] = w->current;
+  hdr->nwindows += w->current.nwindows - w->missing;
+
+  memset(w->chunk, 0, sizeof(w->chunk));
+  w->current.nwindows = 0;
+  w->missing = 0;
+
+  /* Keep the provisional header up to date while it can describe the file */
+  if(hdr->flags & HELI_STREAM_CONTIGUOUS)
+    return streamPwrite(w->fd, hdr, sizeof(*hdr), 0);
+
+  return 0;
+}
+
+/**
+ * @brief Open a helicity stream file for writing
+ * @details Create (or truncate) a helicity stream file, and write a
+ *          provisional header flagged HELI_STREAM_UNFINISHED.  Memory use
+ *          of the writer is one chunk, plus 16 bytes of index per chunk
+ *          written.
+ * @param[in] path Name of the file
+ * @param[in] snapshot Register snapshot to embed in the header (may be NULL).
+ *            @see heliGetRegisterSnapshot
+ * @return Pointer to the writer if successful, otherwise NULL
+ */
+heliStreamWriter_t *
+heliStreamOpenWrite(const char *path, const heliRegs *snapshot)
+{
+  heliStreamWriter_t *w = calloc(1, sizeof(*w));
+  if(w == NULL)
+    {
+      HELI_ERR("Unable to allocate writer\n");
+      return NULL;
+    }
+
+  w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(w->fd < 0)
+    {
+      HELI_ERR("Unable to open %s\n", path);
+      free(w);
+      return NULL;
+    }
+
+  heliStreamHeader_t *hdr = &w->hdr;
+  memcpy(hdr->magic, HELI_STREAM_MAGIC, sizeof(hdr->magic));
+  hdr->version = HELI_STREAM_VERSION;
+  hdr->flags = HELI_STREAM_CONTIGUOUS | HELI_STREAM_UNFINISHED;
+  hdr->chunkWindows = HELI_STREAM_CHUNK_WINDOWS;
+  hdr->nsignals = HELI_WINDOW_NSIGNALS;
+
+  if(snapshot != NULL)
+    {
+      uint32_t ireg;
+      for(ireg = 0; ireg < sizeof(heliRegs); ireg++)
+	hdr->regs[ireg] = ((const volatile uint8_t *) snapshot)[ireg];
+      hdr->fwMonth = snapshot->month;
+      hdr->fwDay = snapshot->day;
+      hdr->fwYear = snapshot->year;
+    }
+
+  if(streamPwrite(w->fd, hdr, sizeof(*hdr), 0) < 0)
+    {
+      HELI_ERR("Unable to write header to %s\n", path);
+      close(w->fd);
+      free(w);
+      return NULL;
+    }
+
+  return w;
+}
+
+/* Skip the windows up to window, within the chunk being filled */
+static int32_t
+streamAddGap(heliStreamWriter_t *w, uint64_t window)
+{
+  heliStreamHeader_t *hdr = &w->hdr;
+  heliStreamIndex_t *cur = &w->current;
+  uint64_t first = cur->firstWindow + cur->nwindows;
+
+  if(hdr->ngaps == w->ngapAlloc)
+    {
+      uint64_t nalloc = (w->ngapAlloc) ? 2 * w->ngapAlloc : 1024;
+      heliStreamGap_t *gaps = realloc(w->gaps, nalloc * sizeof(*gaps));
+      if(gaps == NULL)
+	{
+	  HELI_ERR("Unable to allocate gap table\n");
+	  return -1;
+	}
+      w->gaps = gaps;
+      w->ngapAlloc = nalloc;
+    }
+
+  w->gaps[hdr->ngaps].firstWindow = first;
+  w->gaps[hdr->ngaps].nwindows = window - first;
+  hdr->ngaps++;
+  hdr->flags &= ~HELI_STREAM_CONTIGUOUS;
+
+  w->missing += window - first;
+  cur->nwindows = window - cur->firstWindow;
+
+  return 0;
+}
+
+/**
+ * @brief Append a window to a helicity stream file
+ * @details Append a window to a helicity stream file.  Window numbers must
+ *          increase.  A gap that ends within the current chunk is kept in
+ *          it; a longer gap starts a new chunk.
+ * @param[in] w Writer from heliStreamOpenWrite
+ * @param[in] window Window number
+ * @param[in] signals Mask of HELI_WINDOW_* signals
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliStreamWrite(heliStreamWriter_t *w, uint64_t window, uint8_t signals)
+{
+  heliStreamIndex_t *cur = &w->current;
+
+  /* Going back would break the chunk search of the reader */
+  if(((w->hdr.nchunks > 0) || (cur->nwindows > 0)) && (window < w->nextWindow))
+    {
+      HELI_ERR("Window %llu is before the next window (%llu)\n",
+	       (unsigned long long) window, (unsigned long long) w->nextWindow);
+      return -1;
+    }
+
+  if((cur->nwindows > 0) && (window != w->nextWindow) &&
+     (window - cur->firstWindow < HELI_STREAM_CHUNK_WINDOWS))
+    {
+      if(streamAddGap(w, window) < 0)
+	return -1;
+    }
+
+  if((cur->nwindows == HELI_STREAM_CHUNK_WINDOWS) ||
+     ((cur->nwindows > 0) && (window != cur->firstWindow + cur->nwindows)))
+    {
+      if(streamFlushChunk(w) < 0)
+	return -1;
+    }
+
+  if(cur->nwindows == 0)
+    cur->firstWindow = window;
+
+  uint32_t ibit = cur->nwindows++;
+  uint32_t isig;
+  for(isig = 0; isig < HELI_WINDOW_NSIGNALS; isig++)
+    {
+      if(signals & (1 << isig))
+	w->chunk[isig * HELI_STREAM_PLANE_BYTES + (ibit >> 3)] |= (1 << (ibit & 7));
+    }
+  w->nextWindow = window + 1;
+
+  return 0;
+}
+
+/**
+ * @brief Append consecutive windows to a helicity stream file
+ * @details Append consecutive windows to a helicity stream file
+ * @param[in] w Writer from heliStreamOpenWrite
+ * @param[in] window Number of the first window
+ * @param[in] signals Array of HELI_WINDOW_* masks, one per window
+ * @param[in] nwindows Number of windows
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliStreamWriteBlock(heliStreamWriter_t *w, uint64_t window,
+		     const uint8_t *signals, uint32_t nwindows)
+{
+  uint32_t iwin;
+  for(iwin = 0; iwin < nwindows; iwin++)
+    {
+      if(heliStreamWrite(w, window + iwin, signals[iwin]) < 0)
+	return -1;
+    }
+
+  return 0;
+}
+
+/**
+ * @brief Finish and close a helicity stream file
+ * @details Write the last chunk, the chunk index, the gap table and the
+ *          header, then release the writer.
+ * @param[in] w Writer from heliStreamOpenWrite
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliStreamCloseWrite(heliStreamWriter_t *w)
+{
+  int32_t rval = 0;
+  heliStreamHeader_t *hdr = &w->hdr;
+
+  if(streamFlushChunk(w) < 0)
+    rval = -1;
+
+  hdr->flags &= ~HELI_STREAM_UNFINISHED;
+  hdr->indexOffset = (uint64_t) HELI_STREAM_PAGE * (1 + hdr->nchunks);
+  hdr->gapOffset = hdr->indexOffset + hdr->nchunks * sizeof(heliStreamIndex_t);
+
+  if(rval == 0)
+    rval = streamPwrite(w->fd, w->index, hdr->nchunks * sizeof(heliStreamIndex_t),
+			hdr->indexOffset);
+  if(rval == 0)
+    rval = streamPwrite(w->fd, w->gaps, hdr->ngaps * sizeof(heliStreamGap_t),
+			hdr->gapOffset);
+  if(rval == 0)
+    rval = streamPwrite(w->fd, hdr, sizeof(*hdr), 0);
+
+  if(close(w->fd) < 0)
+    {
+      perror("close");
+      rval = -1;
+    }
+
+  free(w->index);
+  free(w->gaps);
+  free(w);
+
+  return rval;
+}
+
+/* Check that the chunks and gaps are in order, and do not overlap */
+static int32_t
+streamCheckIndex(const heliStreamHeader_t *hdr, const heliStreamIndex_t *index,
+		 const heliStreamGap_t *gaps)
+{
+  uint64_t ichunk, igap, next = 0, nwindows = 0;
+
+  if((hdr->nchunks > 0) && (index[0].firstWindow != hdr->firstWindow))
+    return -1;
+
+  for(ichunk = 0; ichunk < hdr->nchunks; ichunk++)
+    {
+      const heliStreamIndex_t *idx = &index[ichunk];
+
+      if((idx->nwindows == 0) || (idx->nwindows > hdr->chunkWindows) ||
+	 ((ichunk > 0) && (idx->firstWindow < next)) ||
+	 (idx->firstWindow > UINT64_MAX - idx->nwindows))
+	return -1;
+
+      if((hdr->flags & HELI_STREAM_CONTIGUOUS) &&
+	 (idx->firstWindow != hdr->firstWindow + ichunk * hdr->chunkWindows))
+	return -1;
+
+      next = idx->firstWindow + idx->nwindows;
+      nwindows += idx->nwindows;
+    }
+
+  for(igap = 0, next = 0; igap < hdr->ngaps; igap++)
+    {
+      if((gaps[igap].nwindows == 0) || (gaps[igap].firstWindow < next) ||
+	 (gaps[igap].nwindows > hdr->chunkWindows) ||
+	 (gaps[igap].firstWindow > UINT64_MAX - gaps[igap].nwindows))
+	return -1;
+
+      next = gaps[igap].firstWindow + gaps[igap].nwindows;
+      nwindows -= gaps[igap].nwindows;
+    }
+
+  return (nwindows == hdr->nwindows) ? 0 : -1;
+}
+
+/*
+  Rebuild the index of a file that was never closed.  Its header was last
+  written while the windows were contiguous, so every chunk it counts is
+  full, except maybe the last.
+*/
+static heliStreamIndex_t *
+streamRecoverIndex(const heliStreamHeader_t *hdr, uint64_t size)
+{
+  heliStreamIndex_t *index;
+  uint64_t ichunk, nwindows = hdr->nwindows;
+
+  if(!(hdr->flags & HELI_STREAM_CONTIGUOUS) || (hdr->ngaps != 0) ||
+     (hdr->nchunks >= size / HELI_STREAM_PAGE) ||
+     (nwindows > hdr->nchunks * hdr->chunkWindows) ||
+     ((hdr->nchunks > 0) && (nwindows <= (hdr->nchunks - 1) * hdr->chunkWindows)) ||
+     (hdr->firstWindow > UINT64_MAX - nwindows))
+    return NULL;
+
+  index = calloc(hdr->nchunks ? hdr->nchunks : 1, sizeof(*index));
+  if(index == NULL)
+    return NULL;
+
+  for(ichunk = 0; ichunk < hdr->nchunks; ichunk++)
+    {
+      index[ichunk].firstWindow = hdr->firstWindow + ichunk * hdr->chunkWindows;
+      index[ichunk].nwindows = (nwindows < hdr->chunkWindows) ? nwindows : hdr->chunkWindows;
+      nwindows -= index[ichunk].nwindows;
+    }
+
+  return index;
+}
+
+/**
+ * @brief Open a helicity stream file for reading
+ * @details Map a helicity stream file into memory.  Reading a window touches
+ *          a single page of the file.  A file flagged HELI_STREAM_UNFINISHED
+ *          (the writer never closed it) is read up to its first gap.
+ * @param[in] path Name of the file
+ * @return Pointer to the reader if successful, otherwise NULL
+ */
+heliStreamReader_t *
+heliStreamOpenRead(const char *path)
+{
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+  if(fd < 0)
+    {
+      HELI_ERR("Unable to open %s\n", path);
+      return NULL;
+    }
+
+  if((fstat(fd, &st) < 0) || (st.st_size < (off_t) sizeof(heliStreamHeader_t)))
+    {
+      HELI_ERR("%s is not a helicity stream file\n", path);
+      close(fd);
+      return NULL;
+    }
+
+  uint8_t *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED)
+    {
+      perror("mmap");
+      return NULL;
+    }
+
+  const heliStreamHeader_t *hdr = (const heliStreamHeader_t *) map;
+  heliStreamIndex_t *recovered = NULL;
+  if((memcmp(hdr->magic, HELI_STREAM_MAGIC, sizeof(hdr->magic)) != 0) ||
+     (hdr->version != HELI_STREAM_VERSION) ||
+     (hdr->chunkWindows != HELI_STREAM_CHUNK_WINDOWS) ||
+     (hdr->nsignals != HELI_WINDOW_NSIGNALS))
+    {
+      HELI_ERR("%s is not a valid helicity stream file\n", path);
+      munmap(map, st.st_size);
+      return NULL;
+    }
+
+  if(hdr->flags & HELI_STREAM_UNFINISHED)
+    {
+      recovered = streamRecoverIndex(hdr, st.st_size);
+      if(recovered == NULL)
+	{
+	  HELI_ERR("Unable to recover unfinished helicity stream file %s\n", path);
+	  munmap(map, st.st_size);
+	  return NULL;
+	}
+      printf("%s: WARNING: %s was not closed, recovered %llu windows\n",
+	     __func__, path, (unsigned long long) hdr->nwindows);
+    }
+  else if((hdr->nchunks > (uint64_t) st.st_size / HELI_STREAM_PAGE) ||
+	  (hdr->ngaps > (uint64_t) st.st_size / sizeof(heliStreamGap_t)) ||
+	  (hdr->indexOffset != (uint64_t) HELI_STREAM_PAGE * (1 + hdr->nchunks)) ||
+	  (hdr->gapOffset != hdr->indexOffset + hdr->nchunks * sizeof(heliStreamIndex_t)) ||
+	  (hdr->gapOffset + hdr->ngaps * sizeof(heliStreamGap_t) > (uint64_t) st.st_size) ||
+	  (streamCheckIndex(hdr, (const heliStreamIndex_t *) (map + hdr->indexOffset),
+			    (const heliStreamGap_t *) (map + hdr->gapOffset)) < 0))
+    {
+      HELI_ERR("%s is not a valid helicity stream file\n", path);
+      munmap(map, st.st_size);
+      return NULL;
+    }
+
+  heliStreamReader_t *r = calloc(1, sizeof(*r));
+  if(r == NULL)
+    {
+      HELI_ERR("Unable to allocate reader\n");
+      free(recovered);
+      munmap(map, st.st_size);
+      return NULL;
+    }
+
+  r->map = map;
+  r->size = st.st_size;
+  r->hdr = hdr;
+  if(recovered != NULL)
+    {
+      r->recovered = recovered;
+      r->index = recovered;
+      r->gaps = NULL;
+    }
+  else
+    {
+      r->index = (const heliStreamIndex_t *) (map + hdr->indexOffset);
+      r->gaps = (const heliStreamGap_t *) (map + hdr->gapOffset);
+    }
+
+  return r;
+}
+
+/**
+ * @brief Return the header of a helicity stream file
+ * @param[in] r Reader from heliStreamOpenRead
+ * @return Pointer to the (mapped) header
+ */
+const heliStreamHeader_t *
+heliStreamGetHeader(const heliStreamReader_t *r)
+{
+  return r->hdr;
+}
+
+/* Find the chunk holding window.  Return its index, or -1 if not present */
+static int64_t
+streamFindChunk(const heliStreamReader_t *r, uint64_t window)
+{
+  const heliStreamHeader_t *hdr = r->hdr;
+  uint64_t ichunk;
+
+  if((hdr->nchunks == 0) || (window < hdr->firstWindow))
+    return -1;
+
+  if(hdr->flags & HELI_STREAM_CONTIGUOUS)
+    {
+      ichunk = (window - hdr->firstWindow) / hdr->chunkWindows;
+      if(ichunk >= hdr->nchunks)
+	return -1;
+    }
+  else
+    {
+      /* Last chunk starting at or before window */
+      uint64_t lo = 0, hi = hdr->nchunks;
+      while(hi - lo > 1)
+	{
+	  uint64_t mid = (lo + hi) / 2;
+	  if(r->index[mid].firstWindow <= window)
+	    lo = mid;
+	  else
+	    hi = mid;
+	}
+      ichunk = lo;
+    }
+
+  if(window - r->index[ichunk].firstWindow >= r->index[ichunk].nwindows)
+    return -1;
+
+  return (int64_t) ichunk;
+}
+
+/* Return the first window at or after window that is in a gap, or UINT64_MAX */
+static uint64_t
+streamNextGap(const heliStreamReader_t *r, uint64_t window)
+{
+  const heliStreamHeader_t *hdr = r->hdr;
+  uint64_t lo = 0, hi = hdr->ngaps;
+
+  /* First gap that ends after window */
+  while(lo < hi)
+    {
+      uint64_t mid = (lo + hi) / 2;
+      if(r->gaps[mid].firstWindow + r->gaps[mid].nwindows <= window)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  if(lo == hdr->ngaps)
+    return UINT64_MAX;
+
+  return (r->gaps[lo].firstWindow > window) ? r->gaps[lo].firstWindow : window;
+}
+
+/**
+ * @brief Read the signals of a window
+ * @details Read the signals of a window
+ * @param[in] r Reader from heliStreamOpenRead
+ * @param[in] window Window number
+ * @param[out] signals Mask of HELI_WINDOW_* signals
+ * @return 0 if successful, otherwise -1 (window not in file)
+ */
+int32_t
+heliStreamRead(const heliStreamReader_t *r, uint64_t window, uint8_t *signals)
+{
+  int64_t ichunk = streamFindChunk(r, window);
+  if((ichunk < 0) || (streamNextGap(r, window) == window))
+    return -1;
+
+  const uint8_t *chunk = r->map + (uint64_t) HELI_STREAM_PAGE * (1 + ichunk);
+  uint32_t ibit = window - r->index[ichunk].firstWindow;
+  uint32_t isig;
+
+  *signals = 0;
+  for(isig = 0; isig < HELI_WINDOW_NSIGNALS; isig++)
+    *signals |= ((chunk[isig * HELI_STREAM_PLANE_BYTES + (ibit >> 3)] >> (ibit & 7)) & 1) << isig;
+
+  return 0;
+}
+
+/**
+ * @brief Read the signals of consecutive windows
+ * @details Read the signals of consecutive windows, stopping at the first
+ *          window not in the file (or in a gap).
+ * @param[in] r Reader from heliStreamOpenRead
+ * @param[in] window Number of the first window
+ * @param[out] signals Array of HELI_WINDOW_* masks, one per window
+ * @param[in] nwindows Number of windows
+ * @return Number of windows read
+ */
+int32_t
+heliStreamReadBlock(const heliStreamReader_t *r, uint64_t window,
+		    uint8_t *signals, uint32_t nwindows)
+{
+  uint32_t nread = 0;
+  uint64_t gap = streamNextGap(r, window);
+
+  if(gap - window < nwindows)
+    nwindows = gap - window;
+
+  while(nread < nwindows)
+    {
+      int64_t ichunk = streamFindChunk(r, window + nread);
+      if(ichunk < 0)
+	break;
+
+      const heliStreamIndex_t *idx = &r->index[ichunk];
+      const uint8_t *chunk = r->map + (uint64_t) HELI_STREAM_PAGE * (1 + ichunk);
+      uint32_t ibit = window + nread - idx->firstWindow;
+
+      for(; (ibit < idx->nwindows) && (nread < nwindows); ibit++, nread++)
+	{
+	  uint8_t sig = 0;
+	  uint32_t isig;
+	  for(isig = 0; isig < HELI_WINDOW_NSIGNALS; isig++)
+	    sig |= ((chunk[isig * HELI_STREAM_PLANE_BYTES + (ibit >> 3)] >> (ibit & 7)) & 1) << isig;
+	  signals[nread] = sig;
+	}
+    }
+
+  return nread;
+}
+
+/**
+ * @brief Close a helicity stream file
+ * @param[in] r Reader from heliStreamOpenRead
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+heliStreamCloseRead(heliStreamReader_t *r)
+{
+  int32_t rval = 0;
+
+  if(munmap(r->map, r->size) < 0)
+    {
+      perror("munmap");
+      rval = -1;
+    }
+  free(r->recovered);
+  free(r);
+
+  return rval;
+}
@@ -0,0 +1,98 @@
+#pragma once
+/*
+ * Copyright 2022, Jefferson Science Associates, LLC.
+ * Subject to the terms in the LICENSE file found in the top-level directory.
+ *
+ *     Authors: Bryan Moffit
+ *              moffit@jlab.org                   Jefferson Lab, MS-12B3
+ *              Phone: (757) 269-5660             12000 Jefferson Ave.
+ *              Fax:   (757) 269-5800             Newport News, VA 23606
+ *
+ * Description: Header for the Helicity Stream file format
+ *
+ *   A helicity stream file holds the board output signals (HELI_WINDOW_*)
+ *   for every window of a run.  Each signal is stored as a bit plane.
+ *   Windows are grouped in fixed size chunks of one page each, indexed
+ *   by the number of their first window.  A gap in the window numbers
+ *   that ends within the current chunk is kept in that chunk, and listed
+ *   in the gap table; a longer gap starts a new chunk.
+ *
+ *   File layout:
+ *     heliStreamHeader_t                   (HELI_STREAM_PAGE bytes)
+ *     chunk 0 ... chunk N-1                (HELI_STREAM_PAGE bytes each)
+ *       plane 0 : HELI_WINDOW_HELICITY     (HELI_STREAM_PLANE_BYTES)
+ *       plane 1 : HELI_WINDOW_PATTERN_SYNC
+ *       plane 2 : HELI_WINDOW_PAIR_SYNC
+ *       plane 3 : HELI_WINDOW_TSETTLE
+ *     heliStreamIndex_t[N]
+ *     heliStreamGap_t[ngaps]
+ *
+ *   The index, the gap table and the final header are written on close.
+ *   Until then the header is flagged HELI_STREAM_UNFINISHED, and is
+ *   rewritten after each chunk while the windows are contiguous.  The
+ *   reader recovers the windows of a file that was never closed up to
+ *   its first gap; the windows after it are lost.
+ *
+ */
+
+#include <stdint.h>
+#include "heliLib.h"
+
+#define HELI_STREAM_MAGIC         "HELISTRM"
+#define HELI_STREAM_VERSION       2
+#define HELI_STREAM_PAGE          4096
+#define HELI_STREAM_PLANE_BYTES   (HELI_STREAM_PAGE / HELI_WINDOW_NSIGNALS)
+#define HELI_STREAM_CHUNK_WINDOWS (HELI_STREAM_PLANE_BYTES * 8)
+
+/* Header flags */
+#define HELI_STREAM_CONTIGUOUS    (1 << 0) /* No gaps in window numbers */
+#define HELI_STREAM_UNFINISHED    (1 << 1) /* Not closed, no index or gaps */
+
+typedef struct
+{
+  char     magic[8];          /* HELI_STREAM_MAGIC */
+  uint32_t version;           /* HELI_STREAM_VERSION */
+  uint32_t flags;             /* HELI_STREAM_* flags */
+  uint32_t chunkWindows;      /* Windows per chunk */
+  uint32_t nsignals;          /* Bit planes per chunk */
+  uint64_t firstWindow;       /* Number of the first window in the file */
+  uint64_t nwindows;          /* Number of windows in the file */
+  uint64_t nchunks;           /* Number of chunks in the file */
+  uint64_t indexOffset;       /* File offset of the chunk index */
+  uint64_t ngaps;             /* Number of gaps within chunks */
+  uint64_t gapOffset;         /* File offset of the gap table */
+  uint8_t  regs[sizeof(heliRegs)]; /* Register snapshot at start of run */
+  uint8_t  fwMonth;           /* Firmware date */
+  uint8_t  fwDay;
+  uint8_t  fwYear;
+  uint8_t  _blank[HELI_STREAM_PAGE - 91];
+} heliStreamHeader_t;
+
+typedef struct
+{
+  uint64_t firstWindow;       /* Number of the first window in the chunk */
+  uint32_t nwindows;          /* Windows spanned by the chunk, gaps included */
+  uint32_t _blank;
+} heliStreamIndex_t;
+
+typedef struct
+{
+  uint64_t firstWindow;       /* First missing window */
+  uint64_t nwindows;          /* Number of missing windows */
+} heliStreamGap_t;
+
+typedef struct heliStreamWriter heliStreamWriter_t;
+typedef struct heliStreamReader heliStreamReader_t;
+
+heliStreamWriter_t *heliStreamOpenWrite(const char *path, const heliRegs *snapshot);
+int32_t heliStreamWrite(heliStreamWriter_t *w, uint64_t window, uint8_t signals);
+int32_t heliStreamWriteBlock(heliStreamWriter_t *w, uint64_t window,
+			     const uint8_t *signals, uint32_t nwindows);
+int32_t heliStreamCloseWrite(heliStreamWriter_t *w);
+
+heliStreamReader_t *heliStreamOpenRead(const char *path);
+const heliStreamHeader_t *heliStreamGetHeader(const heliStreamReader_t *r);
+int32_t heliStreamRead(const heliStreamReader_t *r, uint64_t window, uint8_t *signals);
+int32_t heliStreamReadBlock(const heliStreamReader_t *r, uint64_t window,
+			    uint8_t *signals, uint32_t nwindows);
+int32_t heliStreamCloseRead(heliStreamReader_t *r);
@@ -0,0 +1,213 @@
+/*
+ * File:
+ *    heliAuditQuery.c
+ *
+ * Description:
+ *    Print the records of a register audit log, or the logged
+ *    configuration at a given time
+ *
+ *
+ */
+
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <getopt.h>
+#include "heliLib.h"
+#include "heliAudit.h"
+
+char progName[128];
+
+/* this structure holds the user arguments */
+typedef struct
+{
+  char     *file;
+  uint64_t nlast;
+  int32_t  doTime;
+  uint64_t time;
+} argValue_t;
+
+static const char *regNames[sizeof(heliRegs)] =
+  {
+    "month", "day", "year", "", "state", "reset", "", "tsettle",
+    "", "tstable", "", "delay", "", "pattern", "", "clock"
+  };
+
+void
+usage()
+{
+  printf("\nUsage: \n");
+  printf("\t %s [options] {audit log}\n", progName);
+  printf("Print the records of a register audit log\n");
+  printf("\n");
+  printf(" -n, --last {records}              print the last {records} records (default: 20)\n");
+  printf(" -t, --time {YYYY-MM-DD HH:MM:SS}  print the logged configuration at local time\n");
+  printf(" -h, --help                        this help message\n");
+  printf("\n");
+  printf("Exit status:\n");
+  printf("  0  if OK,\n");
+  printf("  1  if argument ERROR\n");
+  printf("  3  if the time is older than the log\n");
+  printf("\n");
+}
+
+/* parse the command line with getopt_long, return user arguments */
+int32_t
+parseArgs(int32_t argc, char *argv[], argValue_t *value)
+{
+  int32_t rval = 0;
+  struct tm tm;
+
+  static struct option long_options[] =
+  {
+    /* {const char *name, int has_arg, int *flag, int val} */
+    {"help",       no_argument,       0,        'h'},
+    {"last",       required_argument, 0,        'n'},
+    {"time",       required_argument, 0,        't'},
+    {0, 0, 0, 0}
+  };
+
+  /* Initialize output */
+  memset(value, 0, sizeof(*value));
+  value->nlast = 20;
+
+  while(1)
+    {
+      int opt_param, option_index = 0;
+      opt_param = getopt_long (argc, argv, "hn:t:",
+			       long_options, &option_index);
+
+      if (opt_param == -1) /* No more option parameters left */
+	break;
+
+      switch (opt_param)
+	{
+	case 0:
+	  break;
+
+	case 'n': /* LAST */
+	  value->nlast = strtoull(optarg, NULL, 10);
+	  break;
+
+	case 't': /* TIME */
+	  memset(&tm, 0, sizeof(tm));
+	  if(strptime(optarg, "%Y-%m-%d %H:%M:%S", &tm) == NULL)
+	    {
+	      printf("%s: ERROR: Invalid time (%s)\n", progName, optarg);
+	      rval = 1;
+	      break;
+	    }
+	  tm.tm_isdst = -1;
+	  value->doTime = 1;
+	  value->time = (uint64_t) mktime(&tm) * 1000000000ULL;
+	  break;
+
+	case 'h': /* help */
+	case '?': /* Invalid Option */
+	default:
+	  usage();
+	  rval = 1;
+	}
+    }
+
+  if(optind < argc)
+    value->file = argv[optind];
+  else if(rval == 0)
+    {
+      usage();
+      rval = 1;
+    }
+
+  return rval;
+}
+
+void
+printRecord(uint64_t seq, const heliAuditRecord_t *rec)
+{
+  char tstr[64];
+  time_t sec = rec->time / 1000000000ULL;
+  struct tm tm;
+
+  localtime_r(&sec, &tm);
+  strftime(tstr, sizeof(tstr), "%Y-%m-%d %H:%M:%S", &tm);
+
+  if(rec->type == HELI_AUDIT_CHECKPOINT)
+    {
+      printf("%10llu  %s.%06llu  %6u  checkpoint\n", (unsigned long long) seq, tstr,
+	     (unsigned long long) (rec->time % 1000000000ULL) / 1000, rec->pid);
+      return;
+    }
+
+  printf("%10llu  %s.%06llu  %6u  %-5s  %-26s  %-8s  0x%02x -> 0x%02x\n",
+	 (unsigned long long) seq, tstr,
+	 (unsigned long long) (rec->time % 1000000000ULL) / 1000, rec->pid,
+	 (rec->type == HELI_AUDIT_SYNC) ? "sync" : "write", rec->caller,
+	 regNames[rec->reg & 0xf], rec->oldValue, rec->newValue);
+}
+
+int
+main(int argc, char *argv[])
+{
+  argValue_t args;
+  heliAuditLog_t *log;
+  heliAuditRecord_t rec;
+  uint64_t first, next, seq;
+  int32_t rval = 0;
+
+  strncpy(progName, argv[0], sizeof(progName) - 1);
+
+  if(parseArgs(argc, argv, &args) != 0)
+    return 1;
+
+  if(access(args.file, R_OK | W_OK) != 0)
+    {
+      printf("%s: ERROR: Unable to open %s\n", progName, args.file);
+      return 1;
+    }
+
+  log = heliAuditOpen(args.file, 0);
+  if(log == NULL)
+    return 1;
+
+  if(args.doTime)
+    {
+      heliRegs config;
+
+      if(heliAuditConfigAt(log, args.time, &config) < 0)
+	{
+	  printf("%s: ERROR: time is older than the log\n", progName);
+	  rval = 3;
+	}
+      else
+	{
+	  printf("     tsettle (0x07) = 0x%02x\n", config.tsettle);
+	  printf("     tstable (0x09) = 0x%02x\n", config.tstable);
+	  printf("       delay (0x0b) = 0x%02x\n", config.delay);
+	  printf("     pattern (0x0d) = 0x%02x\n", config.pattern);
+	  printf("       clock (0x0f) = 0x%02x\n", config.clock);
+	  printf("       reset (0x05) = 0x%02x\n", config.reset);
+	}
+    }
+  else
+    {
+      heliAuditGetRange(log, &first, &next);
+      if(next - first > args.nlast)
+	first = next - args.nlast;
+
+      printf("       seq  time                        pid  type   caller                      register  old     new\n");
+      for(seq = first; seq < next; seq++)
+	{
+	  if(heliAuditRead(log, seq, &rec) == 0)
+	    printRecord(seq, &rec);
+	}
+    }
+
+  heliAuditClose(log);
+
+  return rval;
+}
@@ -0,0 +1,353 @@
+/*
+ * File:
+ *    heliCatalog.c
+ *
+ * Description:
+ *    Record the module registers at the start or end of a run in a run
+ *    catalog, or find the runs of the catalog that used given settings
+ *
+ *
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <getopt.h>
+#include "jvme.h"
+#include "heliLib.h"
+#include "heliCatalog.h"
+
+char progName[128];
+
+/* this structure holds the user arguments */
+typedef struct
+{
+  char     *file;
+  uint32_t address;
+  uint8_t  record;
+  int32_t  haveRun;
+  uint32_t run;
+  heliCatalogQuery_t q;
+  uint32_t maxRanges;
+  int32_t  list;
+} argValue_t;
+
+void
+usage()
+{
+  printf("\nUsage: \n");
+  printf("\t %s [options] {catalog} [address]\n", progName);
+  printf("Find the runs of a run catalog that used the given settings,\n");
+  printf("or record the module registers (default address: 0xa00000)\n");
+  printf("\n");
+  printf(" -r, --record {start|end}          record the registers at the start or end of --run\n");
+  printf(" -R, --run {n}                     run number to record\n");
+  printf(" -m, --mode {index,...}            clock modes\n");
+  printf(" -p, --pattern {index,...}         helicity patterns\n");
+  printf(" -d, --delay {index,...}           reporting delays\n");
+  printf(" -t, --tsettle {index,...}         tsettle\n");
+  printf(" -s, --tstable {index,...}         tstable\n");
+  printf(" -b, --boardclock {index,...}      board clock output\n");
+  printf(" -u, --unchanged                   only runs with the same configuration at the end\n");
+  printf(" -n, --ranges {n}                  print at most {n} ranges (default: 100)\n");
+  printf(" -l, --list                        print each matching run\n");
+  printf(" -h, --help                        this help message\n");
+  printf("\n");
+  printf("Settings not given match any value.  The catalog is created by --record.\n");
+  printf("\n");
+  printf("Exit status:\n");
+  printf("  0  if OK,\n");
+  printf("  1  if argument ERROR\n");
+  printf("  2  if VME Driver ERROR\n");
+  printf("  3  if helicity generator library ERROR\n");
+  printf("\n");
+}
+
+/* Allow each value of a comma separated list */
+int32_t
+parseValues(heliCatalogQuery_t *q, heliFieldId_t field, char *list)
+{
+  char *tok, *save = NULL, *end;
+
+  for(tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save))
+    {
+      uint32_t value = strtoul(tok, &end, 0);
+
+      if((end == tok) || (*end != '\0') ||
+	 (heliCatalogQueryAllow(q, field, value) != 0))
+	{
+	  printf("%s: ERROR: Invalid value (%s)\n", progName, tok);
+	  return -1;
+	}
+    }
+
+  return 0;
+}
+
+/* parse the command line with getopt_long, return user arguments */
+int32_t
+parseArgs(int32_t argc, char *argv[], argValue_t *value)
+{
+  int32_t rval = 0;
+
+  static struct option long_options[] =
+  {
+    /* {const char *name, int has_arg, int *flag, int val} */
+    {"help",       no_argument,       0,        'h'},
+    {"record",     required_argument, 0,        'r'},
+    {"run",        required_argument, 0,        'R'},
+    {"mode",       required_argument, 0,        'm'},
+    {"pattern",    required_argument, 0,        'p'},
+    {"delay",      required_argument, 0,        'd'},
+    {"tsettle",    required_argument, 0,        't'},
+    {"tstable",    required_argument, 0,        's'},
+    {"boardclock", required_argument, 0,        'b'},
+    {"unchanged",  no_argument,       0,        'u'},
+    {"ranges",     required_argument, 0,        'n'},
+    {"list",       no_argument,       0,        'l'},
+    {0, 0, 0, 0}
+  };
+
+  /* Initialize output */
+  memset(value, 0, sizeof(*value));
+  value->address = 0x00a00000; // my test module
+  value->maxRanges = 100;
+  heliCatalogQueryInit(&value->q);
+
+  while(1)
+    {
+      int opt_param, option_index = 0;
+      opt_param = getopt_long (argc, argv, "hr:R:m:p:d:t:s:b:un:l",
+			       long_options, &option_index);
+
+      if (opt_param == -1) /* No more option parameters left */
+	break;
+
+      switch (opt_param)
+	{
+	case 0:
+	  break;
+
+	case 'r': /* RECORD */
+	  if(strcmp(optarg, "start") == 0)
+	    value->record = HELI_CATALOG_START;
+	  else if(strcmp(optarg, "end") == 0)
+	    value->record = HELI_CATALOG_END;
+	  else
+	    {
+	      printf("%s: ERROR: Invalid record type (%s)\n", progName, optarg);
+	      rval = 1;
+	    }
+	  break;
+
+	case 'R': /* RUN */
+	  value->run = strtoul(optarg, NULL, 10);
+	  value->haveRun = 1;
+	  break;
+
+	case 'm': /* MODE */
+	  if(parseValues(&value->q, HELI_REGFIELD_MODE, optarg) != 0)
+	    rval = 1;
+	  break;
+
+	case 'p': /* PATTERN */
+	  if(parseValues(&value->q, HELI_REGFIELD_PATTERN, optarg) != 0)
+	    rval = 1;
+	  break;
+
+	case 'd': /* DELAY */
+	  if(parseValues(&value->q, HELI_REGFIELD_DELAY, optarg) != 0)
+	    rval = 1;
+	  break;
+
+	case 't': /* TSETTLE */
+	  if(parseValues(&value->q, HELI_REGFIELD_TSETTLE, optarg) != 0)
+	    rval = 1;
+	  break;
+
+	case 's': /* TSTABLE */
+	  if(parseValues(&value->q, HELI_REGFIELD_TSTABLE, optarg) != 0)
+	    rval = 1;
+	  break;
+
+	case 'b': /* BOARDCLOCK */
+	  if(parseValues(&value->q, HELI_REGFIELD_BOARDCLOCK, optarg) != 0)
+	    rval = 1;
+	  break;
+
+	case 'u': /* UNCHANGED */
+	  value->q.unchanged = 1;
+	  break;
+
+	case 'n': /* RANGES */
+	  value->maxRanges = strtoul(optarg, NULL, 10);
+	  break;
+
+	case 'l': /* LIST */
+	  value->list = 1;
+	  break;
+
+	case 'h': /* help */
+	case '?': /* Invalid Option */
+	default:
+	  usage();
+	  rval = 1;
+	}
+    }
+
+  if(optind < argc)
+    value->file = argv[optind++];
+  else if(rval == 0)
+    {
+      usage();
+      rval = 1;
+    }
+
+  if(optind < argc)
+    value->address = (unsigned int) strtoll(argv[optind],NULL,16)&0xffffffff;
+
+  if((rval == 0) && value->record && !value->haveRun)
+    {
+      printf("%s: ERROR: --record requires --run\n", progName);
+      rval = 1;
+    }
+
+  return rval;
+}
+
+/* Record the module registers */
+int32_t
+record(argValue_t *args, heliCatalog_t *cat)
+{
+  int32_t stat, rval = 0;
+
+  stat = vmeOpenDefaultWindows();
+  if(stat != OK)
+    {
+      rval = 2;
+      goto CLOSE;
+    }
+
+  if((heliInit(args->address, 0) != 0) ||
+     (heliCatalogRecordBoard(cat, args->run, args->record) != 0))
+    rval = 3;
+
+ CLOSE:
+
+  vmeClearException(1);
+
+  stat = vmeCloseDefaultWindows();
+  if (stat != OK)
+    {
+      printf("vmeCloseDefaultWindows failed: code 0x%08x\n",stat);
+      return 2;
+    }
+
+  return rval;
+}
+
+void
+printRun(const heliCatalogRun_t *run)
+{
+  char tstr[64] = "-";
+  time_t sec = (run->startTime ? run->startTime : run->endTime) / 1000000000ULL;
+  struct tm tm;
+
+  if(sec)
+    {
+      localtime_r(&sec, &tm);
+      strftime(tstr, sizeof(tstr), "%Y-%m-%d %H:%M:%S", &tm);
+    }
+
+  printf("%8u  %s  %4u  %7u  %5u  %7u  %7u  %10.3f  %s%s\n",
+	 run->run, tstr,
+	 heliFieldGet(&run->start, HELI_REGFIELD_MODE),
+	 heliFieldGet(&run->start, HELI_REGFIELD_PATTERN),
+	 heliFieldGet(&run->start, HELI_REGFIELD_DELAY),
+	 heliFieldGet(&run->start, HELI_REGFIELD_TSETTLE),
+	 heliFieldGet(&run->start, HELI_REGFIELD_TSTABLE),
+	 run->frequency,
+	 (run->flags & HELI_CATALOG_RUN_ENDED) ? "" : "no end ",
+	 (run->flags & HELI_CATALOG_RUN_CHANGED) ? "changed" : "");
+}
+
+int
+main(int argc, char *argv[])
+{
+  argValue_t args;
+  heliCatalog_t *cat;
+  heliCatalogRange_t *ranges;
+  heliCatalogRun_t run;
+  struct timespec t0, t1;
+  uint64_t nruns;
+  int64_t nranges, row;
+  uint32_t irange, r;
+  int32_t rval = 0;
+
+  strncpy(progName, argv[0], sizeof(progName) - 1);
+
+  if(parseArgs(argc, argv, &args) != 0)
+    return 1;
+
+  cat = heliCatalogOpen(args.file, (args.record != 0));
+  if(cat == NULL)
+    return 1;
+
+  if(args.record)
+    {
+      rval = record(&args, cat);
+      heliCatalogClose(cat);
+      return rval;
+    }
+
+  ranges = calloc(args.maxRanges ? args.maxRanges : 1, sizeof(*ranges));
+  if(ranges == NULL)
+    {
+      printf("%s: ERROR: Unable to allocate memory\n", progName);
+      heliCatalogClose(cat);
+      return 3;
+    }
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  nranges = heliCatalogQuery(cat, &args.q, ranges, args.maxRanges, &nruns);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  if(args.list)
+    printf("     run  start                mode  pattern  delay  tsettle  tstable   frequency\n");
+
+  for(irange = 0; (irange < nranges) && (irange < args.maxRanges); irange++)
+    {
+      if(!args.list)
+	{
+	  if(ranges[irange].first == ranges[irange].last)
+	    printf("%u\n", ranges[irange].first);
+	  else
+	    printf("%u-%u\n", ranges[irange].first, ranges[irange].last);
+	  continue;
+	}
+
+      for(r = ranges[irange].first; ; r++)
+	{
+	  row = heliCatalogFindRun(cat, r);
+	  if((row >= 0) && (heliCatalogGetRun(cat, row, &run) == 0))
+	    printRun(&run);
+	  if(r == ranges[irange].last)
+	    break;
+	}
+    }
+
+  if(nranges > args.maxRanges)
+    printf("... %lld more ranges\n", (long long) (nranges - args.maxRanges));
+
+  printf("# runs=%llu/%u ranges=%lld query_us=%.1f\n",
+	 (unsigned long long) nruns, heliCatalogRuns(cat), (long long) nranges,
+	 ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) * 1e-3);
+
+  free(ranges);
+  heliCatalogClose(cat);
+
+  return rval;
+}
@@ -73,9 +73,6 @@ main(int32_t argc, char *argv[])
       exit(rval);
     }
 
-  vmeCheckMutexHealth(1);
-  vmeBusLock();
-
   stat = heliInit(address, HELI_INIT_DEBUG);
   if (stat != OK)
     {
@@ -94,8 +91,6 @@ main(int32_t argc, char *argv[])
       heliStatus(1);
     }
 
-  vmeBusUnlock();
-
   stat = vmeCloseDefaultWindows();
   if (stat != OK)
     {
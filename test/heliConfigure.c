@@ -18,6 +18,7 @@
 #include <getopt.h>
 #include "jvme.h"
 #include "heliLib.h"
+#include "heliAlign.h"
 
 char progName[128];
 int Verbose=0;
@@ -31,7 +32,10 @@ enum doBits
     DO_TSTABLE    = 1 << 4,
     DO_BOARDCLOCK = 1 << 5,
     DO_RESET      = 1 << 6,
-    LIST          = 1 << 7
+    LIST          = 1 << 7,
+    DO_SAVE       = 1 << 8,
+    DO_RESTORE    = 1 << 9,
+    DO_ALIGN      = 1 << 10
   };
 
 /* this structure holds the user arguments */
@@ -43,6 +47,9 @@ typedef struct
   uint32_t TSETTLEs;
   uint32_t TSTABLEs;
   uint32_t BOARDCLOCKs;
+  char *SAVEs;
+  char *RESTOREs;
+  uint8_t ALIGNs;
 } argValue_t;
 
 void
@@ -61,6 +68,11 @@ usage()
   printf(" -l, --list {selections}           list the available selections for {selections}\n");
   printf("                                   (e.g. --list mode,pattern,tstable)\n");
   printf(" -r, --reset                       reset the module\n");
+  printf("     --restore {file}              restore the configuration saved in {file}\n");
+  printf("     --save {file}                 save the configuration to {file}\n");
+  printf(" -a, --align {state}               write the selections as one burst, after the next\n");
+  printf("                                   pattern boundary.  {state}: sequencer state of a\n");
+  printf("                                   window that began a pattern, in the last 256 windows\n");
   printf(" -h, --help                        this help message\n");
   printf("\n");
   printf("Exit status:\n");
@@ -73,7 +85,7 @@ usage()
 
 /* Search through the --list string, searching for helicity generator parameter names */
 void
-fillListBits(char argString[], uint8_t *listBits)
+fillListBits(char argString[], uint16_t *listBits)
 {
   *listBits = 0;
 
@@ -100,11 +112,10 @@ fillListBits(char argString[], uint8_t *listBits)
 
 /* parse the command line with getopt_long, return user arguments */
 int32_t
-parseArgs(int32_t argc, char *argv[], argValue_t *value, uint8_t *doBits)
+parseArgs(int32_t argc, char *argv[], argValue_t *value, uint16_t *doBits)
 {
   int32_t rval = 0;
 
-  char listString[256];
   static struct option long_options[] =
   {
     /* {const char *name, int has_arg, int *flag, int val} */
@@ -118,6 +129,9 @@ parseArgs(int32_t argc, char *argv[], argValue_t *value, uint8_t *doBits)
     {"boardclock", required_argument, 0,        'b'},
     {"list",       required_argument, 0,        'l'},
     {"reset",      required_argument, 0,        'r'},
+    {"save",       required_argument, 0,        'S'},
+    {"restore",    required_argument, 0,        'R'},
+    {"align",      required_argument, 0,        'a'},
     {0, 0, 0, 0}
   };
 
@@ -129,7 +143,7 @@ parseArgs(int32_t argc, char *argv[], argValue_t *value, uint8_t *doBits)
     {
       int opt_param, option_index = 0;
       option_index = 0;
-      opt_param = getopt_long (argc, argv, "hm:p:d:t:s:b:l:r",
+      opt_param = getopt_long (argc, argv, "hm:p:d:t:s:b:l:ra:",
 			       long_options, &option_index);
 
       if (opt_param == -1) /* No more option parameters left */
@@ -174,6 +188,21 @@ parseArgs(int32_t argc, char *argv[], argValue_t *value, uint8_t *doBits)
 	  *doBits |= DO_RESET;
 	  break;
 
+	case 'S': /* SAVE */
+	  *doBits |= DO_SAVE;
+	  value->SAVEs = optarg;
+	  break;
+
+	case 'R': /* RESTORE */
+	  *doBits |= DO_RESTORE;
+	  value->RESTOREs = optarg;
+	  break;
+
+	case 'a': /* ALIGN */
+	  *doBits |= DO_ALIGN;
+	  value->ALIGNs = strtol(optarg, NULL, 0);
+	  break;
+
 	case 'l': /* list */
 	  fillListBits(optarg, doBits);
 	  break;
@@ -191,6 +220,12 @@ parseArgs(int32_t argc, char *argv[], argValue_t *value, uint8_t *doBits)
       rval = -1;
     }
 
+  if((*doBits & DO_ALIGN) && (*doBits & DO_RESET))
+    {
+      printf("%s: ERROR: --align and --reset are exclusive\n", progName);
+      rval = -1;
+    }
+
 
   return rval;
 }
@@ -198,7 +233,7 @@ parseArgs(int32_t argc, char *argv[], argValue_t *value, uint8_t *doBits)
 /* function to list available selections of the helicity generator */
 
 void
-helicity_generator_list_selections(uint8_t listMask)
+helicity_generator_list_selections(uint16_t listMask)
 {
 
   if(listMask & DO_CLOCK)
@@ -239,10 +274,52 @@ helicity_generator_list_selections(uint8_t listMask)
 
 }
 
+/* function to apply the user selections after the next pattern boundary */
+
+int32_t
+helicity_generator_align(uint16_t setMask, argValue_t args)
+{
+  heliAlign_t align;
+  heliAlignResult_t res;
+  heliConfig_t cfg;
+
+  if((heliAlignInit(&align) != 0) || (heliAlignSetReference(&align, args.ALIGNs) != 0))
+    return -1;
+
+  if(setMask & DO_RESTORE)
+    {
+      printf("Restore Configuration from %s\n", args.RESTOREs);
+      if((heliLoadConfig(args.RESTOREs, &cfg) != 0) ||
+	 (heliAlignQueueConfig(&align, &cfg) != 0))
+	return -1;
+    }
+
+#define QUEUE(_bit, _field, _value) {					\
+    if((setMask & (_bit)) && (heliAlignQueueField(&align, _field, _value) != 0)) \
+      return -1;							\
+  }
+  QUEUE(DO_CLOCK, HELI_REGFIELD_MODE, args.CLOCKs);
+  QUEUE(DO_PATTERN, HELI_REGFIELD_PATTERN, args.PATTERNs);
+  QUEUE(DO_DELAY, HELI_REGFIELD_DELAY, args.DELAYs);
+  QUEUE(DO_TSETTLE, HELI_REGFIELD_TSETTLE, args.TSETTLEs);
+  QUEUE(DO_TSTABLE, HELI_REGFIELD_TSTABLE, args.TSTABLEs);
+  QUEUE(DO_BOARDCLOCK, HELI_REGFIELD_BOARDCLOCK, args.BOARDCLOCKs);
+#undef QUEUE
+
+  if(heliAlignApply(&align, 10000, &res) != 0)
+    return -1;
+
+  printf("Aligned %u field(s) at window %llu: wait %.3f ms, latency <= %.1f us, %u window(s) late\n",
+	 res.nfields, (unsigned long long) res.window, res.waitNs * 1e-6,
+	 res.latencyNs * 1e-3, res.late);
+
+  return 0;
+}
+
 /* function to apply the user selections to the helicity generator */
 
 int32_t
-helicity_generator_set(uint8_t setMask, argValue_t args)
+helicity_generator_set(uint16_t setMask, argValue_t args)
 {
   int32_t rval = 0;
 
@@ -252,6 +329,16 @@ helicity_generator_set(uint8_t setMask, argValue_t args)
       rval = heliReset();
     }
 
+  if(setMask & DO_RESTORE)
+    {
+      heliConfig_t cfg;
+      printf("Restore Configuration from %s\n", args.RESTOREs);
+      if(heliLoadConfig(args.RESTOREs, &cfg) == 0)
+	rval |= heliApplyConfig(&cfg);
+      else
+	rval = -1;
+    }
+
   if(setMask & DO_CLOCK)
     {
       printf("Select Mode %d\n", args.CLOCKs);
@@ -288,6 +375,12 @@ helicity_generator_set(uint8_t setMask, argValue_t args)
       rval |= heliSelectBoardClock(args.BOARDCLOCKs);
     }
 
+  if(setMask & DO_SAVE)
+    {
+      printf("Save Configuration to %s\n", args.SAVEs);
+      rval |= heliSaveConfig(args.SAVEs);
+    }
+
   return rval;
 }
 
@@ -298,11 +391,13 @@ helicity_generator_set(uint8_t setMask, argValue_t args)
 int32_t
 main(int32_t argc, char *argv[])
 {
-  int32_t iarg = 0, stat = 0, rval = 0;
+  int32_t stat = 0, rval = 0;
 
   strncpy(progName, argv[0], 128);
 
-  argValue_t setting = {0,0,0,0,0,0}; uint8_t doBits = 0;
+  argValue_t setting; uint16_t doBits = 0;
+
+  memset(&setting, 0, sizeof(setting));
 
   if(parseArgs(argc, argv, &setting, &doBits) < 0)
     exit(1);
@@ -315,8 +410,6 @@ main(int32_t argc, char *argv[])
       exit(rval);
     }
 
-  vmeCheckMutexHealth(1);
-  vmeBusLock();
   printf("\n");
 
   stat = heliInit(HELICITY_GENERATOR_ADDRESS, HELI_INIT_DEBUG);
@@ -333,7 +426,17 @@ main(int32_t argc, char *argv[])
     }
   else
     {
-      stat = helicity_generator_set(doBits, setting);
+      if(doBits & DO_ALIGN)
+	{
+	  stat = helicity_generator_align(doBits, setting);
+	  if((stat == OK) && (doBits & DO_SAVE))
+	    {
+	      printf("Save Configuration to %s\n", setting.SAVEs);
+	      stat = heliSaveConfig(setting.SAVEs);
+	    }
+	}
+      else
+	stat = helicity_generator_set(doBits, setting);
 
       if (stat != OK)
 	{
@@ -345,7 +448,6 @@ main(int32_t argc, char *argv[])
 
 
  CLOSE:
-  vmeBusUnlock();
 
   stat = vmeCloseDefaultWindows();
   if (stat != OK)
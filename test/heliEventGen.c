@@ -0,0 +1,402 @@
+/*
+ * File:
+ *    heliEventGen.c
+ *
+ * Description:
+ *    Generate a synthetic helicity tagged event stream, with Poisson
+ *    trigger timing and injected helicity correlated asymmetries, to a
+ *    file, a pipe, or through the in-process ring to a consumer thread.
+ *
+ *
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <getopt.h>
+#include "heliLib.h"
+#include "heliEvent.h"
+#include "heliRing.h"
+
+#define EVENT_BATCH 4096
+#define RING_EVENTS (1 << 20)
+
+char progName[128];
+
+/* this structure holds the user arguments */
+typedef struct
+{
+  heliConfig_t cfg;
+  char     *RESTOREs;
+  char     *output;
+  uint64_t nevents;
+  double   jitter;
+  uint32_t seed;
+  int32_t  text;
+  int32_t  ring;
+  heliEventModel_t model;
+} argValue_t;
+
+/* Consumer of the ring, measures the injected asymmetries from the truth */
+typedef struct
+{
+  heliRing_t *ring;
+  uint64_t nevents;
+  uint64_t count[2];
+  double   sum[2];
+} consumer_t;
+
+void
+usage()
+{
+  printf("\nUsage: \n");
+  printf("\t %s [options]\n", progName);
+  printf("Generate a synthetic helicity tagged event stream\n");
+  printf("\n");
+  printf(" -m, --mode {index}                clock mode (default: 3, free clock)\n");
+  printf(" -p, --pattern {index}             helicity pattern (default: 1, quartet)\n");
+  printf(" -d, --delay {index}               reporting delay (default: 3)\n");
+  printf(" -t, --tsettle {index}             tsettle (default: 14)\n");
+  printf(" -s, --tstable {index}             tstable (default: 30)\n");
+  printf("     --restore {file}              use the configuration saved in {file}\n");
+  printf(" -n, --events {n}                  events to generate (default: 1000000)\n");
+  printf(" -r, --rate {Hz}                   mean trigger rate (default: 100000)\n");
+  printf("     --rate-asym {value}           injected rate asymmetry (default: 0)\n");
+  printf("     --yield {value}               mean yield (default: 1000)\n");
+  printf("     --sigma {value}               RMS yield (default: 100)\n");
+  printf("     --yield-asym {value}          injected yield asymmetry (default: 0.001)\n");
+  printf(" -j, --jitter {ns}                 RMS line sync jitter (default: 0)\n");
+  printf("     --seed {value}                shift register seed (default: 1)\n");
+  printf("     --key {value}                 random number key (default: 1)\n");
+  printf(" -o, --output {file}               write heliEvent_t records to {file} (default: stdout)\n");
+  printf("     --text                        write text, one event per line:\n");
+  printf("                                   time[ns] window signals yield truth\n");
+  printf("     --ring                        send the events through the in-process ring\n");
+  printf("                                   to a consumer thread, and report rates\n");
+  printf(" -h, --help                        this help message\n");
+  printf("\n");
+  printf("Exit status:\n");
+  printf("  0  if OK,\n");
+  printf("  1  if argument ERROR\n");
+  printf("  3  if helicity generator library ERROR\n");
+  printf("\n");
+}
+
+/* parse the command line with getopt_long, return user arguments */
+int32_t
+parseArgs(int32_t argc, char *argv[], argValue_t *value)
+{
+  int32_t rval = 0;
+
+  static struct option long_options[] =
+  {
+    /* {const char *name, int has_arg, int *flag, int val} */
+    {"help",       no_argument,       0,        'h'},
+    {"mode",       required_argument, 0,        'm'},
+    {"pattern",    required_argument, 0,        'p'},
+    {"delay",      required_argument, 0,        'd'},
+    {"tsettle",    required_argument, 0,        't'},
+    {"tstable",    required_argument, 0,        's'},
+    {"restore",    required_argument, 0,        'R'},
+    {"events",     required_argument, 0,        'n'},
+    {"rate",       required_argument, 0,        'r'},
+    {"rate-asym",  required_argument, 0,        'A'},
+    {"yield",      required_argument, 0,        'Y'},
+    {"sigma",      required_argument, 0,        'G'},
+    {"yield-asym", required_argument, 0,        'a'},
+    {"jitter",     required_argument, 0,        'j'},
+    {"seed",       required_argument, 0,        'S'},
+    {"key",        required_argument, 0,        'K'},
+    {"output",     required_argument, 0,        'o'},
+    {"text",       no_argument,       0,        'T'},
+    {"ring",       no_argument,       0,        'X'},
+    {0, 0, 0, 0}
+  };
+
+  /* Initialize output */
+  memset(value, 0, sizeof(*value));
+  value->cfg.clock = HELI_MODE_FREE_CLOCK;
+  value->cfg.pattern = HELI_PATTERN_QUARTET;
+  value->cfg.delay = HELI_DELAY_4;
+  value->cfg.tsettle = 14;
+  value->cfg.tstable = 30;
+  value->nevents = 1000000;
+  value->seed = 1;
+  heliEventDefaultModel(&value->model);
+
+  while(1)
+    {
+      int opt_param, option_index = 0;
+      opt_param = getopt_long (argc, argv, "hm:p:d:t:s:n:r:j:o:",
+			       long_options, &option_index);
+
+      if (opt_param == -1) /* No more option parameters left */
+	break;
+
+      switch (opt_param)
+	{
+	case 0:
+	  break;
+
+	case 'm': /* MODE */
+	  value->cfg.clock = strtoul(optarg, NULL, 10) & HELI_HELICITY_CLOCK_MASK;
+	  break;
+
+	case 'p': /* PATTERN */
+	  value->cfg.pattern = strtoul(optarg, NULL, 10);
+	  break;
+
+	case 'd': /* DELAY */
+	  value->cfg.delay = strtoul(optarg, NULL, 10);
+	  break;
+
+	case 't': /* TSETTLE */
+	  value->cfg.tsettle = strtoul(optarg, NULL, 10);
+	  break;
+
+	case 's': /* TSTABLE */
+	  value->cfg.tstable = strtoul(optarg, NULL, 10);
+	  break;
+
+	case 'R': /* RESTORE */
+	  value->RESTOREs = optarg;
+	  break;
+
+	case 'n': /* EVENTS */
+	  value->nevents = strtoull(optarg, NULL, 10);
+	  break;
+
+	case 'r': /* RATE */
+	  value->model.rate = strtod(optarg, NULL);
+	  break;
+
+	case 'A': /* RATE ASYMMETRY */
+	  value->model.rateAsym = strtod(optarg, NULL);
+	  break;
+
+	case 'Y': /* YIELD */
+	  value->model.yieldMean = strtod(optarg, NULL);
+	  break;
+
+	case 'G': /* SIGMA */
+	  value->model.yieldSigma = strtod(optarg, NULL);
+	  break;
+
+	case 'a': /* YIELD ASYMMETRY */
+	  value->model.yieldAsym = strtod(optarg, NULL);
+	  break;
+
+	case 'j': /* JITTER */
+	  value->jitter = strtod(optarg, NULL);
+	  break;
+
+	case 'S': /* SEED */
+	  value->seed = strtoul(optarg, NULL, 0);
+	  break;
+
+	case 'K': /* KEY */
+	  value->model.key = strtoull(optarg, NULL, 0);
+	  break;
+
+	case 'o': /* OUTPUT */
+	  value->output = optarg;
+	  break;
+
+	case 'T': /* TEXT */
+	  value->text = 1;
+	  break;
+
+	case 'X': /* RING */
+	  value->ring = 1;
+	  break;
+
+	case 'h': /* help */
+	case '?': /* Invalid Option */
+	default:
+	  usage();
+	  rval = 1;
+	}
+    }
+
+  if((rval == 0) &&
+     ((value->cfg.tsettle > HELI_TSETTLE_MASK) || (value->cfg.tstable > HELI_TSTABLE_MASK) ||
+      (value->cfg.delay > HELI_DELAY_MASK)))
+    {
+      printf("%s: ERROR: Invalid tsettle, tstable or delay\n", progName);
+      rval = 1;
+    }
+
+  return rval;
+}
+
+void *
+consumerThread(void *arg)
+{
+  consumer_t *c = (consumer_t *) arg;
+  heliEvent_t *ev;
+  uint64_t done = 0;
+  uint32_t n, iev;
+
+  while(done < c->nevents)
+    {
+      n = heliRingPeek(c->ring, EVENT_BATCH, (void **) &ev);
+      if(n == 0)
+	{
+	  sched_yield();
+	  continue;
+	}
+
+      for(iev = 0; iev < n; iev++)
+	{
+	  c->count[ev[iev].truth]++;
+	  c->sum[ev[iev].truth] += ev[iev].yield;
+	}
+
+      heliRingRelease(c->ring, n);
+      done += n;
+    }
+
+  return NULL;
+}
+
+/* Generate into the ring, for a consumer thread */
+int32_t
+runRing(argValue_t *args, heliEventGen_t *gen)
+{
+  consumer_t c;
+  pthread_t tid;
+  heliEvent_t *ev;
+  uint64_t done = 0;
+  uint32_t n;
+  struct timespec t0, t1;
+  double elapsed, meanP, meanM;
+
+  memset(&c, 0, sizeof(c));
+  c.nevents = args->nevents;
+  c.ring = heliRingCreate(sizeof(heliEvent_t), RING_EVENTS);
+  if(c.ring == NULL)
+    return 3;
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  pthread_create(&tid, NULL, consumerThread, &c);
+
+  while(done < args->nevents)
+    {
+      n = heliRingReserve(c.ring, EVENT_BATCH, (void **) &ev);
+      if(n == 0)
+	{
+	  sched_yield();
+	  continue;
+	}
+      if(n > args->nevents - done)
+	n = args->nevents - done;
+
+      heliEventGenerate(gen, ev, n);
+      heliRingCommit(c.ring, n);
+      done += n;
+    }
+
+  pthread_join(tid, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+
+  meanP = c.count[1] ? c.sum[1] / c.count[1] : 0;
+  meanM = c.count[0] ? c.sum[0] / c.count[0] : 0;
+
+  printf("events=%llu\n", (unsigned long long) done);
+  printf("elapsed_s=%.3f\n", elapsed);
+  printf("events_per_s=%.0f\n", (elapsed > 0) ? done / elapsed : 0);
+  printf("virtual_s=%.3f\n", gen->time * 1e-9);
+  printf("rate_asym=%.6f\n",
+	 ((double) c.count[1] - c.count[0]) / (c.count[1] + c.count[0]));
+  printf("yield_asym=%.6f\n", (meanP + meanM > 0) ? (meanP - meanM) / (meanP + meanM) : 0);
+
+  heliRingDestroy(c.ring);
+
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  argValue_t args;
+  heliEventGen_t *gen;
+  heliEvent_t *events;
+  uint64_t done = 0;
+  uint32_t n, iev;
+  FILE *out = stdout;
+  int32_t rval = 0;
+
+  strncpy(progName, argv[0], sizeof(progName) - 1);
+
+  if(parseArgs(argc, argv, &args) != 0)
+    return 1;
+
+  if(args.RESTOREs && (heliLoadConfig(args.RESTOREs, &args.cfg) != 0))
+    return 1;
+
+  gen = malloc(sizeof(*gen));
+  events = malloc(EVENT_BATCH * sizeof(heliEvent_t));
+  if((gen == NULL) || (events == NULL))
+    {
+      printf("%s: ERROR: Unable to allocate memory\n", progName);
+      return 3;
+    }
+
+  if(heliEventInit(gen, &args.cfg, args.seed, args.jitter, &args.model) != 0)
+    return 3;
+
+  if(args.ring)
+    {
+      rval = runRing(&args, gen);
+      goto DONE;
+    }
+
+  if(args.output)
+    {
+      out = fopen(args.output, args.text ? "w" : "wb");
+      if(out == NULL)
+	{
+	  printf("%s: ERROR: Unable to open %s\n", progName, args.output);
+	  rval = 1;
+	  goto DONE;
+	}
+    }
+
+  while(done < args.nevents)
+    {
+      n = (args.nevents - done < EVENT_BATCH) ? (args.nevents - done) : EVENT_BATCH;
+      heliEventGenerate(gen, events, n);
+
+      if(args.text)
+	{
+	  for(iev = 0; iev < n; iev++)
+	    fprintf(out, "%llu %u 0x%x %u %u\n",
+		    (unsigned long long) events[iev].time, events[iev].window,
+		    events[iev].signals, events[iev].yield, events[iev].truth);
+	}
+      else if(fwrite(events, sizeof(heliEvent_t), n, out) != n)
+	{
+	  rval = 3;
+	  break;
+	}
+      done += n;
+    }
+
+  if(out != stdout)
+    fclose(out);
+  else
+    fflush(out);
+
+ DONE:
+  free(events);
+  free(gen);
+
+  return rval;
+}
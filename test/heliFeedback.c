@@ -0,0 +1,304 @@
+/*
+ * File:
+ *    heliFeedback.c
+ *
+ * Description:
+ *    Close the charge asymmetry feedback loop on a simulated beam.  The
+ *    charge asymmetry of the beam follows the setpoint, and each new
+ *    setpoint is also written to an actuator stand-in (file or socket).
+ *
+ *
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+#include "heliLib.h"
+#include "heliSeq.h"
+#include "heliFeedback.h"
+
+#define WINDOW_BATCH 4096
+
+extern uint32_t iDelayVals[16];
+
+char progName[128];
+
+/* this structure holds the user arguments */
+typedef struct
+{
+  heliFeedbackConfig_t cfg;
+  uint32_t pattern;
+  uint32_t delay;
+  uint64_t iterations;
+  double   asym;
+  double   charge;
+  double   sigma;
+  uint64_t key;
+  char     *target;
+} argValue_t;
+
+/* Simulated beam: charge asymmetry = asym + slope * setpoint */
+typedef struct
+{
+  double   asym;
+  double   slope;
+  double   setpoint;
+  heliFeedbackSink_t *sink;
+} beam_t;
+
+void
+usage()
+{
+  printf("\nUsage: \n");
+  printf("\t %s [options]\n", progName);
+  printf("Close the charge asymmetry feedback loop on a simulated beam\n");
+  printf("\n");
+  printf(" -p, --pattern {index}             helicity pattern (default: 1, quartet)\n");
+  printf(" -d, --delay {index}               reporting delay (default: 3)\n");
+  printf(" -n, --patterns {n}                patterns per iteration (default: 1000)\n");
+  printf(" -i, --iterations {n}              iterations to run (default: 20)\n");
+  printf(" -g, --gain {value}                fraction corrected per iteration (default: 0.5)\n");
+  printf(" -s, --slope {value}               asymmetry per actuator unit (default: 0.001)\n");
+  printf("     --deadband {errors}           skip corrections within {errors} (default: 0)\n");
+  printf(" -a, --asym {value}                beam charge asymmetry at setpoint 0 (default: 0.0005)\n");
+  printf("     --charge {value}              mean charge per window (default: 1000)\n");
+  printf("     --sigma {value}               RMS charge per window (default: 1)\n");
+  printf("     --key {value}                 noise random number key (default: 1)\n");
+  printf(" -o, --output {target}             actuator stand-in: file, -, udp:host:port, unix:path\n");
+  printf(" -h, --help                        this help message\n");
+  printf("\n");
+  printf("Actuator output, one line per iteration:\n");
+  printf("  iteration setpoint step asym asymError patterns rejected\n");
+  printf("\n");
+  printf("Exit status:\n");
+  printf("  0  if OK,\n");
+  printf("  1  if argument ERROR\n");
+  printf("  3  if helicity generator library ERROR\n");
+  printf("\n");
+}
+
+/* parse the command line with getopt_long, return user arguments */
+int32_t
+parseArgs(int32_t argc, char *argv[], argValue_t *value)
+{
+  int32_t rval = 0;
+  uint32_t delay = 3;
+
+  static struct option long_options[] =
+  {
+    /* {const char *name, int has_arg, int *flag, int val} */
+    {"help",       no_argument,       0,        'h'},
+    {"pattern",    required_argument, 0,        'p'},
+    {"delay",      required_argument, 0,        'd'},
+    {"patterns",   required_argument, 0,        'n'},
+    {"iterations", required_argument, 0,        'i'},
+    {"gain",       required_argument, 0,        'g'},
+    {"slope",      required_argument, 0,        's'},
+    {"deadband",   required_argument, 0,        'D'},
+    {"asym",       required_argument, 0,        'a'},
+    {"charge",     required_argument, 0,        'C'},
+    {"sigma",      required_argument, 0,        'S'},
+    {"key",        required_argument, 0,        'K'},
+    {"output",     required_argument, 0,        'o'},
+    {0, 0, 0, 0}
+  };
+
+  /* Initialize output */
+  memset(value, 0, sizeof(*value));
+  heliFeedbackDefaultConfig(&value->cfg);
+  value->cfg.slope = 0.001;
+  value->pattern = HELI_PATTERN_QUARTET;
+  value->iterations = 20;
+  value->asym = 0.0005;
+  value->charge = 1000;
+  value->sigma = 1;
+  value->key = 1;
+
+  while(1)
+    {
+      int opt_param, option_index = 0;
+      opt_param = getopt_long (argc, argv, "hp:d:n:i:g:s:a:o:",
+			       long_options, &option_index);
+
+      if (opt_param == -1) /* No more option parameters left */
+	break;
+
+      switch (opt_param)
+	{
+	case 0:
+	  break;
+
+	case 'p': /* PATTERN */
+	  value->pattern = strtoul(optarg, NULL, 10);
+	  break;
+
+	case 'd': /* DELAY */
+	  delay = strtoul(optarg, NULL, 10);
+	  break;
+
+	case 'n': /* PATTERNS */
+	  value->cfg.patterns = strtoul(optarg, NULL, 10);
+	  break;
+
+	case 'i': /* ITERATIONS */
+	  value->iterations = strtoull(optarg, NULL, 10);
+	  break;
+
+	case 'g': /* GAIN */
+	  value->cfg.gain = strtod(optarg, NULL);
+	  break;
+
+	case 's': /* SLOPE */
+	  value->cfg.slope = strtod(optarg, NULL);
+	  break;
+
+	case 'D': /* DEADBAND */
+	  value->cfg.deadband = strtod(optarg, NULL);
+	  break;
+
+	case 'a': /* ASYM */
+	  value->asym = strtod(optarg, NULL);
+	  break;
+
+	case 'C': /* CHARGE */
+	  value->charge = strtod(optarg, NULL);
+	  break;
+
+	case 'S': /* SIGMA */
+	  value->sigma = strtod(optarg, NULL);
+	  break;
+
+	case 'K': /* KEY */
+	  value->key = strtoull(optarg, NULL, 0);
+	  break;
+
+	case 'o': /* OUTPUT */
+	  value->target = optarg;
+	  break;
+
+	case 'h': /* help */
+	case '?': /* Invalid Option */
+	default:
+	  usage();
+	  rval = 1;
+	}
+    }
+
+  if((rval == 0) && (delay > HELI_DELAY_MASK))
+    {
+      printf("%s: ERROR: Invalid delay (%u)\n", progName, delay);
+      rval = 1;
+    }
+  else
+    value->delay = iDelayVals[delay & HELI_DELAY_MASK];
+
+  return rval;
+}
+
+/* Counter based random number, uniform in (0,1) */
+static inline double
+uniform(uint64_t key, uint64_t counter)
+{
+  uint64_t z = key ^ (counter * 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  z ^= z >> 31;
+  return ((z >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+/* Apply the setpoint to the beam, and write it to the stand-in */
+int32_t
+beamActuate(void *arg, const heliFeedbackResult_t *result)
+{
+  beam_t *beam = (beam_t *) arg;
+
+  beam->setpoint = result->setpoint;
+
+  if(beam->sink)
+    return heliFeedbackSinkActuate(beam->sink, result);
+
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  argValue_t args;
+  beam_t beam;
+  heliFeedback_t *fb;
+  heliSeq_t reported, truth;
+  uint8_t signals[WINDOW_BATCH], helicity[WINDOW_BATCH];
+  double yields[WINDOW_BATCH];
+  uint64_t counter = 0, iwin;
+  struct timespec t0, t1;
+  double engine = 0, a;
+  int32_t rval = 0;
+
+  strncpy(progName, argv[0], sizeof(progName) - 1);
+
+  if(parseArgs(argc, argv, &args) != 0)
+    return 1;
+
+  memset(&beam, 0, sizeof(beam));
+  beam.asym = args.asym;
+  beam.slope = args.cfg.slope;
+  beam.setpoint = args.cfg.setpoint;
+
+  if(args.target)
+    {
+      beam.sink = heliFeedbackSinkOpen(args.target);
+      if(beam.sink == NULL)
+	return 1;
+    }
+
+  fb = malloc(sizeof(*fb));
+  if((fb == NULL) ||
+     (heliFeedbackInit(fb, &args.cfg, args.pattern, args.delay, beamActuate, &beam) != 0) ||
+     (heliSeqInit(&reported, args.pattern, args.delay, 1, 0) != 0))
+    {
+      rval = 3;
+      goto CLOSE;
+    }
+
+  /* The true helicity of window w is reported in window w + delay */
+  truth = reported;
+  heliSeqSkip(&truth, args.delay);
+
+  while(fb->last.iteration < args.iterations)
+    {
+      for(iwin = 0; iwin < WINDOW_BATCH; iwin++)
+	{
+	  double u1 = uniform(args.key, ++counter);
+	  double u2 = uniform(args.key, ++counter);
+
+	  signals[iwin] = heliSeqNext(&reported);
+	  helicity[iwin] = heliSeqNext(&truth) & HELI_WINDOW_HELICITY;
+
+	  a = beam.asym + beam.slope * beam.setpoint;
+	  yields[iwin] = args.charge * (1 + (helicity[iwin] ? a : -a)) +
+	    args.sigma * sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+	}
+
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+      heliFeedbackBlock(fb, signals, yields, WINDOW_BATCH);
+      clock_gettime(CLOCK_MONOTONIC, &t1);
+      engine += (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    }
+
+  fprintf(stderr, "# iterations=%llu setpoint=%.6g asym=%.3g+-%.2g beam_asym=%.3g"
+	  " actuator_errors=%llu engine_ns_per_window=%.1f\n",
+	  (unsigned long long) fb->last.iteration, fb->last.setpoint,
+	  fb->last.asym, fb->last.asymError, beam.asym + beam.slope * beam.setpoint,
+	  (unsigned long long) fb->actuatorErrors, engine * 1e9 / fb->windows);
+
+ CLOSE:
+  free(fb);
+  heliFeedbackSinkClose(beam.sink);
+
+  return rval;
+}
@@ -0,0 +1,266 @@
+/*
+ * File:
+ *    heliReplay.c
+ *
+ * Description:
+ *    Check the offline replay on a generated run, with missed windows,
+ *    extra windows and bit errors injected: the decode in chunks, on
+ *    threads, must equal the decode of the run as one chunk.
+ *
+ *
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <getopt.h>
+#include "heliLib.h"
+#include "heliReplay.h"
+
+char progName[128];
+
+/* this structure holds the user arguments */
+typedef struct
+{
+  uint32_t pattern;
+  uint32_t delay;
+  uint64_t nwindows;
+  uint64_t missedGap;
+  uint64_t extraGap;
+  uint64_t errorGap;
+  uint32_t chunkWindows;
+  uint32_t nthreads;
+  uint32_t seed;
+} argValue_t;
+
+void
+usage()
+{
+  printf("\nUsage: \n");
+  printf("\t %s [options]\n", progName);
+  printf("Check the offline replay on a generated run with injected faults\n");
+  printf("\n");
+  printf(" -p, --pattern {index}             helicity pattern (default: 1, quartet)\n");
+  printf(" -d, --delay {windows}             reporting delay (default: 8)\n");
+  printf(" -n, --windows {n}                 windows to generate (default: 4000000)\n");
+  printf(" -m, --missed {gap}                drop a window every {gap} windows (default: 3000)\n");
+  printf(" -e, --extra {gap}                 repeat a window every {gap} windows (default: 0, none)\n");
+  printf(" -b, --errors {gap}                flip the helicity every {gap} windows (default: 0, none)\n");
+  printf(" -c, --chunk {windows}             windows per chunk (default: 65536)\n");
+  printf(" -T, --threads {n}                 threads (default: 4)\n");
+  printf("     --seed {value}                shift register seed (default: 1)\n");
+  printf(" -h, --help                        this help message\n");
+  printf("\n");
+  printf("Exit status:\n");
+  printf("  0  if OK,\n");
+  printf("  1  if argument ERROR\n");
+  printf("  3  if the decodes differ, or helicity generator library ERROR\n");
+  printf("\n");
+}
+
+/* parse the command line with getopt_long, return user arguments */
+int32_t
+parseArgs(int32_t argc, char *argv[], argValue_t *value)
+{
+  int32_t rval = 0;
+
+  static struct option long_options[] =
+  {
+    /* {const char *name, int has_arg, int *flag, int val} */
+    {"help",       no_argument,       0,        'h'},
+    {"pattern",    required_argument, 0,        'p'},
+    {"delay",      required_argument, 0,        'd'},
+    {"windows",    required_argument, 0,        'n'},
+    {"missed",     required_argument, 0,        'm'},
+    {"extra",      required_argument, 0,        'e'},
+    {"errors",     required_argument, 0,        'b'},
+    {"chunk",      required_argument, 0,        'c'},
+    {"threads",    required_argument, 0,        'T'},
+    {"seed",       required_argument, 0,        'S'},
+    {0, 0, 0, 0}
+  };
+
+  /* Initialize output */
+  memset(value, 0, sizeof(*value));
+  value->pattern = HELI_PATTERN_QUARTET;
+  value->delay = 8;
+  value->nwindows = 4000000;
+  value->missedGap = 3000;
+  value->chunkWindows = 1 << 16;
+  value->nthreads = 4;
+  value->seed = 1;
+
+  while(1)
+    {
+      int opt_param, option_index = 0;
+      opt_param = getopt_long (argc, argv, "hp:d:n:m:e:b:c:T:",
+			       long_options, &option_index);
+
+      if (opt_param == -1) /* No more option parameters left */
+	break;
+
+      switch (opt_param)
+	{
+	case 0:
+	  break;
+
+	case 'p': /* PATTERN */
+	  value->pattern = strtoul(optarg, NULL, 10);
+	  break;
+
+	case 'd': /* DELAY */
+	  value->delay = strtoul(optarg, NULL, 10);
+	  break;
+
+	case 'n': /* WINDOWS */
+	  value->nwindows = strtoull(optarg, NULL, 10);
+	  break;
+
+	case 'm': /* MISSED */
+	  value->missedGap = strtoull(optarg, NULL, 10);
+	  break;
+
+	case 'e': /* EXTRA */
+	  value->extraGap = strtoull(optarg, NULL, 10);
+	  break;
+
+	case 'b': /* ERRORS */
+	  value->errorGap = strtoull(optarg, NULL, 10);
+	  break;
+
+	case 'c': /* CHUNK */
+	  value->chunkWindows = strtoul(optarg, NULL, 10);
+	  break;
+
+	case 'T': /* THREADS */
+	  value->nthreads = strtoul(optarg, NULL, 10);
+	  break;
+
+	case 'S': /* SEED */
+	  value->seed = strtoul(optarg, NULL, 0);
+	  break;
+
+	case 'h': /* help */
+	case '?': /* Invalid Option */
+	default:
+	  usage();
+	  rval = 1;
+	}
+    }
+
+  if((rval == 0) && (heliSeqPatternLength(value->pattern) < 0))
+    {
+      printf("%s: ERROR: Invalid pattern (%u)\n", progName, value->pattern);
+      rval = 1;
+    }
+
+  return rval;
+}
+
+double
+elapsed(const struct timespec *t0)
+{
+  struct timespec t1;
+
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  return (t1.tv_sec - t0->tv_sec) + (t1.tv_nsec - t0->tv_nsec) * 1e-9;
+}
+
+void
+printStats(const char *name, const heliReplayStats_t *s, double sec)
+{
+  printf("%-8s unlocked=%llu mismatches=%llu missed=%llu extra=%llu resyncs=%llu stitched=%llu  %.3f s\n",
+	 name, (unsigned long long) s->unlocked, (unsigned long long) s->mismatches,
+	 (unsigned long long) s->missed, (unsigned long long) s->extra,
+	 (unsigned long long) s->resyncs, (unsigned long long) s->stitched, sec);
+}
+
+int
+main(int argc, char *argv[])
+{
+  argValue_t args;
+  heliSeq_t seq;
+  heliReplayStats_t serialStats, chunkStats;
+  uint8_t *gen, *signals, *serial, *chunked;
+  uint64_t igen, nrec = 0, ndiff = 0, iwin, nmissed = 0, nextra = 0, nerrors = 0;
+  struct timespec t0;
+  double tserial, tchunked;
+
+  strncpy(progName, argv[0], sizeof(progName) - 1);
+
+  if(parseArgs(argc, argv, &args) != 0)
+    return 1;
+
+  gen = malloc(args.nwindows);
+  signals = malloc(2 * args.nwindows);
+  serial = malloc(2 * args.nwindows);
+  chunked = malloc(2 * args.nwindows);
+  if(!gen || !signals || !serial || !chunked)
+    {
+      printf("%s: ERROR: Unable to allocate memory\n", progName);
+      return 3;
+    }
+
+  if(heliSeqInit(&seq, args.pattern, args.delay, args.seed, 0) != 0)
+    return 3;
+  heliSeqGenerate(&seq, gen, args.nwindows);
+
+  /* Record the run, with the faults */
+  for(igen = 0; igen < args.nwindows; igen++)
+    {
+      if(args.missedGap && igen && ((igen % args.missedGap) == 0))
+	{
+	  nmissed++;
+	  continue;
+	}
+
+      signals[nrec++] = gen[igen];
+
+      if(args.extraGap && igen && ((igen % args.extraGap) == args.extraGap / 2))
+	{
+	  signals[nrec++] = gen[igen] ^ HELI_WINDOW_HELICITY;
+	  nextra++;
+	}
+
+      if(args.errorGap && igen && ((igen % args.errorGap) == args.errorGap / 3))
+	{
+	  signals[nrec - 1] ^= HELI_WINDOW_HELICITY;
+	  nerrors++;
+	}
+    }
+
+  printf("windows=%llu injected: missed=%llu extra=%llu errors=%llu\n",
+	 (unsigned long long) nrec, (unsigned long long) nmissed,
+	 (unsigned long long) nextra, (unsigned long long) nerrors);
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  if(heliReplay(args.pattern, args.delay, signals, serial, nrec,
+		nrec ? nrec : 1, 1, &serialStats) != 0)
+    return 3;
+  tserial = elapsed(&t0);
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  if(heliReplay(args.pattern, args.delay, signals, chunked, nrec,
+		args.chunkWindows, args.nthreads, &chunkStats) != 0)
+    return 3;
+  tchunked = elapsed(&t0);
+
+  for(iwin = 0; iwin < nrec; iwin++)
+    if(serial[iwin] != chunked[iwin])
+      ndiff++;
+
+  printStats("serial", &serialStats, tserial);
+  printStats("chunked", &chunkStats, tchunked);
+  printf("windows that differ: %llu\n", (unsigned long long) ndiff);
+
+  free(gen);
+  free(signals);
+  free(serial);
+  free(chunked);
+
+  return (ndiff == 0) ? 0 : 3;
+}
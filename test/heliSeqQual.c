@@ -0,0 +1,316 @@
+/*
+ * File:
+ *    heliSeqQual.c
+ *
+ * Description:
+ *    Statistical quality tests of the helicity pattern polarities, from
+ *    a recorded helicity stream file or from the library generator.
+ *    Results are printed as key=value lines.
+ *
+ *
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <getopt.h>
+#include "heliLib.h"
+#include "heliStream.h"
+#include "heliQual.h"
+
+/* From heliLib.c */
+extern uint32_t iDelayVals[16];
+
+#define READ_WINDOWS (1 << 20)
+
+char progName[128];
+
+/* this structure holds the user arguments */
+typedef struct
+{
+  char     *file;
+  uint64_t nwindows;
+  int32_t  pattern;
+  int32_t  delay;
+  uint32_t seed;
+  uint32_t nthreads;
+  heliQualConfig_t cfg;
+} argValue_t;
+
+void
+usage()
+{
+  printf("\nUsage: \n");
+  printf("\t %s [options]\n", progName);
+  printf("Run statistical quality tests on the helicity pattern polarities\n");
+  printf("\n");
+  printf(" -f, --file {path}                 test a recorded helicity stream file\n");
+  printf(" -g, --generate {windows}          test windows from the library generator\n");
+  printf(" -p, --pattern {index}             helicity pattern (default: from file)\n");
+  printf(" -d, --delay {windows}             reporting delay (default: from file)\n");
+  printf(" -s, --seed {value}                generator seed (default: 1)\n");
+  printf(" -j, --threads {n}                 number of threads (default: 1)\n");
+  printf(" -a, --alpha {value}               significance level (default: 0.01)\n");
+  printf(" -h, --help                        this help message\n");
+  printf("\n");
+  printf("Exit status:\n");
+  printf("  0  if all tests PASS,\n");
+  printf("  1  if argument ERROR\n");
+  printf("  3  if helicity generator library ERROR\n");
+  printf("  4  if any test FAIL\n");
+  printf("\n");
+}
+
+/* parse the command line with getopt_long, return user arguments */
+int32_t
+parseArgs(int32_t argc, char *argv[], argValue_t *value)
+{
+  int32_t rval = 0;
+
+  static struct option long_options[] =
+  {
+    /* {const char *name, int has_arg, int *flag, int val} */
+    {"help",       no_argument,       0,        'h'},
+    {"file",       required_argument, 0,        'f'},
+    {"generate",   required_argument, 0,        'g'},
+    {"pattern",    required_argument, 0,        'p'},
+    {"delay",      required_argument, 0,        'd'},
+    {"seed",       required_argument, 0,        's'},
+    {"threads",    required_argument, 0,        'j'},
+    {"alpha",      required_argument, 0,        'a'},
+    {0, 0, 0, 0}
+  };
+
+  /* Initialize output */
+  memset(value, 0, sizeof(*value));
+  value->pattern = -1;
+  value->delay = -1;
+  value->seed = 1;
+  value->nthreads = 1;
+  heliQualDefaultConfig(&value->cfg);
+
+  while(1)
+    {
+      int opt_param, option_index = 0;
+      opt_param = getopt_long (argc, argv, "hf:g:p:d:s:j:a:",
+			       long_options, &option_index);
+
+      if (opt_param == -1) /* No more option parameters left */
+	break;
+
+      switch (opt_param)
+	{
+	case 0:
+	  break;
+
+	case 'f': /* FILE */
+	  value->file = optarg;
+	  break;
+
+	case 'g': /* GENERATE */
+	  value->nwindows = strtoull(optarg, NULL, 10);
+	  break;
+
+	case 'p': /* PATTERN */
+	  value->pattern = strtol(optarg, NULL, 10);
+	  break;
+
+	case 'd': /* DELAY */
+	  value->delay = strtol(optarg, NULL, 10);
+	  break;
+
+	case 's': /* SEED */
+	  value->seed = strtoul(optarg, NULL, 0);
+	  break;
+
+	case 'j': /* THREADS */
+	  value->nthreads = strtoul(optarg, NULL, 10);
+	  break;
+
+	case 'a': /* ALPHA */
+	  value->cfg.alpha = strtod(optarg, NULL);
+	  break;
+
+	case 'h': /* help */
+	case '?': /* Invalid Option */
+	default:
+	  usage();
+	  rval = 1;
+	}
+    }
+
+  if((rval == 0) && ((value->file == NULL) == (value->nwindows == 0)))
+    {
+      usage();
+      rval = 1;
+    }
+
+  if((rval == 0) && (value->file == NULL) && (value->pattern < 0))
+    {
+      printf("%s: ERROR: --generate needs --pattern\n", progName);
+      rval = 1;
+    }
+
+  return rval;
+}
+
+/* Extract the pattern polarities of a recorded stream */
+int64_t
+readStream(argValue_t *args, uint64_t **bits, heliQualPhase_t *phase,
+	   uint64_t *nwindows)
+{
+  const heliStreamHeader_t *hdr;
+  heliStreamReader_t *r;
+  const heliRegs *regs;
+  uint8_t *signals;
+  uint64_t window, nbits = 0, maxbits;
+  uint32_t ncarry = 0;
+  int32_t len, n;
+
+  r = heliStreamOpenRead(args->file);
+  if(r == NULL)
+    return -1;
+
+  hdr = heliStreamGetHeader(r);
+  regs = (const heliRegs *) hdr->regs;
+  if(args->pattern < 0)
+    args->pattern = regs->pattern & HELI_PATTERN_MASK;
+  if(args->delay < 0)
+    args->delay = iDelayVals[regs->delay & HELI_DELAY_MASK];
+
+  printf("source=file\n");
+  printf("file=%s\n", args->file);
+  printf("firmware=%02x/%02x/%02x\n", hdr->fwMonth, hdr->fwDay, hdr->fwYear);
+
+  len = heliSeqPatternLength(args->pattern);
+  if(len < 0)
+    {
+      printf("%s: ERROR: Invalid pattern (%d)\n", progName, args->pattern);
+      heliStreamCloseRead(r);
+      return -1;
+    }
+
+  maxbits = hdr->nwindows / len + 1;
+  *bits = malloc(((maxbits + 63) / 64) * sizeof(uint64_t));
+  signals = malloc(READ_WINDOWS + 256 + 64);
+  if((*bits == NULL) || (signals == NULL))
+    {
+      printf("%s: ERROR: Unable to allocate memory\n", progName);
+      free(signals);
+      heliStreamCloseRead(r);
+      return -1;
+    }
+
+  heliQualPhaseInit(phase, args->pattern);
+
+  window = hdr->firstWindow;
+  while((n = heliStreamReadBlock(r, window, &signals[ncarry], READ_WINDOWS)) > 0)
+    {
+      window += n;
+
+      int64_t used = heliQualExtract(args->pattern, args->delay, signals, ncarry + n,
+				     *bits, &nbits, maxbits, phase);
+      if(used < 0)
+	{
+	  free(signals);
+	  heliStreamCloseRead(r);
+	  return -1;
+	}
+
+      ncarry = ncarry + n - used;
+      memmove(signals, &signals[used], ncarry);
+    }
+
+  *nwindows = window - hdr->firstWindow;
+  if(*nwindows < hdr->nwindows)
+    printf("# stopped at the first gap, window %llu\n", (unsigned long long) window);
+
+  free(signals);
+  heliStreamCloseRead(r);
+
+  return nbits;
+}
+
+int
+main(int argc, char *argv[])
+{
+  argValue_t args;
+  heliQualPhase_t phase;
+  heliQualReport_t report;
+  uint64_t *bits = NULL, nwindows;
+  int64_t nbits;
+  uint32_t itest;
+
+  strncpy(progName, argv[0], sizeof(progName) - 1);
+
+  if(parseArgs(argc, argv, &args) != 0)
+    return 1;
+
+  if(args.file)
+    {
+      nbits = readStream(&args, &bits, &phase, &nwindows);
+    }
+  else
+    {
+      int32_t len = heliSeqPatternLength(args.pattern);
+      if(len < 0)
+	{
+	  printf("%s: ERROR: Invalid pattern (%d)\n", progName, args.pattern);
+	  return 1;
+	}
+
+      printf("source=generator\n");
+      printf("seed=0x%08x\n", args.seed);
+
+      nwindows = args.nwindows;
+      bits = malloc(((nwindows / len + 63) / 64 + 1) * sizeof(uint64_t));
+      if(bits == NULL)
+	{
+	  printf("%s: ERROR: Unable to allocate memory\n", progName);
+	  return 3;
+	}
+      nbits = heliQualGenerate(args.pattern, args.seed, nwindows, bits, &phase, args.nthreads);
+    }
+
+  if((nbits < 0) ||
+     (heliQualRun(&args.cfg, bits, nbits, &phase, args.nthreads, &report) < 0))
+    {
+      free(bits);
+      return 3;
+    }
+
+  printf("pattern=%d\n", args.pattern);
+  printf("windows=%llu\n", (unsigned long long) nwindows);
+  printf("bits=%llu\n", (unsigned long long) report.nbits);
+  printf("ones=%llu\n", (unsigned long long) report.ones);
+  printf("alpha=%g\n", args.cfg.alpha);
+  printf("serial.worst_lag=%u\n", report.worstLag);
+  printf("spectral.blocks=%llu\n", (unsigned long long) report.spectralBlocks);
+  printf("linear_complexity.blocks=%llu\n", (unsigned long long) report.lcBlocks);
+  printf("linear_complexity.min=%u\n", report.lcMin);
+  printf("linear_complexity.max=%u\n", report.lcMax);
+  printf("phase_balance.worst_phase=%u\n", report.worstPhase);
+
+  for(itest = 0; itest < HELI_QUAL_NTESTS; itest++)
+    {
+      const heliQualResult_t *t = &report.test[itest];
+      const char *name = heliQualTestName(itest);
+
+      if(!t->run)
+	{
+	  printf("%s.result=SKIP\n", name);
+	  continue;
+	}
+      printf("%s.statistic=%.6g\n", name, t->statistic);
+      printf("%s.pvalue=%.6g\n", name, t->pvalue);
+      printf("%s.result=%s\n", name, t->pass ? "PASS" : "FAIL");
+    }
+
+  printf("result=%s\n", report.pass ? "PASS" : "FAIL");
+
+  free(bits);
+
+  return report.pass ? 0 : 4;
+}
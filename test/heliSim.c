@@ -0,0 +1,253 @@
+/*
+ * File:
+ *    heliSim.c
+ *
+ * Description:
+ *    Write the output edges of a simulated helicity generator board, on
+ *    a virtual clock, to standard out.  Use as a pipe source.
+ *
+ *
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <getopt.h>
+#include "heliLib.h"
+#include "heliSim.h"
+
+#define EDGE_BATCH 4096
+
+char progName[128];
+
+/* this structure holds the user arguments */
+typedef struct
+{
+  heliConfig_t cfg;
+  char     *RESTOREs;
+  uint64_t nwindows;
+  double   jitter;
+  uint32_t seed;
+  uint64_t key;
+  int32_t  binary;
+} argValue_t;
+
+void
+usage()
+{
+  printf("\nUsage: \n");
+  printf("\t %s [options]\n", progName);
+  printf("Write the output edges of a simulated helicity generator board\n");
+  printf("\n");
+  printf(" -m, --mode {index}                clock mode (default: 3, free clock)\n");
+  printf(" -p, --pattern {index}             helicity pattern (default: 1, quartet)\n");
+  printf(" -d, --delay {index}               reporting delay (default: 3)\n");
+  printf(" -t, --tsettle {index}             tsettle (default: 14)\n");
+  printf(" -s, --tstable {index}             tstable (default: 30)\n");
+  printf(" -b, --boardclock {index}          board clock output (default: 0, 20 MHz)\n");
+  printf("     --restore {file}              use the configuration saved in {file}\n");
+  printf(" -n, --windows {n}                 windows to simulate (default: 1000)\n");
+  printf(" -j, --jitter {ns}                 RMS line sync jitter (default: 0)\n");
+  printf("     --seed {value}                shift register seed (default: 1)\n");
+  printf("     --key {value}                 jitter random number key (default: 1)\n");
+  printf(" -B, --binary                      write heliSimEdge_t records\n");
+  printf(" -h, --help                        this help message\n");
+  printf("\n");
+  printf("Text output, one edge per line:  time[ns] window signals changed\n");
+  printf("\n");
+  printf("Exit status:\n");
+  printf("  0  if OK,\n");
+  printf("  1  if argument ERROR\n");
+  printf("  3  if helicity generator library ERROR\n");
+  printf("\n");
+}
+
+/* parse the command line with getopt_long, return user arguments */
+int32_t
+parseArgs(int32_t argc, char *argv[], argValue_t *value)
+{
+  int32_t rval = 0;
+
+  static struct option long_options[] =
+  {
+    /* {const char *name, int has_arg, int *flag, int val} */
+    {"help",       no_argument,       0,        'h'},
+    {"mode",       required_argument, 0,        'm'},
+    {"pattern",    required_argument, 0,        'p'},
+    {"delay",      required_argument, 0,        'd'},
+    {"tsettle",    required_argument, 0,        't'},
+    {"tstable",    required_argument, 0,        's'},
+    {"boardclock", required_argument, 0,        'b'},
+    {"restore",    required_argument, 0,        'R'},
+    {"windows",    required_argument, 0,        'n'},
+    {"jitter",     required_argument, 0,        'j'},
+    {"seed",       required_argument, 0,        'S'},
+    {"key",        required_argument, 0,        'K'},
+    {"binary",     no_argument,       0,        'B'},
+    {0, 0, 0, 0}
+  };
+
+  /* Initialize output */
+  memset(value, 0, sizeof(*value));
+  value->cfg.clock = HELI_MODE_FREE_CLOCK;
+  value->cfg.pattern = HELI_PATTERN_QUARTET;
+  value->cfg.delay = HELI_DELAY_4;
+  value->cfg.tsettle = 14;
+  value->cfg.tstable = 30;
+  value->nwindows = 1000;
+  value->seed = 1;
+  value->key = 1;
+
+  while(1)
+    {
+      int opt_param, option_index = 0;
+      opt_param = getopt_long (argc, argv, "hm:p:d:t:s:b:n:j:B",
+			       long_options, &option_index);
+
+      if (opt_param == -1) /* No more option parameters left */
+	break;
+
+      switch (opt_param)
+	{
+	case 0:
+	  break;
+
+	case 'm': /* MODE */
+	  value->cfg.clock = (value->cfg.clock & ~HELI_HELICITY_CLOCK_MASK) |
+	    (strtoul(optarg, NULL, 10) & HELI_HELICITY_CLOCK_MASK);
+	  break;
+
+	case 'p': /* PATTERN */
+	  value->cfg.pattern = strtoul(optarg, NULL, 10);
+	  break;
+
+	case 'd': /* DELAY */
+	  value->cfg.delay = strtoul(optarg, NULL, 10);
+	  break;
+
+	case 't': /* TSETTLE */
+	  value->cfg.tsettle = strtoul(optarg, NULL, 10);
+	  break;
+
+	case 's': /* TSTABLE */
+	  value->cfg.tstable = strtoul(optarg, NULL, 10);
+	  break;
+
+	case 'b': /* BOARDCLOCK */
+	  if(strtoul(optarg, NULL, 10))
+	    value->cfg.clock |= HELI_BOARDCLOCK_10MHZ;
+	  else
+	    value->cfg.clock &= ~HELI_BOARDCLOCK_10MHZ;
+	  break;
+
+	case 'R': /* RESTORE */
+	  value->RESTOREs = optarg;
+	  break;
+
+	case 'n': /* WINDOWS */
+	  value->nwindows = strtoull(optarg, NULL, 10);
+	  break;
+
+	case 'j': /* JITTER */
+	  value->jitter = strtod(optarg, NULL);
+	  break;
+
+	case 'S': /* SEED */
+	  value->seed = strtoul(optarg, NULL, 0);
+	  break;
+
+	case 'K': /* KEY */
+	  value->key = strtoull(optarg, NULL, 0);
+	  break;
+
+	case 'B': /* BINARY */
+	  value->binary = 1;
+	  break;
+
+	case 'h': /* help */
+	case '?': /* Invalid Option */
+	default:
+	  usage();
+	  rval = 1;
+	}
+    }
+
+  if((rval == 0) &&
+     ((value->cfg.tsettle > HELI_TSETTLE_MASK) || (value->cfg.tstable > HELI_TSTABLE_MASK) ||
+      (value->cfg.delay > HELI_DELAY_MASK)))
+    {
+      printf("%s: ERROR: Invalid tsettle, tstable or delay\n", progName);
+      rval = 1;
+    }
+
+  return rval;
+}
+
+int
+main(int argc, char *argv[])
+{
+  argValue_t args;
+  heliSim_t sim;
+  heliSimEdge_t *edges;
+  uint64_t nedges, done = 0;
+  struct timespec t0, t1;
+  double elapsed;
+  uint32_t n, iedge;
+
+  strncpy(progName, argv[0], sizeof(progName) - 1);
+
+  if(parseArgs(argc, argv, &args) != 0)
+    return 1;
+
+  if(args.RESTOREs && (heliLoadConfig(args.RESTOREs, &args.cfg) != 0))
+    return 1;
+
+  if(heliSimInit(&sim, &args.cfg, args.seed, args.jitter, args.key) != 0)
+    return 3;
+
+  edges = malloc(EDGE_BATCH * sizeof(heliSimEdge_t));
+  if(edges == NULL)
+    {
+      printf("%s: ERROR: Unable to allocate memory\n", progName);
+      return 3;
+    }
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+
+  nedges = 2 * args.nwindows;
+  while(done < nedges)
+    {
+      n = (nedges - done < EDGE_BATCH) ? (nedges - done) : EDGE_BATCH;
+      n = heliSimRun(&sim, edges, n);
+
+      if(args.binary)
+	{
+	  if(fwrite(edges, sizeof(heliSimEdge_t), n, stdout) != n)
+	    break;
+	}
+      else
+	{
+	  for(iedge = 0; iedge < n; iedge++)
+	    printf("%llu %llu 0x%x 0x%x\n",
+		   (unsigned long long) edges[iedge].time,
+		   (unsigned long long) edges[iedge].window,
+		   edges[iedge].signals, edges[iedge].changed);
+	}
+      done += n;
+    }
+  fflush(stdout);
+
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+
+  fprintf(stderr, "# windows=%llu virtual_s=%.3f elapsed_s=%.3f speedup=%.0f\n",
+	  (unsigned long long) (done / 2), heliSimTime(&sim) * 1e-9, elapsed,
+	  (elapsed > 0) ? heliSimTime(&sim) * 1e-9 / elapsed : 0);
+
+  free(edges);
+
+  return (done == nedges) ? 0 : 3;
+}
@@ -5,6 +5,9 @@
  * Description:
  *    show status of helicity generator module and library
  *
+ *    With --watch, sample the module every {ms} and write only the
+ *    fields that changed, as text, JSON or binary records.
+ *
  *
  */
 
@@ -14,52 +17,218 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <signal.h>
+#include <time.h>
+#include <getopt.h>
 #include "jvme.h"
 #include "heliLib.h"
+#include "heliFormat.h"
 
-int
-main(int argc, char *argv[])
+char progName[128];
+
+/* this structure holds the user arguments */
+typedef struct
+{
+  uint32_t address;
+  uint32_t watchMs;
+  uint32_t format;
+} argValue_t;
+
+static volatile sig_atomic_t stopWatch = 0;
+
+void
+usage()
+{
+  printf("\nUsage: \n");
+  printf("\t %s [options] [address]\n", progName);
+  printf("Show the status of the helicity generator module (default address: 0xa00000)\n");
+  printf("\n");
+  printf(" -w, --watch {ms}                  sample every {ms}, write the changed fields\n");
+  printf(" -f, --format {text|json|bin}      output format for --watch (default: text)\n");
+  printf(" -h, --help                        this help message\n");
+  printf("\n");
+  printf("Exit status:\n");
+  printf("  0  if OK,\n");
+  printf("  1  if argument ERROR\n");
+  printf("  2  if VME Driver ERROR\n");
+  printf("  3  if helicity generator library ERROR\n");
+  printf("\n");
+}
+
+/* parse the command line with getopt_long, return user arguments */
+int32_t
+parseArgs(int32_t argc, char *argv[], argValue_t *value)
 {
+  int32_t rval = 0;
+
+  static struct option long_options[] =
+  {
+    /* {const char *name, int has_arg, int *flag, int val} */
+    {"help",       no_argument,       0,        'h'},
+    {"watch",      required_argument, 0,        'w'},
+    {"format",     required_argument, 0,        'f'},
+    {0, 0, 0, 0}
+  };
 
-  int stat;
-  uint32_t address=0;
+  /* Initialize output */
+  memset(value, 0, sizeof(*value));
+  value->address = 0x00a00000; // my test module
+  value->format = HELI_FORMAT_TEXT;
 
-  if (argc > 1)
+  while(1)
     {
-      address = (unsigned int) strtoll(argv[1],NULL,16)&0xffffffff;
+      int opt_param, option_index = 0;
+      opt_param = getopt_long (argc, argv, "hw:f:",
+			       long_options, &option_index);
+
+      if (opt_param == -1) /* No more option parameters left */
+	break;
+
+      switch (opt_param)
+	{
+	case 0:
+	  break;
+
+	case 'w': /* WATCH */
+	  value->watchMs = strtoul(optarg, NULL, 10);
+	  if(value->watchMs == 0)
+	    {
+	      printf("%s: ERROR: Invalid watch interval (%s)\n", progName, optarg);
+	      rval = 1;
+	    }
+	  break;
+
+	case 'f': /* FORMAT */
+	  if(strcmp(optarg, "text") == 0)
+	    value->format = HELI_FORMAT_TEXT;
+	  else if(strcmp(optarg, "json") == 0)
+	    value->format = HELI_FORMAT_JSON;
+	  else if(strcmp(optarg, "bin") == 0)
+	    value->format = HELI_FORMAT_BIN;
+	  else
+	    {
+	      printf("%s: ERROR: Invalid format (%s)\n", progName, optarg);
+	      rval = 1;
+	    }
+	  break;
+
+	case 'h': /* help */
+	case '?': /* Invalid Option */
+	default:
+	  usage();
+	  rval = 1;
+	}
     }
-  else
+
+  if(optind < argc)
+    value->address = (unsigned int) strtoll(argv[optind],NULL,16)&0xffffffff;
+
+  return rval;
+}
+
+static void
+watchSignal(int sig)
+{
+  stopWatch = 1;
+}
+
+/* Write the changed fields every watchMs, until interrupted */
+int32_t
+watch(argValue_t *args)
+{
+  heliRegs prev, cur;
+  uint32_t fields = HELI_FIELD_ALL;
+  struct timespec next, now;
+  char buf[512];
+  int32_t len, stat;
+
+  signal(SIGINT, watchSignal);
+  signal(SIGTERM, watchSignal);
+
+  memset(&prev, 0, sizeof(prev));
+  clock_gettime(CLOCK_MONOTONIC, &next);
+
+  while(!stopWatch)
     {
-      address = 0x00a00000; // my test module
+      stat = heliGetRegisterSnapshot(&cur);
+      if(stat != 0)
+	return 3;
+
+      clock_gettime(CLOCK_REALTIME, &now);
+
+      fields |= heliFormatDiff(&prev, &cur);
+      if(fields)
+	{
+	  len = heliFormatStatus(args->format, &cur, fields,
+				 (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec,
+				 buf, sizeof(buf));
+	  if((len < 0) || (write(STDOUT_FILENO, buf, len) != len))
+	    return 3;
+	}
+      prev = cur;
+      fields = 0;
+
+      next.tv_sec += args->watchMs / 1000;
+      next.tv_nsec += (args->watchMs % 1000) * 1000000L;
+      if(next.tv_nsec >= 1000000000L)
+	{
+	  next.tv_sec++;
+	  next.tv_nsec -= 1000000000L;
+	}
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
     }
 
-  printf("\n %s: address = 0x%08x\n", argv[0], address);
-  printf("----------------------------\n");
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+
+  int stat, rval = 0;
+  argValue_t args;
+
+  strncpy(progName, argv[0], sizeof(progName) - 1);
+
+  if(parseArgs(argc, argv, &args) != 0)
+    return 1;
+
+  if(args.watchMs == 0)
+    {
+      printf("\n %s: address = 0x%08x\n", argv[0], args.address);
+      printf("----------------------------\n");
+    }
 
   stat = vmeOpenDefaultWindows();
   if(stat != OK)
-    goto CLOSE;
+    {
+      rval = 2;
+      goto CLOSE;
+    }
 
-  vmeCheckMutexHealth(1);
-  vmeBusLock();
+  if(heliInit(args.address, HELI_INIT_DEBUG) != 0)
+    {
+      rval = 3;
+      goto CLOSE;
+    }
 
-  heliInit(address, HELI_INIT_DEBUG);
-  heliStatus(1);
+  if(args.watchMs)
+    rval = watch(&args);
+  else
+    heliStatus(1);
 
  CLOSE:
 
-  vmeBusUnlock();
-
   vmeClearException(1);
 
   stat = vmeCloseDefaultWindows();
   if (stat != OK)
     {
       printf("vmeCloseDefaultWindows failed: code 0x%08x\n",stat);
-      return -1;
+      return 2;
     }
 
-  exit(0);
+  exit(rval);
 }
 
 /*